@@ -34,7 +34,7 @@ function RandomLayout:layout(group, r1, r2, r3, r4, markdamage)
 	
 	for i = 1, #children do
 		local c = children[i]
-		local minw, minh = c.MinMax:get()
+		local minw, minh = c:getMinMax()
 		local x0, y0, x1, y1
 		repeat
 			x0 = math.random(0, w - 1 - minw)
@@ -31,7 +31,7 @@ v:setInput(0x0901)
 --	init
 --
 
-local screen = { }
+local screen = visual.createPixmap(WIDTH, HEIGHT)
 local palette = { }
 local palindex = 0
 
@@ -67,22 +67,20 @@ function effect()
 
 	local palettescale = #palette / 10
 	local yc1, yc2, yc3 = yp1, yp2, yp3
-	local i = 0
 
 	for y = 0, HEIGHT - 1 do
 
 		local xc1, xc2 = xp1, xp2
 		local ysin = sintab[yc1] + sintab[yc2] + sintab[yc3] + 5
 
-		for x = i, i + WIDTH - 1 do
+		for x = 0, WIDTH - 1 do
 
 			local c = sintab[xc1] + sintab[xc2] + ysin
-			screen[x] = palette[FLOOR(c * palettescale)]
+			screen:setPixel(x, y, palette[FLOOR(c * palettescale)])
 			xc1 = (xc1 - 12) % 1024
 			xc2 = (xc2 + 13) % 1024
 
 		end
-		i = i + WIDTH
 
 		yc1 = (yc1 + 8) % 1024
 		yc2 = (yc2 + 11) % 1024
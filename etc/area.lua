@@ -185,6 +185,7 @@
 --		[[#tek.lib.region : Region]]
 --		- Area:rethinkLayout() - Causes a relayout of the element and its group
 --		- Area:setFlags() - Sets an element's flags
+--		- Area:setRect() - Sets the element's layouted rectangle
 --		- Area:setState() - Sets the background attribute of an element
 --		- Area:show() - Gets called when the element is about to be shown
 --
@@ -213,7 +214,7 @@ local tonumber = tonumber
 local type = type
 
 local Area = Element.module("tek.ui.class.area", "tek.ui.class.element")
-Area._VERSION = "Area 57.5"
+Area._VERSION = "Area 57.7"
 
 local FL_REDRAW = ui.FL_REDRAW
 local FL_LAYOUT = ui.FL_LAYOUT
@@ -228,6 +229,8 @@ local FL_AUTOPOSITION = ui.FL_AUTOPOSITION
 local FL_ERASEBG = ui.FL_ERASEBG
 local FL_TRACKDAMAGE = ui.FL_TRACKDAMAGE
 local FL_DONOTBLIT = ui.FL_DONOTBLIT
+local FL_RELAYOUT = ui.FL_RELAYOUT
+local FL_RELAYOUTCHILD = ui.FL_RELAYOUTCHILD
 
 local HUGE = ui.HUGE
 
@@ -304,7 +307,8 @@ function Area:cleanup()
 	self.DamageRegion = false
 	self.MinMax = newregion()
 	self.Rect = newregion()
-	self:checkClearFlags(FL_LAYOUT + FL_SETUP + FL_REDRAW)
+	self:checkClearFlags(0, FL_LAYOUT + FL_SETUP + FL_REDRAW + FL_RELAYOUT +
+		FL_RELAYOUTCHILD)
 end
 
 -------------------------------------------------------------------------------
@@ -348,6 +352,13 @@ function Area:rethinkLayout(repaint, check_size)
 			-- indicate possible change of group structure:
 			self:getGroup():setFlags(FL_CHANGED)
 		end
+		-- mark the path to the element for relayouting:
+		self:setFlags(FL_RELAYOUT)
+		local p = self:getParent()
+		while p do
+			p:setFlags(FL_RELAYOUTCHILD)
+			p = p:getParent()
+		end
 		self.Window:addLayout(self, repaint or 0, check_size or false)
 	end
 end
@@ -502,6 +513,23 @@ function Area:layout(x0, y0, x1, y1, markdamage)
 	return true
 end
 
+-------------------------------------------------------------------------------
+--	changed = Area:setRect(x0, y0, x1, y1): Sets the rectangle which the
+--	element is layouted to, without any of the side effects of Area:layout(),
+--	and returns '''true''' if the rectangle has changed. This function is
+--	intended for classes implementing shortcuts in their layouting.
+-------------------------------------------------------------------------------
+
+function Area:setRect(x0, y0, x1, y1)
+	local r = self.Rect
+	local r1, r2, r3, r4 = r:get()
+	if r1 ~= x0 or r2 ~= y0 or r3 ~= x1 or r4 ~= y1 then
+		r:setRect(x0, y0, x1, y1)
+		return true
+	end
+	return false
+end
+
 -------------------------------------------------------------------------------
 --	Area:punch(region): Subtracts the element from (by punching a hole into)
 --	the specified Region. This function is called by the layouter.
@@ -27,6 +27,10 @@ struct ImgLoader
 	TUINT iml_Width;
 	TUINT iml_Height;
 	TUINT iml_Flags;
+	/* Requested size; 0 for the original. If only one is given, the
+	** image is scaled proportionally: */
+	TUINT iml_ReqWidth;
+	TUINT iml_ReqHeight;
 	TBOOL (*iml_ReadFunc)(struct ImgLoader *ld, TUINT8 *buf, TSIZE nbytes);
 	long (*iml_SeekFunc)(struct ImgLoader *ld, long offs, int whence);
 	union 
@@ -34,6 +38,8 @@ struct ImgLoader
 		struct ImgMemLoader Memory;
 		struct ImgFileLoader File;
 	} iml_Loader;
+	/* Decoder state, private: */
+	TAPTR iml_Decoder;
 };
 
 TLIBAPI TBOOL imgload_init_file(struct ImgLoader *ld, struct TExecBase *TExecBase, 
@@ -41,5 +47,8 @@ TLIBAPI TBOOL imgload_init_file(struct ImgLoader *ld, struct TExecBase *TExecBas
 TLIBAPI TBOOL imgload_init_memory(struct ImgLoader *ld, struct TExecBase *TExecBase,
 	const char *src, size_t len);
 TLIBAPI TBOOL imgload_load(struct ImgLoader *ld);
+TLIBAPI TBOOL imgload_begin(struct ImgLoader *ld);
+TLIBAPI TINT imgload_read(struct ImgLoader *ld, TUINT numrows);
+TLIBAPI void imgload_end(struct ImgLoader *ld);
 
 #endif /* _TEK_LIB_IMGLOAD_H */
@@ -0,0 +1,80 @@
+#ifndef _TEK_LIB_INTERVAL_H
+#define _TEK_LIB_INTERVAL_H
+
+#include <tek/exec.h>
+
+/*
+**	interval.h - Interval timer for display drivers
+**	Written by Timm S. Mueller <tmueller at schulze-mueller.de>
+**	See copyright notice in teklib/COPYRIGHT
+**
+**	The timer runs on demand only, i.e. while at least one window has
+**	TITYPE_INTERVAL in its input mask, so that an idle display task can
+**	sleep without timeout. Deadlines are kept on an absolute grid, which
+**	is advanced past ticks that were missed, and resynchronized only if
+**	the system time appears to have been set.
+*/
+
+/* Interval period, 1/50s: */
+#define INTERVAL_PERIOD		20000
+/* Lateness beyond which the grid is resynchronized: */
+#define INTERVAL_MAXLATE	1000000
+
+struct Interval
+{
+	/* Next deadline, in system time: */
+	TINT64 ivl_Next;
+	/* Timer is running: */
+	TBOOL ivl_Active;
+};
+
+static TINLINE void interval_init(struct Interval *ivl)
+{
+	ivl->ivl_Next = 0;
+	ivl->ivl_Active = TFALSE;
+}
+
+/*
+**	expired = interval_check(ivl, demand, now, waitt)
+**	Checks the interval timer against the current time. demand indicates
+**	whether any windows subscribe to interval messages. Returns TTRUE if
+**	interval messages are due. If demand is nonzero, the time to wait until
+**	the next deadline is placed in waitt; otherwise, the timer is stopped
+**	and waitt remains untouched.
+*/
+
+static TINLINE TBOOL interval_check(struct Interval *ivl, TBOOL demand,
+	TTIME *now, TTIME *waitt)
+{
+	TINT64 t = now->tdt_Int64;
+	TBOOL expired = TFALSE;
+	if (!demand)
+	{
+		ivl->ivl_Active = TFALSE;
+		return TFALSE;
+	}
+	if (!ivl->ivl_Active)
+	{
+		/* first tick one period after the timer was requested: */
+		ivl->ivl_Active = TTRUE;
+		ivl->ivl_Next = t + INTERVAL_PERIOD;
+	}
+	else if (t >= ivl->ivl_Next)
+	{
+		TINT64 late = t - ivl->ivl_Next;
+		expired = TTRUE;
+		if (late < INTERVAL_MAXLATE)
+			ivl->ivl_Next += (late / INTERVAL_PERIOD + 1) * INTERVAL_PERIOD;
+		else
+			ivl->ivl_Next = t + INTERVAL_PERIOD;
+	}
+	else if (ivl->ivl_Next - t > INTERVAL_PERIOD)
+	{
+		/* system time was set back: */
+		ivl->ivl_Next = t + INTERVAL_PERIOD;
+	}
+	waitt->tdt_Int64 = ivl->ivl_Next - t;
+	return expired;
+}
+
+#endif /* _TEK_LIB_INTERVAL_H */
@@ -23,6 +23,11 @@
 #define TEKUI_FL_INITIALFOCUS	0x08000
 #define TEKUI_FL_ISWINDOW		0x10000
 #define TEKUI_FL_DONOTBLIT		0x20000
+#define TEKUI_FL_KEEPMINWIDTH	0x40000
+#define TEKUI_FL_KEEPMINHEIGHT	0x80000
+#define TEKUI_FL_NOFOCUS		0x100000
+#define TEKUI_FL_RELAYOUT		0x200000
+#define TEKUI_FL_RELAYOUTCHILD	0x400000
 
 #define TEK_UI_OVERLAP(d0, d1, d2, d3, s0, s1, s2, s3) \
 ((s2) >= (d0) && (s0) <= (d2) && (s3) >= (d1) && (s1) <= (d3))
@@ -30,4 +35,55 @@
 #define TEK_UI_OVERLAPRECT(d, s) \
 TEK_UI_OVERLAP((d)[0], (d)[1], (d)[2], (d)[3], (s)[0], (s)[1], (s)[2], (s)[3])
 
+/*
+**	Native interface of a font object, found as a light userdata in the
+**	font's metatable under the key TEKUI_FONTAPI. textsizes() measures a
+**	number of runs, given as pairs of offset and length in bytes, with a
+**	single display request, and returns the number of runs measured.
+*/
+
+#define TEKUI_FONTAPI			"__fontapi"
+
+struct TEKUIFontAPI
+{
+	TINT (*textsizes)(TAPTR font, TSTRPTR text, TINT *runs, TINT *widths,
+		TINT numruns);
+};
+
+/*
+**	Geometry retained by tek.ui.class.area. Each element owns
+**	a userdata of this type, which is stored in the element's field
+**	TEKUI_AREA_FIELD. ar_Valid indicates which of the rectangles are
+**	currently defined. TEKUI_AREA_ASKMINMAX marks the arguments and results
+**	of the last askMinMax() on behalf of a layouter as reusable; it is
+**	cleared in the element and its parents by Area:rethinkLayout() when
+**	a size check is requested. TEKUI_AREA_STRUCTURE marks the structure
+**	of a group, as cached by its layouter, as valid; it is cleared in the
+**	element and its parent under the same condition.
+*/
+
+#define TEKUI_AREA_FIELD		"AreaData"
+#define TEKUI_AREA_CLASSNAME	"tek.ui.class.area*"
+
+#define TEKUI_AREA_RECT			0x0001
+#define TEKUI_AREA_MINMAX		0x0002
+#define TEKUI_AREA_MARGIN		0x0004
+#define TEKUI_AREA_ASKMINMAX	0x0008
+#define TEKUI_AREA_STRUCTURE	0x0010
+
+struct TEKUIArea
+{
+	/* Rectangles defined, see TEKUI_AREA_*: */
+	TUINT ar_Valid;
+	/* Layouted rectangle: */
+	TINT ar_Rect[4];
+	/* Calculated minimum and maximum sizes: */
+	TINT ar_MinMax[4];
+	/* Margins, cached from the element's style properties: */
+	TINT ar_Margin[4];
+	/* Arguments and results of the last askMinMax() by a layouter: */
+	TINT ar_AskArgs[4];
+	TINT ar_AskResult[4];
+};
+
 #endif
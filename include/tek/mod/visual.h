@@ -91,6 +91,7 @@ typedef TTAG TVPEN;
 #define TVisual_ExtraArgs			(TVISTAGS_ + 0x119)
 #define TVisual_HaveWindowManager	(TVISTAGS_ + 0x11a)
 #define TVisual_WindowHints			(TVISTAGS_ + 0x11b)
+#define TVisual_AntiAlias			(TVISTAGS_ + 0x11c)
 
 /* Tagged rendering: */
 
@@ -122,6 +123,8 @@ struct TVRequest
 		struct { TAPTR Font; TTAGITEM *Tags; TUINT Num; } GetFontAttrs;
 		struct { TAPTR Font; TSTRPTR Text; TINT NumChars; TINT Width; } 
 			TextSize;
+		struct { TAPTR Font; TSTRPTR Text; TINT *Runs; TINT *Widths;
+			TINT NumRuns; } TextSizes;
 		struct { TAPTR Handle; TTAGITEM *Tags; } QueryFonts;
 		struct { TAPTR Handle; TTAGITEM *Attrs; } GetNextFont;
 		struct { TAPTR Window; TUINT Mask; TUINT OldMask; } SetInput;
@@ -143,8 +146,15 @@ struct TVRequest
 		struct { TAPTR Window; TINT Rect[4]; TINT DestX; TINT DestY;
 			TTAGITEM *Tags; } CopyArea;
 		struct { TAPTR Window; TINT Rect[4]; TTAGITEM *Tags; } ClipRect;
+		struct { TAPTR Window; TINT *Rects; TINT NumRects; TTAGITEM *Tags; }
+			ClipRegion;
 		struct { TAPTR Window; TINT RRect[4]; TAPTR Buf; TINT TotWidth;
 			TTAGITEM *Tags; } DrawBuffer;
+		struct { TAPTR Pixmap; TAPTR Buf; TINT Width; TINT Height;
+			TINT TotWidth; TTAGITEM *Tags; } CreatePixmap;
+		struct { TAPTR Pixmap; } FreePixmap;
+		struct { TAPTR Window; TAPTR Pixmap; TINT RRect[4]; TINT SrcX;
+			TINT SrcY; TTAGITEM *Tags; } DrawPixmap;
 		struct { TAPTR Window; TINT Rect[4]; } Flush;
 		struct { TAPTR Window; TUINT Type; TAPTR Data; TSIZE Length; } GetSelection;
 		struct { TAPTR Window; TUINT Type; TAPTR Data; TSIZE Length; } SetSelection;
@@ -184,6 +194,11 @@ struct TVRequest
 #define TVCMD_FLUSH			0x101e
 #define TVCMD_GETSELECTION	0x101f
 #define TVCMD_SETSELECTION	0x1020
+#define TVCMD_TEXTSIZES		0x1021
+#define TVCMD_SETCLIPREGION	0x1022
+#define TVCMD_CREATEPIXMAP	0x1023
+#define TVCMD_FREEPIXMAP	0x1024
+#define TVCMD_DRAWPIXMAP	0x1025
 #define TVCMD_EXTENDED		0x2000
 
 /*****************************************************************************/
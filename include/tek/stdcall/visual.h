@@ -112,4 +112,19 @@
 #define TVisualSetSelection(visual,sel,len,tags) \
 	(*(((TMODCALL TINT(**)(TAPTR,TSTRPTR,TSIZE,TTAGITEM *))(visual))[-43]))(visual,sel,len,tags)
 
+#define TVisualTextSizes(visual,font,text,runs,widths,numruns) \
+	(*(((TMODCALL TINT(**)(TAPTR,TAPTR,TSTRPTR,TINT *,TINT *,TINT))(visual))[-44]))(visual,font,text,runs,widths,numruns)
+
+#define TVisualSetClipRegion(visual,rects,num,tags) \
+	(*(((TMODCALL void(**)(TAPTR,TINT *,TINT,TTAGITEM *))(visual))[-45]))(visual,rects,num,tags)
+
+#define TVisualCreatePixmap(visual,buf,w,h,totw,tags) \
+	(*(((TMODCALL TAPTR(**)(TAPTR,TAPTR,TINT,TINT,TINT,TTAGITEM *))(visual))[-46]))(visual,buf,w,h,totw,tags)
+
+#define TVisualFreePixmap(visual,pixmap) \
+	(*(((TMODCALL void(**)(TAPTR,TAPTR))(visual))[-47]))(visual,pixmap)
+
+#define TVisualDrawPixmap(visual,pixmap,x,y,w,h,sx,sy,tags) \
+	(*(((TMODCALL void(**)(TAPTR,TAPTR,TINT,TINT,TINT,TINT,TINT,TINT,TTAGITEM *))(visual))[-48]))(visual,pixmap,x,y,w,h,sx,sy,tags)
+
 #endif /* _TEK_STDCALL_VISUAL_H */
@@ -28,6 +28,8 @@ dfb_openvisual(DFBDISPLAY *mod, struct TVRequest *req)
 
 	v->userdata = TGetTag(tags, TVisual_UserData, TNULL);
 	v->eventmask = (TUINT) TGetTag(tags, TVisual_EventMask, 0);
+	if (v->eventmask & TITYPE_INTERVAL)
+		mod->dfb_NumInterval++;
 
 	TInitList(&v->penlist);
 	v->bgpen = TVPEN_UNDEFINED;
@@ -161,6 +163,8 @@ dfb_closevisual(DFBDISPLAY *mod, struct TVRequest *req)
 	TDBPRINTF(TDB_INFO,("Visual close\n"));
 
 	TRemove(&v->node);
+	if (v->eventmask & TITYPE_INTERVAL)
+		mod->dfb_NumInterval--;
 
 	if (mod->dfb_Focused == (TAPTR) v)
 	{
@@ -193,7 +197,11 @@ dfb_setinput(DFBDISPLAY *mod, struct TVRequest *req)
 {
 	DFBWINDOW *v = req->tvr_Op.SetInput.Window;
 	req->tvr_Op.SetInput.OldMask = v->eventmask;
+	if (v->eventmask & TITYPE_INTERVAL)
+		mod->dfb_NumInterval--;
 	v->eventmask = req->tvr_Op.SetInput.Mask;
+	if (v->eventmask & TITYPE_INTERVAL)
+		mod->dfb_NumInterval++;
 	/* spool out possible remaining messages: */
 	dfb_sendimessages(mod, TFALSE);
 }
@@ -444,6 +452,42 @@ dfb_setcliprect(DFBDISPLAY *mod, struct TVRequest *req)
 	v->winsurface->SetClip(v->winsurface, &clip);
 }
 
+/*****************************************************************************/
+/*
+**	DirectFB surfaces support a single clipping rectangle; a clipping
+**	region is approximated by its bounding box.
+*/
+
+LOCAL void
+dfb_setclipregion(DFBDISPLAY *mod, struct TVRequest *req)
+{
+	DFBWINDOW *v = req->tvr_Op.ClipRegion.Window;
+	TINT *r = req->tvr_Op.ClipRegion.Rects;
+	TINT i, num = req->tvr_Op.ClipRegion.NumRects;
+	DFBRegion clip;
+
+	if (num == 0)
+	{
+		clip.x1 = clip.y1 = -1;
+		clip.x2 = clip.y2 = -1;
+	}
+	else
+	{
+		clip.x1 = r[0];
+		clip.y1 = r[1];
+		clip.x2 = r[2];
+		clip.y2 = r[3];
+		for (i = 1, r += 4; i < num; ++i, r += 4)
+		{
+			clip.x1 = TMIN(clip.x1, r[0]);
+			clip.y1 = TMIN(clip.y1, r[1]);
+			clip.x2 = TMAX(clip.x2, r[2]);
+			clip.y2 = TMAX(clip.y2, r[3]);
+		}
+	}
+	v->winsurface->SetClip(v->winsurface, &clip);
+}
+
 /*****************************************************************************/
 
 LOCAL void
@@ -791,6 +835,19 @@ dfb_textsize(DFBDISPLAY *mod, struct TVRequest *req)
 
 /*****************************************************************************/
 
+LOCAL void
+dfb_textsizes(DFBDISPLAY *mod, struct TVRequest *req)
+{
+	TINT *runs = req->tvr_Op.TextSizes.Runs;
+	TINT *widths = req->tvr_Op.TextSizes.Widths;
+	TINT i;
+	for (i = 0; i < req->tvr_Op.TextSizes.NumRuns; ++i, runs += 2)
+		widths[i] = dfb_hosttextsize(mod, req->tvr_Op.TextSizes.Font,
+			req->tvr_Op.TextSizes.Text + runs[0], runs[1]);
+}
+
+/*****************************************************************************/
+
 LOCAL void
 dfb_getfontattrs(DFBDISPLAY *mod, struct TVRequest *req)
 {
@@ -268,6 +268,7 @@ static TBOOL dfb_initinstance(struct TTask *task)
 
 		/* list of all open visuals: */
 		TInitList(&inst->dfb_vlist);
+		inst->dfb_NumInterval = 0;
 
 		/* init fontmanager and default font */
 		TInitList(&inst->dfb_fm.openfonts);
@@ -431,6 +432,7 @@ dfb_docmd(DFBDISPLAY *inst, struct TVRequest *req)
 		case TVCMD_CLOSEFONT: dfb_closefont(inst, req); break;
 		case TVCMD_GETFONTATTRS: dfb_getfontattrs(inst, req); break;
 		case TVCMD_TEXTSIZE: dfb_textsize(inst, req); break;
+		case TVCMD_TEXTSIZES: dfb_textsizes(inst, req); break;
 		case TVCMD_QUERYFONTS: dfb_queryfonts(inst, req); break;
 		case TVCMD_GETNEXTFONT: dfb_getnextfont(inst, req); break;
 		case TVCMD_SETINPUT: dfb_setinput(inst, req); break;
@@ -453,7 +455,13 @@ dfb_docmd(DFBDISPLAY *inst, struct TVRequest *req)
 		case TVCMD_COPYAREA: dfb_copyarea(inst, req); break;
 		case TVCMD_SETCLIPRECT: dfb_setcliprect(inst, req); break;
 		case TVCMD_UNSETCLIPRECT: dfb_unsetcliprect(inst, req); break;
+		case TVCMD_SETCLIPREGION: dfb_setclipregion(inst, req); break;
 		case TVCMD_DRAWBUFFER: dfb_drawbuffer(inst, req); break;
+		case TVCMD_CREATEPIXMAP:
+		case TVCMD_FREEPIXMAP:
+		case TVCMD_DRAWPIXMAP:
+			/* no native pixmaps, clients use drawbuffer */
+			break;
 		default:
 			TDBPRINTF(TDB_ERROR,("Unknown command code: %d\n",
 			req->tvr_Req.io_Command));
@@ -471,20 +479,17 @@ static void dfb_taskfunc(struct TTask *task)
 	DFBWINDOW *v;
 	struct TNode *node, *next;
 
-	/* interval time: 1/50s: */
-	TTIME intt = { 20000 };
-	/* next absolute time to send interval message: */
-	TTIME nextt;
+	struct timeval *ptv;
+	struct Interval interval;
 	TTIME waitt, nowt;
 
-	TExecGetSystemTime(inst->dfb_ExecBase, &nextt);
-	TAddTime(&nextt, &intt);
+	interval_init(&interval);
 
 	TDBPRINTF(TDB_ERROR,("Device instance running\n"));
 
 	do
 	{
-		TBOOL do_interval = TFALSE;
+		TBOOL do_interval;
 
 		while ((req = TExecGetMsg(inst->dfb_ExecBase, inst->dfb_CmdPort)))
 		{
@@ -503,16 +508,29 @@ static void dfb_taskfunc(struct TTask *task)
 		FD_SET(inst->dfb_FDInput, &rset);
 		FD_SET(inst->dfb_FDSigPipeRead, &rset);
 
-		/* calculate new delta to wait: */
+		/* check if time interval has expired: */
 		TExecGetSystemTime(inst->dfb_ExecBase, &nowt);
-		waitt = nextt;
-		TSubTime(&waitt, &nowt);
+		do_interval = interval_check(&interval, inst->dfb_NumInterval > 0,
+			&nowt, &waitt);
 
-		tv.tv_sec = waitt.tdt_Int64 / 1000000;
-		tv.tv_usec = waitt.tdt_Int64 % 1000000;
+		/* calculate new delta to wait, if any window needs intervals: */
+		ptv = NULL;
+		if (do_interval)
+		{
+			/* poll only, interval messages are due: */
+			tv.tv_sec = 0;
+			tv.tv_usec = 0;
+			ptv = &tv;
+		}
+		else if (inst->dfb_NumInterval > 0)
+		{
+			tv.tv_sec = waitt.tdt_Int64 / 1000000;
+			tv.tv_usec = waitt.tdt_Int64 % 1000000;
+			ptv = &tv;
+		}
 
 		/* wait for display, signal fd and timeout: */
-		if (select(inst->dfb_FDMax, &rset, NULL, NULL, &tv) > 0)
+		if (select(inst->dfb_FDMax, &rset, NULL, NULL, ptv) > 0)
 		{
 			if (FD_ISSET(inst->dfb_FDSigPipeRead, &rset))
 			{
@@ -528,21 +546,6 @@ static void dfb_taskfunc(struct TTask *task)
 			}
 		}
 
-		/* check if time interval has expired: */
-		TExecGetSystemTime(inst->dfb_ExecBase, &nowt);
-		if (TCmpTime(&nowt, &nextt) > 0)
-		{
-			/* expired; send interval: */
-			do_interval = TTRUE;
-			TAddTime(&nextt, &intt);
-			if (TCmpTime(&nowt, &nextt) >= 0)
-			{
-				/* nexttime expired already; create new time from now: */
-				nextt = nowt;
-				TAddTime(&nextt, &intt);
-			}
-		}
-
 		/* send out input messages to owners: */
 		dfb_sendimessages(inst, do_interval);
 
@@ -15,6 +15,7 @@
 #include <tek/exec.h>
 #include <tek/teklib.h>
 #include <tek/lib/utf8.h>
+#include <tek/lib/interval.h>
 
 #include <tek/proto/exec.h>
 #include <tek/mod/visual.h>
@@ -22,7 +23,7 @@
 /*****************************************************************************/
 
 #define DFBDISPLAY_VERSION		1
-#define DFBDISPLAY_REVISION		0
+#define DFBDISPLAY_REVISION		1
 #define DFBDISPLAY_NUMVECTORS	10
 
 #define DEF_WINWIDTH			600
@@ -170,6 +171,9 @@ typedef struct
 	int dfb_FDSigPipeWrite;
 	int dfb_FDMax;
 
+	/* Number of windows subscribed to interval messages: */
+	TINT dfb_NumInterval;
+
 	/* pooled input messages: */
 	struct TList dfb_imsgpool;
 	/* list of all visuals: */
@@ -256,6 +260,7 @@ LOCAL void dfb_drawtext(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_openfont(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_getfontattrs(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_textsize(DFBDISPLAY *mod, struct TVRequest *req);
+LOCAL void dfb_textsizes(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_setfont(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_closefont(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_queryfonts(DFBDISPLAY *mod, struct TVRequest *req);
@@ -267,6 +272,7 @@ LOCAL void dfb_copyarea(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_setcliprect(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_drawfarc(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_unsetcliprect(DFBDISPLAY *mod, struct TVRequest *req);
+LOCAL void dfb_setclipregion(DFBDISPLAY *mod, struct TVRequest *req);
 LOCAL void dfb_drawbuffer(DFBDISPLAY *mod, struct TVRequest *req);
 
 LOCAL TAPTR dfb_hostopenfont(DFBDISPLAY *mod, TTAGITEM *tags);
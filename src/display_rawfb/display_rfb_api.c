@@ -269,10 +269,14 @@ static void rfb_openvisual(struct rfb_Display *mod, struct TVRequest *req)
 	v->rfbw_FGPen = TVPEN_UNDEFINED;
 
 	region_init(&mod->rfb_RectPool, &v->rfbw_DirtyRegion, TNULL);
+	region_init(&mod->rfb_RectPool, &v->rfbw_ClipRegion, TNULL);
+	region_init(&mod->rfb_RectPool, &v->rfbw_ClipMask, TNULL);
+	region_init(&mod->rfb_RectPool, &v->rfbw_VisRegion, TNULL);
 
 	/* add window on top of window stack: */
 	TLock(mod->rfb_Lock);
 	TAddHead(&mod->rfb_VisualList, &v->rfbw_Node);
+	mod->rfb_LayerSerial++;
 	rfb_focuswindow(mod, v);
 	if (v->rfbw_InputMask & TITYPE_INTERVAL)
 		mod->rfb_NumInterval++;
@@ -315,6 +319,7 @@ static void rfb_closevisual(struct rfb_Display *mod, struct TVRequest *req)
 		mod->rfb_FocusWindow = TNULL;
 
 	TRemove(&v->rfbw_Node);
+	mod->rfb_LayerSerial++;
 
 	if (v->rfbw_InputMask & TITYPE_INTERVAL)
 		mod->rfb_NumInterval--;
@@ -350,6 +355,9 @@ static void rfb_closevisual(struct rfb_Display *mod, struct TVRequest *req)
 	TUnlock(mod->rfb_Lock);
 
 	region_free(&mod->rfb_RectPool, &v->rfbw_DirtyRegion);
+	region_free(&mod->rfb_RectPool, &v->rfbw_ClipRegion);
+	region_free(&mod->rfb_RectPool, &v->rfbw_ClipMask);
+	region_free(&mod->rfb_RectPool, &v->rfbw_VisRegion);
 
 	TFree(v);
 
@@ -503,96 +511,52 @@ static void rfb_plot(struct rfb_Display *mod, struct TVRequest *req)
 
 static void rfb_drawstrip(struct rfb_Display *mod, struct TVRequest *req)
 {
-	TINT i, x0, y0, x1, y1, x2, y2;
 	struct rfb_Window *v = req->tvr_Op.Strip.Window;
-	TINT *array = req->tvr_Op.Strip.Array;
 	TINT num = req->tvr_Op.Strip.Num;
 	TTAGITEM *tags = req->tvr_Op.Strip.Tags;
 	TVPEN pen = (TVPEN) TGetTag(tags, TVisual_Pen, TVPEN_UNDEFINED);
 	TVPEN *penarray = (TVPEN *) TGetTag(tags, TVisual_PenArray, TNULL);
-	TINT wx = v->rfbw_WinRect.r[0];
-	TINT wy = v->rfbw_WinRect.r[1];
+	TUINT flags = 0;
 
 	if (num < 3)
 		return;
 
+	if (TGetTag(tags, TVisual_AntiAlias, TFALSE))
+		flags |= FBP_POLY_ANTIALIAS;
+
 	if (penarray)
-		rfb_setfgpen(mod, v, penarray[2]);
+		rfb_setfgpen(mod, v, penarray[num - 1]);
 	else
 		rfb_setfgpen(mod, v, pen);
 
-	x0 = array[0] + wx;
-	y0 = array[1] + wy;
-	x1 = array[2] + wx;
-	y1 = array[3] + wy;
-	x2 = array[4] + wx;
-	y2 = array[5] + wy;
-
-	fbp_drawtriangle(mod, v, x0, y0, x1, y1, x2, y2,
-		(struct rfb_Pen *) v->rfbw_FGPen);
-
-	for (i = 3; i < num; i++)
-	{
-		x0 = x1;
-		y0 = y1;
-		x1 = x2;
-		y1 = y2;
-		x2 = array[i * 2] + wx;
-		y2 = array[i * 2 + 1] + wy;
-
-		if (penarray)
-			rfb_setfgpen(mod, v, penarray[i]);
-
-		fbp_drawtriangle(mod, v, x0, y0, x1, y1, x2, y2,
-			(struct rfb_Pen *) v->rfbw_FGPen);
-	}
+	fbp_drawpolygon(mod, v, req->tvr_Op.Strip.Array, num, flags,
+		(struct rfb_Pen *) v->rfbw_FGPen, penarray);
 }
 
 /*****************************************************************************/
 
 static void rfb_drawfan(struct rfb_Display *mod, struct TVRequest *req)
 {
-	TINT i, x0, y0, x1, y1, x2, y2;
 	struct rfb_Window *v = req->tvr_Op.Fan.Window;
-	TINT *array = req->tvr_Op.Fan.Array;
 	TINT num = req->tvr_Op.Fan.Num;
 	TTAGITEM *tags = req->tvr_Op.Fan.Tags;
 	TVPEN pen = (TVPEN) TGetTag(tags, TVisual_Pen, TVPEN_UNDEFINED);
 	TVPEN *penarray = (TVPEN *) TGetTag(tags, TVisual_PenArray, TNULL);
-	TINT wx = v->rfbw_WinRect.r[0];
-	TINT wy = v->rfbw_WinRect.r[1];
+	TUINT flags = FBP_POLY_FAN;
 
 	if (num < 3)
 		return;
 
+	if (TGetTag(tags, TVisual_AntiAlias, TFALSE))
+		flags |= FBP_POLY_ANTIALIAS;
+
 	if (penarray)
-		rfb_setfgpen(mod, v, penarray[2]);
+		rfb_setfgpen(mod, v, penarray[num - 1]);
 	else
 		rfb_setfgpen(mod, v, pen);
 
-	x0 = array[0] + wx;
-	y0 = array[1] + wy;
-	x1 = array[2] + wx;
-	y1 = array[3] + wy;
-	x2 = array[4] + wx;
-	y2 = array[5] + wy;
-
-	fbp_drawtriangle(mod, v, x0, y0, x1, y1, x2, y2,
-		(struct rfb_Pen *) v->rfbw_FGPen);
-
-	for (i = 3; i < num; i++)
-	{
-		x1 = x2;
-		y1 = y2;
-		x2 = array[i * 2] + wx;
-		y2 = array[i * 2 + 1] + wy;
-
-		if (penarray)
-			rfb_setfgpen(mod, v, penarray[i]);
-
-		fbp_drawtriangle(mod, v, x0, y0, x1, y1, x2, y2,
-			(struct rfb_Pen *) v->rfbw_FGPen);
-	}
+	fbp_drawpolygon(mod, v, req->tvr_Op.Fan.Array, num, flags,
+		(struct rfb_Pen *) v->rfbw_FGPen, penarray);
 }
 
 /*****************************************************************************/
@@ -659,7 +623,56 @@ static void rfb_setcliprect(struct rfb_Display *mod, struct TVRequest *req)
 
 	REGION_RECT_SET(&v->rfbw_UserClipRect, x0, y0, x1, y1);
 	v->rfbw_Flags |= RFBWFL_USERCLIP;
+	v->rfbw_Flags &= ~RFBWFL_CLIPREGION;
+	rfb_setrealcliprect(mod, v);
+}
+
+/*****************************************************************************/
+/*
+**	The clipping region is kept in screen coordinates, and its bounding box
+**	is set as the user clipping rectangle, against which primitives are
+**	checked first. Drawing operations obtain the region minus the layers
+**	above the window from a mask that is cached until the clipping or the
+**	window stack changes.
+*/
+
+static void rfb_setclipregion(struct rfb_Display *mod,
+	struct TVRequest *req)
+{
+	struct rfb_Window *v = req->tvr_Op.ClipRegion.Window;
+	struct RectPool *pool = &mod->rfb_RectPool;
+	TINT *r = req->tvr_Op.ClipRegion.Rects;
+	TINT num = req->tvr_Op.ClipRegion.NumRects;
+	TINT wx = v->rfbw_WinRect.r[0];
+	TINT wy = v->rfbw_WinRect.r[1];
+	TBOOL success = TTRUE;
+	TINT i, bbox[4];
+
+	bbox[0] = bbox[1] = RFB_HUGE;
+	bbox[2] = bbox[3] = -RFB_HUGE;
+	region_free(pool, &v->rfbw_ClipRegion);
+	region_init(pool, &v->rfbw_ClipRegion, TNULL);
+	for (i = 0; i < num; ++i, r += 4)
+	{
+		bbox[0] = TMIN(bbox[0], r[0] + wx);
+		bbox[1] = TMIN(bbox[1], r[1] + wy);
+		bbox[2] = TMAX(bbox[2], r[2] + wx);
+		bbox[3] = TMAX(bbox[3], r[3] + wy);
+		if (success)
+			success = region_insertrect(pool, &v->rfbw_ClipRegion.rg_Rects,
+				r[0] + wx, r[1] + wy, r[2] + wx, r[3] + wy);
+	}
+
+	REGION_RECT_SET(&v->rfbw_UserClipRect, bbox[0], bbox[1], bbox[2],
+		bbox[3]);
+	v->rfbw_Flags |= RFBWFL_USERCLIP;
+	if (success)
+		v->rfbw_Flags |= RFBWFL_CLIPREGION;
+	else
+		v->rfbw_Flags &= ~RFBWFL_CLIPREGION;
 	rfb_setrealcliprect(mod, v);
+	if (num == 0)
+		v->rfbw_ClipRect.r[0] = -1;
 }
 
 /*****************************************************************************/
@@ -669,7 +682,7 @@ static void rfb_unsetcliprect(struct rfb_Display *mod, struct TVRequest *req)
 	struct rfb_Window *v = req->tvr_Op.ClipRect.Window;
 
 	v->rfbw_UserClipRect = v->rfbw_WinRect;
-	v->rfbw_Flags &= ~RFBWFL_USERCLIP;
+	v->rfbw_Flags &= ~(RFBWFL_USERCLIP | RFBWFL_CLIPREGION);
 	rfb_setrealcliprect(mod, v);
 }
 
@@ -734,6 +747,131 @@ static void rfb_drawbuffer(struct rfb_Display *mod, struct TVRequest *req)
 	fbp_drawbuffer(mod, v, &src, rect, alpha);
 }
 
+/*****************************************************************************/
+/*
+**	Pixmaps are converted to the format of the pixel buffer once, when
+**	they are created; see struct rfb_Pixmap. Only ARGB sources are accepted
+**	with an alpha channel. If the conversion is not supported, no pixmap
+**	is returned, and the client falls back to drawing buffers.
+*/
+
+static void rfb_createpixmap(struct rfb_Display *mod, struct TVRequest *req)
+{
+	TAPTR TExecBase = TGetExecBase(mod);
+	TTAGITEM *tags = req->tvr_Op.CreatePixmap.Tags;
+	TINT w = req->tvr_Op.CreatePixmap.Width;
+	TINT h = req->tvr_Op.CreatePixmap.Height;
+	TUINT dstfmt = mod->rfb_PixBuf.tpb_Format;
+	TBOOL alpha = TGetTag(tags, TVisual_AlphaChannel, TFALSE);
+	struct TVPixBuf src;
+	struct rfb_Pixmap *pm;
+	TUINT fmt;
+	TINT x, y;
+
+	req->tvr_Op.CreatePixmap.Pixmap = TNULL;
+	src.tpb_Data = req->tvr_Op.CreatePixmap.Buf;
+	src.tpb_Format = TGetTag(tags, TVisual_PixelFormat, TVPIXFMT_A8R8G8B8);
+	src.tpb_BytesPerLine = req->tvr_Op.CreatePixmap.TotWidth *
+		TVPIXFMT_BYTES_PER_PIXEL(src.tpb_Format);
+
+	if (w < 1 || h < 1 || src.tpb_Data == TNULL)
+		return;
+
+	switch (dstfmt)
+	{
+		case TVPIXFMT_08R8G8B8:
+		case TVPIXFMT_A8R8G8B8:
+		case TVPIXFMT_R5G6B5:
+		case TVPIXFMT_0R5G5B5:
+		case TVPIXFMT_0B5G5R5:
+			fmt = alpha ? TVPIXFMT_A8R8G8B8 : dstfmt;
+			break;
+		case TVPIXFMT_08B8G8R8:
+		case TVPIXFMT_A8B8G8R8:
+			fmt = alpha ? TVPIXFMT_A8B8G8R8 : dstfmt;
+			break;
+		default:
+			return;
+	}
+	if (alpha && src.tpb_Format != TVPIXFMT_A8R8G8B8)
+		return;
+
+	pm = TAlloc(mod->rfb_MemMgr, sizeof(struct rfb_Pixmap) +
+		w * h * TVPIXFMT_BYTES_PER_PIXEL(fmt));
+	if (pm == TNULL)
+		return;
+	pm->pixbuf.tpb_Data = (TUINT8 *) (pm + 1);
+	pm->pixbuf.tpb_Format = fmt;
+	pm->pixbuf.tpb_BytesPerLine = w * TVPIXFMT_BYTES_PER_PIXEL(fmt);
+	pm->width = w;
+	pm->height = h;
+	pm->dstfmt = dstfmt;
+	pm->alpha = alpha;
+
+	if (alpha)
+	{
+		for (y = 0; y < h; ++y)
+		{
+			TUINT *s = (TUINT *) TVPB_GETADDRESS(&src, 0, y);
+			TUINT *d = (TUINT *) TVPB_GETADDRESS(&pm->pixbuf, 0, y);
+			for (x = 0; x < w; ++x)
+			{
+				TUINT p = s[x];
+				TUINT a = TVPIXFMT_ARGB32_GET_ALPHA8(p);
+				TUINT r = (TVPIXFMT_ARGB32_GET_RED8(p) * a + 127) / 255;
+				TUINT g = (TVPIXFMT_ARGB32_GET_GREEN8(p) * a + 127) / 255;
+				TUINT b = (TVPIXFMT_ARGB32_GET_BLUE8(p) * a + 127) / 255;
+				d[x] = (a << 24) | (fmt == TVPIXFMT_A8B8G8R8 ?
+					TVPIXFMT_R_G_B_TO_ABGR32(r, g, b) :
+					TVPIXFMT_R_G_B_TO_ARGB32(r, g, b));
+			}
+		}
+	}
+	else if (pixconv_convert(&src, &pm->pixbuf, 0, 0, w - 1, h - 1, 0, 0,
+		TFALSE, TFALSE))
+	{
+		TFree(pm);
+		return;
+	}
+
+	TAddTail(&mod->rfb_PixmapList, &pm->node);
+	req->tvr_Op.CreatePixmap.Pixmap = pm;
+}
+
+/*****************************************************************************/
+
+static void rfb_freepixmap(struct rfb_Display *mod, struct TVRequest *req)
+{
+	TAPTR TExecBase = TGetExecBase(mod);
+	struct rfb_Pixmap *pm = req->tvr_Op.FreePixmap.Pixmap;
+
+	TRemove(&pm->node);
+	TFree(pm);
+}
+
+/*****************************************************************************/
+
+static void rfb_drawpixmap(struct rfb_Display *mod, struct TVRequest *req)
+{
+	struct rfb_Window *v = req->tvr_Op.DrawPixmap.Window;
+	struct rfb_Pixmap *pm = req->tvr_Op.DrawPixmap.Pixmap;
+	TINT sx = req->tvr_Op.DrawPixmap.SrcX;
+	TINT sy = req->tvr_Op.DrawPixmap.SrcY;
+	TINT w = req->tvr_Op.DrawPixmap.RRect[2];
+	TINT h = req->tvr_Op.DrawPixmap.RRect[3];
+	TINT rect[4];
+
+	if (pm->dstfmt != v->rfbw_PixBuf.tpb_Format || w < 1 || h < 1 ||
+		sx < 0 || sy < 0 || sx + w > pm->width || sy + h > pm->height)
+		return;
+
+	rect[0] = req->tvr_Op.DrawPixmap.RRect[0] + v->rfbw_WinRect.r[0];
+	rect[1] = req->tvr_Op.DrawPixmap.RRect[1] + v->rfbw_WinRect.r[1];
+	rect[2] = rect[0] + w - 1;
+	rect[3] = rect[1] + h - 1;
+	fbp_drawpixmap(mod, v, pm, rect, sx, sy);
+}
+
 /*****************************************************************************/
 
 static void rbp_move_expose(struct rfb_Display *mod, struct rfb_Window *v,
@@ -830,6 +968,7 @@ static void rfb_movewindow(struct rfb_Display *mod, struct rfb_Window *v,
 		v->rfbw_UserClipRect.r[1] += dy;
 		v->rfbw_UserClipRect.r[2] += dx;
 		v->rfbw_UserClipRect.r[3] += dy;
+		region_shift(&v->rfbw_ClipRegion, dx, dy);
 	}
 
 	rfb_setwinrect(mod, v);
@@ -847,6 +986,7 @@ static void rfb_movewindow(struct rfb_Display *mod, struct rfb_Window *v,
 	}
 	else
 		TAddHead(&mod->rfb_VisualList, &v->rfbw_Node);
+	mod->rfb_LayerSerial++;
 
 	struct RectPool *pool = &mod->rfb_RectPool;
 	struct Region R;
@@ -1142,6 +1282,7 @@ static void rfb_setattrs(struct rfb_Display *mod, struct TVRequest *req)
 						TLock(mod->rfb_Lock);
 						TRemove(&v->rfbw_Node);
 						TAddHead(&mod->rfb_VisualList, &v->rfbw_Node);
+						mod->rfb_LayerSerial++;
 						TUnlock(mod->rfb_Lock);
 						rfb_damage(mod, v->rfbw_ScreenRect.r, TNULL);
 					}
@@ -1292,6 +1433,18 @@ static void rfb_textsize(struct rfb_Display *mod, struct TVRequest *req)
 
 /*****************************************************************************/
 
+static void rfb_textsizes(struct rfb_Display *mod, struct TVRequest *req)
+{
+	TINT *runs = req->tvr_Op.TextSizes.Runs;
+	TINT *widths = req->tvr_Op.TextSizes.Widths;
+	TINT i;
+	for (i = 0; i < req->tvr_Op.TextSizes.NumRuns; ++i, runs += 2)
+		widths[i] = rfb_hosttextsize(mod, req->tvr_Op.TextSizes.Font,
+			req->tvr_Op.TextSizes.Text + runs[0], runs[1]);
+}
+
+/*****************************************************************************/
+
 static void rfb_getfontattrs(struct rfb_Display *mod, struct TVRequest *req)
 {
 	struct rfb_attrdata data;
@@ -1353,6 +1506,9 @@ LOCAL void rfb_docmd(struct rfb_Display *mod, struct TVRequest *req)
 		case TVCMD_TEXTSIZE:
 			rfb_textsize(mod, req);
 			break;
+		case TVCMD_TEXTSIZES:
+			rfb_textsizes(mod, req);
+			break;
 		case TVCMD_QUERYFONTS:
 			rfb_queryfonts(mod, req);
 			break;
@@ -1413,9 +1569,21 @@ LOCAL void rfb_docmd(struct rfb_Display *mod, struct TVRequest *req)
 		case TVCMD_UNSETCLIPRECT:
 			rfb_unsetcliprect(mod, req);
 			break;
+		case TVCMD_SETCLIPREGION:
+			rfb_setclipregion(mod, req);
+			break;
 		case TVCMD_DRAWBUFFER:
 			rfb_drawbuffer(mod, req);
 			break;
+		case TVCMD_CREATEPIXMAP:
+			rfb_createpixmap(mod, req);
+			break;
+		case TVCMD_FREEPIXMAP:
+			rfb_freepixmap(mod, req);
+			break;
+		case TVCMD_DRAWPIXMAP:
+			rfb_drawpixmap(mod, req);
+			break;
 		case TVCMD_FLUSH:
 			rfb_flush(mod, req);
 			break;
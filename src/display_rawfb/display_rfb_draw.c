@@ -6,11 +6,10 @@
 **	See copyright notice in teklib/COPYRIGHT
 */
 
+#include <stdlib.h>
 #include <string.h>
 #include "display_rfb_mod.h"
-
-#define	MAX_VERT	6
-#define	NUM_VERT	3
+#include <tek/inline/exec.h>
 
 #define	OC_TOP		0x1
 #define	OC_BOTTOM	0x2
@@ -22,15 +21,6 @@ struct Coord
 	TINT x, y;
 };
 
-struct Slope
-{
-	TINT inta;					/* integer part */
-	TINT z;						/* numerator */
-	TINT n;						/* denumerator */
-	TINT cz;					/* current numerator */
-	struct Coord S;				/* start coordinate */
-};
-
 /*****************************************************************************/
 
 TINLINE static void CopyLineOver(struct rfb_Window *v, TINT xs, TINT ys,
@@ -107,145 +97,6 @@ static void intersect(struct Coord *res, struct Coord v1, struct Coord v2,
 
 /*****************************************************************************/
 
-static TBOOL inside(struct Coord v, struct Coord ce[2], TUINT which)
-{
-	switch (which)
-	{
-		case OC_BOTTOM:
-			if (v.y >= ce[0].y)
-				return TTRUE;
-			break;
-		case OC_TOP:
-			if (v.y <= ce[1].y)
-				return TTRUE;
-			break;
-		case OC_LEFT:
-			if (v.x >= ce[0].x)
-				return TTRUE;
-			break;
-		case OC_RIGHT:
-			if (v.x <= ce[1].x)
-				return TTRUE;
-			break;
-		default:
-			break;
-	}
-	return TFALSE;
-}
-
-static void output(struct Coord outva[MAX_VERT], struct Coord v, TINT *outlen)
-{
-	if (*outlen < MAX_VERT)
-	{
-		/* filter out double entries */
-		if (*outlen == 0 || (outva[(*outlen) - 1].x != v.x
-				|| outva[(*outlen) - 1].y != v.y))
-		{
-			outva[*outlen].x = v.x;
-			outva[*outlen].y = v.y;
-			(*outlen)++;
-		}
-	}
-}
-
-/* sutherland hodgman polygon clipping */
-static void shpolyclip(struct Coord outva[MAX_VERT], TINT *outlen, TINT inlen,
-	struct Coord inva[NUM_VERT], struct Coord clipedge[2], TUINT which)
-{
-	struct Coord s, p, i;
-	TINT j;
-
-	*outlen = 0;
-	s.x = inva[inlen - 1].x;
-	s.y = inva[inlen - 1].y;
-
-	for (j = 0; j < inlen; j++)
-	{
-		p.x = inva[j].x;
-		p.y = inva[j].y;
-
-		if (inside(p, clipedge, which))
-		{
-			/* cases 1 and 4 */
-			if (inside(s, clipedge, which))
-			{
-				/* case 1 */
-				output(outva, p, outlen);
-			}
-			else
-			{
-				/* case 4 */
-				intersect(&i, s, p, clipedge, which);
-				output(outva, i, outlen);
-				output(outva, p, outlen);
-			}
-		}
-		else
-		{
-			/* cases 2 and 3 */
-			if (inside(s, clipedge, which))
-			{
-				/* case 2 */
-				intersect(&i, s, p, clipedge, which);
-				output(outva, i, outlen);
-			}					/* else do nothing (case 3) */
-		}
-
-		/* advance to next pair of vertices */
-		s.x = p.x;
-		s.y = p.y;
-	}
-}
-
-static TBOOL clippoly(struct Coord res[MAX_VERT], TINT *outlen, TINT x0,
-	TINT y0, TINT x1, TINT y1, TINT x2, TINT y2, TINT xmin, TINT ymin,
-	TINT xmax, TINT ymax)
-{
-	struct Coord outva[MAX_VERT];
-	struct Coord inva[NUM_VERT];
-	struct Coord clipedge[2];
-	TINT inlen = NUM_VERT;
-
-	inva[0].x = x0;
-	inva[0].y = y0;
-	inva[1].x = x1;
-	inva[1].y = y1;
-	inva[2].x = x2;
-	inva[2].y = y2;
-
-	clipedge[0].x = xmin;
-	clipedge[0].y = ymin;
-	clipedge[1].x = xmax;
-	clipedge[1].y = ymax;
-
-	/* process right clip boundary */
-	shpolyclip(outva, outlen, inlen, inva, clipedge, OC_RIGHT);
-	if (!*outlen)
-		return TFALSE;
-
-	/* process bottom clip boundary */
-	inlen = *outlen;
-	shpolyclip(res, outlen, inlen, outva, clipedge, OC_BOTTOM);
-	if (!*outlen)
-		return TFALSE;
-
-	/* process left clip boundary */
-	inlen = *outlen;
-	shpolyclip(outva, outlen, inlen, res, clipedge, OC_LEFT);
-	if (!*outlen)
-		return TFALSE;
-
-	/* process top clip boundary */
-	inlen = *outlen;
-	shpolyclip(res, outlen, inlen, outva, clipedge, OC_TOP);
-	if (!*outlen)
-		return TFALSE;
-
-	return TTRUE;
-}
-
-/*****************************************************************************/
-
 static TUINT getoutcode(TINT x, TINT y, TINT xmin, TINT ymin, TINT xmax,
 	TINT ymax)
 {
@@ -336,9 +187,8 @@ LOCAL void fbp_drawfrect(struct rfb_Display *mod, struct rfb_Window *v,
 {
 	struct Region R;
 
-	if (!rfb_getlayermask(mod, &R, v->rfbw_ClipRect.r, v, 0, 0))
+	if (!rfb_getclipmask(mod, &R, v, rect))
 		return;
-	region_andrect(&mod->rfb_RectPool, &R, rect, 0, 0);
 	TINT y;
 	TUINT dfmt = v->rfbw_PixBuf.tpb_Format;
 	TUINT p = pixconv_rgbfmt(dfmt, pen->rgb);
@@ -368,9 +218,8 @@ LOCAL void fbp_drawrect(struct rfb_Display *mod, struct rfb_Window *v,
 {
 	struct Region R;
 
-	if (!rfb_getlayermask(mod, &R, v->rfbw_ClipRect.r, v, 0, 0))
+	if (!rfb_getclipmask(mod, &R, v, rect))
 		return;
-	region_andrect(&mod->rfb_RectPool, &R, rect, 0, 0);
 	TINT y;
 	TINT xmin = rect[0];
 	TINT ymin = rect[1];
@@ -418,7 +267,7 @@ LOCAL void fbp_drawline(struct rfb_Display *mod, struct rfb_Window *v,
 {
 	struct Region R;
 
-	if (!rfb_getlayermask(mod, &R, v->rfbw_ClipRect.r, v, 0, 0))
+	if (!rfb_getclipmask(mod, &R, v, TNULL))
 		return;
 
 	struct Coord res[2];
@@ -572,266 +421,459 @@ LOCAL void fbp_drawline(struct rfb_Display *mod, struct rfb_Window *v,
 
 /*****************************************************************************/
 
-static void initslope(struct Slope *m, struct Coord *c1, struct Coord *c2)
+/*
+**	Scanline polygon rasterizer. The triangles of a strip or fan are
+**	entered into an edge table, sorted by their topmost scanline. Scanlines
+**	are then traversed from top to bottom, with an active list of the
+**	triangles intersecting the current scanline, in drawing order. The
+**	spans of consecutive triangles sharing the same pen are merged and
+**	intersected with the rectangles of the clip region, which are
+**	determined once per scanline. Without anti-aliasing, a pixel is set if
+**	its center lies inside or on the edge of a triangle. With
+**	anti-aliasing, coverage is accumulated from four subscanlines with
+**	exact horizontal coverage, and partially covered pixels are blended.
+*/
+
+/* Subscanlines per scanline, at y - 3/8, y - 1/8, y + 1/8, y + 3/8: */
+#define POLY_SUBSAMPLES	4
+/* Coverage of a fully covered pixel: */
+#define POLY_FULL		256
+
+struct PolyTri
 {
-	TINT dx = c2->x - c1->x;
-	TINT dy = c2->y - c1->y;
+	/* Vertices, sorted by y: */
+	TINT xa, ya, xb, yb, xc, yc;
+	/* Slopes of the edges, 16.16 fixed point: */
+	TINT dac, dab, dbc;
+	/* Consecutive triangles sharing the same pen form a group: */
+	TINT group;
+	struct rfb_Pen *pen;
+	TUINT pixel;
+};
 
-	memset(m, 0x0, sizeof(struct Slope));
-	m->S.x = c1->x;
-	m->S.y = c1->y;
+struct PolyEdge
+{
+	/* Topmost scanline and index of a triangle: */
+	TINT y, idx;
+};
 
-	if (dx && dy)
+struct PolySpan
+{
+	TINT x0, x1;
+};
+
+static int poly_cmpedge(const void *a, const void *b)
+{
+	const struct PolyEdge *e0 = a, *e1 = b;
+
+	if (e0->y != e1->y)
+		return e0->y < e1->y ? -1 : 1;
+	return e0->idx - e1->idx;
+}
+
+static TINT poly_slope(TINT x0, TINT y0, TINT x1, TINT y1)
+{
+	if (y1 == y0)
+		return 0;
+	return (TINT) ((TINT64) (x1 - x0) * 0x10000 / (y1 - y0));
+}
+
+static void poly_inittri(struct PolyTri *t, TINT x0, TINT y0, TINT x1,
+	TINT y1, TINT x2, TINT y2)
+{
+	TINT h;
+
+	/* sort that ya <= yb <= yc */
+	if (y0 > y1)
 	{
-		if (abs(dx) >= dy)
-		{
-			/* calculate integer part */
-			m->inta = dx / dy;
-			m->z = dx - (m->inta * dy);
-			if (m->z)
-				m->n = dy;
-		}
-		else
+		h = x0; x0 = x1; x1 = h;
+		h = y0; y0 = y1; y1 = h;
+	}
+	if (y1 > y2)
+	{
+		h = x1; x1 = x2; x2 = h;
+		h = y1; y1 = y2; y2 = h;
+		if (y0 > y1)
 		{
-			/* dx < dy */
-			m->z = dx;
-			m->n = dy;
+			h = x0; x0 = x1; x1 = h;
+			h = y0; y0 = y1; y1 = h;
 		}
 	}
+
+	t->xa = x0;
+	t->ya = y0;
+	t->xb = x1;
+	t->yb = y1;
+	t->xc = x2;
+	t->yc = y2;
+	t->dac = poly_slope(x0, y0, x2, y2);
+	t->dab = poly_slope(x0, y0, x1, y1);
+	t->dbc = poly_slope(x1, y1, x2, y2);
 }
 
-static void hline(struct rfb_Window *v, struct Slope *ms, struct Slope *me,
-	TINT y, TUINT p)
+/* x on an edge at y8 (in eighths of a scanline), 16.16 fixed point: */
+
+static TINLINE TINT64 poly_edgex(TINT x, TINT y, TINT d, TINT y8)
 {
-	TINT xs, xe, rs = 0, re = 0;
+	return (TINT64) x * 0x10000 + (((TINT64) d * (y8 - y * 8)) >> 3);
+}
 
-	/* check, if we need to round up coordinates */
-	if (ms->n && abs(ms->cz) * 2 >= ms->n)
-		rs = 1;
-	if (me->n && abs(me->cz) * 2 >= me->n)
-		re = 1;
+static void poly_span(struct PolyTri *t, TINT y8, TINT64 *x0, TINT64 *x1)
+{
+	TINT64 xl, xr;
 
-	/* sort that xs < xe */
-	if (ms->S.x + rs > me->S.x + re)
+	if (t->ya == t->yc)
 	{
-		xs = me->S.x + re;
-		xe = ms->S.x + rs;
+		/* flat triangle */
+		xl = TMIN(TMIN(t->xa, t->xb), t->xc);
+		xr = TMAX(TMAX(t->xa, t->xb), t->xc);
+		*x0 = xl * 0x10000;
+		*x1 = xr * 0x10000;
+		return;
 	}
+
+	xl = poly_edgex(t->xa, t->ya, t->dac, y8);
+	if (y8 < t->yb * 8)
+		xr = poly_edgex(t->xa, t->ya, t->dab, y8);
 	else
-	{
-		xs = ms->S.x + rs;
-		xe = me->S.x + re;
-	}
+		xr = poly_edgex(t->xb, t->yb, t->dbc, y8);
 
-	pixconv_buf_line_set(&v->rfbw_PixBuf, xs, y, xe - xs + 1, p);
+	*x0 = TMIN(xl, xr);
+	*x1 = TMAX(xl, xr);
 }
 
-static void rendertriangle(struct rfb_Window *v, struct Coord v1,
-	struct Coord v2, struct Coord v3, TUINT p)
-{
-	struct Coord A, B, C;
-	struct Slope mAB, mAC, mBC;
-	TINT y;
+/* sort spans by their start, and merge overlapping or adjacent ones: */
 
-	/* sort that A.y <= B.y <= C.y */
-	A.x = v1.x;
-	A.y = v1.y;
-	B.x = v2.x;
-	B.y = v2.y;
-	C.x = v3.x;
-	C.y = v3.y;
+static TINT poly_mergespans(struct PolySpan *s, TINT n, TINT adj)
+{
+	TINT i, j;
 
-	if (A.y > v2.y)
+	for (i = 1; i < n; ++i)
 	{
-		B.x = A.x;
-		B.y = A.y;
-		A.x = v2.x;
-		A.y = v2.y;
+		struct PolySpan t = s[i];
+
+		for (j = i; j > 0 && s[j - 1].x0 > t.x0; --j)
+			s[j] = s[j - 1];
+		s[j] = t;
 	}
 
-	if (A.y > v3.y)
+	for (i = 0, j = 1; j < n; ++j)
 	{
-		C.x = B.x;
-		C.y = B.y;
-		B.x = A.x;
-		B.y = A.y;
-		A.x = v3.x;
-		A.y = v3.y;
+		if (s[j].x0 <= s[i].x1 + adj)
+		{
+			if (s[j].x1 > s[i].x1)
+				s[i].x1 = s[j].x1;
+		}
+		else
+			s[++i] = s[j];
 	}
-	else
+
+	return n ? i + 1 : 0;
+}
+
+static void poly_fillspans(struct rfb_Window *v, TINT *clip, TINT nclip,
+	struct PolySpan *s, TINT n, TINT y, TUINT p)
+{
+	TUINT dfmt = v->rfbw_PixBuf.tpb_Format;
+	TINT i, j;
+
+	for (i = 0; i < nclip; ++i, clip += 2)
 	{
-		if (B.y > v3.y)
+		for (j = 0; j < n; ++j)
 		{
-			C.x = B.x;
-			C.y = B.y;
-			B.x = v3.x;
-			B.y = v3.y;
+			TINT x0 = TMAX(s[j].x0, clip[0]);
+			TINT x1 = TMIN(s[j].x1, clip[1]);
+
+			if (x0 <= x1)
+				pixconv_line_set(TVPB_GETADDRESS(&v->rfbw_PixBuf, x0, y),
+					dfmt, x1 - x0 + 1, p);
 		}
 	}
+}
 
-	initslope(&mAB, &A, &B);
-	initslope(&mAC, &A, &C);
-	initslope(&mBC, &B, &C);
+/* add coverage of a span, given relative to the buffer in 16.16: */
+
+static void poly_coverage(TUINT16 *cov, TINT u0, TINT u1)
+{
+	TINT w = POLY_FULL / POLY_SUBSAMPLES;
+	TINT p0 = u0 >> 16;
+	TINT p1 = u1 >> 16;
 
-	for (y = A.y; y < B.y; y++, mAC.S.x += mAC.inta, mAB.S.x += mAB.inta)
+	if (p0 == p1)
 	{
-		hline(v, &mAC, &mAB, y, p);
+		cov[p0] += ((u1 - u0) * w) >> 16;
+		return;
+	}
 
-		if (mAC.n)
-		{
-			mAC.cz += mAC.z;
-			if (mAC.z < 0)
-			{
-				if (mAC.cz < 0)
-				{
-					mAC.S.x -= 1;
-					mAC.cz += mAC.n;
-				}
-			}
-			else
-			{
-				if (mAC.cz >= mAC.n)
-				{
-					mAC.S.x += 1;
-					mAC.cz -= mAC.n;
-				}
-			}
-		}
+	cov[p0] += ((0x10000 - (u0 & 0xffff)) * w) >> 16;
+	while (++p0 < p1)
+		cov[p0] += w;
+	cov[p1] += ((u1 & 0xffff) * w) >> 16;
+}
 
-		if (mAB.n)
-		{
-			mAB.cz += mAB.z;
+static void poly_fillcoverage(struct rfb_Window *v, TINT *clip, TINT nclip,
+	TUINT16 *cov, TUINT8 *alpha, TINT bx, TINT c0, TINT c1, TINT y,
+	struct rfb_Pen *pen, TUINT p)
+{
+	TUINT dfmt = v->rfbw_PixBuf.tpb_Format;
+	TINT r = (pen->rgb >> 16) & 0xff;
+	TINT g = (pen->rgb >> 8) & 0xff;
+	TINT b = pen->rgb & 0xff;
+	TINT i, x;
 
-			if (mAB.z < 0)
-			{
-				if (mAB.cz < 0)
-				{
-					mAB.S.x -= 1;
-					mAB.cz += mAB.n;
-				}
-			}
-			else
-			{
-				if (mAB.cz >= mAB.n)
-				{
-					mAB.S.x += 1;
-					mAB.cz -= mAB.n;
-				}
-			}
-		}
+	/* 255 marks a fully covered pixel, 0 an uncovered one: */
+	for (x = c0; x <= c1; ++x)
+	{
+		TINT c = cov[x - bx];
+
+		alpha[x - bx] = c >= POLY_FULL ? 255 : TMIN(c, 254);
+		cov[x - bx] = 0;
 	}
 
-	for (; y <= C.y; y++, mAC.S.x += mAC.inta, mBC.S.x += mBC.inta)
+	for (i = 0; i < nclip; ++i, clip += 2)
 	{
-		hline(v, &mAC, &mBC, y, p);
+		TINT x0 = TMAX(c0, clip[0]);
+		TINT x1 = TMIN(c1, clip[1]);
 
-		if (mAC.n)
+		for (x = x0; x <= x1;)
 		{
-			mAC.cz += mAC.z;
+			TUINT8 a = alpha[x - bx];
+			TINT e = x + 1;
 
-			if (mAC.z < 0)
+			if (a == 0)
 			{
-				if (mAC.cz < 0)
-				{
-					mAC.S.x -= 1;
-					mAC.cz += mAC.n;
-				}
+				x = e;
+				continue;
 			}
-			else
+			if (a == 255)
 			{
-				if (mAC.cz >= mAC.n)
-				{
-					mAC.S.x += 1;
-					mAC.cz -= mAC.n;
-				}
-			}
-		}
-
-		if (mBC.n)
-		{
-			mBC.cz += mBC.z;
-
-			if (mBC.z < 0)
-			{
-				if (mBC.cz < 0)
-				{
-					mBC.S.x -= 1;
-					mBC.cz += mBC.n;
-				}
+				while (e <= x1 && alpha[e - bx] == 255)
+					e++;
+				pixconv_line_set(TVPB_GETADDRESS(&v->rfbw_PixBuf, x, y),
+					dfmt, e - x, p);
 			}
 			else
 			{
-				if (mBC.cz >= mBC.n)
-				{
-					mBC.S.x += 1;
-					mBC.cz -= mBC.n;
-				}
+				while (e <= x1 && alpha[e - bx] != 0 && alpha[e - bx] != 255)
+					e++;
+				pixconv_writealpha(TVPB_GETADDRESS(&v->rfbw_PixBuf, x, y),
+					alpha + x - bx, e - x, dfmt, r, g, b);
 			}
+			x = e;
 		}
 	}
 }
 
-/*****************************************************************************/
+/*
+**	fbp_drawpolygon(mod, v, array, num, flags, pen, penarray)
+**	Draws a strip or fan (if FBP_POLY_FAN is set in flags) of triangles
+**	from num vertices, with coordinates relative to the window. If penarray
+**	is given, it contains a pen per vertex, and the triangle ending with
+**	that vertex is drawn in it; otherwise, all triangles are drawn with pen.
+**	If FBP_POLY_ANTIALIAS is set, edges are drawn anti-aliased.
+*/
 
-LOCAL void fbp_drawtriangle(struct rfb_Display *mod, struct rfb_Window *v,
-	TINT x0, TINT y0, TINT x1, TINT y1, TINT x2, TINT y2, struct rfb_Pen *pen)
+LOCAL void fbp_drawpolygon(struct rfb_Display *mod, struct rfb_Window *v,
+	TINT *array, TINT num, TUINT flags, struct rfb_Pen *pen,
+	TVPEN *penarray)
 {
-	struct Coord res[MAX_VERT];
-	TINT outlen;
-
+	TAPTR TExecBase = TGetExecBase(mod);
+	TINT wx = v->rfbw_WinRect.r[0];
+	TINT wy = v->rfbw_WinRect.r[1];
+	TINT numtri = num - 2;
+	TINT bbox[4], minmax[4];
+	TINT i, j, y, bw, nact, nord, nclip;
 	struct Region R;
+	struct PolyTri *tris;
+	struct PolyEdge *order;
+	struct PolySpan *spans;
+	TINT *active, *clip;
+	TUINT16 *cov;
+	TUINT8 *alpha;
+	TSIZE size;
+	TAPTR buf;
+
+	if (numtri < 1)
+		return;
 
-	if (!rfb_getlayermask(mod, &R, v->rfbw_ClipRect.r, v, 0, 0))
+	bbox[0] = bbox[2] = array[0];
+	bbox[1] = bbox[3] = array[1];
+	for (i = 1; i < num; ++i)
+	{
+		bbox[0] = TMIN(bbox[0], array[i * 2]);
+		bbox[1] = TMIN(bbox[1], array[i * 2 + 1]);
+		bbox[2] = TMAX(bbox[2], array[i * 2]);
+		bbox[3] = TMAX(bbox[3], array[i * 2 + 1]);
+	}
+	bbox[0] += wx;
+	bbox[1] += wy;
+	bbox[2] += wx;
+	bbox[3] += wy;
+
+	if (!rfb_getclipmask(mod, &R, v, bbox))
 		return;
+	region_getminmax(&mod->rfb_RectPool, &R, minmax);
+
+	/* scratch memory, retained across calls: */
+	bw = bbox[2] - bbox[0] + 2;
+	size = sizeof(struct PolyTri) * numtri + sizeof(struct PolyEdge) * numtri
+		+ sizeof(struct PolySpan) * numtri + sizeof(TINT) * numtri
+		+ sizeof(TINT) * 2 * R.rg_Rects.rl_NumNodes;
+	if (flags & FBP_POLY_ANTIALIAS)
+		size += (sizeof(TUINT16) + sizeof(TUINT8)) * bw;
+	buf = mod->rfb_RasterBuffer;
+	if (buf && TGetSize(buf) < size)
+	{
+		TFree(buf);
+		buf = TNULL;
+	}
+	if (buf == TNULL)
+		buf = TAlloc(mod->rfb_MemMgr, size);
+	mod->rfb_RasterBuffer = buf;
+	if (buf == TNULL)
+	{
+		region_free(&mod->rfb_RectPool, &R);
+		return;
+	}
 
-	TUINT p = pixconv_rgbfmt(v->rfbw_PixBuf.tpb_Format, pen->rgb);
+	tris = buf;
+	order = (struct PolyEdge *) (tris + numtri);
+	spans = (struct PolySpan *) (order + numtri);
+	active = (TINT *) (spans + numtri);
+	clip = active + numtri;
+	cov = (TUINT16 *) (clip + 2 * R.rg_Rects.rl_NumNodes);
+	alpha = (TUINT8 *) (cov + bw);
 
-	struct TNode *next, *node = R.rg_Rects.rl_List.tlh_Head.tln_Succ;
+	/* set up triangles and edge table: */
+	for (i = 0; i < numtri; ++i)
+	{
+		struct PolyTri *t = &tris[i];
+		TINT *p0 = (flags & FBP_POLY_FAN) ? array : array + i * 2;
+		TINT *p1 = array + i * 2 + 2;
+		TINT *p2 = array + i * 2 + 4;
+
+		poly_inittri(t, p0[0] + wx, p0[1] + wy, p1[0] + wx, p1[1] + wy,
+			p2[0] + wx, p2[1] + wy);
+		t->pen = penarray ? (struct rfb_Pen *) penarray[i + 2] : pen;
+		t->pixel = pixconv_rgbfmt(v->rfbw_PixBuf.tpb_Format, t->pen->rgb);
+		t->group = i == 0 ? 0 :
+			tris[i - 1].group + (t->pen->rgb != tris[i - 1].pen->rgb);
+		order[i].y = t->ya;
+		order[i].idx = i;
+	}
+	qsort(order, numtri, sizeof(struct PolyEdge), poly_cmpedge);
 
-	for (; (next = node->tln_Succ); node = next)
+	if (flags & FBP_POLY_ANTIALIAS)
+		memset(cov, 0, sizeof(TUINT16) * bw);
+
+	/* mark touched areas dirty: */
 	{
-		struct RectNode *rn = (struct RectNode *) node;
-		TINT *r = rn->rn_Rect;
+		struct TNode *next, *node = R.rg_Rects.rl_List.tlh_Head.tln_Succ;
 
-		if (!clippoly(res, &outlen, x0, y0, x1, y1, x2, y2,
-				r[0], r[1], r[2], r[3]))
-			continue;
+		for (; (next = node->tln_Succ); node = next)
+			rfb_markdirty(mod, v, ((struct RectNode *) node)->rn_Rect);
+	}
 
-		TINT d[4];
+	nact = nord = 0;
+	for (y = minmax[1]; y <= minmax[3]; ++y)
+	{
+		struct TNode *next, *node;
 
-		if (outlen == 1)
+		/* enter triangles starting at this scanline, in drawing order: */
+		for (; nord < numtri && order[nord].y <= y; ++nord)
 		{
-			d[0] = res[0].x;
-			d[1] = res[0].y;
-			d[2] = res[0].x;
-			d[3] = res[0].y;
-			rfb_markdirty(mod, v, d);
-			pixconv_setpixelbuf(&v->rfbw_PixBuf, res[0].x, res[0].y, p);
+			TINT idx = order[nord].idx;
+
+			for (j = nact++; j > 0 && active[j - 1] > idx; --j)
+				active[j] = active[j - 1];
+			active[j] = idx;
 		}
-		else if (outlen == 2)
+
+		/* retire triangles ending above this scanline: */
+		for (i = j = 0; i < nact; ++i)
+			if (tris[active[i]].yc >= y)
+				active[j++] = active[i];
+		nact = j;
+		if (nact == 0)
+			continue;
+
+		/* clip rectangles intersecting this scanline: */
+		nclip = 0;
+		node = R.rg_Rects.rl_List.tlh_Head.tln_Succ;
+		for (; (next = node->tln_Succ); node = next)
 		{
-			TINT rect[4] = { res[0].x, res[0].y, res[1].x, res[1].y };
-			rfb_markdirty(mod, v, rect);
-			fbp_drawline(mod, v, rect, pen);
+			TINT *r = ((struct RectNode *) node)->rn_Rect;
+
+			if (y >= r[1] && y <= r[3])
+			{
+				clip[nclip * 2] = r[0];
+				clip[nclip * 2 + 1] = r[2];
+				nclip++;
+			}
 		}
-		else
+		if (nclip == 0)
+			continue;
+
+		for (i = 0; i < nact; i = j)
 		{
-			TINT i;
+			struct PolyTri *t = &tris[active[i]];
+			TINT n = 0, k;
+			TINT64 x0, x1;
 
-			d[0] = TMIN(TMIN(res[0].x, res[1].x), res[2].x);
-			d[1] = TMIN(TMIN(res[0].y, res[1].y), res[2].y);
-			d[2] = TMAX(TMAX(res[0].x, res[1].x), res[2].x);
-			d[3] = TMAX(TMAX(res[0].y, res[1].y), res[2].y);
-			rfb_markdirty(mod, v, d);
+			j = i + 1;
+			while (j < nact && tris[active[j]].group == t->group)
+				j++;
 
-			rendertriangle(v, res[0], res[1], res[2], p);
-			for (i = 2; i < outlen; i++)
+			if (!(flags & FBP_POLY_ANTIALIAS))
+			{
+				for (k = i; k < j; ++k)
+				{
+					poly_span(&tris[active[k]], y * 8, &x0, &x1);
+					spans[n].x0 = (TINT) ((x0 + 0x8000) >> 16);
+					spans[n].x1 = (TINT) ((x1 + 0x8000) >> 16);
+					n++;
+				}
+				n = poly_mergespans(spans, n, 1);
+				poly_fillspans(v, clip, nclip, spans, n, y, t->pixel);
+			}
+			else
 			{
-				if ((i + 1) < outlen)
-					rendertriangle(v, res[0], res[i], res[i + 1], p);
+				TINT s, c0 = bw, c1 = -1;
+				TINT64 bx = (TINT64) bbox[0] * 0x10000 - 0x8000;
+
+				for (s = 0; s < POLY_SUBSAMPLES; ++s)
+				{
+					TINT y8 = y * 8 + s * 2 - 3;
+
+					for (n = 0, k = i; k < j; ++k)
+					{
+						struct PolyTri *tk = &tris[active[k]];
+
+						if (y8 < tk->ya * 8 || y8 > tk->yc * 8)
+							continue;
+						poly_span(tk, y8, &x0, &x1);
+						spans[n].x0 = (TINT) TMAX(x0 - bx, 0);
+						spans[n].x1 = (TINT) TMIN(x1 - bx,
+							(TINT64) (bw - 1) << 16);
+						if (spans[n].x0 < spans[n].x1)
+							n++;
+					}
+					n = poly_mergespans(spans, n, 0);
+					for (k = 0; k < n; ++k)
+					{
+						poly_coverage(cov, spans[k].x0, spans[k].x1);
+						c0 = TMIN(c0, spans[k].x0 >> 16);
+						c1 = TMAX(c1, spans[k].x1 >> 16);
+					}
+				}
+
+				if (c0 <= c1)
+					poly_fillcoverage(v, clip, nclip, cov, alpha, bbox[0],
+						c0 + bbox[0], c1 + bbox[0], y, t->pen, t->pixel);
 			}
 		}
 	}
+
 	region_free(&mod->rfb_RectPool, &R);
 }
 
@@ -842,9 +884,8 @@ LOCAL void fbp_drawbuffer(struct rfb_Display *mod, struct rfb_Window *v,
 {
 	struct Region R;
 
-	if (!rfb_getlayermask(mod, &R, v->rfbw_ClipRect.r, v, 0, 0))
+	if (!rfb_getclipmask(mod, &R, v, rect))
 		return;
-	region_andrect(&mod->rfb_RectPool, &R, rect, 0, 0);
 	struct TNode *next, *node = R.rg_Rects.rl_List.tlh_Head.tln_Succ;
 
 	for (; (next = node->tln_Succ); node = next)
@@ -867,6 +908,127 @@ LOCAL void fbp_drawbuffer(struct rfb_Display *mod, struct rfb_Window *v,
 
 /*****************************************************************************/
 
+static TUINT fbp_blendpixel16(TUINT fmt, TUINT s, TUINT d)
+{
+	TUINT ia = 255 - TVPIXFMT_ARGB32_GET_ALPHA8(s);
+	TUINT r, g, b;
+
+	switch (fmt)
+	{
+		case TVPIXFMT_R5G6B5:
+			r = TVPIXFMT_RGB16_GET_RED8(d);
+			g = TVPIXFMT_RGB16_GET_GREEN8(d);
+			b = TVPIXFMT_RGB16_GET_BLUE8(d);
+			break;
+		case TVPIXFMT_0R5G5B5:
+			r = TVPIXFMT_RGB15_GET_RED8(d);
+			g = TVPIXFMT_RGB15_GET_GREEN8(d);
+			b = TVPIXFMT_RGB15_GET_BLUE8(d);
+			break;
+		default:
+			r = TVPIXFMT_BGR15_GET_RED8(d);
+			g = TVPIXFMT_BGR15_GET_GREEN8(d);
+			b = TVPIXFMT_BGR15_GET_BLUE8(d);
+			break;
+	}
+	r = TVPIXFMT_ARGB32_GET_RED8(s) + ((r * ia) >> 8);
+	g = TVPIXFMT_ARGB32_GET_GREEN8(s) + ((g * ia) >> 8);
+	b = TVPIXFMT_ARGB32_GET_BLUE8(s) + ((b * ia) >> 8);
+	switch (fmt)
+	{
+		case TVPIXFMT_R5G6B5:
+			return TVPIXFMT_R_G_B_TO_RGB16(r, g, b);
+		case TVPIXFMT_0R5G5B5:
+			return TVPIXFMT_R_G_B_TO_RGB15(r, g, b);
+		default:
+			return TVPIXFMT_R_G_B_TO_BGR15(r, g, b);
+	}
+}
+
+/*
+**	Draws a pixmap that is already in the format of the pixel buffer.
+**	Opaque pixmaps are copied row by row; premultiplied pixmaps are
+**	composited without any conversion of the source.
+*/
+
+LOCAL void fbp_drawpixmap(struct rfb_Display *mod, struct rfb_Window *v,
+	struct rfb_Pixmap *pm, TINT rect[4], TINT sx, TINT sy)
+{
+	struct TVPixBuf *dst = &v->rfbw_PixBuf;
+	TUINT fmt = dst->tpb_Format;
+	TINT bpp = TVPIXFMT_BYTES_PER_PIXEL(fmt);
+	struct Region R;
+
+	if (!rfb_getclipmask(mod, &R, v, rect))
+		return;
+	struct TNode *next, *node = R.rg_Rects.rl_List.tlh_Head.tln_Succ;
+
+	for (; (next = node->tln_Succ); node = next)
+	{
+		struct RectNode *r = (struct RectNode *) node;
+
+		rfb_markdirty(mod, v, r->rn_Rect);
+		TINT x0 = r->rn_Rect[0];
+		TINT y0 = r->rn_Rect[1];
+		TINT w = r->rn_Rect[2] - x0 + 1;
+		TINT y1 = r->rn_Rect[3];
+		TINT px = x0 - rect[0] + sx;
+		TINT py = y0 - rect[1] + sy;
+		TINT x, y;
+
+		for (y = y0; y <= y1; ++y, ++py)
+		{
+			TUINT8 *s = TVPB_GETADDRESS(&pm->pixbuf, px, py);
+			TUINT8 *d = TVPB_GETADDRESS(dst, x0, y);
+
+			if (!pm->alpha)
+				memcpy(d, s, w * bpp);
+			else if (bpp == 4)
+			{
+				TUINT *sp = (TUINT *) s;
+				TUINT *dp = (TUINT *) d;
+
+				for (x = 0; x < w; ++x)
+				{
+					TUINT p = sp[x];
+					TUINT a = p >> 24;
+
+					if (a == 255)
+						dp[x] = p & 0xffffff;
+					else if (a)
+					{
+						TUINT q = dp[x];
+						TUINT ia = 255 - a;
+
+						dp[x] = (p & 0xffffff) +
+							((((q & 0xff00ff) * ia) >> 8) & 0xff00ff) +
+							((((q & 0xff00) * ia) >> 8) & 0xff00);
+					}
+				}
+			}
+			else
+			{
+				TUINT *sp = (TUINT *) s;
+				TUINT16 *dp = (TUINT16 *) d;
+
+				for (x = 0; x < w; ++x)
+				{
+					TUINT p = sp[x];
+					TUINT a = p >> 24;
+
+					if (a == 255)
+						dp[x] = fbp_blendpixel16(fmt, p, 0);
+					else if (a)
+						dp[x] = fbp_blendpixel16(fmt, p, dp[x]);
+				}
+			}
+		}
+	}
+	region_free(&mod->rfb_RectPool, &R);
+}
+
+/*****************************************************************************/
+
 LOCAL void fbp_doexpose(struct rfb_Display *mod, struct rfb_Window *v,
 	struct Region *L, struct THook *exposehook)
 {
@@ -894,14 +1056,8 @@ LOCAL TBOOL fbp_copyarea_int(struct rfb_Display *mod, struct rfb_Window *v,
 
 	struct Region R;
 
-	if (!rfb_getlayermask(mod, &R, dr, v, 0, 0))
-		return TFALSE;
-
-	if (R.rg_Rects.rl_NumNodes == 0)
-	{
-		region_free(pool, &R);
+	if (!rfb_getvismask(mod, &R, v, dr))
 		return TFALSE;
-	}
 
 	TINT yinc = dy < 0 ? -1 : 1;
 	TINT y, i, h;
@@ -919,6 +1075,17 @@ LOCAL TBOOL fbp_copyarea_int(struct rfb_Display *mod, struct rfb_Window *v,
 	}
 
 	TINT bpp = TVPIXFMT_BYTES_PER_PIXEL(v->rfbw_PixBuf.tpb_Format);
+	TBOOL winbackbuffer = v->rfbw_Flags & RFBWFL_BACKBUFFER;
+
+#if defined(ENABLE_VNCSERVER) && defined(ENABLE_VNCSERVER_COPYRECT)
+	/* the buffer is shared with the VNC task; large copies in sync: */
+	TBOOL vnccopy = mod->rfb_VNCTask && !winbackbuffer;
+	TBOOL vncsync = vnccopy && rfb_vnc_begincopy(mod, &R);
+#endif
+
+	/* update device(s) by copying when the buffer is flushed: */
+	if (!winbackbuffer)
+		rfb_markcopy(mod, &R, dx, dy);
 
 	if (R.rg_Rects.rl_NumNodes == 1)
 	{
@@ -942,28 +1109,11 @@ LOCAL TBOOL fbp_copyarea_int(struct rfb_Display *mod, struct rfb_Window *v,
 			dy1 = t;
 		}
 
-#if defined(ENABLE_VNCSERVER)
-		if (mod->rfb_VNCTask && !(v->rfbw_Flags & RFBWFL_BACKBUFFER))
-			rfb_vnc_copyrect(mod, v, dx, dy, x0, y0, x1, y1, yinc);
-		else
-#endif
-		{
-			/* update own buffer */
-			for (i = 0, y = dy0; i < h; ++i, y -= yinc)
-				CopyLineOver(v, x0 - dx, y - dy, x0, y, (x1 - x0 + 1) * bpp);
-		}
-
-		/* update sub device */
-		TINT d[4];
-
-		d[0] = rn->rn_Rect[0];
-		d[1] = rn->rn_Rect[1];
-		d[2] = rn->rn_Rect[2];
-		d[3] = rn->rn_Rect[3];
-		if (v->rfbw_Flags & RFBWFL_BACKBUFFER)
-			rfb_markdirty(mod, v, d);
-		else
-			rfb_copyrect_sub(mod, d, dx, dy);
+		/* update own buffer */
+		for (i = 0, y = dy0; i < h; ++i, y -= yinc)
+			CopyLineOver(v, x0 - dx, y - dy, x0, y, (x1 - x0 + 1) * bpp);
+		if (winbackbuffer)
+			rfb_markdirty(mod, v, rn->rn_Rect);
 	}
 	else
 	{
@@ -1054,13 +1204,19 @@ LOCAL TBOOL fbp_copyarea_int(struct rfb_Display *mod, struct rfb_Window *v,
 		{
 			struct RectNode *rn = (struct RectNode *) n;
 
-			/* this would be incorrect, unfortunately: */
-			/* rfb_copyrect_sub(mod, rn->rn_Rect, dx, dy); */
-			rfb_markdirty(mod, v, rn->rn_Rect);
+			if (winbackbuffer)
+				rfb_markdirty(mod, v, rn->rn_Rect);
 			TAddTail(&R.rg_Rects.rl_List, n);
 		}
 	}
 
+#if defined(ENABLE_VNCSERVER) && defined(ENABLE_VNCSERVER_COPYRECT)
+	if (vncsync)
+		rfb_vnc_endcopy(mod, &R, dx, dy);
+	else if (vnccopy)
+		rfb_vnc_flush(mod, &R);
+#endif
+
 	region_free(pool, &R);
 
 	return TTRUE;	/* do expose */
@@ -718,6 +718,7 @@ LOCAL void rfb_hostclosefont(struct rfb_Display *mod, TAPTR font)
 ** INPUT:
 **  - a pointer to a font returned by rfb_hostopenfont()
 **  - the textstring to measure
+**  - the length of the textstring in bytes
 **
 ** RETURN:
 **  - the width of the textstring in pixel
@@ -737,11 +738,9 @@ LOCAL TINT rfb_hosttextsize(struct rfb_Display *mod, TAPTR font, TSTRPTR text,
 	imgtype.height = myface->pxsize;
 	imgtype.flags = FT_LOAD_DEFAULT | FT_LOAD_RENDER;
 
-	utf8initreader(&rd, (const unsigned char *) text, -1);
-
-	int i = 0;
+	utf8initreader(&rd, (const unsigned char *) text, len);
 
-	while (i++ < len && (c = utf8read(&rd)) > 0)
+	while ((c = utf8read(&rd)) > 0)
 	{
 		FTC_SBit sbit;
 		FT_UInt gindex =
@@ -783,7 +782,7 @@ LOCAL TVOID rfb_hostdrawtext(struct rfb_Display *mod, struct rfb_Window *v,
 
 	struct Region R;
 
-	if (!rfb_getlayermask(mod, &R, v->rfbw_ClipRect.r, v, 0, 0))
+	if (!rfb_getclipmask(mod, &R, v, TNULL))
 		return;
 
 	struct rfb_Pen *textpen = (struct rfb_Pen *) fgpen;
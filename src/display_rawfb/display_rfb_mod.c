@@ -227,6 +227,10 @@ static TINT rfb_cmdrectaffected(struct rfb_Display *mod, struct TVRequest *req,
 			v = req->tvr_Op.DrawBuffer.Window;
 			xywh = req->tvr_Op.DrawBuffer.RRect;
 			break;
+		case TVCMD_DRAWPIXMAP:
+			v = req->tvr_Op.DrawPixmap.Window;
+			xywh = req->tvr_Op.DrawPixmap.RRect;
+			break;
 		case TVCMD_COPYAREA:
 		{
 			v = req->tvr_Op.CopyArea.Window;
@@ -381,6 +385,7 @@ static void rfb_exittask(struct rfb_Display *mod)
 #endif
 
 	TFree(mod->rfb_PtrBackBuffer.data);
+	TFree(mod->rfb_RasterBuffer);
 	if (mod->rfb_Flags & RFBFL_PTR_ALLOCATED)
 		TFree(mod->rfb_PtrImage.tpb_Data);
 
@@ -393,6 +398,10 @@ static void rfb_exittask(struct rfb_Display *mod)
 	for (; (next = node->tln_Succ); node = next)
 		rfb_hostclosefont(mod, (TAPTR) node);
 
+	/* free pixmaps left over by clients: */
+	while ((node = TRemHead(&mod->rfb_PixmapList)))
+		TFree(node);
+
 	if (mod->rfb_Flags & RFBFL_BUFFER_OWNER)
 		TFree(mod->rfb_PixBuf.tpb_Data);
 
@@ -428,10 +437,14 @@ static TBOOL rfb_inittask(struct TTask *task)
 		/* list of all open visuals: */
 		TInitList(&mod->rfb_VisualList);
 
+		/* list of pixmaps: */
+		TInitList(&mod->rfb_PixmapList);
+
 		/* init fontmanager and default font */
 		TInitList(&mod->rfb_FontManager.openfonts);
 
 		region_init(&mod->rfb_RectPool, &mod->rfb_DirtyRegion, TNULL);
+		mod->rfb_NumCopies = 0;
 
 		mod->rfb_PixBuf.tpb_Format = TVPIXFMT_UNDEFINED;
 		mod->rfb_DevWidth = RFB_DEF_WIDTH;
@@ -488,9 +501,7 @@ static void rfb_runtask(struct TTask *task)
 	struct TVRequest *req;
 	TUINT sig = 0;
 
-	TTIME intt = { 20000 };
-	/* next absolute time to send interval message: */
-	TTIME nextt;
+	struct Interval interval;
 	TTIME waitt, nowt, *pwaitt;
 
 	TAPTR cmdport = TGetUserPort(task);
@@ -500,9 +511,7 @@ static void rfb_runtask(struct TTask *task)
 
 	TDBPRINTF(TDB_INFO, ("RawFB device context running\n"));
 
-	TGetSystemTime(&nowt);
-	nextt = nowt;
-	TAddTime(&nextt, &intt);
+	interval_init(&interval);
 
 	do
 	{
@@ -536,10 +545,11 @@ static void rfb_runtask(struct TTask *task)
 		/* check if time interval has expired: */
 		TGetSystemTime(&nowt);
 
-		/* do interval timers */
+		/* do interval timers, if requested by any window: */
+		pwaitt = TNULL;
 		if (mod->rfb_NumInterval > 0)
 		{
-			if (TCmpTime(&nowt, &nextt) >= 0)
+			if (interval_check(&interval, TTRUE, &nowt, &waitt))
 			{
 				/* expired; send intervals: */
 				TLock(mod->rfb_InstanceLock);
@@ -556,23 +566,11 @@ static void rfb_runtask(struct TTask *task)
 						TPutMsg(v->rfbw_IMsgPort, TNULL, imsg);
 				}
 				TUnlock(mod->rfb_InstanceLock);
-				TAddTime(&nextt, &intt);
-			}
-
-			/* calculate new wait time: */
-			waitt = nextt;
-			TSubTime(&waitt, &nowt);
-			if (waitt.tdt_Int64 <= 0 || waitt.tdt_Int64 > 20000)
-			{
-				nextt = nowt;
-				TAddTime(&nextt, &intt);
-				waitt = nextt;
-				TSubTime(&waitt, &nowt);
 			}
 			pwaitt = &waitt;
 		}
 		else
-			pwaitt = TNULL;
+			interval_check(&interval, TFALSE, &nowt, &waitt);
 
 #if defined(ENABLE_LINUXFB)
 		rfb_linux_wait(mod, pwaitt);
@@ -775,9 +773,11 @@ static void rfb_processevent(struct rfb_Display *mod)
 				{
 					region_free(&mod->rfb_RectPool, &mod->rfb_DirtyRegion);
 					mod->rfb_Flags &= ~RFBFL_DIRTY;
+					mod->rfb_NumCopies = 0;
 
 					TINT neww = mod->rfb_Width = msg->timsg_Width;
 					TINT newh = mod->rfb_Height = msg->timsg_Height;
+					mod->rfb_LayerSerial++;
 
 					TUINT pixfmt = mod->rfb_PixBuf.tpb_Format;
 					TUINT bpp = TVPIXFMT_BYTES_PER_PIXEL(pixfmt);
@@ -1092,29 +1092,144 @@ LOCAL TBOOL rfb_getlayers(struct rfb_Display *mod, struct Region *A,
 }
 
 /*****************************************************************************/
+/*
+**	Copy the rectangles of region M to the empty region A, optionally
+**	intersected with a rectangle. Returns TFALSE if out of memory, in which
+**	case A is left empty.
+*/
 
-LOCAL TBOOL rfb_getlayermask(struct rfb_Display *mod, struct Region *A,
-	TINT *crect, struct rfb_Window *v, TINT dx, TINT dy)
+static TBOOL rfb_copymask(struct RectPool *pool, struct Region *A,
+	struct Region *M, TINT *rect)
+{
+	struct TNode *next, *node = M->rg_Rects.rl_List.tlh_Head.tln_Succ;
+
+	region_init(pool, A, TNULL);
+	for (; (next = node->tln_Succ); node = next)
+	{
+		TINT *s = ((struct RectNode *) node)->rn_Rect;
+		TINT r[4];
+
+		r[0] = s[0];
+		r[1] = s[1];
+		r[2] = s[2];
+		r[3] = s[3];
+		if (rect && !region_intersect(r, rect))
+			continue;
+		if (!region_insertrect(pool, &A->rg_Rects, r[0], r[1], r[2], r[3]))
+		{
+			region_free(pool, A);
+			return TFALSE;
+		}
+	}
+	return TTRUE;
+}
+
+/*****************************************************************************/
+/*
+**	Get the window's visible region, i.e. its rectangle on the screen minus
+**	the windows above it. The region is cached until the layer serial
+**	changes, which happens when windows are opened, closed, moved, resized
+**	or restacked. Returns TNULL if out of memory.
+*/
+
+static struct Region *rfb_getvisregion(struct rfb_Display *mod,
+	struct rfb_Window *v)
 {
-	if (crect[0] < 0)
-		return TFALSE;
 	struct RectPool *pool = &mod->rfb_RectPool;
+	struct Region *V = &v->rfbw_VisRegion;
 
-	if (!region_init(pool, A, crect))
+	if (!(v->rfbw_Flags & RFBWFL_VISREGION) ||
+		v->rfbw_VisRegionSerial != mod->rfb_LayerSerial)
+	{
+		struct Rect s = v->rfbw_WinRect;
+		TBOOL success = TTRUE;
+
+		region_free(pool, V);
+		v->rfbw_Flags &= ~RFBWFL_VISREGION;
+		if (v->rfbw_Flags & RFBWFL_BACKBUFFER)
+			success = region_orrect(pool, V, s.r, TFALSE);
+		else
+		{
+			struct Rect scr;
+
+			REGION_RECT_SET(&scr, 0, 0, mod->rfb_Width - 1,
+				mod->rfb_Height - 1);
+			if (region_intersect(s.r, scr.r))
+			{
+				struct Region L;
+
+				success = region_orrect(pool, V, s.r, TFALSE) &&
+					rfb_getlayers(mod, &L, v, 0, 0);
+				if (success)
+				{
+					success = region_subregion(pool, V, &L);
+					region_free(pool, &L);
+				}
+			}
+		}
+		if (!success)
+		{
+			region_free(pool, V);
+			return TNULL;
+		}
+		v->rfbw_Flags |= RFBWFL_VISREGION;
+		v->rfbw_VisRegionSerial = mod->rfb_LayerSerial;
+	}
+	return V;
+}
+
+/*****************************************************************************/
+/*
+**	Get the window's visible region, intersected with a rectangle. Returns
+**	TFALSE if the result is empty.
+*/
+
+LOCAL TBOOL rfb_getvismask(struct rfb_Display *mod, struct Region *A,
+	struct rfb_Window *v, TINT *rect)
+{
+	struct Region *V = rfb_getvisregion(mod, v);
+
+	return V && rfb_copymask(&mod->rfb_RectPool, A, V, rect) &&
+		A->rg_Rects.rl_NumNodes > 0;
+}
+
+/*****************************************************************************/
+/*
+**	Get the window's drawable area, i.e. its visible region intersected with
+**	the clipping rectangle and, if present, the clipping region, and
+**	optionally with the rectangle of a drawing operation. The area before
+**	the last intersection is cached until the clipping or the layers have
+**	changed. Returns TFALSE if the result is empty.
+*/
+
+LOCAL TBOOL rfb_getclipmask(struct rfb_Display *mod, struct Region *A,
+	struct rfb_Window *v, TINT *rect)
+{
+	struct RectPool *pool = &mod->rfb_RectPool;
+	struct Region *M = &v->rfbw_ClipMask;
+
+	if (v->rfbw_ClipRect.r[0] < 0)
 		return TFALSE;
-	if (v->rfbw_Flags & RFBWFL_BACKBUFFER)
-		return TTRUE;
-	TBOOL success = TFALSE;
-	struct Region L;
 
-	if (rfb_getlayers(mod, &L, v, dx, dy))
+	if (!(v->rfbw_Flags & RFBWFL_CLIPMASK) ||
+		v->rfbw_ClipMaskSerial != mod->rfb_LayerSerial)
 	{
-		success = region_subregion(pool, A, &L);
-		region_free(pool, &L);
+		struct Region *V = rfb_getvisregion(mod, v);
+
+		region_free(pool, M);
+		v->rfbw_Flags &= ~RFBWFL_CLIPMASK;
+		if (V == TNULL || !rfb_copymask(pool, M, V, v->rfbw_ClipRect.r))
+			return TFALSE;
+		if ((v->rfbw_Flags & RFBWFL_CLIPREGION) &&
+			!region_andregion(pool, M, &v->rfbw_ClipRegion))
+		{
+			region_free(pool, M);
+			return TFALSE;
+		}
+		v->rfbw_Flags |= RFBWFL_CLIPMASK;
+		v->rfbw_ClipMaskSerial = mod->rfb_LayerSerial;
 	}
-	if (!success)
-		region_free(pool, A);
-	return success;
+	return rfb_copymask(pool, A, M, rect) && A->rg_Rects.rl_NumNodes > 0;
 }
 
 /*****************************************************************************/
@@ -1257,6 +1372,134 @@ LOCAL void rfb_markdirty(struct rfb_Display *mod, struct rfb_Window *v,
 	}
 }
 
+/*****************************************************************************/
+/*
+**	Record the copying of a region in the screen buffer for replay on the
+**	device(s) when the buffer is flushed; this must be done before the
+**	pixels are moved in the buffer. R contains the destination rectangles,
+**	dx/dy is the offset from the source. Dirty parts of the source are
+**	marked dirty also at the destination, as the device would move stale
+**	pixels there. Rectangles are queued in an order in which none of them
+**	overwrites the source of another; those for which no such order exists,
+**	or which do not fit in the queue, are marked dirty instead. Copies
+**	are not queued for VNC clients; they receive large copies as CopyRect
+**	updates and small ones as modified rectangles, see rfb_vnc_begincopy().
+*/
+
+LOCAL void rfb_markcopy(struct rfb_Display *mod, struct Region *R, TINT dx,
+	TINT dy)
+{
+	struct RectPool *pool = &mod->rfb_RectPool;
+	struct Region *D = &mod->rfb_DirtyRegion;
+	TBOOL replay = (mod->rfb_Flags & RFBFL_BUFFER_DEVICE) ||
+		mod->rfb_RndDevice;
+	TBOOL device = replay;
+	TINT i, j, k, n0 = mod->rfb_NumCopies, n = n0;
+
+#if defined(ENABLE_VNCSERVER) && !defined(ENABLE_VNCSERVER_COPYRECT)
+	if (mod->rfb_VNCTask)
+	{
+		device = TTRUE;
+		replay = TFALSE;
+	}
+#endif
+	if (!device)
+	{
+		/* the buffer is the device */
+		return;
+	}
+
+	struct TNode *next, *node = R->rg_Rects.rl_List.tlh_Head.tln_Succ;
+
+	if (replay && R->rg_Rects.rl_NumNodes <= RFB_MAXCOPIES - n0)
+	{
+		struct rfb_CopyRect *c = mod->rfb_Copies;
+
+		for (; (next = node->tln_Succ); node = next, ++n)
+		{
+			TINT *r = ((struct RectNode *) node)->rn_Rect;
+
+			c[n].rect[0] = r[0];
+			c[n].rect[1] = r[1];
+			c[n].rect[2] = r[2];
+			c[n].rect[3] = r[3];
+			c[n].dx = dx;
+			c[n].dy = dy;
+		}
+		/* order, so that sources are read before they are overwritten: */
+		for (i = n0; i < n; ++i)
+		{
+			for (j = i; j < n; ++j)
+			{
+				TINT *d = c[j].rect;
+
+				for (k = i; k < n; ++k)
+				{
+					TINT *s = c[k].rect;
+
+					if (k != j && REGION_OVERLAP(d[0], d[1], d[2], d[3],
+						s[0] - dx, s[1] - dy, s[2] - dx, s[3] - dy))
+						break;
+				}
+				if (k == n)
+					break;
+			}
+			if (j == n)
+			{
+				/* cyclic; mark the remainder dirty */
+				for (k = i; k < n; ++k)
+					region_orrect(pool, D, c[k].rect, TTRUE);
+				n = i;
+				break;
+			}
+			if (j != i)
+			{
+				struct rfb_CopyRect t = c[i];
+
+				c[i] = c[j];
+				c[j] = t;
+			}
+		}
+		/* move dirty parts of the sources along: */
+		struct Region T;
+
+		region_init(pool, &T, TNULL);
+		for (i = n0; i < n; ++i)
+		{
+			node = D->rg_Rects.rl_List.tlh_Head.tln_Succ;
+			for (; (next = node->tln_Succ); node = next)
+			{
+				TINT *r = ((struct RectNode *) node)->rn_Rect;
+				TINT s[4];
+
+				s[0] = c[i].rect[0] - dx;
+				s[1] = c[i].rect[1] - dy;
+				s[2] = c[i].rect[2] - dx;
+				s[3] = c[i].rect[3] - dy;
+				if (region_intersect(s, r))
+				{
+					s[0] += dx;
+					s[1] += dy;
+					s[2] += dx;
+					s[3] += dy;
+					region_orrect(pool, &T, s, TTRUE);
+				}
+			}
+		}
+		node = T.rg_Rects.rl_List.tlh_Head.tln_Succ;
+		for (; (next = node->tln_Succ); node = next)
+			region_orrect(pool, D, ((struct RectNode *) node)->rn_Rect, TTRUE);
+		region_free(pool, &T);
+		mod->rfb_NumCopies = n;
+	}
+	else
+	{
+		for (; (next = node->tln_Succ); node = next)
+			region_orrect(pool, D, ((struct RectNode *) node)->rn_Rect, TTRUE);
+	}
+	mod->rfb_Flags |= RFBFL_DIRTY;
+}
+
 /*****************************************************************************/
 
 LOCAL void rfb_setwinrect(struct rfb_Display *mod, struct rfb_Window *v)
@@ -1271,12 +1514,14 @@ LOCAL void rfb_setwinrect(struct rfb_Display *mod, struct rfb_Window *v)
 		y = v->rfbw_ScreenRect.r[1];
 	}
 	REGION_RECT_SET(&v->rfbw_WinRect, x, y, x + w - 1, y + h - 1);
+	mod->rfb_LayerSerial++;
 }
 
 /*****************************************************************************/
 
 LOCAL void rfb_setrealcliprect(struct rfb_Display *mod, struct rfb_Window *v)
 {
+	v->rfbw_Flags &= ~RFBWFL_CLIPMASK;
 	v->rfbw_ClipRect = v->rfbw_UserClipRect;
 	TBOOL res = region_intersect(v->rfbw_ClipRect.r, v->rfbw_WinRect.r);
 
@@ -1325,6 +1570,36 @@ LOCAL void rfb_focuswindow(struct rfb_Display *mod, struct rfb_Window *v)
 
 /*****************************************************************************/
 
+/*
+**	Replay a copy in a device buffer
+*/
+
+static void rfb_copypixbuf(struct TVPixBuf *buf, struct rfb_CopyRect *c)
+{
+	TINT x0 = c->rect[0];
+	TINT y0 = c->rect[1];
+	TINT y1 = c->rect[3];
+	TINT bpl = buf->tpb_BytesPerLine;
+	TINT numb = (c->rect[2] - x0 + 1) *
+		TVPIXFMT_BYTES_PER_PIXEL(buf->tpb_Format);
+	TUINT8 *dst, *src;
+
+	if (c->dy > 0)
+	{
+		/* bottom-up: */
+		dst = TVPB_GETADDRESS(buf, x0, y1);
+		bpl = -bpl;
+	}
+	else
+		dst = TVPB_GETADDRESS(buf, x0, y0);
+	src = dst - c->dy * buf->tpb_BytesPerLine -
+		c->dx * TVPIXFMT_BYTES_PER_PIXEL(buf->tpb_Format);
+	for (; y0 <= y1; ++y0, dst += bpl, src += bpl)
+		memmove(dst, src, numb);
+}
+
+/*****************************************************************************/
+
 LOCAL void rfb_flush_clients(struct rfb_Display *mod, TBOOL also_external)
 {
 	TAPTR TExecBase = mod->rfb_ExecBase;
@@ -1386,6 +1661,7 @@ LOCAL void rfb_flush_clients(struct rfb_Display *mod, TBOOL also_external)
 	{
 		struct Region *D = &mod->rfb_DirtyRegion;
 		struct TNode *next, *node;
+		TINT i;
 
 #if defined(ENABLE_VNCSERVER)
 		if (also_external && mod->rfb_VNCTask)
@@ -1394,6 +1670,13 @@ LOCAL void rfb_flush_clients(struct rfb_Display *mod, TBOOL also_external)
 		/* flush to sub pixbuf: */
 		if (mod->rfb_Flags & RFBFL_BUFFER_DEVICE)
 		{
+			if (mod->rfb_NumCopies > 0)
+			{
+				/* the pointer would be moved along: */
+				rfb_restoreptrbg(mod);
+				for (i = 0; i < mod->rfb_NumCopies; ++i)
+					rfb_copypixbuf(&mod->rfb_DevBuf, &mod->rfb_Copies[i]);
+			}
 			node = D->rg_Rects.rl_List.tlh_Head.tln_Succ;
 			for (; (next = node->tln_Succ); node = next)
 			{
@@ -1421,6 +1704,23 @@ LOCAL void rfb_flush_clients(struct rfb_Display *mod, TBOOL also_external)
 
 			struct TVRequest *req = mod->rfb_RndRequest;
 
+			for (i = 0; i < mod->rfb_NumCopies; ++i)
+			{
+				struct rfb_CopyRect *c = &mod->rfb_Copies[i];
+				TINT *r = c->rect;
+
+				req->tvr_Req.io_Command = TVCMD_COPYAREA;
+				req->tvr_Op.CopyArea.Window = mod->rfb_RndInstance;
+				req->tvr_Op.CopyArea.Rect[0] = r[0] - c->dx;
+				req->tvr_Op.CopyArea.Rect[1] = r[1] - c->dy;
+				req->tvr_Op.CopyArea.Rect[2] = r[2] - r[0] + 1;
+				req->tvr_Op.CopyArea.Rect[3] = r[3] - r[1] + 1;
+				req->tvr_Op.CopyArea.DestX = r[0];
+				req->tvr_Op.CopyArea.DestY = r[1];
+				req->tvr_Op.CopyArea.Tags = TNULL;
+				TDoIO(&req->tvr_Req);
+			}
+
 			req->tvr_Req.io_Command = TVCMD_DRAWBUFFER;
 			req->tvr_Op.DrawBuffer.Window = mod->rfb_RndInstance;
 			req->tvr_Op.DrawBuffer.Tags = tags;
@@ -1455,6 +1755,7 @@ LOCAL void rfb_flush_clients(struct rfb_Display *mod, TBOOL also_external)
 
 		region_free(&mod->rfb_RectPool, D);
 		mod->rfb_Flags &= ~RFBFL_DIRTY;
+		mod->rfb_NumCopies = 0;
 	}
 }
 
@@ -1482,43 +1783,3 @@ LOCAL TBOOL rfb_resizewinbuffer(struct rfb_Display *mod, struct rfb_Window *v,
 	v->rfbw_PixBuf = newbuf;
 	return TTRUE;
 }
-
-/*****************************************************************************/
-
-LOCAL void rfb_copyrect_sub(struct rfb_Display *mod, TINT *rect, TINT dx,
-	TINT dy)
-{
-	if (mod->rfb_Flags & RFBFL_BUFFER_DEVICE)
-	{
-		/* NOTE: this is just a flush, not a copyrect */
-		TINT x0 = rect[0];
-		TINT y0 = rect[1];
-		TINT x1 = rect[2];
-		TINT y1 = rect[3];
-
-		pixconv_convert(&mod->rfb_PixBuf, &mod->rfb_DevBuf,
-			x0, y0, x1, y1, x0, y0, TFALSE, TFALSE);
-	}
-
-	if (mod->rfb_RndDevice)
-	{
-		TAPTR TExecBase = mod->rfb_ExecBase;
-		struct TVRequest *req = mod->rfb_RndRequest;
-
-		req->tvr_Req.io_Command = TVCMD_COPYAREA;
-		TINT x0 = rect[0] - dx;
-		TINT y0 = rect[1] - dy;
-		TINT x1 = rect[2] - dx;
-		TINT y1 = rect[3] - dy;
-
-		req->tvr_Op.CopyArea.Window = mod->rfb_RndInstance;
-		req->tvr_Op.CopyArea.Rect[0] = x0;
-		req->tvr_Op.CopyArea.Rect[1] = y0;
-		req->tvr_Op.CopyArea.Rect[2] = x1 - x0 + 1;
-		req->tvr_Op.CopyArea.Rect[3] = y1 - y0 + 1;
-		req->tvr_Op.CopyArea.DestX = x0 + dx;
-		req->tvr_Op.CopyArea.DestY = y0 + dy;
-		req->tvr_Op.CopyArea.Tags = TNULL;
-		TDoIO(&req->tvr_Req);
-	}
-}
@@ -15,6 +15,7 @@
 #include <tek/lib/region.h>
 #include <tek/lib/utf8.h>
 #include <tek/lib/pixconv.h>
+#include <tek/lib/interval.h>
 
 #include <ft2build.h>
 #include FT_FREETYPE_H
@@ -29,7 +30,7 @@
 /*****************************************************************************/
 
 #define RFB_DISPLAY_VERSION     2
-#define RFB_DISPLAY_REVISION    0
+#define RFB_DISPLAY_REVISION    6
 #define RFB_DISPLAY_NUMVECTORS  10
 
 #ifndef LOCAL
@@ -63,6 +64,13 @@
 #define RFBWFL_USERCLIP         0x0020
 #define RFBWFL_BACKBUFFER       0x0400
 #define RFBWFL_DIRTY            0x0800
+#define RFBWFL_CLIPREGION       0x1000
+#define RFBWFL_CLIPMASK         0x2000
+#define RFBWFL_VISREGION        0x4000
+
+/* polygon flags */
+#define FBP_POLY_FAN            0x0001
+#define FBP_POLY_ANTIALIAS      0x0002
 
 #ifndef RFB_DEF_WIDTH
 #define RFB_DEF_WIDTH           640
@@ -75,6 +83,9 @@
 
 #define RFB_DIRTY_ALIGN         7
 
+/* Maximum number of copies pending on the device(s): */
+#define RFB_MAXCOPIES           32
+
 /*****************************************************************************/
 
 #if defined(ENABLE_LINUXFB)
@@ -103,6 +114,31 @@ struct rfb_BackBuffer
 	TINT rect[4];
 };
 
+struct rfb_CopyRect
+{
+	/* Destination rectangle on screen: */
+	TINT rect[4];
+	/* Offset from the source: */
+	TINT dx, dy;
+};
+
+/*
+**	Pixmaps are kept in the format of the pixel buffer. Those with an
+**	alpha channel are stored as 32 bit pixels with premultiplied alpha,
+**	in the color order of the pixel buffer, or in ARGB order if the pixel
+**	buffer has fewer than 32 bits per pixel.
+*/
+
+struct rfb_Pixmap
+{
+	struct TNode node;
+	struct TVPixBuf pixbuf;
+	TINT width, height;
+	/* Format of the pixel buffer the pixmap was converted for: */
+	TUINT dstfmt;
+	TBOOL alpha;
+};
+
 /*****************************************************************************/
 
 /*
@@ -207,6 +243,8 @@ struct rfb_Display
 	struct TList rfb_VisualList;
 
 	struct RectPool rfb_RectPool;
+	/* Incremented when windows are opened, closed, moved or restacked: */
+	TUINT rfb_LayerSerial;
 
 	/* pixel buffer exposed to drawing functions: */
 	struct TVPixBuf rfb_PixBuf;
@@ -235,7 +273,16 @@ struct rfb_Display
 
 	TUINT32 rfb_unicodebuffer[RFB_UTF8_BUFSIZE];
 
+	/* Scratch memory of the polygon rasterizer: */
+	TAPTR rfb_RasterBuffer;
+
+	/* list of pixmaps: */
+	struct TList rfb_PixmapList;
+
 	struct Region rfb_DirtyRegion;
+	/* Copies carried out in the buffer, to be replayed on the device(s): */
+	struct rfb_CopyRect rfb_Copies[RFB_MAXCOPIES];
+	TINT rfb_NumCopies;
 
 	struct rfb_Window *rfb_FocusWindow;
 
@@ -315,6 +362,19 @@ struct rfb_Window
 	TINT rfbw_MaxHeight;
 
 	struct Region rfbw_DirtyRegion;
+
+	/* Clipping region (user), valid with RFBWFL_CLIPREGION: */
+	struct Region rfbw_ClipRegion;
+	/* Clipping rectangle and region minus layers, valid with
+	** RFBWFL_CLIPMASK: */
+	struct Region rfbw_ClipMask;
+	/* Layer serial at the time the clip mask was determined: */
+	TUINT rfbw_ClipMaskSerial;
+	/* Window rectangle on screen minus layers, valid with
+	** RFBWFL_VISREGION: */
+	struct Region rfbw_VisRegion;
+	/* Layer serial at the time the visible region was determined: */
+	TUINT rfbw_VisRegionSerial;
 };
 
 struct rfb_Pen
@@ -341,10 +401,13 @@ LOCAL void fbp_drawrect(struct rfb_Display *mod, struct rfb_Window *v,
 	TINT rect[4], struct rfb_Pen *pen);
 LOCAL void fbp_drawline(struct rfb_Display *mod, struct rfb_Window *v,
 	TINT rect[4], struct rfb_Pen *pen);
-LOCAL void fbp_drawtriangle(struct rfb_Display *mod, struct rfb_Window *v,
-	TINT x0, TINT y0, TINT x1, TINT y1, TINT x2, TINT y2, struct rfb_Pen *pen);
+LOCAL void fbp_drawpolygon(struct rfb_Display *mod, struct rfb_Window *v,
+	TINT *array, TINT num, TUINT flags, struct rfb_Pen *pen,
+	TVPEN *penarray);
 LOCAL void fbp_drawbuffer(struct rfb_Display *mod, struct rfb_Window *v,
 	struct TVPixBuf *src, TINT rect[4], TBOOL alpha);
+LOCAL void fbp_drawpixmap(struct rfb_Display *mod, struct rfb_Window *v,
+	struct rfb_Pixmap *pm, TINT rect[4], TINT sx, TINT sy);
 LOCAL void fbp_doexpose(struct rfb_Display *mod, struct rfb_Window *v,
 	struct Region *L, struct THook *exposehook);
 LOCAL TBOOL fbp_copyarea_int(struct rfb_Display *mod, struct rfb_Window *v,
@@ -365,8 +428,10 @@ LOCAL TINT rfb_sendevent(struct rfb_Display *mod, TUINT type, TUINT code,
 	TINT x, TINT y);
 LOCAL TBOOL rfb_getlayers(struct rfb_Display *mod, struct Region *A,
 	struct rfb_Window *v, TINT dx, TINT dy);
-LOCAL TBOOL rfb_getlayermask(struct rfb_Display *mod, struct Region *A,
-	TINT *crect, struct rfb_Window *v, TINT dx, TINT dy);
+LOCAL TBOOL rfb_getclipmask(struct rfb_Display *mod, struct Region *A,
+	struct rfb_Window *v, TINT *rect);
+LOCAL TBOOL rfb_getvismask(struct rfb_Display *mod, struct Region *A,
+	struct rfb_Window *v, TINT *rect);
 LOCAL TBOOL rfb_damage(struct rfb_Display *mod, TINT drect[],
 	struct rfb_Window *v);
 LOCAL void rfb_markdirty(struct rfb_Display *mod, struct rfb_Window *v,
@@ -377,7 +442,7 @@ LOCAL void rfb_focuswindow(struct rfb_Display *mod, struct rfb_Window *v);
 LOCAL void rfb_flush_clients(struct rfb_Display *mod, TBOOL also_external);
 LOCAL TBOOL rfb_resizewinbuffer(struct rfb_Display *mod, struct rfb_Window *v,
 	TINT oldw, TINT oldh, TINT w, TINT h);
-LOCAL void rfb_copyrect_sub(struct rfb_Display *mod, TINT *rect, TINT dx,
+LOCAL void rfb_markcopy(struct rfb_Display *mod, struct Region *R, TINT dx,
 	TINT dy);
 
 LOCAL FT_Error rfb_fontrequester(FTC_FaceID faceID, FT_Library lib,
@@ -401,8 +466,9 @@ LOCAL void rfb_docmd(struct rfb_Display *mod, struct TVRequest *req);
 int rfb_vnc_init(struct rfb_Display *mod, int port);
 void rfb_vnc_exit(struct rfb_Display *mod);
 void rfb_vnc_flush(struct rfb_Display *mod, struct Region *D);
-void rfb_vnc_copyrect(struct rfb_Display *mod, struct rfb_Window *v, int dx,
-	int dy, int x0, int y0, int x1, int y1, int yinc);
+TBOOL rfb_vnc_begincopy(struct rfb_Display *mod, struct Region *R);
+void rfb_vnc_endcopy(struct rfb_Display *mod, struct Region *R, int dx,
+	int dy);
 #endif
 
 #if defined(ENABLE_LINUXFB)
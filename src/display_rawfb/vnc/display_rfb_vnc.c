@@ -443,51 +443,66 @@ void rfb_vnc_flush(struct rfb_Display *mod, struct Region *D)
 	sraRgnDestroy(region);
 }
 
-void rfb_vnc_copyrect(struct rfb_Display *mod, struct rfb_Window *v, int dx,
-	int dy, int x0, int y0, int x1, int y1, int yinc)
+/*
+**	The screen buffer is shared with the VNC task, so a copy in the buffer
+**	must not interleave with updates sent from it: pending updates are
+**	flushed, and we wait until event processing is interrupted, before the
+**	pixels are moved. Afterwards, the copy is scheduled as a CopyRect
+**	update, before any further modification can be sent. This is worth
+**	the roundtrip only for copies of more than VNCSERVER_COPYRECT_MINPIXELS
+**	pixels in R; returns TFALSE for smaller copies, which the caller marks
+**	as modified using rfb_vnc_flush() after moving the pixels.
+*/
+
+TBOOL rfb_vnc_begincopy(struct rfb_Display *mod, struct Region *R)
 {
-	int i, y;
-	int w = x1 - x0 + 1;
-	int h = y1 - y0 + 1;
-	int dy0 = y0;
-	int dy1 = y1;
+#if defined(ENABLE_VNCSERVER_COPYRECT)
+	struct TNode *next, *node;
+	TINT npixels = 0;
+	char wrbuf = 0;
 
-	if (yinc > 0)
+	node = R->rg_Rects.rl_List.tlh_Head.tln_Succ;
+	for (; (next = node->tln_Succ); node = next)
 	{
-		int t = dy0;
+		TINT *r = ((struct RectNode *) node)->rn_Rect;
 
-		dy0 = dy1;
-		dy1 = t;
+		npixels += (r[2] - r[0] + 1) * (r[3] - r[1] + 1);
 	}
+	if (npixels <= VNCSERVER_COPYRECT_MINPIXELS)
+		return TFALSE;
+
+	/* flush dirty rects */
+	rfb_flush_clients(mod, TTRUE);
+	/* break rfbProcessEvents */
+	if (write(mod->rfb_RFBPipeFD[1], &wrbuf, 1) != 1)
+		TDBPRINTF(TDB_ERROR, ("error writing to signalfd\n"));
+	/* wait for completion of rfbProcessEvents */
+	TExecWait(mod->rfb_ExecBase, mod->rfb_RFBReadySignal);
+	return TTRUE;
+#else
+	return TFALSE;
+#endif
+}
 
-	TUINT bpl = w * TVPIXFMT_BYTES_PER_PIXEL(mod->rfb_PixBuf.tpb_Format);
-
+void rfb_vnc_endcopy(struct rfb_Display *mod, struct Region *R, int dx,
+	int dy)
+{
 #if defined(ENABLE_VNCSERVER_COPYRECT)
-	if (w * h > VNCSERVER_COPYRECT_MINPIXELS)
+	struct TNode *next, *node;
+	sraRegionPtr region = sraRgnCreate();
+
+	node = R->rg_Rects.rl_List.tlh_Head.tln_Succ;
+	for (; (next = node->tln_Succ); node = next)
 	{
-		char wrbuf = 0;
-
-		/* flush dirty rects */
-		rfb_flush_clients(mod, TTRUE);
-		/* break rfbProcessEvents */
-		if (write(mod->rfb_RFBPipeFD[1], &wrbuf, 1) != 1)
-			TDBPRINTF(TDB_ERROR, ("error writing to signalfd\n"));
-		/* wait for completion of rfbProcessEvents */
-		TExecWait(mod->rfb_ExecBase, mod->rfb_RFBReadySignal);
-		/* update own buffer */
-		for (i = 0, y = dy0; i < h; ++i, y -= yinc)
-			CopyLineOver(v, x0 - dx, y - dy, x0, y, bpl);
-		/* schedule copyrect */
-		rfbScheduleCopyRect(mod->rfb_RFBScreen, x0, y0, x1 + 1, y1 + 1,
-			dx, dy);
+		struct RectNode *rn = (struct RectNode *) node;
+		sraRegionPtr rect = sraRgnCreateRect(rn->rn_Rect[0], rn->rn_Rect[1],
+			rn->rn_Rect[2] + 1, rn->rn_Rect[3] + 1);
+
+		sraRgnOr(region, rect);
+		sraRgnDestroy(rect);
 	}
-	else
+	/* schedule copyrect */
+	rfbScheduleCopyRegion(mod->rfb_RFBScreen, region, dx, dy);
+	sraRgnDestroy(region);
 #endif
-	{
-		/* update own buffer */
-		for (i = 0, y = dy0; i < h; ++i, y -= yinc)
-			CopyLineOver(v, x0 - dx, y - dy, x0, y, bpl);
-		/* mark dirty */
-		rfbMarkRectAsModified(mod->rfb_RFBScreen, x0, y0, x1 + 1, y1 + 1);
-	}
 }
@@ -516,6 +516,31 @@ fb_setcliprect(WINDISPLAY *mod, struct TVRequest *req)
 
 /*****************************************************************************/
 
+LOCAL void
+fb_setclipregion(WINDISPLAY *mod, struct TVRequest *req)
+{
+	WINWINDOW *win = req->tvr_Op.ClipRegion.Window;
+	RECT *cr = &win->fbv_ClipRect;
+	TINT *r = req->tvr_Op.ClipRegion.Rects;
+	TINT i, num = req->tvr_Op.ClipRegion.NumRects;
+	HRGN rgn = CreateRectRgn(0, 0, 0, 0);
+	SetRectEmpty(cr);
+	for (i = 0; i < num; ++i, r += 4)
+	{
+		RECT rect;
+		HRGN rrgn;
+		SetRect(&rect, r[0], r[1], r[2] + 1, r[3] + 1);
+		rrgn = CreateRectRgnIndirect(&rect);
+		CombineRgn(rgn, rgn, rrgn, RGN_OR);
+		DeleteObject(rrgn);
+		UnionRect(cr, cr, &rect);
+	}
+	SelectClipRgn(win->fbv_HDC, rgn);
+	DeleteObject(rgn);
+}
+
+/*****************************************************************************/
+
 LOCAL void
 fb_unsetcliprect(WINDISPLAY *mod, struct TVRequest *req)
 {
@@ -976,6 +1001,19 @@ fb_textsize(WINDISPLAY *mod, struct TVRequest *req)
 
 /*****************************************************************************/
 
+LOCAL void
+fb_textsizes(WINDISPLAY *mod, struct TVRequest *req)
+{
+	TINT *runs = req->tvr_Op.TextSizes.Runs;
+	TINT *widths = req->tvr_Op.TextSizes.Widths;
+	TINT i;
+	for (i = 0; i < req->tvr_Op.TextSizes.NumRuns; ++i, runs += 2)
+		widths[i] = fb_hosttextsize(mod, req->tvr_Op.TextSizes.Font,
+			req->tvr_Op.TextSizes.Text + runs[0], runs[1]);
+}
+
+/*****************************************************************************/
+
 LOCAL void fb_getfontattrs(WINDISPLAY *mod, struct TVRequest *req)
 {
 	struct attrdata data;
@@ -388,13 +388,9 @@ static void fb_runinstance(TAPTR task)
 
 	TDBPRINTF(TDB_INFO,("Device instance running\n"));
 
-	/* interval time: 1/50s: */
-	TTIME intt = { 20000 };
-	/* next absolute time to send interval message: */
-	TTIME nextt;
+	struct Interval interval;
 	TTIME waitt, nowt;
-	TGetSystemTime(&nextt);
-	TAddTime(&nextt, &intt);
+	interval_init(&interval);
 
 	do
 	{
@@ -418,28 +414,16 @@ static void fb_runinstance(TAPTR task)
 
 		/* check if time interval has expired: */
 		TGetSystemTime(&nowt);
-		if (TCmpTime(&nowt, &nextt) > 0)
+		if (interval_check(&interval, mod->fbd_NumInterval > 0, &nowt,
+			&waitt))
 		{
-			/* expired; schedule next interval message: */
-			TAddTime(&nextt, &intt);
-			if (TCmpTime(&nowt, &nextt) >= 0)
-			{
-				/* nexttime expired already; create new time from now: */
-				nextt = nowt;
-				TAddTime(&nextt, &intt);
-			}
 			/* send interval messages to subscribers: */
-			if (mod->fbd_NumInterval > 0)
-				fb_sendinterval(mod);
+			fb_sendinterval(mod);
 		}
 
 		/* calculate timeout when subscribers for interval messages: */
 		if (mod->fbd_NumInterval > 0)
-		{
-			waitt = nextt;
-			TSubTime(&waitt, &nowt);
 			timeout = &waitt;
-		}
 
 		/* wake up input thread (to process invalidation?): */
 		if (reqServiced)
@@ -545,6 +529,9 @@ static void fb_docmd(WINDISPLAY *mod, struct TVRequest *req)
 		case TVCMD_TEXTSIZE:
 			fb_textsize(mod, req);
 			break;
+		case TVCMD_TEXTSIZES:
+			fb_textsizes(mod, req);
+			break;
 		case TVCMD_QUERYFONTS:
 			fb_queryfonts(mod, req);
 			break;
@@ -599,9 +586,17 @@ static void fb_docmd(WINDISPLAY *mod, struct TVRequest *req)
 		case TVCMD_UNSETCLIPRECT:
 			fb_unsetcliprect(mod, req);
 			break;
+		case TVCMD_SETCLIPREGION:
+			fb_setclipregion(mod, req);
+			break;
 		case TVCMD_DRAWBUFFER:
 			fb_drawbuffer(mod, req);
 			break;
+		case TVCMD_CREATEPIXMAP:
+		case TVCMD_FREEPIXMAP:
+		case TVCMD_DRAWPIXMAP:
+			/* no native pixmaps on Windows, clients use drawbuffer */
+			break;
 		case TVCMD_FLUSH:
 			GdiFlush();
 			break;
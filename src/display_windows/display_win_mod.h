@@ -16,6 +16,7 @@
 #include <tek/inline/exec.h>
 #include <tek/mod/visual.h>
 #include <tek/lib/utf8.h>
+#include <tek/lib/interval.h>
 
 #include <windows.h>
 
@@ -25,7 +26,7 @@
 #define FB_DISPLAY_CLASSNAME_POPUP "tek_display_windows_popup_class"
 
 #define FB_DISPLAY_VERSION		1
-#define FB_DISPLAY_REVISION		0
+#define FB_DISPLAY_REVISION		1
 #define FB_DISPLAY_NUMVECTORS	10
 
 #define FB_DEF_WIDTH			600
@@ -260,6 +261,7 @@ LOCAL void fb_drawtext(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_openfont(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_getfontattrs(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_textsize(WINDISPLAY *mod, struct TVRequest *req);
+LOCAL void fb_textsizes(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_setfont(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_closefont(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_queryfonts(WINDISPLAY *mod, struct TVRequest *req);
@@ -269,6 +271,7 @@ LOCAL void fb_drawfan(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_copyarea(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_setcliprect(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_unsetcliprect(WINDISPLAY *mod, struct TVRequest *req);
+LOCAL void fb_setclipregion(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_drawbuffer(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_getselection(WINDISPLAY *mod, struct TVRequest *req);
 LOCAL void fb_setselection(WINDISPLAY *mod, struct TVRequest *req);
@@ -123,6 +123,7 @@ static void x11_closevisual(struct X11Display *mod, struct TVRequest *req)
 
 	x11_freeimage(mod, v);
 	TFree(v->tempbuf);
+	TFree(v->cliprects);
 #if defined(ENABLE_XSHM)
 	x11_releasesharedmemory(mod, v);
 #endif
@@ -832,25 +833,58 @@ static void x11_copyarea(struct X11Display *mod, struct TVRequest *req)
 
 /*****************************************************************************/
 
-static void x11_setcliprect(struct X11Display *mod, struct TVRequest *req)
+/*
+**	Check if the clipping, given as num rectangles x0, y0, x1, y1, or
+**	num = -1 for none, is already in effect in the window, and remember
+**	it otherwise. This saves the server round trips for setting the same
+**	clipping again, which is frequent when elements are drawn in a row.
+*/
+
+static TBOOL x11_sameclip(struct X11Display *mod, struct X11Window *v,
+	TINT *rects, TINT num)
+{
+	TAPTR TExecBase = TGetExecBase(mod);
+	TSIZE size = sizeof(TINT) * 4 * TMAX(num, 0);
+
+	if ((v->flags & X11WFL_CLIPCACHED) && v->numcliprects == num &&
+		(size == 0 || memcmp(v->cliprects, rects, size) == 0))
+		return TTRUE;
+	v->flags &= ~X11WFL_CLIPCACHED;
+	if (size > 0 && (v->cliprects == TNULL || TGetSize(v->cliprects) < size))
+	{
+		TFree(v->cliprects);
+		v->cliprects = TAlloc(TNULL, size);
+		if (v->cliprects == TNULL)
+			return TFALSE;
+	}
+	if (size > 0)
+		memcpy(v->cliprects, rects, size);
+	v->numcliprects = num;
+	v->flags |= X11WFL_CLIPCACHED;
+	return TFALSE;
+}
+
+static void x11_setclip(struct X11Display *mod, struct X11Window *v,
+	TINT *rects, TINT num)
 {
-	struct X11Window *v = req->tvr_Op.ClipRect.Window;
-	TINT x = req->tvr_Op.ClipRect.Rect[0];
-	TINT y = req->tvr_Op.ClipRect.Rect[1];
-	TINT w = req->tvr_Op.ClipRect.Rect[2];
-	TINT h = req->tvr_Op.ClipRect.Rect[3];
 	Region region;
 	XRectangle rectangle;
+	TINT i;
 
-	region = XCreateRegion();
+	if (x11_sameclip(mod, v, rects, num))
+		return;
 
-	rectangle.x = (short) x;
-	rectangle.y = (short) y;
-	rectangle.width = (unsigned short) w;
-	rectangle.height = (unsigned short) h;
+	region = XCreateRegion();
 
-	/* union rect into region */
-	XUnionRectWithRegion(&rectangle, region, region);
+	for (i = 0; i < num; ++i, rects += 4)
+	{
+		rectangle.x = (short) rects[0];
+		rectangle.y = (short) rects[1];
+		rectangle.width = (unsigned short) (rects[2] - rects[0] + 1);
+		rectangle.height = (unsigned short) (rects[3] - rects[1] + 1);
+		/* union rect into region */
+		XUnionRectWithRegion(&rectangle, region, region);
+	}
 	/* set clip region */
 	XSetRegion(mod->x11_Display, v->gc, region);
 
@@ -862,12 +896,35 @@ static void x11_setcliprect(struct X11Display *mod, struct TVRequest *req)
 	XDestroyRegion(region);
 }
 
+static void x11_setcliprect(struct X11Display *mod, struct TVRequest *req)
+{
+	struct X11Window *v = req->tvr_Op.ClipRect.Window;
+	TINT r[4];
+
+	r[0] = req->tvr_Op.ClipRect.Rect[0];
+	r[1] = req->tvr_Op.ClipRect.Rect[1];
+	r[2] = r[0] + req->tvr_Op.ClipRect.Rect[2] - 1;
+	r[3] = r[1] + req->tvr_Op.ClipRect.Rect[3] - 1;
+	x11_setclip(mod, v, r, 1);
+}
+
+/*****************************************************************************/
+
+static void x11_setclipregion(struct X11Display *mod, struct TVRequest *req)
+{
+	x11_setclip(mod, req->tvr_Op.ClipRegion.Window,
+		req->tvr_Op.ClipRegion.Rects, req->tvr_Op.ClipRegion.NumRects);
+}
+
 /*****************************************************************************/
 
 static void x11_unsetcliprect(struct X11Display *mod, struct TVRequest *req)
 {
 	struct X11Window *v = req->tvr_Op.ClipRect.Window;
 
+	if (x11_sameclip(mod, v, TNULL, -1))
+		return;
+
 	/*XSetClipMask(mod->x11_Display, v->gc, None); */
 	XSetRegion(mod->x11_Display, v->gc, mod->x11_HugeRegion);
 #if defined(ENABLE_XFT)
@@ -1154,6 +1211,18 @@ static void x11_textsize(struct X11Display *mod, struct TVRequest *req)
 
 /*****************************************************************************/
 
+static void x11_textsizes(struct X11Display *mod, struct TVRequest *req)
+{
+	TINT *runs = req->tvr_Op.TextSizes.Runs;
+	TINT *widths = req->tvr_Op.TextSizes.Widths;
+	TINT i;
+	for (i = 0; i < req->tvr_Op.TextSizes.NumRuns; ++i, runs += 2)
+		widths[i] = x11_hosttextsize(mod, req->tvr_Op.TextSizes.Font,
+			req->tvr_Op.TextSizes.Text + runs[0], runs[1]);
+}
+
+/*****************************************************************************/
+
 static void x11_getfontattrs(struct X11Display *mod, struct TVRequest *req)
 {
 	struct attrdata data;
@@ -1558,6 +1627,9 @@ LOCAL void x11_docmd(struct X11Display *inst, struct TVRequest *req)
 		case TVCMD_TEXTSIZE:
 			x11_textsize(inst, req);
 			break;
+		case TVCMD_TEXTSIZES:
+			x11_textsizes(inst, req);
+			break;
 		case TVCMD_QUERYFONTS:
 			x11_queryfonts(inst, req);
 			break;
@@ -1618,9 +1690,17 @@ LOCAL void x11_docmd(struct X11Display *inst, struct TVRequest *req)
 		case TVCMD_UNSETCLIPRECT:
 			x11_unsetcliprect(inst, req);
 			break;
+		case TVCMD_SETCLIPREGION:
+			x11_setclipregion(inst, req);
+			break;
 		case TVCMD_DRAWBUFFER:
 			x11_drawbuffer(inst, req);
 			break;
+		case TVCMD_CREATEPIXMAP:
+		case TVCMD_FREEPIXMAP:
+		case TVCMD_DRAWPIXMAP:
+			/* no native pixmaps on X11, clients use drawbuffer */
+			break;
 		case TVCMD_GETSELECTION:
 			x11_getselection(inst, req);
 			break;
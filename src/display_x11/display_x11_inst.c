@@ -590,18 +590,12 @@ LOCAL void x11_taskfunc(struct TTask *task)
 	TUINT ireplysignal = TGetPortSignal(inst->x11_IReplyPort);
 	TUINT waitsigs = cmdportsignal | ireplysignal | TTASK_SIG_ABORT;
 
-	/* interval time: 1/50s: */
-	TTIME intt = { 20000 };
-
-	/* next absolute time to send interval message: */
-	TTIME nextt;
+	struct Interval interval;
 	TTIME waitt, nowt;
 
 	TDBPRINTF(TDB_INFO, ("Device instance running\n"));
 
-	TGetSystemTime(&nowt);
-	nextt = nowt;
-	TAddTime(&nextt, &intt);
+	interval_init(&interval);
 
 	do
 	{
@@ -657,7 +651,7 @@ LOCAL void x11_taskfunc(struct TTask *task)
 
 		if (inst->x11_NumInterval > 0 || inst->x11_RequestInProgress)
 		{
-			if (TCmpTime(&nowt, &nextt) >= 0)
+			if (interval_check(&interval, TTRUE, &nowt, &waitt))
 			{
 				/* expired; send interval: */
 				struct TNode *next, *node = inst->x11_vlist.tlh_Head.tln_Succ;
@@ -671,25 +665,17 @@ LOCAL void x11_taskfunc(struct TTask *task)
 						x11_getimsg(inst, v, &imsg, TITYPE_INTERVAL))
 						TPutMsg(v->imsgport, TNULL, imsg);
 				}
-				TAddTime(&nextt, &intt);
-			}
-
-			/* calculate new wait time: */
-			waitt = nextt;
-			TSubTime(&waitt, &nowt);
-			if (waitt.tdt_Int64 <= 0 || waitt.tdt_Int64 > 20000)
-			{
-				nextt = nowt;
-				TAddTime(&nextt, &intt);
-				waitt = nextt;
-				TSubTime(&waitt, &nowt);
 			}
 			tv.tv_sec = waitt.tdt_Int64 / 1000000;
 			tv.tv_usec = waitt.tdt_Int64 % 1000000;
 			ptv = &tv;
 		}
 		else
+		{
+			/* nothing animating, sleep until input arrives: */
+			interval_check(&interval, TFALSE, &nowt, &waitt);
 			ptv = NULL;
+		}
 
 		/* wait for display, signal fd and timeout: */
 		if (select(inst->x11_fd_max, &rset, NULL, NULL, ptv) > 0)
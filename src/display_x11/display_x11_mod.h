@@ -12,6 +12,7 @@
 #include <tek/mod/visual.h>
 #include <tek/lib/region.h>
 #include <tek/lib/utf8.h>
+#include <tek/lib/interval.h>
 
 #include <X11/X.h>
 #include <X11/Xlib.h>
@@ -36,7 +37,7 @@
 /*****************************************************************************/
 
 #define X11DISPLAY_VERSION		1
-#define X11DISPLAY_REVISION		1
+#define X11DISPLAY_REVISION		3
 #define X11DISPLAY_NUMVECTORS	10
 
 #define X11_UTF8_BUFSIZE 4096
@@ -140,6 +141,7 @@ struct X11FontAttr
 #define X11WFL_WAIT_RESIZE		0x0040
 #define X11WFL_CHANGE_VIDMODE	0x0080
 #define X11WFL_IS_ROOTWINDOW	0x0100
+#define X11WFL_CLIPCACHED		0x0200
 
 /*****************************************************************************/
 
@@ -288,6 +290,10 @@ struct X11Window
 	TUINT bpp;
 
 	TINT mousex, mousey;
+
+	/* Clipping in effect, valid with X11WFL_CLIPCACHED; -1 = none: */
+	TINT *cliprects;
+	TINT numcliprects;
 };
 
 struct attrdata
@@ -5,8 +5,518 @@
 #include <tek/lib/imgload.h>
 
 #if defined(ENABLE_PNG)
-
 #include <png.h>
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define IMGLOAD_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define IMGLOAD_NEON
+#endif
+
+/*
+**	Maximum number of source pixels or rows averaged into a destination
+**	pixel or row. Beyond this ratio, spans are decimated evenly:
+*/
+#define IMGLOAD_MAXTAPS	16
+
+/*****************************************************************************/
+/*
+**	Images are scaled while they are being decoded: decoders obtain a
+**	row from imgscale_getrow(), fill it with ARGB pixels (or skip it, if
+**	TNULL is returned), and pass it on with imgscale_putrow(). Besides the
+**	destination frame, only a few rows are held in memory. Reductions use
+**	area averaging, enlargements are filtered bilinearly. Channels are
+**	treated as bytes, regardless of their order.
+*/
+
+struct ImgScaler
+{
+	TUINT sc_SrcWidth, sc_SrcHeight;
+	TUINT sc_DstWidth, sc_DstHeight;
+	/* Next source and destination row: */
+	TUINT sc_SrcY, sc_DstY;
+	/* Destination frame: */
+	TUINT *sc_Dst;
+	/* Work area, holding the rows and column map below: */
+	TUINT *sc_Work;
+	/* Source row: */
+	TUINT *sc_Row;
+	/* Horizontally scaled rows, previous and current: */
+	TUINT *sc_HRow[2];
+	/* Vertical accumulator, 4 channels per pixel: */
+	TUINT *sc_Acc;
+	TUINT sc_AccRows;
+	/* Per destination column: source start, or 16.16 source position: */
+	TUINT *sc_XMap;
+	/* Current source row is not sampled: */
+	TBOOL sc_SkipRow;
+};
+
+/*
+**	pos = imgscale_boxpos(d, s, n): Start of the source span for
+**	destination pixel d, when reducing s to n pixels
+*/
+
+static TUINT imgscale_boxpos(TUINT d, TUINT s, TUINT n)
+{
+	return (TUINT64) d * s / n;
+}
+
+/*
+**	pos = imgscale_linpos(d, s, n): 16.16 source position of the centre
+**	of destination pixel d, when enlarging s to n pixels
+*/
+
+static TUINT imgscale_linpos(TUINT d, TUINT s, TUINT n)
+{
+	TINT64 p = (((TINT64) (2 * d + 1) * s) << 16) / (2 * n) - 0x8000;
+	return p < 0 ? 0 : (TUINT) p;
+}
+
+/*
+**	imgscale_accumulate(acc, row, n): Add the channels of n pixels to
+**	an accumulator of 4 * n values
+*/
+
+static void imgscale_accumulate(TUINT *acc, const TUINT *row, TUINT n)
+{
+	TUINT i = 0;
+#if defined(IMGLOAD_SSE2)
+	__m128i z = _mm_setzero_si128();
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i *a = (__m128i *) (acc + i * 4);
+		__m128i p = _mm_loadu_si128((const __m128i *) (row + i));
+		__m128i lo = _mm_unpacklo_epi8(p, z);
+		__m128i hi = _mm_unpackhi_epi8(p, z);
+		_mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a),
+			_mm_unpacklo_epi16(lo, z)));
+		_mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1),
+			_mm_unpackhi_epi16(lo, z)));
+		_mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2),
+			_mm_unpacklo_epi16(hi, z)));
+		_mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3),
+			_mm_unpackhi_epi16(hi, z)));
+	}
+#elif defined(IMGLOAD_NEON)
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32_t *a = acc + i * 4;
+		uint8x16_t p = vld1q_u8((const uint8_t *) (row + i));
+		uint16x8_t lo = vmovl_u8(vget_low_u8(p));
+		uint16x8_t hi = vmovl_u8(vget_high_u8(p));
+		vst1q_u32(a, vaddw_u16(vld1q_u32(a), vget_low_u16(lo)));
+		vst1q_u32(a + 4, vaddw_u16(vld1q_u32(a + 4), vget_high_u16(lo)));
+		vst1q_u32(a + 8, vaddw_u16(vld1q_u32(a + 8), vget_low_u16(hi)));
+		vst1q_u32(a + 12, vaddw_u16(vld1q_u32(a + 12), vget_high_u16(hi)));
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		const TUINT8 *p = (const TUINT8 *) (row + i);
+		TUINT *a = acc + i * 4;
+		a[0] += p[0];
+		a[1] += p[1];
+		a[2] += p[2];
+		a[3] += p[3];
+	}
+}
+
+/*
+**	imgscale_average(dst, acc, n, rows): Store the average of rows
+**	accumulated rows in n destination pixels, and clear the accumulator
+*/
+
+static void imgscale_average(TUINT *dst, TUINT *acc, TUINT n, TUINT rows)
+{
+	TUINT i, inv = 0x10000 / rows;
+	TUINT8 *d = (TUINT8 *) dst;
+	for (i = 0; i < n * 4; ++i)
+		d[i] = (acc[i] * inv + 0x8000) >> 16;
+	memset(acc, 0, n * 4 * sizeof(TUINT));
+}
+
+/*
+**	imgscale_blend(dst, a, b, f, n): Blend n pixels from a and b, with
+**	weight f/256 for b
+*/
+
+static void imgscale_blend(TUINT *dst, const TUINT *a, const TUINT *b,
+	TUINT f, TUINT n)
+{
+	TUINT i = 0;
+	if (f == 0)
+	{
+		memcpy(dst, a, n * sizeof(TUINT));
+		return;
+	}
+#if defined(IMGLOAD_SSE2)
+	{
+		__m128i z = _mm_setzero_si128();
+		__m128i fb = _mm_set1_epi16(f);
+		__m128i fa = _mm_set1_epi16(256 - f);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128i pa = _mm_loadu_si128((const __m128i *) (a + i));
+			__m128i pb = _mm_loadu_si128((const __m128i *) (b + i));
+			__m128i lo = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpacklo_epi8(pa, z), fa),
+				_mm_mullo_epi16(_mm_unpacklo_epi8(pb, z), fb));
+			__m128i hi = _mm_add_epi16(
+				_mm_mullo_epi16(_mm_unpackhi_epi8(pa, z), fa),
+				_mm_mullo_epi16(_mm_unpackhi_epi8(pb, z), fb));
+			_mm_storeu_si128((__m128i *) (dst + i), _mm_packus_epi16(
+				_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+		}
+	}
+#elif defined(IMGLOAD_NEON)
+	{
+		uint8x8_t fa = vdup_n_u8(256 - f);
+		uint8x8_t fb = vdup_n_u8(f);
+		for (; i + 4 <= n; i += 4)
+		{
+			uint8x16_t pa = vld1q_u8((const uint8_t *) (a + i));
+			uint8x16_t pb = vld1q_u8((const uint8_t *) (b + i));
+			uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(pa), fa),
+				vget_low_u8(pb), fb);
+			uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(pa), fa),
+				vget_high_u8(pb), fb);
+			vst1q_u8((uint8_t *) (dst + i),
+				vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+		}
+	}
+#endif
+	for (; i < n; ++i)
+	{
+		const TUINT8 *pa = (const TUINT8 *) (a + i);
+		const TUINT8 *pb = (const TUINT8 *) (b + i);
+		TUINT8 *d = (TUINT8 *) (dst + i);
+		d[0] = (pa[0] * (256 - f) + pb[0] * f) >> 8;
+		d[1] = (pa[1] * (256 - f) + pb[1] * f) >> 8;
+		d[2] = (pa[2] * (256 - f) + pb[2] * f) >> 8;
+		d[3] = (pa[3] * (256 - f) + pb[3] * f) >> 8;
+	}
+}
+
+/*
+**	imgscale_hbox(sc, dst, src): Reduce a row horizontally
+*/
+
+static void imgscale_hbox(struct ImgScaler *sc, TUINT *dst, const TUINT *src)
+{
+	const TUINT *xmap = sc->sc_XMap;
+	TUINT x, i;
+	for (x = 0; x < sc->sc_DstWidth; ++x)
+	{
+		TUINT x0 = xmap[x], x1 = xmap[x + 1];
+		TUINT step = (x1 - x0 + IMGLOAD_MAXTAPS - 1) / IMGLOAD_MAXTAPS;
+		TUINT s0 = 0, s1 = 0, s2 = 0, s3 = 0, n = 0;
+		TUINT8 *d = (TUINT8 *) (dst + x);
+		for (i = x0; i < x1; i += step, ++n)
+		{
+			const TUINT8 *p = (const TUINT8 *) (src + i);
+			s0 += p[0];
+			s1 += p[1];
+			s2 += p[2];
+			s3 += p[3];
+		}
+		d[0] = (s0 + n / 2) / n;
+		d[1] = (s1 + n / 2) / n;
+		d[2] = (s2 + n / 2) / n;
+		d[3] = (s3 + n / 2) / n;
+	}
+}
+
+/*
+**	imgscale_hlinear(sc, dst, src): Enlarge a row horizontally
+*/
+
+static void imgscale_hlinear(struct ImgScaler *sc, TUINT *dst,
+	const TUINT *src)
+{
+	const TUINT *xmap = sc->sc_XMap;
+	TUINT x, last = sc->sc_SrcWidth - 1;
+	for (x = 0; x < sc->sc_DstWidth; ++x)
+	{
+		TUINT p = xmap[x];
+		TUINT x0 = p >> 16;
+		TUINT f = (p >> 8) & 0xff;
+		const TUINT8 *a = (const TUINT8 *) (src + x0);
+		const TUINT8 *b = (const TUINT8 *) (src + (x0 < last ? x0 + 1 : last));
+		TUINT8 *d = (TUINT8 *) (dst + x);
+		d[0] = (a[0] * (256 - f) + b[0] * f) >> 8;
+		d[1] = (a[1] * (256 - f) + b[1] * f) >> 8;
+		d[2] = (a[2] * (256 - f) + b[2] * f) >> 8;
+		d[3] = (a[3] * (256 - f) + b[3] * f) >> 8;
+	}
+}
+
+/*
+**	success = imgscale_init(sc, exec, sw, sh, dw, dh): Prepare scaling
+**	from sw x sh to dw x dh pixels. Regardless of the outcome, the scaler
+**	must be released using imgscale_exit().
+*/
+
+static TBOOL imgscale_init(struct ImgScaler *sc, struct TExecBase *TExecBase,
+	TUINT sw, TUINT sh, TUINT dw, TUINT dh)
+{
+	TUINT x;
+	memset(sc, 0, sizeof *sc);
+	sc->sc_SrcWidth = sw;
+	sc->sc_SrcHeight = sh;
+	sc->sc_DstWidth = dw;
+	sc->sc_DstHeight = dh;
+	sc->sc_Dst = TAlloc(TNULL, (TSIZE) dw * dh * sizeof(TUINT));
+	if (sc->sc_Dst == TNULL)
+		return TFALSE;
+	if (sw == dw && sh == dh)
+		return TTRUE;
+	sc->sc_Work = TAlloc0(TNULL, (sw + 7 * dw + 1) * sizeof(TUINT));
+	if (sc->sc_Work == TNULL)
+		return TFALSE;
+	sc->sc_Row = sc->sc_Work;
+	sc->sc_HRow[0] = sc->sc_Row + sw;
+	sc->sc_HRow[1] = sc->sc_HRow[0] + dw;
+	sc->sc_Acc = sc->sc_HRow[1] + dw;
+	sc->sc_XMap = sc->sc_Acc + 4 * dw;
+	if (dw < sw)
+	{
+		for (x = 0; x <= dw; ++x)
+			sc->sc_XMap[x] = imgscale_boxpos(x, sw, dw);
+	}
+	else if (dw > sw)
+	{
+		for (x = 0; x < dw; ++x)
+			sc->sc_XMap[x] = imgscale_linpos(x, sw, dw);
+	}
+	return TTRUE;
+}
+
+/*
+**	dst = imgscale_exit(sc, exec, success): Release the scaler. If
+**	successful, returns the destination frame, otherwise frees it.
+*/
+
+static TUINT *imgscale_exit(struct ImgScaler *sc, struct TExecBase *TExecBase,
+	TBOOL success)
+{
+	TFree(sc->sc_Work);
+	sc->sc_Work = TNULL;
+	if (success)
+		return sc->sc_Dst;
+	TFree(sc->sc_Dst);
+	sc->sc_Dst = TNULL;
+	return TNULL;
+}
+
+/*
+**	row = imgscale_getrow(sc): Get the buffer for the next source row,
+**	or TNULL if this row is not sampled
+*/
+
+static TUINT *imgscale_getrow(struct ImgScaler *sc)
+{
+	TUINT sh = sc->sc_SrcHeight, dh = sc->sc_DstHeight;
+	if (sc->sc_SrcWidth == sc->sc_DstWidth && sh == dh)
+		return sc->sc_Dst + (TSIZE) sc->sc_SrcY * sc->sc_DstWidth;
+	if (dh < sh)
+	{
+		TUINT y0 = imgscale_boxpos(sc->sc_DstY, sh, dh);
+		TUINT y1 = imgscale_boxpos(sc->sc_DstY + 1, sh, dh);
+		TUINT step = (y1 - y0 + IMGLOAD_MAXTAPS - 1) / IMGLOAD_MAXTAPS;
+		sc->sc_SkipRow = (sc->sc_SrcY - y0) % step != 0;
+		if (sc->sc_SkipRow)
+			return TNULL;
+	}
+	return sc->sc_Row;
+}
+
+/*
+**	imgscale_putrow(sc): Pass on the source row obtained with
+**	imgscale_getrow()
+*/
+
+static void imgscale_putrow(struct ImgScaler *sc)
+{
+	TUINT sw = sc->sc_SrcWidth, sh = sc->sc_SrcHeight;
+	TUINT dw = sc->sc_DstWidth, dh = sc->sc_DstHeight;
+	TUINT sy = sc->sc_SrcY++;
+	TUINT *h = sc->sc_Row;
+
+	if (sw == dw && sh == dh)
+		return; /* written in place */
+
+	if (!sc->sc_SkipRow && dw != sw)
+	{
+		h = sh == dh ? sc->sc_Dst + (TSIZE) sy * dw : sc->sc_HRow[1];
+		if (dw < sw)
+			imgscale_hbox(sc, h, sc->sc_Row);
+		else
+			imgscale_hlinear(sc, h, sc->sc_Row);
+	}
+
+	if (dh < sh)
+	{
+		if (!sc->sc_SkipRow)
+		{
+			imgscale_accumulate(sc->sc_Acc, h, dw);
+			sc->sc_AccRows++;
+		}
+		if (sy + 1 == imgscale_boxpos(sc->sc_DstY + 1, sh, dh))
+		{
+			imgscale_average(sc->sc_Dst + (TSIZE) sc->sc_DstY * dw,
+				sc->sc_Acc, dw, sc->sc_AccRows);
+			sc->sc_AccRows = 0;
+			sc->sc_DstY++;
+		}
+	}
+	else if (dh > sh)
+	{
+		/* emit rows between the previous and this source row: */
+		if (h != sc->sc_HRow[1])
+			memcpy(sc->sc_HRow[1], h, dw * sizeof(TUINT));
+		for (; sc->sc_DstY < dh; sc->sc_DstY++)
+		{
+			TUINT p = imgscale_linpos(sc->sc_DstY, sh, dh);
+			if ((p >> 16) + 1 > sy)
+				break;
+			imgscale_blend(sc->sc_Dst + (TSIZE) sc->sc_DstY * dw,
+				sc->sc_HRow[0], sc->sc_HRow[1], (p >> 8) & 0xff, dw);
+		}
+		h = sc->sc_HRow[0];
+		sc->sc_HRow[0] = sc->sc_HRow[1];
+		sc->sc_HRow[1] = h;
+	}
+	else if (h != sc->sc_Dst + (TSIZE) sy * dw)
+		memcpy(sc->sc_Dst + (TSIZE) sy * dw, h, dw * sizeof(TUINT));
+}
+
+/*
+**	imgscale_finish(sc): Complete the destination frame after the last
+**	source row
+*/
+
+static void imgscale_finish(struct ImgScaler *sc)
+{
+	TUINT dw = sc->sc_DstWidth;
+	if (sc->sc_DstHeight > sc->sc_SrcHeight)
+	{
+		for (; sc->sc_DstY < sc->sc_DstHeight; sc->sc_DstY++)
+			memcpy(sc->sc_Dst + (TSIZE) sc->sc_DstY * dw, sc->sc_HRow[0],
+				dw * sizeof(TUINT));
+	}
+}
+
+/*
+**	n = imgscale_numrows(sc): Number of destination rows completed
+*/
+
+static TUINT imgscale_numrows(struct ImgScaler *sc)
+{
+	if (sc->sc_SrcHeight == sc->sc_DstHeight)
+		return sc->sc_SrcY;
+	return sc->sc_DstY;
+}
+
+/*
+**	imgload_getsize(ld, sw, sh, &dw, &dh): Determine the destination size
+**	from the requested size; if only one dimension is requested, the
+**	aspect ratio is retained
+*/
+
+static void imgload_getsize(struct ImgLoader *ld, TUINT sw, TUINT sh,
+	TUINT *pw, TUINT *ph)
+{
+	TUINT dw = ld->iml_ReqWidth;
+	TUINT dh = ld->iml_ReqHeight;
+	if (dw == 0 && dh == 0)
+	{
+		dw = sw;
+		dh = sh;
+	}
+	else if (dh == 0)
+		dh = (TUINT64) sh * dw / sw;
+	else if (dw == 0)
+		dw = (TUINT64) sw * dh / sh;
+	*pw = dw > 0 ? dw : 1;
+	*ph = dh > 0 ? dh : 1;
+}
+
+/*****************************************************************************/
+/*
+**	Decoder state, held between imgload_begin() and imgload_end():
+*/
+
+struct ImgDecoder
+{
+	struct ImgScaler dec_Scaler;
+	/* Decode the next source row and pass it to the scaler: */
+	TBOOL (*dec_ReadRow)(struct ImgLoader *ld, struct ImgDecoder *dec);
+	/* Release format-specific resources: */
+	void (*dec_Exit)(struct ImgLoader *ld, struct ImgDecoder *dec);
+	/* Source row: */
+	TUINT8 *dec_Row;
+#if defined(ENABLE_PNG)
+	png_structp dec_Png;
+	png_infop dec_PngInfo;
+	png_color *dec_Palette;
+	/* Rows of an interlaced image, which are decoded in full: */
+	png_bytep *dec_Rows;
+	TUINT dec_Mode;
+	TUINT dec_RowBytes;
+	TBOOL dec_Interlaced;
+#endif
+};
+
+static struct ImgDecoder *imgload_newdecoder(struct ImgLoader *ld)
+{
+	struct TExecBase *TExecBase = ld->iml_ExecBase;
+	struct ImgDecoder *dec = TAlloc0(TNULL, sizeof(struct ImgDecoder));
+	ld->iml_Decoder = dec;
+	return dec;
+}
+
+static void imgload_freedecoder(struct ImgLoader *ld, TBOOL success)
+{
+	struct TExecBase *TExecBase = ld->iml_ExecBase;
+	struct ImgDecoder *dec = ld->iml_Decoder;
+	if (dec)
+	{
+		if (dec->dec_Exit)
+			(*dec->dec_Exit)(ld, dec);
+		TFree(dec->dec_Row);
+		imgscale_exit(&dec->dec_Scaler, TExecBase, success);
+		TFree(dec);
+		ld->iml_Decoder = TNULL;
+	}
+}
+
+/*
+**	success = imgload_initimage(ld, dec, sw, sh, format): Prepare the
+**	scaler and the destination image
+*/
+
+static TBOOL imgload_initimage(struct ImgLoader *ld, struct ImgDecoder *dec,
+	TUINT sw, TUINT sh, TUINT format)
+{
+	TUINT dw, dh;
+	imgload_getsize(ld, sw, sh, &dw, &dh);
+	if (!imgscale_init(&dec->dec_Scaler, ld->iml_ExecBase, sw, sh, dw, dh))
+		return TFALSE;
+	ld->iml_Image.tpb_Data = (TUINT8 *) dec->dec_Scaler.sc_Dst;
+	ld->iml_Image.tpb_Format = format;
+	ld->iml_Image.tpb_BytesPerLine = dw * 4;
+	ld->iml_Width = dw;
+	ld->iml_Height = dh;
+	return TTRUE;
+}
+
+/*****************************************************************************/
+
+#if defined(ENABLE_PNG)
 
 static void imgload_pngread(png_structp png, png_bytep buf, png_size_t nbytes)
 {
@@ -15,15 +525,125 @@ static void imgload_pngread(png_structp png, png_bytep buf, png_size_t nbytes)
 		png_error(png, "error reading");
 }
 
-static TBOOL imgload_load_png(struct ImgLoader *ld)
+typedef enum { PNG_PALETTE, PNG_GRAY, PNG_GRAYALPHA, PNG_RGB,
+	PNG_RGB_ALPHA } pngtype_t;
+
+static void imgload_convert_png(TUINT *buf, png_bytep src, TUINT width,
+	pngtype_t mode, png_color *palette)
+{
+	TUINT x;
+	switch (mode)
+	{
+		case PNG_PALETTE:
+			for (x = 0; x < width; ++x)
+			{
+				TUINT8 idx = src[x];
+				TUINT r = palette[idx].red;
+				TUINT g = palette[idx].green;
+				TUINT b = palette[idx].blue;
+				*buf++ = 0xff000000 | (r << 16) | (g << 8) | b;
+			}
+			break;
+		case PNG_GRAY:
+			for (x = 0; x < width; ++x)
+			{
+				TUINT c = src[x];
+				*buf++ = 0xff000000 | (c << 16) | (c << 8) | c;
+			}
+			break;
+		case PNG_GRAYALPHA:
+			for (x = 0; x < width * 2; x += 2)
+			{
+				TUINT c = src[x];
+				TUINT a = src[x + 1];
+				*buf++ = (a << 24) | (c << 16) | (c << 8) | c;
+			}
+			break;
+		case PNG_RGB_ALPHA:
+			for (x = 0; x < width * 4; x += 4)
+			{
+				TUINT r = src[x];
+				TUINT g = src[x + 1];
+				TUINT b = src[x + 2];
+				TUINT a = src[x + 3];
+				*buf++ = (a << 24) | (r << 16) | (g << 8) | b;
+			}
+			break;
+		case PNG_RGB:
+			for (x = 0; x < width * 3; x += 3)
+			{
+				TUINT r = src[x];
+				TUINT g = src[x + 1];
+				TUINT b = src[x + 2];
+				*buf++ = (r << 16) | (g << 8) | b;
+			}
+			break;
+	}
+}
+
+static TBOOL imgload_readrow_png(struct ImgLoader *ld, struct ImgDecoder *dec)
+{
+	struct TExecBase *TExecBase = ld->iml_ExecBase;
+	struct ImgScaler *sc = &dec->dec_Scaler;
+	png_structp png = dec->dec_Png;
+	png_bytep src;
+	TUINT y, *buf;
+
+	if (setjmp(png_jmpbuf(png)))
+	{
+		TDBPRINTF(TDB_INFO,("png load failed\n"));
+		return TFALSE;
+	}
+
+	if (dec->dec_Interlaced)
+	{
+		if (dec->dec_Rows == TNULL)
+		{
+			/* all passes must be decoded before rows can be passed on: */
+			dec->dec_Rows = TAlloc0(TNULL, sc->sc_SrcHeight * sizeof(png_bytep));
+			if (!dec->dec_Rows) png_error(png, "no memory");
+			for (y = 0; y < sc->sc_SrcHeight; y++)
+			{
+				dec->dec_Rows[y] = TAlloc(TNULL, dec->dec_RowBytes);
+				if (!dec->dec_Rows[y]) png_error(png, "no memory");
+			}
+			png_read_image(png, dec->dec_Rows);
+		}
+		src = dec->dec_Rows[sc->sc_SrcY];
+	}
+	else
+	{
+		src = dec->dec_Row;
+		png_read_row(png, src, NULL);
+	}
+
+	buf = imgscale_getrow(sc);
+	if (buf)
+		imgload_convert_png(buf, src, sc->sc_SrcWidth, dec->dec_Mode,
+			dec->dec_Palette);
+	imgscale_putrow(sc);
+	return TTRUE;
+}
+
+static void imgload_exit_png(struct ImgLoader *ld, struct ImgDecoder *dec)
 {
 	struct TExecBase *TExecBase = ld->iml_ExecBase;
-	unsigned int x, y;
+	TUINT y;
+	png_destroy_read_struct(&dec->dec_Png, &dec->dec_PngInfo, NULL);
+	if (dec->dec_Rows)
+	{
+		for (y = 0; y < dec->dec_Scaler.sc_SrcHeight; y++)
+			TFree(dec->dec_Rows[y]);
+		TFree(dec->dec_Rows);
+	}
+}
+
+static TBOOL imgload_begin_png(struct ImgLoader *ld)
+{
+	struct TExecBase *TExecBase = ld->iml_ExecBase;
+	struct ImgDecoder *dec;
 	TUINT8 header[8];
-	
 	png_structp png;
-	png_infop pnginfo = NULL;
-	png_bytep *row_pointers = NULL;
 	
 	if (!((*ld->iml_ReadFunc)(ld, header, sizeof header) &&
 		png_sig_cmp(header, 0, 8) == 0))
@@ -31,167 +651,116 @@ static TBOOL imgload_load_png(struct ImgLoader *ld)
 	if ((*ld->iml_SeekFunc)(ld, 0, SEEK_SET) != 0)
 		return TFALSE;
 	
+	dec = imgload_newdecoder(ld);
+	if (dec == TNULL)
+		return TFALSE;
 	png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
 	if (png == NULL)
+	{
+		imgload_freedecoder(ld, TFALSE);
 		return TFALSE;
+	}
+	dec->dec_Png = png;
+	dec->dec_Exit = imgload_exit_png;
+	dec->dec_ReadRow = imgload_readrow_png;
 	
 	if (setjmp(png_jmpbuf(png)))
 	{
-		if (ld->iml_Height && row_pointers)
-		{
-			for (y = 0; y < ld->iml_Height; y++)
-			{
-				if (row_pointers[y])
-					TFree(row_pointers[y]);
-			}
-			TFree(row_pointers);
-		}
 		TDBPRINTF(TDB_INFO,("png load failed\n"));
-		png_destroy_read_struct(&png, &pnginfo, NULL);
+		imgload_freedecoder(ld, TFALSE);
 		return TFALSE;
 	}
 	
-	pnginfo = png_create_info_struct(png);
-	if (!png) png_error(png, "no memory");
+	dec->dec_PngInfo = png_create_info_struct(png);
+	if (!dec->dec_PngInfo) png_error(png, "no memory");
 	
 	png_set_read_fn(png, ld, imgload_pngread);
 
-	png_read_info(png, pnginfo);
+	png_read_info(png, dec->dec_PngInfo);
 	
-	ld->iml_Width = png_get_image_width(png, pnginfo);
-	ld->iml_Height = png_get_image_height(png, pnginfo);
-	png_set_interlace_handling(png);
-	int numchan = png_get_channels(png, pnginfo);
-	int coltype = png_get_color_type(png, pnginfo);
+	TUINT sw = png_get_image_width(png, dec->dec_PngInfo);
+	TUINT sh = png_get_image_height(png, dec->dec_PngInfo);
+	dec->dec_Interlaced = png_set_interlace_handling(png) > 1;
+	int numchan = png_get_channels(png, dec->dec_PngInfo);
+	int coltype = png_get_color_type(png, dec->dec_PngInfo);
 	png_set_packing(png);
-	png_read_update_info(png, pnginfo);
+	png_read_update_info(png, dec->dec_PngInfo);
 
-	png_color *palette = NULL;
 	int numpal = 0;
 	if (coltype == PNG_COLOR_TYPE_PALETTE)
 	{
-		if (png_get_PLTE(png, pnginfo, &palette, &numpal) != PNG_INFO_PLTE)
+		if (png_get_PLTE(png, dec->dec_PngInfo, &dec->dec_Palette,
+			&numpal) != PNG_INFO_PLTE)
 			png_error(png, "could not get palette");
 	}
 
-	row_pointers = (png_bytep *) TAlloc0(TNULL, 
-		ld->iml_Height * sizeof(png_bytep));
-	if (!row_pointers) png_error(png, "no memory");
-
-	png_uint_32 rowbytes = png_get_rowbytes(png, pnginfo);
-	for (y = 0; y < ld->iml_Height; y++)
-	{
-		row_pointers[y] = (png_byte *) TAlloc(TNULL, rowbytes);
-		if (!row_pointers[y]) png_error(png, "no memory");
-	}
-	
-	/*fprintf(stderr, "numchan=%d coltype=%d width=%d rowbytes=%d numpal=%d\n",
-		numchan, coltype, ld->iml_Width, rowbytes, numpal);*/
-	
-	png_read_image(png, row_pointers);
-	
-	TUINT *buf = TAlloc(TNULL, ld->iml_Width * ld->iml_Height * sizeof(TUINT));
-	if (!buf) png_error(png, "no memory");
-
 	TUINT dstfmt = TVPIXFMT_08R8G8B8;
-	typedef enum { PNG_PALETTE, PNG_GRAY, PNG_GRAYALPHA, PNG_RGB, 
-		PNG_RGB_ALPHA } pngtype_t;
-	pngtype_t mode;
-	if (palette)
-		mode = PNG_PALETTE;
+	ld->iml_Flags &= ~IMLFL_HAS_ALPHA;
+	if (dec->dec_Palette)
+		dec->dec_Mode = PNG_PALETTE;
 	else if (coltype == PNG_COLOR_TYPE_GRAY)
-		mode = PNG_GRAY;
+		dec->dec_Mode = PNG_GRAY;
 	else if (coltype == PNG_COLOR_TYPE_GRAY_ALPHA)
 	{
-		mode = PNG_GRAYALPHA;
+		dec->dec_Mode = PNG_GRAYALPHA;
 		dstfmt = TVPIXFMT_A8R8G8B8;
 		ld->iml_Flags |= IMLFL_HAS_ALPHA;
 	}
 	else if (numchan == 4)
 	{
-		mode = PNG_RGB_ALPHA;
+		dec->dec_Mode = PNG_RGB_ALPHA;
 		dstfmt = TVPIXFMT_A8R8G8B8;
 		ld->iml_Flags |= IMLFL_HAS_ALPHA;
 	}
 	else
-		mode = PNG_RGB;
+		dec->dec_Mode = PNG_RGB;
 
-	ld->iml_Image.tpb_Data = (TUINT8 *) buf;
-	ld->iml_Image.tpb_Format = dstfmt;
-	ld->iml_Image.tpb_BytesPerLine = ld->iml_Width * 4;
-	for (y = 0; y < ld->iml_Height; ++y)
+	dec->dec_RowBytes = png_get_rowbytes(png, dec->dec_PngInfo);
+	if (!dec->dec_Interlaced)
 	{
-		switch (mode)
-		{
-			case PNG_PALETTE:
-				for (x = 0; x < ld->iml_Width; ++x)
-				{
-					TUINT8 idx = row_pointers[y][x];
-					TUINT r = palette[idx].red;
-					TUINT g = palette[idx].green;
-					TUINT b = palette[idx].blue;
-					*buf++ = 0xff000000 | (r << 16) | (g << 8) | b;
-				}
-				break;
-			case PNG_GRAY:
-				for (x = 0; x < ld->iml_Width; ++x)
-				{
-					TUINT8 c = row_pointers[y][x];
-					*buf++ = 0xff000000 | (c << 16) | (c << 8) | c;
-				}
-				break;
-			case PNG_GRAYALPHA:
-				for (x = 0; x < ld->iml_Width * 2; x += 2)
-				{
-					TUINT8 c = row_pointers[y][x];
-					TUINT8 a = row_pointers[y][x + 1];
-					*buf++ = (a << 24) | (c << 16) | (c << 8) | c;
-				}
-				break;
-			case PNG_RGB_ALPHA:
-				for (x = 0; x < ld->iml_Width * 4; x += 4)
-				{
-					TUINT r = row_pointers[y][x];
-					TUINT g = row_pointers[y][x + 1];
-					TUINT b = row_pointers[y][x + 2];
-					TUINT a = row_pointers[y][x + 3];
-					*buf++ = (a << 24) | (r << 16) | (g << 8) | b;
-				}
-				break;
-			case PNG_RGB:
-				for (x = 0; x < ld->iml_Width * 3; x += 3)
-				{
-					TUINT r = row_pointers[y][x];
-					TUINT g = row_pointers[y][x + 1];
-					TUINT b = row_pointers[y][x + 2];
-					*buf++ = (r << 16) | (g << 8) | b;
-				}
-				break;
-		}
+		dec->dec_Row = TAlloc(TNULL, dec->dec_RowBytes);
+		if (!dec->dec_Row) png_error(png, "no memory");
 	}
+	if (!imgload_initimage(ld, dec, sw, sh, dstfmt))
+		png_error(png, "no memory");
 
-	png_destroy_read_struct(&png, &pnginfo, NULL);
-	
-	for (y = 0; y < ld->iml_Height; y++)
-		TFree(row_pointers[y]);
-	TFree(row_pointers);
-	TDBPRINTF(TDB_TRACE,("successfully loaded PNG\n"));
+	TDBPRINTF(TDB_TRACE,("identified PNG w=%d h=%d\n", sw, sh));
 	return TTRUE;
 }
 
 #endif /* defined(ENABLE_PNG) */
 
+/*****************************************************************************/
+
+static TBOOL imgload_readrow_ppm(struct ImgLoader *ld, struct ImgDecoder *dec)
+{
+	struct ImgScaler *sc = &dec->dec_Scaler;
+	TUINT x, w = sc->sc_SrcWidth;
+	TUINT *dstbuf;
+	if (!(*ld->iml_ReadFunc)(ld, dec->dec_Row, w * 3))
+		return TFALSE;
+	dstbuf = imgscale_getrow(sc);
+	if (dstbuf)
+	{
+		TUINT8 *src = dec->dec_Row;
+		for (x = 0; x < w; ++x, src += 3)
+			*dstbuf++ = (src[0] << 16) | (src[1] << 8) | src[2];
+	}
+	imgscale_putrow(sc);
+	return TTRUE;
+}
 
-static TBOOL imgload_load_ppm(struct ImgLoader *ld)
+static TBOOL imgload_begin_ppm(struct ImgLoader *ld)
 {
 	struct TExecBase *TExecBase = ld->iml_ExecBase;
-	int tw, th, maxv = 0, x, y;
+	struct ImgDecoder *dec;
+	int tw, th, maxv = 0;
 	char header[256];
 	if (!(*ld->iml_ReadFunc)(ld, (TUINT8 *) header, sizeof header))
 		return TFALSE;
 	if (!((sscanf(header, "P6\n%d %d\n%d\n", &tw, &th, &maxv) == 3 ||
 		sscanf(header, "P6\n#%*80[^\n]\n%d %d\n%d\n", &tw, &th, &maxv) == 3) &&
-		maxv > 0 && maxv < 256))
+		tw > 0 && th > 0 && maxv > 0 && maxv < 256))
 		return TFALSE;
 	TDBPRINTF(TDB_TRACE,("identified PPM w=%d h=%d\n", tw, th));
 	long offs = (*ld->iml_SeekFunc)(ld, 0, SEEK_END);
@@ -200,50 +769,91 @@ static TBOOL imgload_load_ppm(struct ImgLoader *ld)
 	offs -= 3 * tw * th;
 	if (offs <= 0 || (*ld->iml_SeekFunc)(ld, offs, SEEK_SET) == -1)
 		return TFALSE;
-	size_t len = tw * th * sizeof(TUINT);
-	TUINT *dstbuf = TAlloc(TNULL, len + tw * 3);
-	if (dstbuf == TNULL)
+	dec = imgload_newdecoder(ld);
+	if (dec == TNULL)
 		return TFALSE;
-	ld->iml_Image.tpb_Data = (TUINT8 *) dstbuf;
-	for (y = 0; y < th; ++y)
-	{
-		TUINT8 r, g, b;
-		char *srcbuf = (char *) ld->iml_Image.tpb_Data + len;
-		if (!(*ld->iml_ReadFunc)(ld, (TUINT8 *) srcbuf, tw * 3))
-		{
-			TFree(ld->iml_Image.tpb_Data);
-			return TFALSE;
-		}
-		for (x = 0; x < tw; ++x)
-		{
-			r = *srcbuf++;
-			g = *srcbuf++;
-			b = *srcbuf++;
-			*dstbuf++ = (r << 16) | (g << 8) | b;
-		}
-	}
-	ld->iml_Image.tpb_Format = TVPIXFMT_08R8G8B8;
-	ld->iml_Image.tpb_BytesPerLine = tw * 4;
-	ld->iml_Width = tw;
-	ld->iml_Height = th;
-	/* TRealloc(ld->buf, len); */
-	TDBPRINTF(TDB_TRACE,("successfully loaded PPM\n"));
-	return TTRUE;
+	dec->dec_ReadRow = imgload_readrow_ppm;
+	dec->dec_Row = TAlloc(TNULL, tw * 3);
+	ld->iml_Flags &= ~IMLFL_HAS_ALPHA;
+	if (dec->dec_Row &&
+		imgload_initimage(ld, dec, tw, th, TVPIXFMT_08R8G8B8))
+		return TTRUE;
+	imgload_freedecoder(ld, TFALSE);
+	return TFALSE;
 }
 
+/*****************************************************************************/
+/*
+**	success = imgload_begin(ld): Identify the image and read its header.
+**	On success, iml_Width, iml_Height, iml_Flags and iml_Image describe
+**	the resulting image, but its pixels are yet undefined; they are
+**	decoded using imgload_read(), and the decoder must be released using
+**	imgload_end() in any case. The image data belongs to the caller and
+**	must be freed using TFree().
+*/
 
-TLIBAPI TBOOL imgload_load(struct ImgLoader *ld)
+TLIBAPI TBOOL imgload_begin(struct ImgLoader *ld)
 {
 #if defined(ENABLE_PNG)
-	if (imgload_load_png(ld))
+	if (imgload_begin_png(ld))
 		return TTRUE;
 #endif
 	(*ld->iml_SeekFunc)(ld, 0, SEEK_SET);
-	if (imgload_load_ppm(ld))
+	if (imgload_begin_ppm(ld))
 		return TTRUE;
 	return TFALSE;
 }
 
+/*
+**	numrows = imgload_read(ld, numrows): Decode until the given number of
+**	rows of the resulting image is complete, or the image is finished.
+**	Returns the number of complete rows, or -1 if an error occurred.
+*/
+
+TLIBAPI TINT imgload_read(struct ImgLoader *ld, TUINT numrows)
+{
+	struct ImgDecoder *dec = ld->iml_Decoder;
+	struct ImgScaler *sc;
+	if (dec == TNULL)
+		return -1;
+	sc = &dec->dec_Scaler;
+	while (imgscale_numrows(sc) < numrows &&
+		sc->sc_SrcY < sc->sc_SrcHeight)
+	{
+		if (!(*dec->dec_ReadRow)(ld, dec))
+			return -1;
+	}
+	if (sc->sc_SrcY == sc->sc_SrcHeight)
+		imgscale_finish(sc);
+	return imgscale_numrows(sc);
+}
+
+/*
+**	imgload_end(ld): Release the decoder
+*/
+
+TLIBAPI void imgload_end(struct ImgLoader *ld)
+{
+	imgload_freedecoder(ld, TTRUE);
+}
+
+TLIBAPI TBOOL imgload_load(struct ImgLoader *ld)
+{
+	TBOOL success = imgload_begin(ld);
+	if (success)
+	{
+		success = imgload_read(ld, ld->iml_Height) == (TINT) ld->iml_Height;
+		imgload_end(ld);
+		if (!success)
+		{
+			struct TExecBase *TExecBase = ld->iml_ExecBase;
+			TFree(ld->iml_Image.tpb_Data);
+			ld->iml_Image.tpb_Data = TNULL;
+		}
+	}
+	return success;
+}
+
 
 static TBOOL imgload_read_file(struct ImgLoader *ld, TUINT8 *buf, TSIZE nbytes)
 {
@@ -233,6 +233,32 @@ EXPORT TINT vis_textsize(struct TVisualBase *mod, struct TVRequest *fontreq,
 	return size;
 }
 
+/*****************************************************************************/
+/*
+**	Measure a number of runs in a text with a single request. Runs are
+**	pairs of offset and length in bytes, like the length passed to
+**	TVisualTextSize(), and the width of each run is placed in the widths
+**	array. Returns the number of runs measured.
+*/
+
+EXPORT TINT vis_textsizes(struct TVisualBase *mod, struct TVRequest *fontreq,
+	TSTRPTR t, TINT *runs, TINT *widths, TINT numruns)
+{
+	TINT n = 0;
+	if (fontreq && numruns > 0)
+	{
+		struct TExecBase *TExecBase = TGetExecBase(mod);
+		fontreq->tvr_Req.io_Command = TVCMD_TEXTSIZES;
+		fontreq->tvr_Op.TextSizes.Text = t;
+		fontreq->tvr_Op.TextSizes.Runs = runs;
+		fontreq->tvr_Op.TextSizes.Widths = widths;
+		fontreq->tvr_Op.TextSizes.NumRuns = numruns;
+		TDoIO(&fontreq->tvr_Req);
+		n = fontreq->tvr_Op.TextSizes.NumRuns;
+	}
+	return n;
+}
+
 /*****************************************************************************/
 
 EXPORT TAPTR vis_queryfonts(struct TVisualBase *mod, TTAGITEM *tags)
@@ -515,6 +541,28 @@ EXPORT void vis_setcliprect(struct TVisualBase *inst, TINT x, TINT y, TINT w,
 
 /*****************************************************************************/
 
+/*
+**	Set a clipping region, consisting of num rectangles in the array rects,
+**	given as quartets of x0, y0, x1, y1 each. The rectangles must not
+**	overlap. Drivers are expected to keep the region until the next change
+**	of the clipping; those without support for regions clip to their
+**	bounding box. An empty region (num = 0) clips everything.
+*/
+
+EXPORT void vis_setclipregion(struct TVisualBase *inst, TINT *rects, TINT num,
+	TTAGITEM *tags)
+{
+	struct TVRequest *req = visi_getreq(inst, TVCMD_SETCLIPREGION,
+		inst->vis_Display, TNULL);
+	req->tvr_Op.ClipRegion.Window = inst->vis_Window;
+	req->tvr_Op.ClipRegion.Rects = rects;
+	req->tvr_Op.ClipRegion.NumRects = num;
+	req->tvr_Op.ClipRegion.Tags = tags;
+	visi_dosync(inst, req);
+}
+
+/*****************************************************************************/
+
 EXPORT void vis_unsetcliprect(struct TVisualBase *inst)
 {
 	struct TVRequest *req = visi_getreq(inst, TVCMD_UNSETCLIPRECT,
@@ -632,6 +680,79 @@ EXPORT void vis_drawbuffer(struct TVisualBase *inst,
 
 /*****************************************************************************/
 
+/*
+**	Create a pixmap on the display from an array of w * h pixels, in lines
+**	of totw pixels each. The display keeps a copy of the pixels, in a
+**	format of its choice, so that they need not be converted each time the
+**	pixmap is drawn. Tags are TVisual_Display, TVisual_PixelFormat (default
+**	TVPIXFMT_A8R8G8B8) and TVisual_AlphaChannel. Returns TNULL if the
+**	display does not support pixmaps, in which case the caller should use
+**	TVisualDrawBuffer() instead.
+*/
+
+EXPORT struct TVRequest *vis_createpixmap(struct TVisualBase *mod, TAPTR buf,
+	TINT w, TINT h, TINT totw, TTAGITEM *tags)
+{
+	struct TVRequest *req = visi_getreq(mod, TVCMD_CREATEPIXMAP,
+		mod->vis_Display, tags);
+	if (req)
+	{
+		struct TExecBase *TExecBase = TGetExecBase(mod);
+		req->tvr_Op.CreatePixmap.Pixmap = TNULL;
+		req->tvr_Op.CreatePixmap.Buf = buf;
+		req->tvr_Op.CreatePixmap.Width = w;
+		req->tvr_Op.CreatePixmap.Height = h;
+		req->tvr_Op.CreatePixmap.TotWidth = totw;
+		req->tvr_Op.CreatePixmap.Tags = tags;
+		TDoIO(&req->tvr_Req);
+		if (req->tvr_Op.CreatePixmap.Pixmap)
+			return req;
+		visi_ungetreq(mod, req);
+	}
+	return TNULL;
+}
+
+/*****************************************************************************/
+
+EXPORT void vis_freepixmap(struct TVisualBase *mod, struct TVRequest *pixmap)
+{
+	if (pixmap)
+	{
+		pixmap->tvr_Req.io_Command = TVCMD_FREEPIXMAP;
+		visi_dosync(mod, pixmap);
+	}
+}
+
+/*****************************************************************************/
+
+/*
+**	Draw the rectangle of w * h pixels at sx, sy in the pixmap to x, y.
+**	As the pixels are owned by the display, this is performed
+**	asynchronously, unless tags are given.
+*/
+
+EXPORT void vis_drawpixmap(struct TVisualBase *inst, struct TVRequest *pixmap,
+	TINT x, TINT y, TINT w, TINT h, TINT sx, TINT sy, TTAGITEM *tags)
+{
+	struct TVRequest *req = visi_getreq(inst, TVCMD_DRAWPIXMAP,
+		inst->vis_Display, TNULL);
+	req->tvr_Op.DrawPixmap.Window = inst->vis_Window;
+	req->tvr_Op.DrawPixmap.Pixmap = pixmap->tvr_Op.CreatePixmap.Pixmap;
+	req->tvr_Op.DrawPixmap.RRect[0] = x;
+	req->tvr_Op.DrawPixmap.RRect[1] = y;
+	req->tvr_Op.DrawPixmap.RRect[2] = w;
+	req->tvr_Op.DrawPixmap.RRect[3] = h;
+	req->tvr_Op.DrawPixmap.SrcX = sx;
+	req->tvr_Op.DrawPixmap.SrcY = sy;
+	req->tvr_Op.DrawPixmap.Tags = tags;
+	if (tags)
+		visi_dosync(inst, req);
+	else
+		visi_doasync(inst, req);
+}
+
+/*****************************************************************************/
+
 EXPORT TAPTR vis_getselection(struct TVisualBase *inst, TTAGITEM *tags)
 {
 	struct TVRequest *req = visi_getreq(inst, TVCMD_GETSELECTION,
@@ -65,6 +65,13 @@ vis_vectors[VISUAL_NUMVECTORS] =
 	
 	(TMFPTR) vis_getselection,
 	(TMFPTR) vis_setselection,
+	
+	(TMFPTR) vis_textsizes,
+	(TMFPTR) vis_setclipregion,
+	
+	(TMFPTR) vis_createpixmap,
+	(TMFPTR) vis_freepixmap,
+	(TMFPTR) vis_drawpixmap,
 };
 
 static void
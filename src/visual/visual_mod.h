@@ -17,8 +17,8 @@
 /*****************************************************************************/
 
 #define VISUAL_VERSION		5
-#define VISUAL_REVISION		0
-#define VISUAL_NUMVECTORS	43
+#define VISUAL_REVISION		3
+#define VISUAL_NUMVECTORS	48
 
 #ifndef LOCAL
 #define LOCAL
@@ -143,5 +143,14 @@ EXPORT void vis_drawbuffer(struct TVisualBase *inst,
 
 EXPORT TAPTR vis_getselection(struct TVisualBase *inst, TTAGITEM *tags);
 EXPORT TINT vis_setselection(struct TVisualBase *inst, TSTRPTR sel, TSIZE len, TTAGITEM *tags);
+EXPORT TINT vis_textsizes(struct TVisualBase *mod, struct TVRequest *font,
+	TSTRPTR t, TINT *runs, TINT *widths, TINT numruns);
+EXPORT void vis_setclipregion(struct TVisualBase *mod, TINT *rects, TINT num,
+	TTAGITEM *tags);
+EXPORT struct TVRequest *vis_createpixmap(struct TVisualBase *mod, TAPTR buf,
+	TINT w, TINT h, TINT totw, TTAGITEM *tags);
+EXPORT void vis_freepixmap(struct TVisualBase *mod, struct TVRequest *pixmap);
+EXPORT void vis_drawpixmap(struct TVisualBase *inst, struct TVRequest *pixmap,
+	TINT x, TINT y, TINT w, TINT h, TINT sx, TINT sy, TTAGITEM *tags);
 
 #endif
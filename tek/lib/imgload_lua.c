@@ -0,0 +1,247 @@
+/*-----------------------------------------------------------------------------
+--
+--	tek.lib.imgload
+--	Written by Timm S. Mueller <tmueller at schulze-mueller.de>
+--	See copyright notice in COPYRIGHT
+--
+--	OVERVIEW::
+--		This library decodes pictures in the PNG and PPM file formats
+--		(PNG support may depend on the build configuration). Unlike
+--		Visual.createPixmap(), it does not depend on a display, and can be
+--		used in child tasks. Pictures are scaled while they are being
+--		decoded, and their pixels can be retrieved in bands of rows, in a
+--		format suitable for pixmap:fromString().
+--
+--	FUNCTIONS::
+--		- decoder:close() - Releases a decoder
+--		- decoder:getAttrs() - Returns size and transparency of a picture
+--		- imgload.open() - Opens a picture for decoding
+--		- decoder:read() - Decodes rows of a picture
+--
+-------------------------------------------------------------------------------
+
+module "tek.lib.imgload"
+_VERSION = "ImgLoad 1.0"
+
+******************************************************************************/
+
+#include <string.h>
+#include <lualib.h>
+#include <tek/debug.h>
+#include <tek/teklib.h>
+#include <tek/lib/tek_lua.h>
+#include <tek/lib/tekui.h>
+#include <tek/lib/imgload.h>
+#include <tek/inline/exec.h>
+
+#define TEK_LIB_IMGLOAD_VERSION "ImgLoad 1.0"
+#define TEK_LIB_IMGLOAD_NAME "tek.lib.imgload"
+#define TEK_LIB_IMGLOAD_DECODER_NAME "tek.lib.imgload.decoder*"
+
+typedef struct
+{
+	struct ImgLoader dec_Loader;
+	/* Number of rows delivered: */
+	TINT dec_NumRows;
+	/* Reference to the source string or file: */
+	int dec_RefSource;
+	TBOOL dec_Open;
+} TEKImgDecoder;
+
+/*-----------------------------------------------------------------------------
+--	decoder = imgload.open(src[, width[, height]]): Opens a picture for
+--	decoding. The {{src}} argument can be a string containing the picture,
+--	or an open file, which must remain open until the decoder is closed.
+--	Optionally, a size can be specified to scale the picture to; if only
+--	one of width and height are given, the picture is scaled
+--	proportionally. Returns '''nil''' if the picture cannot be identified.
+-----------------------------------------------------------------------------*/
+
+static int tek_lib_imgload_open(lua_State *L)
+{
+	struct TExecBase *TExecBase = *(TAPTR *) lua_touserdata(L,
+		lua_upvalueindex(1));
+	TEKImgDecoder *dec;
+	size_t len;
+	const char *src = lua_tolstring(L, 1, &len);
+	FILE **f = TNULL;
+	TINT w = luaL_optinteger(L, 2, 0);
+	TINT h = luaL_optinteger(L, 3, 0);
+	if (w < 0 || h < 0)
+		luaL_argerror(L, w < 0 ? 2 : 3, "Invalid size");
+	if (src == TNULL)
+	{
+		f = luaL_checkudata(L, 1, LUA_FILEHANDLE);
+		if (*f == NULL)
+			luaL_error(L, "attempt to use a closed file");
+	}
+
+	dec = lua_newuserdata(L, sizeof(TEKImgDecoder));
+	/* s: decoder */
+	memset(dec, 0, sizeof(TEKImgDecoder));
+	dec->dec_RefSource = LUA_NOREF;
+	luaL_getmetatable(L, TEK_LIB_IMGLOAD_DECODER_NAME);
+	/* s: decoder, meta */
+	lua_setmetatable(L, -2);
+	/* s: decoder */
+
+	if (f)
+		imgload_init_file(&dec->dec_Loader, TExecBase, *f);
+	else
+		imgload_init_memory(&dec->dec_Loader, TExecBase, src, len);
+	dec->dec_Loader.iml_ReqWidth = w;
+	dec->dec_Loader.iml_ReqHeight = h;
+	if (!imgload_begin(&dec->dec_Loader))
+		return 0;
+	dec->dec_Open = TTRUE;
+
+	/* keep source from being collected: */
+	lua_pushvalue(L, 1);
+	/* s: decoder, src */
+	dec->dec_RefSource = luaL_ref(L, LUA_REGISTRYINDEX);
+	/* s: decoder */
+	return 1;
+}
+
+/*-----------------------------------------------------------------------------
+--	decoder:close(): Releases the decoder and the decoded picture.
+-----------------------------------------------------------------------------*/
+
+static int tek_lib_imgload_close(lua_State *L)
+{
+	TEKImgDecoder *dec = luaL_checkudata(L, 1, TEK_LIB_IMGLOAD_DECODER_NAME);
+	if (dec->dec_Open)
+	{
+		struct TExecBase *TExecBase = dec->dec_Loader.iml_ExecBase;
+		dec->dec_Open = TFALSE;
+		imgload_end(&dec->dec_Loader);
+		TFree(dec->dec_Loader.iml_Image.tpb_Data);
+		dec->dec_Loader.iml_Image.tpb_Data = TNULL;
+		luaL_unref(L, LUA_REGISTRYINDEX, dec->dec_RefSource);
+		dec->dec_RefSource = LUA_NOREF;
+	}
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+--	width, height, alpha = decoder:getAttrs(): Returns the size of the
+--	resulting picture, and a boolean indicating the presence of an alpha
+--	channel.
+-----------------------------------------------------------------------------*/
+
+static int tek_lib_imgload_getattrs(lua_State *L)
+{
+	TEKImgDecoder *dec = luaL_checkudata(L, 1, TEK_LIB_IMGLOAD_DECODER_NAME);
+	if (!dec->dec_Open)
+		luaL_error(L, "attempt to use a closed decoder");
+	lua_pushinteger(L, dec->dec_Loader.iml_Width);
+	lua_pushinteger(L, dec->dec_Loader.iml_Height);
+	lua_pushboolean(L, dec->dec_Loader.iml_Flags & IMLFL_HAS_ALPHA);
+	return 3;
+}
+
+/*-----------------------------------------------------------------------------
+--	data, y, numrows = decoder:read([numrows]): Decodes the given number of
+--	rows (or all remaining rows) of the resulting picture, and returns them
+--	as a string, followed by the first row's index (starting at {{0}}) and
+--	the number of rows returned. The string contains four bytes per pixel,
+--	in the order alpha, red, green, blue, as expected by
+--	pixmap:fromString(). Returns '''nil''' when all rows have been
+--	delivered. Raises an error if the picture is corrupt.
+-----------------------------------------------------------------------------*/
+
+static int tek_lib_imgload_read(lua_State *L)
+{
+	TEKImgDecoder *dec = luaL_checkudata(L, 1, TEK_LIB_IMGLOAD_DECODER_NAME);
+	struct ImgLoader *ld = &dec->dec_Loader;
+	struct TExecBase *TExecBase = ld->iml_ExecBase;
+	TINT y0 = dec->dec_NumRows;
+	TINT numrows = luaL_optinteger(L, 2, ld->iml_Height - y0);
+	TINT y1, i, n;
+	TUINT8 *buf, *d;
+	if (!dec->dec_Open)
+		luaL_error(L, "attempt to use a closed decoder");
+	if (y0 >= (TINT) ld->iml_Height)
+		return 0;
+	if (numrows < 1)
+		luaL_argerror(L, 2, "Invalid number of rows");
+	y1 = imgload_read(ld, TMIN((TUINT) (y0 + numrows), ld->iml_Height));
+	if (y1 < 0)
+		luaL_error(L, "error decoding image");
+	if (y1 == y0)
+		return 0;
+	n = (y1 - y0) * ld->iml_Width;
+	buf = TAlloc(TNULL, n * 4);
+	if (buf == TNULL)
+		luaL_error(L, "out of memory");
+	d = buf;
+	for (i = 0; i < y1 - y0; ++i)
+	{
+		const TUINT *s = (const TUINT *) TVPB_GETADDRESS(&ld->iml_Image, 0,
+			y0 + i);
+		TUINT x;
+		for (x = 0; x < ld->iml_Width; ++x, d += 4)
+		{
+			TUINT p = s[x];
+			d[0] = p >> 24;
+			d[1] = p >> 16;
+			d[2] = p >> 8;
+			d[3] = p;
+		}
+	}
+	lua_pushlstring(L, (const char *) buf, n * 4);
+	TFree(buf);
+	dec->dec_NumRows = y1;
+	lua_pushinteger(L, y0);
+	lua_pushinteger(L, y1 - y0);
+	return 3;
+}
+
+/*****************************************************************************/
+
+static const luaL_Reg tek_lib_imgload_funcs[] =
+{
+	{ "open", tek_lib_imgload_open },
+	{ NULL, NULL }
+};
+
+static const luaL_Reg tek_lib_imgload_methods[] =
+{
+	{ "__gc", tek_lib_imgload_close },
+	{ "close", tek_lib_imgload_close },
+	{ "getAttrs", tek_lib_imgload_getattrs },
+	{ "read", tek_lib_imgload_read },
+	{ NULL, NULL }
+};
+
+TMODENTRY int luaopen_tek_lib_imgload(lua_State *L)
+{
+	/* require "tek.lib.exec": */
+	lua_getglobal(L, "require");
+	/* s: require() */
+	lua_pushliteral(L, "tek.lib.exec");
+	/* s: require(), "tek.lib.exec" */
+	lua_call(L, 1, 1);
+	/* s: exectab */
+	lua_getfield(L, -1, "base");
+	/* s: exectab, execbase */
+	lua_remove(L, -2);
+	/* s: execbase */
+
+	tek_lua_register(L, TEK_LIB_IMGLOAD_NAME, tek_lib_imgload_funcs, 1);
+	/* s: libtab */
+	lua_pushstring(L, TEK_LIB_IMGLOAD_VERSION);
+	lua_setfield(L, -2, "_VERSION");
+
+	luaL_newmetatable(L, TEK_LIB_IMGLOAD_DECODER_NAME);
+	/* s: libtab, meta */
+	tek_lua_register(L, NULL, tek_lib_imgload_methods, 0);
+	lua_pushvalue(L, -1);
+	/* s: libtab, meta, meta */
+	lua_setfield(L, -2, "__index");
+	/* s: libtab, meta */
+	lua_pop(L, 1);
+	/* s: libtab */
+
+	return 1;
+}
@@ -95,6 +95,7 @@
 #include "region.c"
 #include "string.c"
 #include "support.c"
+#include "imgload_lua.c"
 
 #include "../../src/misc/utf8.c"
 #include "../../src/misc/region.c"
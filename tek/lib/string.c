@@ -17,6 +17,7 @@
 --		- String.encodeutf8() - Encode codepoints to UTF-8
 --		- String:erase() - Erases a range of a string
 --		- String:find() - Finds the UTF-8 string in a string object
+--		- String:findall() - Finds all occurrences of an UTF-8 string
 --		- String.foreachutf8() - Iterate codepoints of an UTF-8 encoded string
 --		- String:free() - Reset string object, free associated data
 --		- String:get() - Returns string
@@ -34,7 +35,7 @@
 -------------------------------------------------------------------------------
 
 module "tek.lib.string"
-_VERSION = "String 2.0"
+_VERSION = "String 2.1"
 local String = _M
 
 ******************************************************************************/
@@ -48,7 +49,7 @@ local String = _M
 #include <tek/lib/utf8.h>
 #include <tek/lib/tekui.h>
 
-#define TEK_LIB_STRING_VERSION	"String Library 2.0"
+#define TEK_LIB_STRING_VERSION	"String Library 2.1"
 #define TEK_LIB_STRING_NAME		"tek.lib.string"
 
 /*****************************************************************************/
@@ -1173,76 +1174,214 @@ static int tek_string_getchar(lua_State *L)
 	return 1;
 }
 
-/*-----------------------------------------------------------------------------
---	p0, p1 = String:find(utf8[, pos]): Finds the specified UTF-8 encoded
---	string in the string object, and if found, returns the first and last
---	position of its next occurrence from the starting position
---	(default: {{1}}).
------------------------------------------------------------------------------*/
+/*
+**	Linear UTF-8 representation of a string's characters, starting at
+**	a given position. If the string is compacted, this refers to its UTF-8
+**	buffer, and the start is located using the hint. Otherwise, the
+**	characters from the start position are encoded to a temporary buffer.
+*/
 
-static int tek_string_find(lua_State *L)
+typedef struct
+{
+	const unsigned char *buf;
+	tek_size len;
+	tek_size offs;
+	unsigned char *temp;
+} tek_linear;
+
+static void tek_string_linearize(lua_State *L, tek_string *s, tek_size p0,
+	tek_linear *lin)
+{
+	unsigned char utf8buf[6];
+	struct TNode *next, *node;
+	tek_node *sn;
+	tek_size pos, i, len;
+	unsigned char *p;
+	
+	assert(p0 > 0 && p0 <= s->ts_Length);
+	
+#if defined(COMPACTION)
+	if (s->ts_UTF8[0])
+	{
+		const unsigned char *buf = s->ts_UTF8[0];
+		tek_size offs = 0;
+		len = s->ts_UTF8Len[0];
+		pos = 1;
+		if (p0 > 1 && s->ts_Hint.pos > 0 && s->ts_Hint.pos <= p0)
+		{
+			pos = s->ts_Hint.pos;
+			offs = s->ts_Hint.utf8pos[0];
+		}
+		for (; pos < p0; ++pos)
+		{
+			do offs++;
+			while (offs < len && (buf[offs] & 0xc0) == 0x80);
+		}
+		lin->buf = buf;
+		lin->len = len;
+		lin->offs = offs;
+		lin->temp = TNULL;
+		return;
+	}
+#endif /* defined(COMPACTION) */
+
+	sn = tek_string_getnode(L, s, p0, &pos);
+	assert(sn);
+	len = 0;
+	i = p0 - pos;
+	for (node = &sn->tsn_Node; (next = node->tln_Succ); node = next, i = 0)
+	{
+		tek_node *n = (tek_node *) node;
+		for (; i < n->tsn_Length; ++i)
+			len += utf8encode(utf8buf, n->tsn_Data[i].cdata[0]) - utf8buf;
+	}
+	
+	p = tek_string_alloc(len);
+	if (p == NULL) luaL_error(L, "out of memory");
+	lin->buf = lin->temp = p;
+	lin->len = len;
+	lin->offs = 0;
+	
+	i = p0 - pos;
+	for (node = &sn->tsn_Node; (next = node->tln_Succ); node = next, i = 0)
+	{
+		tek_node *n = (tek_node *) node;
+		for (; i < n->tsn_Length; ++i)
+			p = utf8encode(p, n->tsn_Data[i].cdata[0]);
+	}
+	assert(p - lin->temp == len);
+}
+
+/*
+**	Boyer-Moore-Horspool search, returns the byte offset of the first
+**	occurrence of the needle in the haystack, or -1
+*/
+
+static tek_size tek_string_search(const unsigned char *hs, tek_size hlen,
+	const unsigned char *nd, tek_size nlen, const tek_size *skip)
+{
+	tek_size last = nlen - 1;
+	tek_size i = 0;
+	if (nlen == 1)
+	{
+		const unsigned char *m = memchr(hs, nd[0], hlen);
+		return m ? m - hs : -1;
+	}
+	while (i + nlen <= hlen)
+	{
+		unsigned char c = hs[i + last];
+		if (c == nd[last] && memcmp(hs + i, nd, last) == 0)
+			return i;
+		i += skip[c];
+	}
+	return -1;
+}
+
+/*
+**	Search the UTF-8 string in arg 2 from the position in arg 3. UTF-8 is
+**	self-synchronizing, so a bytewise match can only begin at a character
+**	boundary; byte offsets are mapped back to positions by counting lead
+**	bytes. Pushes the positions of the first occurrence, or of all
+**	non-overlapping occurrences in a table, returns the number of results.
+*/
+
+static int tek_string_dofind(lua_State *L, int all)
 {
 	tek_string *s = luaL_checkudata(L, 1, TEK_LIB_STRING_NAME "*");
 	size_t rawlen;
-	tek_size slen;
-	tek_char *sbuf;
 	const unsigned char *raws = 
 		(const unsigned char *) luaL_checklstring(L, 2, &rawlen);
 	tek_size p0 = luaL_optinteger(L, 3, 1);
-	struct utf8reader rd;
-	tek_size rdlen = 0;
-	int j = 1;
-	int ss = 0;
-	int i;
+	tek_size nlen = rawlen;
+	tek_size skip[256];
+	tek_linear lin;
+	tek_size slen, b, cp, i;
+	tek_size hb = -1, hcp = 0;
+	int n = 0;
 	
-	if (!getfirst(s->ts_Length, &p0, 1, s->ts_Length))
-		return 0;
+	if (all)
+		lua_newtable(L);
+	
+	if (s->ts_Length == 0 || !getfirst(s->ts_Length, &p0, 1, s->ts_Length))
+		return all;
 
 	slen = utf8getlen(raws, rawlen);
-	if (slen == 0) return 0;
-	sbuf = tek_string_alloc(slen * sizeof(tek_char));
-	if (sbuf == NULL) luaL_error(L, "out of memory");
-
-
-	utf8initreader(&rd, raws, rawlen);
-	for (i = p0; i <= s->ts_Length; ++i)
+	if (slen == 0) return all;
+	
+	for (i = 0; i < 256; ++i)
+		skip[i] = nlen;
+	for (i = 0; i < nlen - 1; ++i)
+		skip[raws[i]] = nlen - 1 - i;
+
+	tek_string_linearize(L, s, p0, &lin);
+	b = lin.offs;
+	cp = p0;
+	for (;;)
 	{
-		tek_char c = tek_string_getval_int(L, s, i, TNULL);
-		assert(c >= 0);
-		if (rdlen < j)
-		{
-			sbuf[j-1] = utf8read(&rd);
-			assert(sbuf[j - 1]);
-			rdlen++;
-		}
-redo:	
-		if (c == sbuf[j - 1])
+		tek_size e, m = tek_string_search(lin.buf + b, lin.len - b, raws, 
+			nlen, skip);
+		if (m < 0)
+			break;
+		for (e = b + m; b < e; ++b)
 		{
-			if (j == 1)
-				ss = i;
-			if (j == slen)
-			{
-				lua_pushinteger(L, ss);
-				lua_pushinteger(L, ss + j - 1);
-				tek_string_free(sbuf, slen * sizeof(tek_char));
-				return 2;
-			}
-			j++;
+			if ((lin.buf[b] & 0xc0) != 0x80)
+				cp++;
 		}
-		else
+		hb = b;
+		hcp = cp;
+		if (!all)
 		{
-			if (j > 1)
-			{
-				j = 1;
-				goto redo;
-			}
-			j = 1;
+			lua_pushinteger(L, cp);
+			lua_pushinteger(L, cp + slen - 1);
+			n = 2;
+			break;
 		}
+		lua_pushinteger(L, cp);
+		lua_rawseti(L, -2, ++n);
+		lua_pushinteger(L, cp + slen - 1);
+		lua_rawseti(L, -2, ++n);
+		b += nlen;
+		cp += slen;
 	}
 	
-	tek_string_free(sbuf, slen * sizeof(tek_char));
+	if (lin.temp)
+		tek_string_free(lin.temp, lin.len);
+#if defined(COMPACTION)
+	else if (hb >= 0 && hcp > 1 && !s->ts_UTF8[1])
+	{
+		/* hint at the last match; offsets in metadata are unknown */
+		s->ts_Hint.pos = hcp;
+		s->ts_Hint.utf8pos[0] = hb;
+	}
+#endif
+	
+	return all ? 1 : n;
+}
 
-	return 0;
+/*-----------------------------------------------------------------------------
+--	p0, p1 = String:find(utf8[, pos]): Finds the specified UTF-8 encoded
+--	string in the string object, and if found, returns the first and last
+--	position of its next occurrence from the starting position
+--	(default: {{1}}).
+-----------------------------------------------------------------------------*/
+
+static int tek_string_find(lua_State *L)
+{
+	return tek_string_dofind(L, 0);
+}
+
+/*-----------------------------------------------------------------------------
+--	table = String:findall(utf8[, pos]): Finds all non-overlapping
+--	occurrences of the specified UTF-8 encoded string in the string object
+--	from the starting position (default: {{1}}), and returns a table
+--	containing their first and last positions in succession, i.e. the first
+--	occurrence is at {{table[1]}} to {{table[2]}}, the second at
+--	{{table[3]}} to {{table[4]}}, etc.
+-----------------------------------------------------------------------------*/
+
+static int tek_string_findall(lua_State *L)
+{
+	return tek_string_dofind(L, 1);
 }
 
 /*-----------------------------------------------------------------------------
@@ -1536,6 +1675,8 @@ static int tek_string_foreachchar(lua_State *L)
 /*
 **	text:gettextwidth(tabsize, p0, p1, fixedwidth_or_func[, arg, blankwidth])
 **	func(arg, text, p0, p1): gets raw text width for a range of characters 
+**	text:gettextwidth(tabsize, p0, p1, font[, positions[, blankwidth]])
+**	measures all runs natively, see tek_string_gettextwidth_font()
 */
 
 static int tek_string_getrawwidth_int(lua_State *L, int p0, int p1, int fixedfwidth)
@@ -1553,6 +1694,139 @@ static int tek_string_getrawwidth_int(lua_State *L, int p0, int p1, int fixedfwi
 	return res;
 }
 
+/*
+**	Native path: The characters from p0 to p1 are copied to a linear buffer,
+**	and all runs between tabulators (plus a blank, if no blankwidth is given)
+**	are measured with a single display request through the font's native
+**	interface. If a table is passed in positions, it receives the cumulative
+**	x positions following each character, for hit-testing; in this case,
+**	each character is measured as a run of its own, and the advances are
+**	summed up. The buffer is terminated, as some drivers rely on it. Tab
+**	stops are counted from the start of the text, also if p0 is past it.
+*/
+
+static int tek_string_gettextwidth_font(lua_State *L, tek_string *s,
+	int tabsize, tek_size p0, tek_size p1)
+{
+	struct TEKUIFontAPI *api;
+	TAPTR font = lua_touserdata(L, 5);
+	int havepos = lua_type(L, 6) == LUA_TTABLE;
+	int fwidth = luaL_optinteger(L, 7, -1);
+	tek_size nc = p1 - p0 + 1;
+	tek_size len, size, a, b, e, seg, segstart, offs = 0;
+	tek_linear lin;
+	TINT *runs, *widths;
+	unsigned char *buf;
+	int numruns = 0, ntabs = 0, r = 0;
+	int x = 0, segx = 0;
+	
+	if (!lua_getmetatable(L, 5))
+		luaL_argerror(L, 5, "font expected");
+	lua_getfield(L, -1, TEKUI_FONTAPI);
+	api = lua_touserdata(L, -1);
+	lua_pop(L, 2);
+	if (api == TNULL)
+		luaL_argerror(L, 5, "font expected");
+	
+	/* find the start of the tab segment containing p0: */
+	tek_string_linearize(L, s, 1, &lin);
+	for (b = lin.offs, segstart = a = 1; a <= p1; ++a)
+	{
+		if (a == p0)
+			offs = b;
+		if (a < p0 && lin.buf[b] == 9)
+			segstart = a + 1;
+		do b++;
+		while (b < lin.len && (lin.buf[b] & 0xc0) == 0x80);
+	}
+	len = b - offs;
+	
+	/* runs, widths, text, a trailing blank and a terminator: */
+	size = (nc + 1) * 3 * sizeof(TINT) + len + 2;
+	runs = tek_string_alloc(size);
+	if (runs == TNULL)
+	{
+		if (lin.temp)
+			tek_string_free(lin.temp, lin.len);
+		luaL_error(L, "out of memory");
+	}
+	widths = runs + (nc + 1) * 2;
+	buf = (unsigned char *) (widths + nc + 1);
+	memcpy(buf, lin.buf + offs, len);
+	buf[len] = ' ';
+	buf[len + 1] = 0;
+	if (lin.temp)
+		tek_string_free(lin.temp, lin.len);
+	
+	/* collect runs: */
+	for (seg = b = 0, a = p0; a <= p1; ++a, b = e)
+	{
+		e = b;
+		do e++;
+		while (e < len && (buf[e] & 0xc0) == 0x80);
+		if (buf[b] == 9)
+		{
+			if (!havepos && b > seg)
+			{
+				runs[numruns * 2] = seg;
+				runs[numruns++ * 2 + 1] = b - seg;
+			}
+			ntabs++;
+			seg = e;
+		}
+		else if (havepos)
+		{
+			runs[numruns * 2] = b;
+			runs[numruns++ * 2 + 1] = e - b;
+		}
+	}
+	if (!havepos && b > seg)
+	{
+		runs[numruns * 2] = seg;
+		runs[numruns++ * 2 + 1] = b - seg;
+	}
+	if (ntabs > 0 && fwidth < 0)
+	{
+		runs[numruns * 2] = len;
+		runs[numruns++ * 2 + 1] = 1;
+	}
+	
+	memset(widths, 0, numruns * sizeof(TINT));
+	(*api->textsizes)(font, (TSTRPTR) buf, runs, widths, numruns);
+	if (ntabs > 0 && fwidth < 0)
+		fwidth = widths[numruns - 1];
+	
+	/* accumulate: */
+	for (seg = b = 0, a = p0; a <= p1; ++a, b = e)
+	{
+		e = b;
+		do e++;
+		while (e < len && (buf[e] & 0xc0) == 0x80);
+		if (buf[b] == 9)
+		{
+			if (!havepos && b > seg)
+				x = segx + widths[r++];
+			x += (tabsize - ((a - segstart) % tabsize)) * fwidth;
+			segx = x;
+			segstart = a + 1;
+			seg = e;
+		}
+		else if (havepos)
+			x += widths[r++];
+		if (havepos)
+		{
+			lua_pushinteger(L, x);
+			lua_rawseti(L, 6, a - p0 + 1);
+		}
+	}
+	if (!havepos && b > seg)
+		x = segx + widths[r++];
+	
+	tek_string_free(runs, size);
+	lua_pushinteger(L, x);
+	return 1;
+}
+
 static int tek_string_gettextwidth(lua_State *L)
 {
 	tek_string *s = luaL_checkudata(L, 1, TEK_LIB_STRING_NAME "*");
@@ -1562,6 +1836,21 @@ static int tek_string_gettextwidth(lua_State *L)
 	int fixedfwidth = -1; /* fixed character width */
 	int fwidth = -1; /* width of a blank character */
 	
+	if (lua_type(L, 5) == LUA_TUSERDATA)
+	{
+		tek_size len = s->ts_Length;
+		if (p1 < 0)
+			p1 += len + 1;
+		p0 = TMAX(p0, 1);
+		p1 = TMIN(p1, len);
+		if (p1 < p0)
+		{
+			lua_pushinteger(L, 0);
+			return 1;
+		}
+		return tek_string_gettextwidth_font(L, s, tabsize, p0, p1);
+	}
+	
 	if (lua_type(L, 5) != LUA_TFUNCTION)
 	{
 		fixedfwidth = luaL_checkinteger(L, 5);
@@ -1684,6 +1973,7 @@ static const luaL_Reg tek_string_methods[] =
 	{ "getval", tek_string_getval },
 	{ "getchar", tek_string_getchar },
 	{ "find", tek_string_find },
+	{ "findall", tek_string_findall },
 	{ "setmetadata", tek_string_setmetadata },
 
 	{ "attachdata", tek_string_attachdata },
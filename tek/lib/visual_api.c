@@ -7,17 +7,18 @@
 --	FUNCTIONS::
 --		- Visual:allocPen() - Obtain a colored pen
 --		- Visual:blitRect() - Move rectangular area
+--		- Visual:blitRegions() - Move a batch of regions
 --		- Visual:clearInput() - Remove input sources
 --		- Visual.close() - Close a visual
 --		- Visual.closeFont() - Close font
 --		- Visual.createGradient() - Create gradient
---		- Visual.createPixmap() - Create pixmap from file or table
+--		- Visual.createPixmap() - Create pixmap from file, table or size
 --		- Visual:drawImage() - Draw simple vector image
 --		- Visual:drawLine() - Draw line
 --		- Visual:drawPixmap() - Draw pixmap
 --		- Visual:drawPoint() - Draw pixel
 --		- Visual:drawRect() - Draw rectangle
---		- Visual:drawRGB() - Draw table as RGB
+--		- Visual:drawRGB() - Draw table or pixmap as RGB
 --		- Visual:drawText() - Draw text
 --		- Visual:fillRect() - Fill rectangle
 --		- Visual:flush() - Flush changes to display
@@ -33,8 +34,9 @@
 --		- Visual:getUserdata() - Get a visual's userdata
 --		- Visual.open() - Open a visual
 --		- Visual.openFont() - Open a font
---		- Visual:popClipRect() - Pop rectangle from stack of clip rects
+--		- Visual:popClipRect() - Pop rectangle or region from clip stack
 --		- Visual:pushClipRect() - Push rectangle on stack of clip rects
+--		- Visual:pushClipRegion() - Push region on stack of clip rects
 --		- Visual:setAttrs() - Set attributes in visual
 --		- Visual:setBGPen() - Set visual's background pen, pixmap or gradient
 --		- Visual:setClipRect() - Set clipping rectangle
@@ -47,6 +49,7 @@
 --		- Visual.sleep() - Wait for number of milliseconds
 --		- Visual:textSize() - Get size of text when rendered with current font
 --		- Visual:unsetClipRect() - Unset clipping rectangle
+--		- Visual:updatePixmap() - Draw modified rows of a pixmap
 --		- Visual.wait() - Wait for any event from any window
 --	
 -------------------------------------------------------------------------------
@@ -57,11 +60,24 @@ local Visual = _M
 
 -----------------------------------------------------------------------------*/
 
+#include <stdlib.h>
 #include <string.h>
 #include "visual_lua.h"
 #include <tek/lib/pixconv.h>
 #include <tek/lib/imgload.h>
 #include <tek/lib/tek_lua.h>
+#include <tek/mod/exec.h>
+#include <tek/proto/hal.h>
+
+#if defined(ENABLE_GRADIENT)
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define GRADIENT_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define GRADIENT_NEON
+#endif
+#endif
 
 /*****************************************************************************/
 /*
@@ -205,7 +221,9 @@ static int getbgpaint(lua_State *L, TEKVisual *vis, int uidx,
 }
 
 /*-----------------------------------------------------------------------------
---	Visual.wait(): Suspends the caller waiting for any event from any window.
+--	Visual.wait([ms]): Suspends the caller waiting for any event from any
+--	window. If a number of 1/1000th seconds is specified, the wait is
+--	aborted after this time has elapsed.
 -----------------------------------------------------------------------------*/
 
 LOCAL LUACFUNC TINT
@@ -213,11 +231,22 @@ tek_lib_visual_wait(lua_State *L)
 {
 	TEKVisual *vis;
 	struct TExecBase *TExecBase;
+	TUINT sigs;
 	lua_getfield(L, LUA_REGISTRYINDEX, TEK_LIB_VISUAL_BASECLASSNAME);
 	vis = lua_touserdata(L, -1);
 	TExecBase = vis->vis_ExecBase;
-	vis->vis_SignalsPending |= TWait(TGetPortSignal(vis->vis_IMsgPort) | 
-		TTASK_SIG_ABORT | TTASK_SIG_TERM | TTASK_SIG_CHLD);
+	sigs = TGetPortSignal(vis->vis_IMsgPort) |
+		TTASK_SIG_ABORT | TTASK_SIG_TERM | TTASK_SIG_CHLD;
+	if (lua_isnumber(L, 1))
+	{
+		TTIME dt;
+		dt.tdt_Int64 = lua_tonumber(L, 1) * 1000;
+		sigs = dt.tdt_Int64 > 0 ? TWaitTime(&dt, sigs) :
+			TSetSignal(0, sigs) & sigs;
+	}
+	else
+		sigs = TWait(sigs);
+	vis->vis_SignalsPending |= sigs;
 	if (vis->vis_SignalsPending & TTASK_SIG_ABORT)
 		luaL_error(L, "received abort signal");
 	lua_pop(L, 1);
@@ -516,6 +545,9 @@ typedef struct
 	struct TExecBase *execbase;
 	TIMSG *imsg;
 	int numfields;
+	/* Damaged rectangles of a refresh message, x0, y0, x1, y1 each: */
+	TINT *rects;
+	int numrects;
 } tek_msg;
 
 LOCAL LUACFUNC TINT tek_msg_reply(lua_State *L)
@@ -548,6 +580,8 @@ LOCAL LUACFUNC TINT tek_msg_reply(lua_State *L)
 		}
 		TReplyMsg(msg->imsg);
 		msg->imsg = NULL;
+		TFree(msg->rects);
+		msg->rects = TNULL;
 	}
 	return 0;
 }
@@ -659,6 +693,32 @@ LOCAL LUACFUNC TINT tek_msg_index(lua_State *L)
 		case 12:
 			lua_pushinteger(L, imsg->timsg_ScreenMouseY);
 			break;
+		case 13:
+			if (imsg->timsg_Type != TITYPE_REFRESH)
+				lua_pushnil(L);
+			else if (msg->rects)
+			{
+				int i;
+				lua_createtable(L, msg->numrects * 4, 0);
+				for (i = 0; i < msg->numrects * 4; ++i)
+				{
+					lua_pushinteger(L, msg->rects[i]);
+					lua_rawseti(L, -2, i + 1);
+				}
+			}
+			else
+			{
+				lua_createtable(L, 4, 0);
+				lua_pushinteger(L, imsg->timsg_X);
+				lua_rawseti(L, -2, 1);
+				lua_pushinteger(L, imsg->timsg_Y);
+				lua_rawseti(L, -2, 2);
+				lua_pushinteger(L, imsg->timsg_X + imsg->timsg_Width - 1);
+				lua_rawseti(L, -2, 3);
+				lua_pushinteger(L, imsg->timsg_Y + imsg->timsg_Height - 1);
+				lua_rawseti(L, -2, 4);
+			}
+			break;
 	}
 	return 1;
 }
@@ -695,6 +755,15 @@ LOCAL LUACFUNC TINT tek_msg_index(lua_State *L)
 --		- {{10}} - Refresh message: Height of damaged area
 --		- {{11}} - Mouse X position on screen
 --		- {{12}} - Mouse Y position on screen
+--		- {{13}} - Refresh message: Table of damaged rectangles, in
+--		sequences of {{x0}}, {{y0}}, {{x1}}, {{y1}}
+--	Input messages are coalesced before they are returned: Mouse movements
+--	and interval messages are skipped if a more recent message of the same
+--	type is pending for the same window (for mouse movements, only if no
+--	other message for the window is queued in between), and all refresh
+--	messages pending for a window are merged into a single message. Fields
+--	{{7}} to {{10}} of a merged refresh message contain the bounding box
+--	of the damaged region, and field {{13}} its exact list of rectangles.
 --	A message will be acknowledged implicitely by garbage collection, or
 --	by invoking the {{msg:reply([table])}} method on it, in which case extra
 --	data can be returned to the sender. Valid fields in {{table}} are:
@@ -722,6 +791,136 @@ static TIMSG *tek_lib_visual_getsigmsg(TEKVisual *vis, TUINT sig)
 	return imsg;
 }
 
+/*
+**	superseded = tek_lib_visual_superseded(vis, imsg): Checks if a mouse
+**	movement or interval message is superseded by a message of the same
+**	type pending for the same window. For mouse movements, a message of
+**	another type for the same window queued in between is considered a
+**	barrier, to preserve the order of positions and button events.
+*/
+
+static TBOOL tek_lib_visual_superseded(TEKVisual *vis, TIMSG *imsg)
+{
+	struct TExecBase *TExecBase = vis->vis_ExecBase;
+	TAPTR hal = TExecBase->texb_HALBase;
+	struct TMsgPort *port = vis->vis_IMsgPort;
+	struct TNode *next, *node;
+	TBOOL superseded = TFALSE;
+	THALLock(hal, &port->tmp_Lock);
+	node = port->tmp_MsgList.tlh_Head.tln_Succ;
+	for (; !superseded && (next = node->tln_Succ); node = next)
+	{
+		TIMSG *m = TGETMSGBODY(node);
+		if (m->timsg_Instance != imsg->timsg_Instance)
+			continue;
+		if (m->timsg_Type == imsg->timsg_Type)
+			superseded = TTRUE;
+		else if (imsg->timsg_Type == TITYPE_MOUSEMOVE)
+			break;
+	}
+	THALUnlock(hal, &port->tmp_Lock);
+	return superseded;
+}
+
+/*
+**	tek_lib_visual_mergerefresh(vis, tmsg): Unlinks all refresh messages
+**	pending for the same window from the input port and merges their
+**	rectangles with that of the message being delivered into a region.
+**	The message's rectangle is updated to the region's bounding box, and
+**	the region's rectangles are placed in the tek_msg.
+*/
+
+static void tek_lib_visual_mergerefresh(TEKVisual *vis, tek_msg *tmsg)
+{
+	struct TExecBase *TExecBase = vis->vis_ExecBase;
+	TAPTR hal = TExecBase->texb_HALBase;
+	struct TMsgPort *port = vis->vis_IMsgPort;
+	TIMSG *imsg = tmsg->imsg;
+	struct TNode *next, *node;
+	struct TList merged;
+	struct RectPool pool;
+	struct Region region;
+	TINT r[4];
+	
+	TInitList(&merged);
+	THALLock(hal, &port->tmp_Lock);
+	node = port->tmp_MsgList.tlh_Head.tln_Succ;
+	for (; (next = node->tln_Succ); node = next)
+	{
+		TIMSG *m = TGETMSGBODY(node);
+		if (m->timsg_Type == TITYPE_REFRESH &&
+			m->timsg_Instance == imsg->timsg_Instance)
+		{
+			TRemove(node);
+			((struct TMessage *) node)->tmsg_Flags &= ~TMSGF_QUEUED;
+			TAddTail(&merged, node);
+		}
+	}
+	THALUnlock(hal, &port->tmp_Lock);
+	
+	if (TISLISTEMPTY(&merged))
+		return;
+	
+	region_initpool(&pool, TExecBase);
+	r[0] = imsg->timsg_X;
+	r[1] = imsg->timsg_Y;
+	r[2] = r[0] + imsg->timsg_Width - 1;
+	r[3] = r[1] + imsg->timsg_Height - 1;
+	if (region_init(&pool, &region, r))
+	{
+		TINT minmax[4];
+		while ((node = TRemHead(&merged)))
+		{
+			TIMSG *m = TGETMSGBODY(node);
+			r[0] = m->timsg_X;
+			r[1] = m->timsg_Y;
+			r[2] = r[0] + m->timsg_Width - 1;
+			r[3] = r[1] + m->timsg_Height - 1;
+			region_orrect(&pool, &region, r, TFALSE);
+			TReplyMsg(m);
+		}
+		if (region_getminmax(&pool, &region, minmax))
+		{
+			imsg->timsg_X = minmax[0];
+			imsg->timsg_Y = minmax[1];
+			imsg->timsg_Width = minmax[2] - minmax[0] + 1;
+			imsg->timsg_Height = minmax[3] - minmax[1] + 1;
+		}
+		tmsg->rects = TAlloc(TNULL,
+			sizeof(TINT) * 4 * region.rg_Rects.rl_NumNodes);
+		if (tmsg->rects)
+		{
+			TINT *p = tmsg->rects;
+			node = region.rg_Rects.rl_List.tlh_Head.tln_Succ;
+			for (; (next = node->tln_Succ); node = next)
+			{
+				struct RectNode *rn = (struct RectNode *) node;
+				*p++ = rn->rn_Rect[0];
+				*p++ = rn->rn_Rect[1];
+				*p++ = rn->rn_Rect[2];
+				*p++ = rn->rn_Rect[3];
+			}
+			tmsg->numrects = region.rg_Rects.rl_NumNodes;
+		}
+		region_free(&pool, &region);
+	}
+	/* not merged due to lack of memory, deliver as a bounding box: */
+	while ((node = TRemHead(&merged)))
+	{
+		TIMSG *m = TGETMSGBODY(node);
+		TINT x1 = TMAX(imsg->timsg_X + imsg->timsg_Width,
+			m->timsg_X + m->timsg_Width);
+		TINT y1 = TMAX(imsg->timsg_Y + imsg->timsg_Height,
+			m->timsg_Y + m->timsg_Height);
+		imsg->timsg_X = TMIN(imsg->timsg_X, m->timsg_X);
+		imsg->timsg_Y = TMIN(imsg->timsg_Y, m->timsg_Y);
+		imsg->timsg_Width = x1 - imsg->timsg_X;
+		imsg->timsg_Height = y1 - imsg->timsg_Y;
+		TReplyMsg(m);
+	}
+	region_destroypool(&pool);
+}
+
 LOCAL LUACFUNC TINT
 tek_lib_visual_getmsg(lua_State *L)
 {
@@ -735,10 +934,21 @@ tek_lib_visual_getmsg(lua_State *L)
 	vis = lua_touserdata(L, -1);
 	TExecBase = vis->vis_ExecBase;
 	
-	if (/*!(imsg = tek_lib_visual_getsigmsg(vis, TTASK_SIG_ABORT)) &&*/
-		!(imsg = tek_lib_visual_getsigmsg(vis, TTASK_SIG_CHLD)) &&
-		!(imsg = tek_lib_visual_getsigmsg(vis, TTASK_SIG_TERM)))
-		imsg = (TIMSG *) TGetMsg(vis->vis_IMsgPort);
+	for (;;)
+	{
+		if (/*!(imsg = tek_lib_visual_getsigmsg(vis, TTASK_SIG_ABORT)) &&*/
+			!(imsg = tek_lib_visual_getsigmsg(vis, TTASK_SIG_CHLD)) &&
+			!(imsg = tek_lib_visual_getsigmsg(vis, TTASK_SIG_TERM)))
+			imsg = (TIMSG *) TGetMsg(vis->vis_IMsgPort);
+		if (imsg && (imsg->timsg_Type == TITYPE_MOUSEMOVE ||
+			imsg->timsg_Type == TITYPE_INTERVAL) &&
+			tek_lib_visual_superseded(vis, imsg))
+		{
+			TReplyMsg(imsg);
+			continue;
+		}
+		break;
+	}
 
 	if (imsg == TNULL)
 	{
@@ -747,13 +957,18 @@ tek_lib_visual_getmsg(lua_State *L)
 	}
 	tmsg = lua_newuserdata(L, sizeof(tek_msg));
 	tmsg->execbase = TExecBase;
+	tmsg->rects = TNULL;
+	tmsg->numrects = 0;
 	lua_getfield(L, LUA_REGISTRYINDEX, "tek_msg*");
 	lua_setmetatable(L, -2);
 	/* s: tekmsg */
 	tmsg->imsg = imsg;
 	tmsg->numfields = 8;
 	if (imsg->timsg_Type == TITYPE_REFRESH)
-		tmsg->numfields += 4;
+	{
+		tek_lib_visual_mergerefresh(vis, tmsg);
+		tmsg->numfields += 5;
+	}
 	else if (imsg->timsg_Type == TITYPE_KEYUP ||
 		imsg->timsg_Type == TITYPE_KEYDOWN)
 		tmsg->numfields++;
@@ -762,6 +977,110 @@ tek_lib_visual_getmsg(lua_State *L)
 
 /*****************************************************************************/
 
+/*
+**	A pixmap that is drawn repeatedly without being modified is copied to
+**	the display, which keeps it in its own pixel format, so that it need
+**	not be converted each time it is drawn. The copy is made on the second
+**	draw, and discarded when the pixmap is modified. If the display does
+**	not support this, the pixmap is drawn from its buffer.
+*/
+
+static void tek_lib_visual_freenativepixmap(TEKPixmap *pm)
+{
+	TEKVisual *base = pm->pxm_VisualBase;
+	if (pm->pxm_Native && base->vis_Base)
+		TVisualFreePixmap(base->vis_Base, pm->pxm_Native);
+	pm->pxm_Native = TNULL;
+}
+
+static TAPTR tek_lib_visual_getnativepixmap(TEKPixmap *pm)
+{
+	TEKVisual *base = pm->pxm_VisualBase;
+	if (pm->pxm_Native == TNULL && pm->pxm_NumDraws >= 0 &&
+		++pm->pxm_NumDraws >= 2 && base->vis_Base)
+	{
+		TTAGITEM tags[3];
+		tags[0].tti_Tag = TVisual_Display;
+		tags[0].tti_Value = (TTAG) base->vis_Display;
+		tags[1].tti_Tag = TVisual_AlphaChannel;
+		tags[1].tti_Value = pm->pxm_Flags & IMLFL_HAS_ALPHA;
+		tags[2].tti_Tag = TTAG_DONE;
+		pm->pxm_Native = TVisualCreatePixmap(base->vis_Base,
+			pm->pxm_Image.tpb_Data, pm->pxm_Width, pm->pxm_Height,
+			pm->pxm_Width, tags);
+		if (pm->pxm_Native == TNULL)
+			pm->pxm_NumDraws = -1;
+	}
+	return pm->pxm_Native;
+}
+
+/*
+**	Rows of a pixmap are tracked as modified until the pixmap is drawn
+**	as a whole with Visual:drawPixmap() or Visual:updatePixmap(). An empty
+**	range (y0 > y1) indicates that the pixmap is up to date.
+*/
+
+static void tek_lib_visual_touchpixmap(TEKPixmap *pm, TINT y0, TINT y1)
+{
+	if (y0 < pm->pxm_DirtyY0)
+		pm->pxm_DirtyY0 = y0;
+	if (y1 > pm->pxm_DirtyY1)
+		pm->pxm_DirtyY1 = y1;
+	tek_lib_visual_freenativepixmap(pm);
+	if (pm->pxm_NumDraws > 0)
+		pm->pxm_NumDraws = 0;
+}
+
+static void tek_lib_visual_cleanpixmap(TEKPixmap *pm)
+{
+	pm->pxm_DirtyY0 = pm->pxm_Height;
+	pm->pxm_DirtyY1 = -1;
+}
+
+static TBOOL tek_lib_visual_clippixmap(TEKPixmap *pm, TINT *r)
+{
+	if (r[0] < 0)
+		r[0] = 0;
+	if (r[1] < 0)
+		r[1] = 0;
+	if (r[2] >= pm->pxm_Width)
+		r[2] = pm->pxm_Width - 1;
+	if (r[3] >= pm->pxm_Height)
+		r[3] = pm->pxm_Height - 1;
+	return r[0] <= r[2] && r[1] <= r[3];
+}
+
+/*
+**	Create a pixmap userdata with an uninitialized A8R8G8B8 buffer:
+*/
+
+static TEKPixmap *tek_lib_visual_newpixmap(lua_State *L, TEKVisual *vis,
+	TINT w, TINT h, TBOOL has_alpha)
+{
+	struct TExecBase *TExecBase = vis->vis_ExecBase;
+	TEKPixmap *pm = lua_newuserdata(L, sizeof(TEKPixmap));
+	pm->pxm_Image.tpb_Data = TNULL;
+	luaL_newmetatable(L, TEK_LIB_VISUALPIXMAP_CLASSNAME);
+	lua_setmetatable(L, -2);
+	pm->pxm_Image.tpb_Data = TAlloc(TNULL, w * h * sizeof(TUINT));
+	if (pm->pxm_Image.tpb_Data == TNULL)
+	{
+		lua_pushstring(L, "out of memory");
+		lua_error(L);
+	}
+	pm->pxm_Image.tpb_Format = TVPIXFMT_A8R8G8B8;
+	pm->pxm_Image.tpb_BytesPerLine = w * 4;
+	pm->pxm_Width = w;
+	pm->pxm_Height = h;
+	pm->pxm_Flags = has_alpha ? IMLFL_HAS_ALPHA : 0;
+	pm->pxm_VisualBase = vis;
+	pm->pxm_DirtyY0 = 0;
+	pm->pxm_DirtyY1 = h - 1;
+	pm->pxm_Native = TNULL;
+	pm->pxm_NumDraws = 0;
+	return pm;
+}
+
 static TINT tek_lib_visual_createpixmap_from_img(lua_State *L)
 {
 	lua_getfield(L, LUA_REGISTRYINDEX, TEK_LIB_VISUAL_BASECLASSNAME);
@@ -771,10 +1090,13 @@ static TINT tek_lib_visual_createpixmap_from_img(lua_State *L)
 	struct ImgLoader ld;
 	size_t len;
 	const char *src = lua_tolstring(L, 1, &len);
+	TINT w = luaL_optinteger(L, 2, 0);
+	TINT h = luaL_optinteger(L, 3, 0);
+	if (w < 0 || h < 0)
+		luaL_argerror(L, w < 0 ? 2 : 3, "Invalid size");
 	if (src)
 	{
-		if (!(imgload_init_memory(&ld, TExecBase, src, len) &&
-			imgload_load(&ld)))
+		if (!imgload_init_memory(&ld, TExecBase, src, len))
 			return 0;
 	}
 	else
@@ -782,10 +1104,14 @@ static TINT tek_lib_visual_createpixmap_from_img(lua_State *L)
 		FILE **f = luaL_checkudata(L, 1, LUA_FILEHANDLE);
 		if (*f == NULL)
 			luaL_error(L, "attempt to use a closed file");
-		if (!(imgload_init_file(&ld, TExecBase, *f) &&
-			imgload_load(&ld)))
+		if (!imgload_init_file(&ld, TExecBase, *f))
 			return 0;
 	}
+	/* the image is scaled while being decoded: */
+	ld.iml_ReqWidth = w;
+	ld.iml_ReqHeight = h;
+	if (!imgload_load(&ld))
+		return 0;
 	
 	TEKPixmap *pm = lua_newuserdata(L, sizeof(TEKPixmap));
 	luaL_newmetatable(L, TEK_LIB_VISUALPIXMAP_CLASSNAME);
@@ -793,7 +1119,6 @@ static TINT tek_lib_visual_createpixmap_from_img(lua_State *L)
 	pm->pxm_Image = ld.iml_Image;
 	pm->pxm_Width = ld.iml_Width;
 	pm->pxm_Height = ld.iml_Height;
-	pm->pxm_Flags = ld.iml_Flags;
 	if (lua_isboolean(L, 4))
 	{
 		if (lua_toboolean(L, 4))
@@ -801,7 +1126,12 @@ static TINT tek_lib_visual_createpixmap_from_img(lua_State *L)
 		else
 			ld.iml_Flags &= ~IMLFL_HAS_ALPHA;
 	}
+	pm->pxm_Flags = ld.iml_Flags;
 	pm->pxm_VisualBase = vis;
+	pm->pxm_DirtyY0 = 0;
+	pm->pxm_DirtyY1 = pm->pxm_Height - 1;
+	pm->pxm_Native = TNULL;
+	pm->pxm_NumDraws = 0;
 	
 	lua_pushinteger(L, pm->pxm_Width);
 	lua_pushinteger(L, pm->pxm_Height);
@@ -813,9 +1143,7 @@ static TINT
 tek_lib_visual_createpixmap_from_table(lua_State *L)
 {
 	TEKVisual *vis;
-	struct TExecBase *TExecBase;
 	TUINT *buf;
-	TEKPixmap *bm;
 	int x, y;
 	
 	int tw = luaL_checkinteger(L, 2);
@@ -827,27 +1155,9 @@ tek_lib_visual_createpixmap_from_table(lua_State *L)
 	lua_getfield(L, LUA_REGISTRYINDEX, TEK_LIB_VISUAL_BASECLASSNAME);
 	vis = lua_touserdata(L, -1);
 	lua_pop(L, 1);
-	TExecBase = vis->vis_ExecBase;
-	
-	bm = lua_newuserdata(L, sizeof(TEKPixmap));
-	luaL_newmetatable(L, TEK_LIB_VISUALPIXMAP_CLASSNAME);
-	lua_setmetatable(L, -2);
-	
-	buf = TAlloc(TNULL, tw * th * sizeof(TUINT));
-	if (buf == TNULL)
-	{
-		lua_pushstring(L, "out of memory");
-		lua_error(L);
-	}
-
-	bm->pxm_Image.tpb_Data = (TUINT8 *) buf;
-	bm->pxm_Image.tpb_Format = TVPIXFMT_A8R8G8B8;
-	bm->pxm_Image.tpb_BytesPerLine = tw * 4;
 	
-	bm->pxm_Width = tw;
-	bm->pxm_Height = th;
-	bm->pxm_Flags = has_alpha ? IMLFL_HAS_ALPHA : 0;
-	bm->pxm_VisualBase = vis;
+	buf = (TUINT *) tek_lib_visual_newpixmap(L, vis, tw, th,
+		has_alpha)->pxm_Image.tpb_Data;
 	
 	for (y = 0; y < th; ++y)
 	{
@@ -862,18 +1172,48 @@ tek_lib_visual_createpixmap_from_table(lua_State *L)
 	return 1;
 }
 
+static TINT
+tek_lib_visual_createpixmap_empty(lua_State *L)
+{
+	TEKVisual *vis;
+	struct TExecBase *TExecBase;
+	TEKPixmap *pm;
+	TINT w = luaL_checkinteger(L, 1);
+	TINT h = luaL_checkinteger(L, 2);
+	TBOOL has_alpha = lua_toboolean(L, 3);
+	if (w < 1 || h < 1)
+		luaL_argerror(L, w < 1 ? 1 : 2, "Invalid size");
+	lua_getfield(L, LUA_REGISTRYINDEX, TEK_LIB_VISUAL_BASECLASSNAME);
+	vis = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	TExecBase = vis->vis_ExecBase;
+	pm = tek_lib_visual_newpixmap(L, vis, w, h, has_alpha);
+	TFillMem(pm->pxm_Image.tpb_Data, w * h * sizeof(TUINT), 0);
+	return 1;
+}
+
 /*-----------------------------------------------------------------------------
 --	pixmap = Visual.createPixmap(src[, width[, height[, alpha[, idx]]]]):
 --	Creates a pixmap object from some source. The {{src}} argument can be a
 --	string, containing a loaded image in some file format (PPM or PNG), an open
 --	file, or a table. In case of a string or a file, width and height determine
 --	an optional size to scale the image to. If only one of width and height are
---	given, the image is scaled proprtionally. In case of a table, the width and
+--	given, the image is scaled proportionally. Scaling takes place while the
+--	image is being decoded, using area averaging for reductions and bilinear
+--	filtering for enlargements. In case of a table, the width and
 --	height arguments are mandatory, and the table is expected to contain RGB
 --	values starting at table index {{0}}, unless another index is given.
 --	The {{alpha}} argument can be used to override presence or absence of an
 --	alpha channel; the default is determined by the picture, or none in the
 --	case of a table source.
+--
+--	pixmap = Visual.createPixmap(width, height[, alpha]): Creates an empty
+--	pixmap of the given size, with all pixels initialized to {{0}}. Pixmaps
+--	are backed by a plain array of ARGB values, which can be accessed and
+--	modified in place using the methods pixmap:getPixel(),
+--	pixmap:setPixel(), pixmap:fill(), pixmap:blit() and
+--	pixmap:fromString(), and be drawn directly using Visual:drawPixmap(),
+--	Visual:updatePixmap() and Visual:drawRGB().
 -----------------------------------------------------------------------------*/
 
 LOCAL LUACFUNC TINT
@@ -881,6 +1221,8 @@ tek_lib_visual_createpixmap(lua_State *L)
 {
 	if (lua_istable(L, 1))
 		return tek_lib_visual_createpixmap_from_table(L);
+	if (lua_type(L, 1) == LUA_TNUMBER)
+		return tek_lib_visual_createpixmap_empty(L);
 	return tek_lib_visual_createpixmap_from_img(L);
 }
 
@@ -892,6 +1234,7 @@ tek_lib_visual_freepixmap(lua_State *L)
 	{
 		TEKVisual *vis = bm->pxm_VisualBase;
 		struct TExecBase *TExecBase = vis->vis_ExecBase;
+		tek_lib_visual_freenativepixmap(bm);
 		TFree(bm->pxm_Image.tpb_Data);
 		bm->pxm_Image.tpb_Data = TNULL;
 	}
@@ -945,7 +1288,119 @@ tek_lib_visual_setpixmap(lua_State *L)
 		if (y < 0 || y >= bm->pxm_Height)
 			luaL_argerror(L, 3, "Invalid position");
 		pixconv_setpixelbuf(&bm->pxm_Image, x, y, val);
+		tek_lib_visual_touchpixmap(bm, y, y);
+	}
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+--	pixmap:fill(x0, y0, x1, y1, rgb): Fills a rectangle in the pixmap with
+--	an RGB (or ARGB) value. The rectangle is clipped to the pixmap.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_fillpixmap(lua_State *L)
+{
+	TEKPixmap *pm = getpixmapptr(L, 1);
+	TINT r[4];
+	TUINT rgb = luaL_checkinteger(L, 6);
+	TINT y;
+	r[0] = luaL_checkinteger(L, 2);
+	r[1] = luaL_checkinteger(L, 3);
+	r[2] = luaL_checkinteger(L, 4);
+	r[3] = luaL_checkinteger(L, 5);
+	if (pm->pxm_Image.tpb_Data && tek_lib_visual_clippixmap(pm, r))
+	{
+		for (y = r[1]; y <= r[3]; ++y)
+			pixconv_buf_line_set(&pm->pxm_Image, r[0], y, r[2] - r[0] + 1,
+				rgb);
+		tek_lib_visual_touchpixmap(pm, r[1], r[3]);
+	}
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+--	pixmap:blit(src, x, y[, sx0, sy0, sx1, sy1]): Copies a rectangle from
+--	the pixmap {{src}} to the position {{x}}, {{y}} in the pixmap. The source
+--	rectangle defaults to the whole of {{src}}. The pixels are copied without
+--	blending, and both source and destination may be the same pixmap.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_blitpixmap(lua_State *L)
+{
+	TEKPixmap *dst = getpixmapptr(L, 1);
+	TEKPixmap *src = getpixmapptr(L, 2);
+	TINT dx = luaL_checkinteger(L, 3);
+	TINT dy = luaL_checkinteger(L, 4);
+	TINT r[4], ox, oy, w, y;
+	r[0] = luaL_optinteger(L, 5, 0);
+	r[1] = luaL_optinteger(L, 6, 0);
+	r[2] = luaL_optinteger(L, 7, src->pxm_Width - 1);
+	r[3] = luaL_optinteger(L, 8, src->pxm_Height - 1);
+	if (!dst->pxm_Image.tpb_Data || !src->pxm_Image.tpb_Data)
+		return 0;
+	ox = dx - r[0];
+	oy = dy - r[1];
+	if (!tek_lib_visual_clippixmap(src, r))
+		return 0;
+	r[0] += ox;
+	r[1] += oy;
+	r[2] += ox;
+	r[3] += oy;
+	if (!tek_lib_visual_clippixmap(dst, r))
+		return 0;
+	w = (r[2] - r[0] + 1) * sizeof(TUINT);
+	if (src == dst && oy > 0)
+	{
+		/* overlapping, copy bottom-up: */
+		for (y = r[3]; y >= r[1]; --y)
+			memmove(TVPB_GETADDRESS(&dst->pxm_Image, r[0], y),
+				TVPB_GETADDRESS(&src->pxm_Image, r[0] - ox, y - oy), w);
+	}
+	else
+	{
+		for (y = r[1]; y <= r[3]; ++y)
+			memmove(TVPB_GETADDRESS(&dst->pxm_Image, r[0], y),
+				TVPB_GETADDRESS(&src->pxm_Image, r[0] - ox, y - oy), w);
+	}
+	tek_lib_visual_touchpixmap(dst, r[1], r[3]);
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+--	pixmap:fromString(str[, x, y, w, h]): Bulk-loads pixels from a string
+--	into a rectangle of the pixmap. The string contains four bytes per
+--	pixel, in the order alpha, red, green, blue, and rows of {{w}} pixels
+--	each. The rectangle defaults to the whole pixmap, and must be fully
+--	contained in it.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_pixmapfromstring(lua_State *L)
+{
+	TEKPixmap *pm = getpixmapptr(L, 1);
+	size_t len;
+	const TUINT8 *s = (const TUINT8 *) luaL_checklstring(L, 2, &len);
+	TINT x0 = luaL_optinteger(L, 3, 0);
+	TINT y0 = luaL_optinteger(L, 4, 0);
+	TINT w = luaL_optinteger(L, 5, pm->pxm_Width - x0);
+	TINT h = luaL_optinteger(L, 6, pm->pxm_Height - y0);
+	TINT x, y;
+	if (pm->pxm_Image.tpb_Data == TNULL)
+		return 0;
+	if (x0 < 0 || y0 < 0 || w < 1 || h < 1 || x0 + w > pm->pxm_Width ||
+		y0 + h > pm->pxm_Height)
+		luaL_argerror(L, 3, "Invalid rectangle");
+	if (len < (size_t) w * h * 4)
+		luaL_argerror(L, 2, "String too short");
+	for (y = y0; y < y0 + h; ++y)
+	{
+		TUINT *p = (TUINT *) TVPB_GETADDRESS(&pm->pxm_Image, x0, y);
+		for (x = 0; x < w; ++x, s += 4)
+			p[x] = ((TUINT) s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3];
 	}
+	tek_lib_visual_touchpixmap(pm, y0, y0 + h - 1);
 	return 0;
 }
 
@@ -978,6 +1433,7 @@ tek_lib_visual_allocpen(lua_State *L)
 		(TUINT)(b);
 	pen->pen_Pen = TVisualAllocPen(vis->vis_Visual, rgb);
 	pen->pen_Visual = vis;
+	pen->pen_RGB = rgb;
 	return 1;
 }
 
@@ -1049,6 +1505,7 @@ tek_lib_visual_frectpixmap(lua_State *L, TEKVisual *vis, TEKPixmap *pm,
 	TINT tw = pm->pxm_Width;
 	TINT th = pm->pxm_Height;
 	TUINT *buf = (TUINT *) pm->pxm_Image.tpb_Data;
+	TAPTR native = tek_lib_visual_getnativepixmap(pm);
 	TINT th0, yo;
 	TINT y = y0;
 	TTAGITEM tags[2];
@@ -1092,8 +1549,12 @@ tek_lib_visual_frectpixmap(lua_State *L, TEKVisual *vis, TEKPixmap *pm,
 		while (ww > 0)
 		{
 			int dw = TMIN(ww, tw0);
-			TVisualDrawBuffer(vis->vis_Visual, x, y, 
-				buf + xo + yo * tw, dw, dh, tw, tags);
+			if (native)
+				TVisualDrawPixmap(vis->vis_Visual, native, x, y, dw, dh,
+					xo, yo, TNULL);
+			else
+				TVisualDrawBuffer(vis->vis_Visual, x, y, 
+					buf + xo + yo * tw, dw, dh, tw, tags);
 			ww -= dw;
 			x += dw;
 			tw0 = tw;
@@ -1109,50 +1570,155 @@ tek_lib_visual_frectpixmap(lua_State *L, TEKVisual *vis, TEKPixmap *pm,
 /*****************************************************************************/
 /*
 **	Gradient support
+**
+**	The gradient parameter t = ((x, y) - A) * (B - A) / |B - A|^2 is linear
+**	in x and y. For each row, the span of pixels with t between 0 and 1 is
+**	determined, and filled by incrementing the color channels in 16.16
+**	fixed point; pixels outside the span are filled with the solid end
+**	colors. Optionally, an ordered dither is applied, which adds a bias
+**	below one step of a 5-6-5 target format to each channel before the
+**	driver truncates it.
 */
 
 #if defined(ENABLE_GRADIENT)
 
-static float mulVec(vec a, vec b)
-{
-	return a.x * b.x + a.y * b.y;
-}
-
-static vec subVec(vec a, vec b)
+/* 4x4 Bayer matrix, levels 0..15: */
+static const TUINT8 gradient_bayer[4][4] =
 {
-	vec c;
-	c.x = a.x - b.x;
-	c.y = a.y - b.y;
-	return c;
-}
+	{  0,  8,  2, 10 },
+	{ 12,  4, 14,  6 },
+	{  3, 11,  1,  9 },
+	{ 15,  7, 13,  5 },
+};
 
-static vec addVec(vec a, vec b)
-{
-	vec c;
-	c.x = a.x + b.x;
-	c.y = a.y + b.y;
-	return c;
-}
+/*
+**	gradient_span(p, n, r, g, b, dr, dg, db, dith)
+**	Renders n pixels, starting with the channel values r, g, b and
+**	advancing by dr, dg, db per pixel, all in 16.16 fixed point. If dith is
+**	not TNULL, it points to four red/blue and four green biases, applied
+**	to successive pixels in turn.
+*/
 
-static vec scaleVec(vec a, float b)
-{
-	vec c;
-	c.x = a.x * b;
-	c.y = a.y * b;
-	return c;
+static void gradient_span(TUINT *p, TINT n, TINT r, TINT g, TINT b,
+	TINT dr, TINT dg, TINT db, const TINT *dith)
+{
+	TINT i = 0;
+#if defined(GRADIENT_SSE2)
+	__m128i vr = _mm_add_epi32(_mm_set1_epi32(r),
+		_mm_set_epi32(3 * dr, 2 * dr, dr, 0));
+	__m128i vg = _mm_add_epi32(_mm_set1_epi32(g),
+		_mm_set_epi32(3 * dg, 2 * dg, dg, 0));
+	__m128i vb = _mm_add_epi32(_mm_set1_epi32(b),
+		_mm_set_epi32(3 * db, 2 * db, db, 0));
+	__m128i sr = _mm_set1_epi32(4 * dr);
+	__m128i sg = _mm_set1_epi32(4 * dg);
+	__m128i sb = _mm_set1_epi32(4 * db);
+	__m128i mr = _mm_set1_epi32(0xff0000);
+	__m128i mg = _mm_set1_epi32(0xff00);
+	if (dith)
+	{
+		__m128i brb = _mm_loadu_si128((const __m128i *) dith);
+		__m128i bg = _mm_loadu_si128((const __m128i *) (dith + 4));
+		__m128i max = _mm_set1_epi32(0xffffff);
+		for (; i + 4 <= n; i += 4)
+		{
+			__m128i R = _mm_add_epi32(vr, brb);
+			__m128i G = _mm_add_epi32(vg, bg);
+			__m128i B = _mm_add_epi32(vb, brb);
+			__m128i c = _mm_cmpgt_epi32(R, max);
+			R = _mm_or_si128(_mm_and_si128(c, max), _mm_andnot_si128(c, R));
+			c = _mm_cmpgt_epi32(G, max);
+			G = _mm_or_si128(_mm_and_si128(c, max), _mm_andnot_si128(c, G));
+			c = _mm_cmpgt_epi32(B, max);
+			B = _mm_or_si128(_mm_and_si128(c, max), _mm_andnot_si128(c, B));
+			_mm_storeu_si128((__m128i *) (p + i),
+				_mm_or_si128(_mm_and_si128(R, mr), _mm_or_si128(
+				_mm_and_si128(_mm_srli_epi32(G, 8), mg),
+				_mm_srli_epi32(B, 16))));
+			vr = _mm_add_epi32(vr, sr);
+			vg = _mm_add_epi32(vg, sg);
+			vb = _mm_add_epi32(vb, sb);
+		}
+	}
+	else
+	{
+		for (; i + 4 <= n; i += 4)
+		{
+			_mm_storeu_si128((__m128i *) (p + i),
+				_mm_or_si128(_mm_and_si128(vr, mr), _mm_or_si128(
+				_mm_and_si128(_mm_srli_epi32(vg, 8), mg),
+				_mm_srli_epi32(vb, 16))));
+			vr = _mm_add_epi32(vr, sr);
+			vg = _mm_add_epi32(vg, sg);
+			vb = _mm_add_epi32(vb, sb);
+		}
+	}
+#elif defined(GRADIENT_NEON)
+	const uint32_t ramp[4] = { 0, 1, 2, 3 };
+	uint32x4_t vi = vld1q_u32(ramp);
+	uint32x4_t vr = vmlaq_n_u32(vdupq_n_u32(r), vi, dr);
+	uint32x4_t vg = vmlaq_n_u32(vdupq_n_u32(g), vi, dg);
+	uint32x4_t vb = vmlaq_n_u32(vdupq_n_u32(b), vi, db);
+	uint32x4_t sr = vdupq_n_u32(4 * dr);
+	uint32x4_t sg = vdupq_n_u32(4 * dg);
+	uint32x4_t sb = vdupq_n_u32(4 * db);
+	uint32x4_t mr = vdupq_n_u32(0xff0000);
+	uint32x4_t mg = vdupq_n_u32(0xff00);
+	if (dith)
+	{
+		uint32x4_t brb = vld1q_u32((const uint32_t *) dith);
+		uint32x4_t bg = vld1q_u32((const uint32_t *) (dith + 4));
+		uint32x4_t max = vdupq_n_u32(0xffffff);
+		for (; i + 4 <= n; i += 4)
+		{
+			uint32x4_t R = vminq_u32(vaddq_u32(vr, brb), max);
+			uint32x4_t G = vminq_u32(vaddq_u32(vg, bg), max);
+			uint32x4_t B = vminq_u32(vaddq_u32(vb, brb), max);
+			vst1q_u32((uint32_t *) (p + i), vorrq_u32(vandq_u32(R, mr),
+				vorrq_u32(vandq_u32(vshrq_n_u32(G, 8), mg),
+				vshrq_n_u32(B, 16))));
+			vr = vaddq_u32(vr, sr);
+			vg = vaddq_u32(vg, sg);
+			vb = vaddq_u32(vb, sb);
+		}
+	}
+	else
+	{
+		for (; i + 4 <= n; i += 4)
+		{
+			vst1q_u32((uint32_t *) (p + i), vorrq_u32(vandq_u32(vr, mr),
+				vorrq_u32(vandq_u32(vshrq_n_u32(vg, 8), mg),
+				vshrq_n_u32(vb, 16))));
+			vr = vaddq_u32(vr, sr);
+			vg = vaddq_u32(vg, sg);
+			vb = vaddq_u32(vb, sb);
+		}
+	}
+#endif
+	r += i * dr;
+	g += i * dg;
+	b += i * db;
+	for (; i < n; ++i)
+	{
+		TINT R = r, G = g, B = b;
+		if (dith)
+		{
+			R = TMIN(R + dith[i & 3], 0xffffff);
+			G = TMIN(G + dith[4 + (i & 3)], 0xffffff);
+			B = TMIN(B + dith[i & 3], 0xffffff);
+		}
+		p[i] = (R & 0xff0000) | ((G >> 8) & 0xff00) | (B >> 16);
+		r += dr;
+		g += dg;
+		b += db;
+	}
 }
 
-static void getS2(vec r0, vec u, int Ar, int Ag, int Ab, int Dr, int Dg, 
-	int Db, float *pr, float *pg, float *pb, float *pf, int x, int y)
+static void gradient_fill(TUINT *p, TINT n, TUINT rgb)
 {
-	vec z = { x, y };
-	float s = mulVec(subVec(z, r0), u) / mulVec(u, u);
-	vec F = subVec(addVec(r0, scaleVec(u, s)), r0);
-	float f = TABS(u.y) > TABS(u.x) ? F.y / u.y : F.x / u.x;
-	*pr = Ar + Dr * f;
-	*pg = Ag + Dg * f;
-	*pb = Ab + Db * f;
-	*pf = f * 256;
+	TINT i;
+	for (i = 0; i < n; ++i)
+		p[i] = rgb;
 }
 
 static void
@@ -1174,11 +1740,13 @@ tek_lib_visual_frectgradient(lua_State *L, TEKVisual *vis, TEKGradient *gr,
 	struct 
 	{ 
 		TINT16 x0, y0, x1, y1;
-		TUINT8 r0, g0, b0, r1, g1, b1;
+		TUINT8 r0, g0, b0, r1, g1, b1, dither;
+		/* the key is hashed as a whole, leave no padding undefined: */
+		TUINT8 pad;
 	} ckey = 
 	{ 
 		gr->A.vec.x, gr->A.vec.y, gr->B.vec.x, gr->B.vec.y, 
-		gr->A.r, gr->A.g, gr->A.b, gr->B.r, gr->B.g, gr->B.b
+		gr->A.r, gr->A.g, gr->A.b, gr->B.r, gr->B.g, gr->B.b, gr->dither, 0
 	};
 	
 	struct TVImageCacheRequest creq;
@@ -1198,148 +1766,109 @@ tek_lib_visual_frectgradient(lua_State *L, TEKVisual *vis, TEKGradient *gr,
 		return; /* cache used, painted successfully */
 #endif
 
-	int y, x;
-	int Ar = gr->A.r;
-	int Ag = gr->A.g;
-	int Ab = gr->A.b;
-	int Br = gr->B.r;
-	int Bg = gr->B.g;
-	int Bb = gr->B.b;
-	int Dr = Br - Ar;
-	int Dg = Bg - Ag;
-	int Db = Bb - Ab;
-	
-	vec r0 = gr->A.vec;
-	vec u = subVec(gr->B.vec, r0);
-	
-	x = x0 - ox;
-	y = y0 - oy;
-
-	float cr0, cg0, cb0, cx0;
-	float cr1, cg1, cb1, cx1;
-	float cr2, cg2, cb2, cx2;
-	getS2(r0, u, Ar, Ag, Ab, Dr, Dg, Db, &cr0, &cg0, &cb0, &cx0, x, y);
-	getS2(r0, u, Ar, Ag, Ab, Dr, Dg, Db, &cr1, &cg1, &cb1, &cx1, x + w - 1, y);
-	getS2(r0, u, Ar, Ag, Ab, Dr, Dg, Db, &cr2, &cg2, &cb2, &cx2, x, y + h - 1);
-	float dr0 = (cr2 - cr0) / (h - 1);
-	float dg0 = (cg2 - cg0) / (h - 1);
-	float db0 = (cb2 - cb0) / (h - 1);
-	float dx0 = (cx2 - cx0) / (h - 1);
-	float dr = (cr1 - cr0) / (w - 1);
-	float dg = (cg1 - cg0) / (w - 1);
-	float db = (cb1 - cb0) / (w - 1);
-	float dx = (cx1 - cx0) / (w - 1);
+	TINT Ar = gr->A.r;
+	TINT Ag = gr->A.g;
+	TINT Ab = gr->A.b;
+	TINT Dr = (TINT) gr->B.r - Ar;
+	TINT Dg = (TINT) gr->B.g - Ag;
+	TINT Db = (TINT) gr->B.b - Ab;
+	TUINT rgba = (Ar << 16) | (Ag << 8) | Ab;
+	TUINT rgbb = ((TUINT) gr->B.r << 16) | ((TUINT) gr->B.g << 8) |
+		(TUINT) gr->B.b;
+	
+	/* t = fa * x + fb * y + fc: */
+	double ux = gr->B.vec.x - gr->A.vec.x;
+	double uy = gr->B.vec.y - gr->A.vec.y;
+	double uu = ux * ux + uy * uy;
+	double fa = 0, fb = 0, fc = 0;
+	if (uu > 0)
+	{
+		fa = ux / uu;
+		fb = uy / uu;
+		fc = -(gr->A.vec.x * ux + gr->A.vec.y * uy) / uu;
+	}
+	
+	/* solid colors left and right of the span: */
+	TUINT rgbl = fa > 0 ? rgba : rgbb;
+	TUINT rgbr = fa > 0 ? rgbb : rgba;
+	
+	/* per-pixel increments in 16.16 fixed point: */
+	TINT dr = (TINT) (Dr * fa * 65536);
+	TINT dg = (TINT) (Dg * fa * 65536);
+	TINT db = (TINT) (Db * fa * 65536);
 	
 	TUINT *buf = TExecAlloc(vis->vis_ExecBase, TNULL, w * h * sizeof(TUINT));
 	if (!buf)
 		return;
 	
-	for (y = 0; y < h; ++y)
+	TINT x = x0 - ox;
+	TINT y;
+	TUINT *p = buf;
+	for (y = 0; y < h; ++y, p += w)
 	{
-		float cr = cr0;
-		float cg = cg0;
-		float cb = cb0;
-		float cx = cx0;
-		cr0 += dr0;
-		cg0 += dg0;
-		cb0 += db0;
-		cx0 += dx0;
-
-		float ce = cx + dx * w;
-		TUINT r, g, b;
-		if (cx < 1 && ce < 1)
-		{
-			r = Ar;
-			g = Ag;
-			b = Ab;
-		}
-		else if (cx > 255 && ce > 255)
-		{
-			r = Br;
-			g = Bg;
-			b = Bb;
-		}
-		else if (cx >= 1 && cx <= 255 && ce >= 1 && ce <= 255)
+		double t0 = fa * x + fb * (y0 - oy + y) + fc;
+		TINT xa = 0, xb = w;
+		
+		if (fa == 0)
 		{
-			if (cx == ce)
-			{
-				r = cr;
-				g = cg;
-				b = cb;
-			}
-			else
+			if (t0 <= 0 || t0 >= 1)
 			{
-				for (x = 0; x < w; ++x)
-				{
-					*buf++ = 
-						((TUINT) cr << 16) | ((TUINT) cg << 8) | (TUINT) cb;
-					cr += dr;
-					cg += dg;
-					cb += db;
-				}
+				gradient_fill(p, w, t0 <= 0 ? rgba : rgbb);
 				continue;
 			}
 		}
-		else if ((cx < 1 && ce <= 255) || (cx <= 255 && ce < 1))
+		else
 		{
-			for (x = 0; x < w; ++x)
+			/* span of pixels with 0 <= t <= 1: */
+			double lo = -t0 / fa;
+			double hi = (1 - t0) / fa;
+			if (lo > hi)
 			{
-				if (cx < 1)
-					*buf++ = 
-						((TUINT) Ar << 16) | ((TUINT) Ag << 8) | (TUINT) Ab;
-				else
-					*buf++ =
-						((TUINT) cr << 16) | ((TUINT) cg << 8) | (TUINT) cb;
-				cr += dr;
-				cg += dg;
-				cb += db;
-				cx += dx;
+				double tmp = lo;
+				lo = hi;
+				hi = tmp;
 			}
-			continue;
-		}
-		else if ((cx >= 1 && ce > 255) || (cx > 255 && ce >= 1))
-		{
-			for (x = 0; x < w; ++x)
+			lo = TMAX(lo, 0);
+			hi = TMIN(hi, w - 1);
+			if (lo > hi)
 			{
-				if (cx > 255)
-					*buf++ =
-						((TUINT) Br << 16) | ((TUINT) Bg << 8) | (TUINT) Bb;
-				else
-					*buf++ =
-						((TUINT) cr << 16) | ((TUINT) cg << 8) | (TUINT) cb;
-				cr += dr;
-				cg += dg;
-				cb += db;
-				cx += dx;
+				gradient_fill(p, w, hi < 0 ? rgbr : rgbl);
+				continue;
 			}
-			continue;
+			xa = (TINT) lo;
+			xa += xa < lo;
+			xb = (TINT) hi + 1;
+			gradient_fill(p, xa, rgbl);
+			gradient_fill(p + xb, w - xb, rgbr);
 		}
-		else
+		
+		if (xa < xb)
 		{
-			for (x = 0; x < w; ++x)
+			double t = t0 + fa * xa;
+			TINT dith[8];
+			TINT *pd = TNULL;
+			t = TMAX(t, 0);
+			t = TMIN(t, 1);
+			if (gr->dither)
 			{
-				if (cx < 1)
-					*buf++ =
-						((TUINT) Ar << 16) | ((TUINT) Ag << 8) | (TUINT) Ab;
-				else if (cx > 255)
-					*buf++ =
-						((TUINT) Br << 16) | ((TUINT) Bg << 8) | (TUINT) Bb;
-				else
-					*buf++ =
-						((TUINT) cr << 16) | ((TUINT) cg << 8) | (TUINT) cb;
-				cr += dr;
-				cg += dg;
-				cb += db;
-				cx += dx;
+				const TUINT8 *bayer = gradient_bayer[(y0 - oy + y) & 3];
+				TINT i;
+				for (i = 0; i < 4; ++i)
+				{
+					TINT d = bayer[(x + xa + i) & 3];
+					/* below one step of 5 and 6 bits per channel: */
+					dith[i] = d << 15;
+					dith[4 + i] = d << 14;
+				}
+				pd = dith;
 			}
-			continue;
+			gradient_span(p + xa, xb - xa,
+				(Ar << 16) + (TINT) (Dr * t * 65536) + (pd ? 0 : 0x8000),
+				(Ag << 16) + (TINT) (Dg * t * 65536) + (pd ? 0 : 0x8000),
+				(Ab << 16) + (TINT) (Db * t * 65536) + (pd ? 0 : 0x8000),
+				dr, dg, db, pd);
 		}
-		
-		for (x = 0; x < w; ++x)
-			*buf++ = ((TUINT) r << 16) | ((TUINT) g << 8) | (TUINT) b;
 	}
-
-	buf -= w * h;
 	
 	/* paint and possibly store in cache: */
 	TVisualDrawBuffer(vis->vis_Visual, x0, y0, buf, w, h, w, tags);
@@ -1536,140 +2065,479 @@ tek_lib_visual_text(lua_State *L)
 	return 0;
 }
 
-/*-----------------------------------------------------------------------------
---	Visual:drawImage(table, x0, y0, x1, y1, pen_or_pentab): Draw a table
---	containing a simple vector image into the specified rectangle, with the
---	specified table of pens, or a single pen. Image table format:
---			{
---			  [1] = { x0, y0, x1, y1, ... }, -- coordinates table
---			  [4] = boolean, -- is_transparent
---			  [5] = { -- table of primitive records
---			    { [1]=fmtcode, [2]=nmpts, [3]={ indices }, [4]=pen_or_table },
---			    ...
---			  }
---			}
---	{{fmtcode}} can be {{0x1000}} for a strip, {{0x2000}} for a fan.
---	The coordinates are in the range from 0 to 0xffff.
------------------------------------------------------------------------------*/
+/*****************************************************************************/
+/*
+**	Images compiled from vector tables. The pens of an image are retained
+**	by their keys in a table referenced from the image; each primitive
+**	refers to a key by its index, or to an index per point.
+*/
 
-LOCAL LUACFUNC TINT
-tek_lib_visual_drawimage(lua_State *L)
+#define getimageptr(L, n) \
+	luaL_checkudata(L, n, TEK_LIB_VISUALIMAGE_CLASSNAME)
+
+/* Maximum number of pixels of an image in the pixmap cache: */
+#define IMAGE_CACHE_MAXPIXELS	65536
+
+/* pop a pen key, and return its index in the image's key table: */
+
+/*
+**	Get scratch memory of at least the specified size, shared by all
+**	visuals, and valid until the next call:
+*/
+
+static TAPTR tek_lib_visual_getdrawbuffer(lua_State *L, TEKVisual *vis,
+	TSIZE size)
 {
-	TEKPen *pen_override = TNULL;
-	TEKVisual *vis = checkvisptr(L, 1);
 	struct TExecBase *TExecBase = vis->vis_ExecBase;
-	TINT sx = vis->vis_ShiftX, sy = vis->vis_ShiftY;
-	lua_Integer rect[4], scalex, scaley;
-	size_t primcount, i, j;
-	TTAGITEM tags[2];
-	tags[1].tti_Tag = TTAG_DONE;
-	
-	if (lua_type(L, 7) != LUA_TTABLE)
-		pen_override = lookuppen(L, vis->vis_refPens, 7);
-	
-	rect[0] = luaL_checkinteger(L, 3);
-	rect[1] = luaL_checkinteger(L, 4);
-	rect[2] = luaL_checkinteger(L, 5);
-	rect[3] = luaL_checkinteger(L, 6);
-	scalex = rect[2] - rect[0];
-	scaley = rect[1] - rect[3];
-	
-	lua_getmetatable(L, 1);
-	/* vismeta */
-	lua_rawgeti(L, -1, vis->vis_refPens);
-	/* vismeta, pentab */
-	lua_remove(L, -2);
-	/* pentab */
-	
-	lua_pushinteger(L, 1);
-	lua_gettable(L, 2);
-	/* s: pentab, coords */
-	lua_pushinteger(L, 5);
-	lua_gettable(L, 2);
-	/* s: pentab, coords, primitives */
-#if LUA_VERSION_NUM < 502
-	primcount = lua_objlen(L, -1);
-#else
-	primcount = lua_rawlen(L, -1);
-#endif
+	TAPTR buf = vis->vis_VisBase->vis_DrawBuffer;
+	if (buf && TGetSize(buf) < size)
+	{
+		TFree(buf);
+		buf = TNULL;
+	}
+	if (buf == TNULL)
+		buf = TAlloc(TNULL, size);
+	vis->vis_VisBase->vis_DrawBuffer = buf;
+	if (buf == TNULL)
+	{
+		lua_pushstring(L, "out of memory");
+		lua_error(L);
+	}
+	return buf;
+}
 
-	for (i = 0; i < primcount; i++)
+static TINT tek_lib_visual_penkey(lua_State *L, int keys, int revkeys,
+	TINT *numpens)
+{
+	TINT n;
+	if (lua_isnil(L, -1))
 	{
-		lua_Integer nump, fmt;
-		size_t bufsize;
-		void *buf;
-		TINT *coord;
-		TINT *pentab;
-		
+		/* only valid with a pen override */
+		lua_pop(L, 1);
+		return -1;
+	}
+	lua_pushvalue(L, -1);
+	lua_rawget(L, revkeys);
+	/* s: key, index */
+	if (lua_isnil(L, -1))
+	{
+		lua_pop(L, 1);
+		n = (*numpens)++;
+		lua_pushvalue(L, -1);
+		lua_rawseti(L, keys, n + 1);
+		lua_pushinteger(L, n);
+		lua_rawset(L, revkeys);
+		return n;
+	}
+	n = lua_tointeger(L, -1);
+	lua_pop(L, 2);
+	return n;
+}
+
+static TEKImage *
+tek_lib_visual_compile(lua_State *L, int idx, TUINT serial)
+{
+	TEKImage *img;
+	size_t numprims, numcoords, i, j;
+	TINT numpoints = 0, maxpoints = 0, numpointpens = 0;
+	int keys, revkeys;
+	
+	luaL_checktype(L, idx, LUA_TTABLE);
+	lua_rawgeti(L, idx, 1);
+	/* s: coords */
+	luaL_checktype(L, -1, LUA_TTABLE);
+	numcoords = tek_lua_len(L, -1) / 2;
+	lua_rawgeti(L, idx, 5);
+	/* s: coords, primitives */
+	luaL_checktype(L, -1, LUA_TTABLE);
+	numprims = tek_lua_len(L, -1);
+	
+	/* determine sizes: */
+	for (i = 0; i < numprims; ++i)
+	{
+		lua_Integer nump;
 		lua_rawgeti(L, -1, i + 1);
-		/* s: pentab, coords, primitives, prim[i] */
+		lua_rawgeti(L, -1, 2);
+		nump = luaL_checkinteger(L, -1);
+		if (nump < 0)
+			luaL_error(L, "invalid number of points");
+		numpoints += nump;
+		maxpoints = TMAX(maxpoints, nump);
+		lua_rawgeti(L, -2, 4);
+		if (lua_type(L, -1) == LUA_TTABLE)
+			numpointpens += nump;
+		lua_pop(L, 3);
+	}
+	
+	img = lua_newuserdata(L, sizeof(TEKImage) + 
+		sizeof(TEKImagePrim) * numprims + sizeof(TINT) * 2 * numpoints +
+		sizeof(TINT) * numpointpens);
+	/* s: coords, primitives, image */
+	img->img_NumPrims = numprims;
+	img->img_MaxPoints = maxpoints;
+	img->img_NumPens = 0;
+	img->img_refPens = LUA_NOREF;
+	img->img_Serial = serial;
+	img->img_Flags = 0;
+	img->img_Prims = (TEKImagePrim *) (img + 1);
+	img->img_Coords = (TINT *) (img->img_Prims + numprims);
+	img->img_PointPens = img->img_Coords + 2 * numpoints;
+	luaL_newmetatable(L, TEK_LIB_VISUALIMAGE_CLASSNAME);
+	lua_setmetatable(L, -2);
+	
+	lua_newtable(L);
+	keys = lua_gettop(L);
+	lua_newtable(L);
+	revkeys = keys + 1;
+	/* s: coords, primitives, image, keys, revkeys */
+	
+	numpoints = 0;
+	numpointpens = 0;
+	for (i = 0; i < numprims; ++i)
+	{
+		TEKImagePrim *prim = &img->img_Prims[i];
+		TINT *coord = img->img_Coords + 2 * numpoints;
+		
+		lua_rawgeti(L, keys - 2, i + 1);
 		lua_rawgeti(L, -1, 1);
-		/* s: pentab, coords, primitives, prim[i], fmtcode */
-		fmt = luaL_checkinteger(L, -1);
 		lua_rawgeti(L, -2, 2);
-		/* s: pentab, coords, primitives, prim[i], fmtcode, nump */
-		nump = luaL_checkinteger(L, -1);
+		prim->prm_Format = luaL_checkinteger(L, -2);
+		prim->prm_NumPoints = lua_tointeger(L, -1);
+		prim->prm_First = numpoints;
+		prim->prm_Pen = -1;
+		prim->prm_PointPens = -1;
+		if (prim->prm_Format & 0x0100)
+			img->img_Flags |= TEKIMAGE_ANTIALIAS;
+		lua_pop(L, 2);
+		lua_rawgeti(L, -1, 3);
+		lua_rawgeti(L, -2, 4);
+		/* s: ..., prim, indices, pen_or_table */
 		
-		bufsize = sizeof(TINT) * 3 * nump;
-		buf = vis->vis_VisBase->vis_DrawBuffer;
-		if (buf && TGetSize(buf) < bufsize)
+		if (lua_type(L, -1) == LUA_TTABLE)
 		{
-			TFree(buf);
-			buf = TNULL;
+			prim->prm_PointPens = numpointpens;
+			img->img_Flags |= TEKIMAGE_POINTPENS;
 		}
-		if (buf == TNULL)
-			buf = TAlloc(TNULL, bufsize);
-		vis->vis_VisBase->vis_DrawBuffer = buf;
-		if (buf == TNULL)
+		else
 		{
-			lua_pushstring(L, "out of memory");
-			lua_error(L);
+			lua_pushvalue(L, -1);
+			prim->prm_Pen = tek_lib_visual_penkey(L, keys, revkeys,
+				&img->img_NumPens);
 		}
-		coord = buf;
 		
-		lua_rawgeti(L, -3, 3);
-		/* s: pentab, coords, primitives, prim[i], fmtcode, nump, indices */
-		lua_rawgeti(L, -4, 4);
-		/* s: pentab, coords, primitives, prim[i], fmtcode, nump, indices, p */
+		for (j = 0; j < (size_t) prim->prm_NumPoints; ++j)
+		{
+			lua_Integer idx;
+			lua_rawgeti(L, -2, j + 1);
+			idx = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			if (idx < 1 || (size_t) idx > numcoords)
+				luaL_error(L, "invalid coordinate index");
+			lua_rawgeti(L, keys - 3, idx * 2 - 1);
+			lua_rawgeti(L, keys - 3, idx * 2);
+			coord[j * 2] = lua_tointeger(L, -2);
+			coord[j * 2 + 1] = lua_tointeger(L, -1);
+			lua_pop(L, 2);
+			if (prim->prm_PointPens >= 0)
+			{
+				lua_rawgeti(L, -1, idx);
+				img->img_PointPens[numpointpens++] =
+					tek_lib_visual_penkey(L, keys, revkeys, &img->img_NumPens);
+			}
+		}
 		
-		pentab = lua_type(L, -1) == LUA_TTABLE ? coord + 2 * nump : TNULL;
-		if (pentab)
-			tags[0].tti_Tag = TVisual_PenArray;
+		lua_pop(L, 3);
+		numpoints += prim->prm_NumPoints;
+	}
+	
+	lua_pop(L, 1);
+	/* s: coords, primitives, image, keys */
+	img->img_refPens = luaL_ref(L, LUA_REGISTRYINDEX);
+	/* s: coords, primitives, image */
+	lua_replace(L, -3);
+	lua_pop(L, 1);
+	/* s: image */
+	return img;
+}
+
+/*-----------------------------------------------------------------------------
+--	image = Visual.compileImage(table): Compiles a table containing a simple
+--	vector image (see Visual:drawImage() for its format) into an image
+--	object. Coordinates and primitive records are packed once, and pens are
+--	retained by their keys. If the display driver supports caching of
+--	pixmaps, the rasterized result is cached per size and set of pen
+--	colors, so that redrawing an unchanged image amounts to a single blit.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_compileimage(lua_State *L)
+{
+	TEKVisual *vis;
+	lua_getfield(L, LUA_REGISTRYINDEX, TEK_LIB_VISUAL_BASECLASSNAME);
+	vis = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	tek_lib_visual_compile(L, 1, ++vis->vis_ImageSerial);
+	return 1;
+}
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_freeimage(lua_State *L)
+{
+	TEKImage *img = getimageptr(L, 1);
+	luaL_unref(L, LUA_REGISTRYINDEX, img->img_refPens);
+	img->img_refPens = LUA_NOREF;
+	return 0;
+}
+
+#if defined(ENABLE_PIXMAP_CACHE)
+
+/* fill a triangle into an ARGB buffer, setting pixels whose center lies
+** inside or on its edges: */
+
+static void tek_lib_visual_filltriangle(TUINT *buf, TINT w, TINT h,
+	TINT *v0, TINT *v1, TINT *v2, TUINT argb)
+{
+	TINT *a = v0, *b = v1, *c = v2, *t;
+	TINT y, y0, y1;
+	if (a[1] > b[1]) { t = a; a = b; b = t; }
+	if (b[1] > c[1]) { t = b; b = c; c = t; }
+	if (a[1] > b[1]) { t = a; a = b; b = t; }
+	y0 = TMAX(a[1], 0);
+	y1 = TMIN(c[1], h - 1);
+	for (y = y0; y <= y1; ++y)
+	{
+		TINT xl, xr, x;
+		TUINT *p = buf + y * w;
+		if (a[1] == c[1])
+		{
+			xl = TMIN(TMIN(a[0], b[0]), c[0]);
+			xr = TMAX(TMAX(a[0], b[0]), c[0]);
+		}
 		else
 		{
-			tags[0].tti_Tag = TVisual_Pen;
-			if (pen_override)
-				tags[0].tti_Value = pen_override->pen_Pen;
+			TINT64 ac = (TINT64) a[0] * 0x10000 +
+				(TINT64) (c[0] - a[0]) * 0x10000 * (y - a[1]) / (c[1] - a[1]);
+			TINT64 o;
+			if (y < b[1])
+				o = (TINT64) a[0] * 0x10000 +
+					(TINT64) (b[0] - a[0]) * 0x10000 * (y - a[1]) /
+					(b[1] - a[1]);
+			else if (c[1] > b[1])
+				o = (TINT64) b[0] * 0x10000 +
+					(TINT64) (c[0] - b[0]) * 0x10000 * (y - b[1]) /
+					(c[1] - b[1]);
 			else
+				o = (TINT64) b[0] * 0x10000;
+			xl = (TINT) ((TMIN(ac, o) + 0x8000) >> 16);
+			xr = (TINT) ((TMAX(ac, o) + 0x8000) >> 16);
+		}
+		xl = TMAX(xl, 0);
+		xr = TMIN(xr, w - 1);
+		for (x = xl; x <= xr; ++x)
+			p[x] = argb;
+	}
+}
+
+#endif
+
+/*-----------------------------------------------------------------------------
+--	Visual:drawImage(image, x0, y0, x1, y1, pen_or_pentab): Draw a simple
+--	vector image into the specified rectangle, with the specified table of
+--	pens, or a single pen. The image can be an object compiled using
+--	Visual.compileImage(), or a table of the following format:
+--			{
+--			  [1] = { x0, y0, x1, y1, ... }, -- coordinates table
+--			  [4] = boolean, -- is_transparent
+--			  [5] = { -- table of primitive records
+--			    { [1]=fmtcode, [2]=nmpts, [3]={ indices }, [4]=pen_or_table },
+--			    ...
+--			  }
+--			}
+--	{{fmtcode}} can be {{0x1000}} for a strip, {{0x2000}} for a fan.
+--	Adding {{0x0100}} requests anti-aliased edges, where supported by the
+--	display driver. The coordinates are in the range from 0 to 0xffff.
+--	If a primitive's pen is a table, it contains a pen per coordinate
+--	index. A table is compiled each time it is drawn, and not cached.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_drawimage(lua_State *L)
+{
+	TEKPen *pen_override = TNULL;
+	TEKVisual *vis = checkvisptr(L, 1);
+	TINT sx = vis->vis_ShiftX, sy = vis->vis_ShiftY;
+	TINT x0, y0, x1, y1, w, h, scalex, scaley;
+	TEKImage *img;
+	TEKPen **pens;
+	TINT *coord;
+	TVPEN *penarray;
+	TSIZE bufsize;
+	void *buf;
+	TINT i, j;
+	TTAGITEM tags[3];
+	
+	if (lua_istable(L, 2))
+	{
+		tek_lib_visual_compile(L, 2, 0);
+		lua_replace(L, 2);
+	}
+	img = getimageptr(L, 2);
+	
+	if (lua_type(L, 7) != LUA_TTABLE)
+		pen_override = lookuppen(L, vis->vis_refPens, 7);
+	
+	x0 = luaL_checkinteger(L, 3);
+	y0 = luaL_checkinteger(L, 4);
+	x1 = luaL_checkinteger(L, 5);
+	y1 = luaL_checkinteger(L, 6);
+	scalex = x1 - x0;
+	scaley = y0 - y1;
+	w = x1 - x0 + 1;
+	h = y1 - y0 + 1;
+	if (w < 1 || h < 1)
+		return 0;
+	
+	/* scratch memory for pens per key, pens per point, and coordinates: */
+	bufsize = sizeof(TEKPen *) * img->img_NumPens +
+		(sizeof(TVPEN) + sizeof(TINT) * 2) * img->img_MaxPoints;
+	buf = tek_lib_visual_getdrawbuffer(L, vis, bufsize);
+	pens = buf;
+	penarray = (TVPEN *) (pens + img->img_NumPens);
+	coord = (TINT *) (penarray + img->img_MaxPoints);
+	
+	/* resolve pen keys; unresolved pens are an error only when used: */
+	lua_rawgeti(L, LUA_REGISTRYINDEX, img->img_refPens);
+	for (i = 0; i < img->img_NumPens; ++i)
+	{
+		lua_rawgeti(L, -1, i + 1);
+		pens[i] = lookuppen(L, vis->vis_refPens, lua_gettop(L));
+		lua_pop(L, 1);
+	}
+	lua_pop(L, 1);
+	
+	vis->vis_Dirty = TTRUE;
+	
+#if defined(ENABLE_PIXMAP_CACHE)
+	if (img->img_Serial && !(img->img_Flags & TEKIMAGE_ANTIALIAS) &&
+		w * h <= IMAGE_CACHE_MAXPIXELS && img->img_NumPens <= 32)
+	{
+		/* key: serial, size, pen override, and colors of all pens */
+		struct TExecBase *TExecBase = vis->vis_ExecBase;
+		TUINT ckey[38];
+		TINT keylen = 5 + img->img_NumPens;
+		struct TVImageCacheRequest creq;
+		TUINT *pbuf;
+		
+		ckey[0] = img->img_Serial;
+		ckey[1] = w;
+		ckey[2] = h;
+		ckey[3] = pen_override != TNULL;
+		ckey[4] = pen_override ? pen_override->pen_RGB : 0;
+		for (i = 0; i < img->img_NumPens; ++i)
+			ckey[5 + i] = pens[i] ? pens[i]->pen_RGB : 0;
+		
+		creq.tvc_CacheManager = vis->vis_CacheManager;
+		creq.tvc_Key = (TUINT8 *) ckey;
+		creq.tvc_KeyLen = sizeof(TUINT) * keylen;
+		creq.tvc_OrigX = x0 + sx;
+		creq.tvc_OrigY = y0 + sy;
+		creq.tvc_Result = TVIMGCACHE_NOTFOUND;
+		tags[0].tti_Tag = TVisual_CacheRequest;
+		tags[0].tti_Value = (TTAG) &creq;
+		tags[1].tti_Tag = TVisual_AlphaChannel;
+		tags[1].tti_Value = TTRUE;
+		tags[2].tti_Tag = TTAG_DONE;
+		
+		TVisualDrawBuffer(vis->vis_Visual, x0 + sx, y0 + sy, TNULL, w, h, w,
+			tags);
+		if (creq.tvc_Result == TVIMGCACHE_FOUND)
+			return 0;
+		
+		/* rasterize all primitives into a transparent buffer: */
+		pbuf = TExecAlloc0(TExecBase, TNULL, sizeof(TUINT) * w * h);
+		if (pbuf)
+		{
+			for (i = 0; i < img->img_NumPrims; ++i)
 			{
-				lua_gettable(L, -8);
-				tags[0].tti_Value = ((TEKPen *) checkpenptr(L, -1))->pen_Pen;
+				TEKImagePrim *prim = &img->img_Prims[i];
+				TINT *src = img->img_Coords + 2 * prim->prm_First;
+				TINT nump = prim->prm_NumPoints;
+				TEKPen *pen = pen_override;
+				if (!pen && prim->prm_Pen >= 0)
+					pen = pens[prim->prm_Pen];
+				for (j = 0; j < nump; ++j)
+				{
+					coord[j * 2] = (src[j * 2] * scalex) / 0x10000;
+					coord[j * 2 + 1] = h - 1 +
+						(src[j * 2 + 1] * scaley) / 0x10000;
+				}
+				for (j = 2; j < nump; ++j)
+				{
+					TINT *v0 = (prim->prm_Format & 0xf000) == 0x2000 ?
+						coord : coord + (j - 2) * 2;
+					TEKPen *tpen = pen;
+					if (prim->prm_PointPens >= 0)
+					{
+						TINT k = img->img_PointPens[prim->prm_PointPens + j];
+						tpen = k >= 0 ? pens[k] : TNULL;
+					}
+					if (tpen == TNULL)
+					{
+						TExecFree(TExecBase, pbuf);
+						luaL_error(L, "pen expected");
+					}
+					tek_lib_visual_filltriangle(pbuf, w, h, v0,
+						coord + (j - 1) * 2, coord + j * 2,
+						0xff000000 | (tpen->pen_RGB & 0xffffff));
+				}
 			}
+			TVisualDrawBuffer(vis->vis_Visual, x0 + sx, y0 + sy, pbuf, w, h,
+				w, tags);
+			TExecFree(TExecBase, pbuf);
+			return 0;
 		}
+	}
+#endif
+
+	tags[1].tti_Tag = TVisual_AntiAlias;
+	tags[2].tti_Tag = TTAG_DONE;
+	for (i = 0; i < img->img_NumPrims; ++i)
+	{
+		TEKImagePrim *prim = &img->img_Prims[i];
+		TINT *src = img->img_Coords + 2 * prim->prm_First;
+		TINT nump = prim->prm_NumPoints;
 		
-		for (j = 0; j < (size_t) nump; ++j)
+		for (j = 0; j < nump; ++j)
 		{
-			lua_Integer idx;
-			lua_rawgeti(L, -2, j + 1);
-			idx = lua_tointeger(L, -1);
-			lua_rawgeti(L, -8, idx * 2 - 1);
-			lua_rawgeti(L, -9, idx * 2);
-			/* index, x, y */
-			coord[j * 2] = rect[0] + sx + 
-				(lua_tointeger(L, -2) * scalex) / 0x10000;
-			coord[j * 2 + 1] = rect[3] + sy +
-				(lua_tointeger(L, -1) * scaley) / 0x10000;
-			if (pentab)
+			coord[j * 2] = x0 + sx + (src[j * 2] * scalex) / 0x10000;
+			coord[j * 2 + 1] = y1 + sy + (src[j * 2 + 1] * scaley) / 0x10000;
+		}
+		
+		if (prim->prm_PointPens >= 0)
+		{
+			tags[0].tti_Tag = TVisual_PenArray;
+			tags[0].tti_Value = (TTAG) penarray;
+			for (j = 0; j < nump; ++j)
 			{
-				lua_rawgeti(L, -7, idx + 1);
-				pentab[j] = ((TEKPen *) checkpenptr(L, -1))->pen_Pen;
-				lua_pop(L, 4);
+				TINT k = img->img_PointPens[prim->prm_PointPens + j];
+				if (k < 0 || pens[k] == TNULL)
+					luaL_error(L, "pen expected");
+				penarray[j] = pens[k]->pen_Pen;
 			}
-			else
-				lua_pop(L, 3);
+		}
+		else
+		{
+			TEKPen *pen = pen_override;
+			if (!pen && prim->prm_Pen >= 0)
+				pen = pens[prim->prm_Pen];
+			if (pen == TNULL)
+				luaL_error(L, "pen expected");
+			tags[0].tti_Tag = TVisual_Pen;
+			tags[0].tti_Value = pen->pen_Pen;
 		}
 		
-		switch (fmt & 0xf000)
+		tags[1].tti_Value = (prim->prm_Format & 0x0100) ? TTRUE : TFALSE;
+		switch (prim->prm_Format & 0xf000)
 		{
 			case 0x1000:
 			case 0x4000:
@@ -1679,12 +2547,8 @@ tek_lib_visual_drawimage(lua_State *L)
 				TVisualDrawFan(vis->vis_Visual, coord, nump, tags);
 				break;
 		}
-		
-		lua_pop(L, 5);
 	}
 	
-	vis->vis_Dirty = TTRUE;
-	lua_pop(L, 3);
 	return 0;
 }
 
@@ -1998,6 +2862,19 @@ static TTAG hookfunc(struct THook *hook, TAPTR obj, TTAG msg)
 	return 0;
 }
 
+static void restoreclip(TEKVisual *vis)
+{
+	TINT *c = vis->vis_ClipRect;
+	if (vis->vis_ClipRegionNum > 0)
+		TVisualSetClipRegion(vis->vis_Visual, vis->vis_ClipRegion,
+			vis->vis_ClipRegionNum, TNULL);
+	else if (vis->vis_HaveClipRect)
+		TVisualSetClipRect(vis->vis_Visual, c[0], c[1], c[2] - c[0] + 1,
+			c[3] - c[1] + 1, TNULL);
+	else
+		TVisualUnsetClipRect(vis->vis_Visual);
+}
+
 /*-----------------------------------------------------------------------------
 --	Visual:blitRect(x0, y0, x1, y1, dx, dy[, exposetable]): Blits the given
 --	rectangle to the destination upper left position {{dx}}/{{dy}}. Source
@@ -2053,6 +2930,184 @@ tek_lib_visual_copyarea(lua_State *L)
 	return 0;
 }
 
+/*-----------------------------------------------------------------------------
+--	region = Visual:blitRegions(blits, region): Performs a batch of blits.
+--	{{blits}} is an array of records of the form {{{ dx, dy, source[, c0, c1,
+--	c2, c3] }}}, each specifying a region to be moved by the given delta,
+--	and optionally a rectangle to clip the destination against. The
+--	rectangles of all records are blitted in an order that prevents them from
+--	overwriting the sources of subsequent blits in the same direction.
+--	Source areas that were previously obscured and are getting exposed by
+--	the blits are added to {{region}}, which is returned.
+-----------------------------------------------------------------------------*/
+
+struct BlitRecord
+{
+	TINT dx, dy;
+	TBOOL clip;
+	TINT c[4];
+};
+
+struct BlitRect
+{
+	TINT key;
+	TINT rect[4];
+	TINT rec;
+};
+
+static int blitrect_cmp(const void *a, const void *b)
+{
+	TINT ka = ((const struct BlitRect *) a)->key;
+	TINT kb = ((const struct BlitRect *) b)->key;
+	return ka > kb ? -1 : ka < kb ? 1 : 0;
+}
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_blitregions(lua_State *L)
+{
+	TTAGITEM tags[2];
+	struct THook hook;
+	TEKVisual *vis = checkvisptr(L, 1);
+	struct TExecBase *TExecBase = vis->vis_ExecBase;
+	TINT sx = vis->vis_ShiftX;
+	TINT sy = vis->vis_ShiftY;
+	struct Region *expose;
+	struct BlitRecord *recs;
+	struct BlitRect *br;
+	TINT numrecs, numrects = 0, i, n = 0;
+	TINT curclip = -1;
+	
+	luaL_checktype(L, 2, LUA_TTABLE);
+	expose = luaL_checkudata(L, 3, TEK_LIB_REGION_CLASSNAME);
+	numrecs = tek_lua_len(L, 2);
+	
+	/* validate, count rectangles: */
+	for (i = 1; i <= numrecs; ++i)
+	{
+		struct Region *r;
+		lua_rawgeti(L, 2, i);
+		luaL_checktype(L, -1, LUA_TTABLE);
+		lua_rawgeti(L, -1, 3);
+		r = luaL_checkudata(L, -1, TEK_LIB_REGION_CLASSNAME);
+		numrects += r->rg_Rects.rl_NumNodes;
+		lua_pop(L, 2);
+	}
+	
+	if (numrects > 0)
+	{
+		recs = TAlloc(TNULL, sizeof(struct BlitRecord) * numrecs +
+			sizeof(struct BlitRect) * numrects);
+		if (recs == TNULL)
+			luaL_error(L, "Out of memory");
+		br = (struct BlitRect *) (recs + numrecs);
+		
+		/* collect rectangles with their sort keys: */
+		for (i = 0; i < numrecs; ++i)
+		{
+			struct BlitRecord *rec = &recs[i];
+			struct Region *r;
+			struct TNode *next, *node;
+			TINT dir;
+			lua_rawgeti(L, 2, i + 1);
+			lua_rawgeti(L, -1, 1);
+			rec->dx = lua_tointeger(L, -1);
+			lua_rawgeti(L, -2, 2);
+			rec->dy = lua_tointeger(L, -1);
+			lua_rawgeti(L, -3, 3);
+			r = lua_touserdata(L, -1);
+			lua_rawgeti(L, -4, 4);
+			rec->clip = lua_isnumber(L, -1);
+			lua_pop(L, 4);
+			if (rec->clip)
+			{
+				TINT j;
+				for (j = 0; j < 4; ++j)
+				{
+					lua_rawgeti(L, -1, j + 4);
+					rec->c[j] = lua_tointeger(L, -1);
+					lua_pop(L, 1);
+				}
+			}
+			lua_pop(L, 1);
+			if (rec->dy == 0)
+				dir = rec->dx > 0 ? 1 : -1;
+			else
+				dir = rec->dy > 0 ? 1 : -1;
+			node = r->rg_Rects.rl_List.tlh_Head.tln_Succ;
+			for (; (next = node->tln_Succ); node = next)
+			{
+				struct RectNode *rn = (struct RectNode *) node;
+				struct BlitRect *b = &br[n++];
+				b->key = (rec->dy == 0 ? rn->rn_Rect[0] : rn->rn_Rect[1]) * dir;
+				memcpy(b->rect, rn->rn_Rect, sizeof b->rect);
+				b->rec = i;
+			}
+		}
+		
+		/* rectangles farthest in the direction of a blit go first: */
+		qsort(br, numrects, sizeof(struct BlitRect), blitrect_cmp);
+		
+		vis->vis_RectBuffer = TNULL;
+		vis->vis_RectBufferNum = 0;
+		TInitHook(&hook, hookfunc, vis);
+		tags[0].tti_Tag = TVisual_ExposeHook;
+		tags[0].tti_Value = (TTAG) &hook;
+		tags[1].tti_Tag = TTAG_DONE;
+		
+		for (i = 0; i < numrects; ++i)
+		{
+			struct BlitRect *b = &br[i];
+			struct BlitRecord *rec = &recs[b->rec];
+			TINT *r = b->rect;
+			if (rec->clip && b->rec != curclip)
+			{
+				TINT x0 = rec->c[0] + sx;
+				TINT y0 = rec->c[1] + sy;
+				TINT x1 = rec->c[2] + sx;
+				TINT y1 = rec->c[3] + sy;
+				if (vis->vis_HaveClipRect)
+				{
+					TINT *c = vis->vis_ClipRect;
+					if (TEK_UI_OVERLAP(x0, y0, x1, y1, c[0], c[1], c[2], c[3]))
+					{
+						x0 = TMAX(x0, c[0]);
+						y0 = TMAX(y0, c[1]);
+						x1 = TMIN(x1, c[2]);
+						y1 = TMIN(y1, c[3]);
+					}
+					else
+						x0 = y0 = x1 = y1 = -1;
+				}
+				TVisualSetClipRect(vis->vis_Visual, x0, y0, 
+					x1 - x0 + 1, y1 - y0 + 1, TNULL);
+				curclip = b->rec;
+			}
+			else if (!rec->clip && curclip >= 0)
+			{
+				restoreclip(vis);
+				curclip = -1;
+			}
+			TVisualCopyArea(vis->vis_Visual, r[0] + sx, r[1] + sy, 
+				r[2] - r[0] + 1, r[3] - r[1] + 1, 
+				r[0] + rec->dx + sx, r[1] + rec->dy + sy, tags);
+		}
+		if (curclip >= 0)
+			restoreclip(vis);
+		
+		/* merge exposures into the region: */
+		for (i = 0; i < vis->vis_RectBufferNum; i += 4)
+			region_orrect(expose->rg_Pool, expose, vis->vis_RectBuffer + i,
+				TFALSE);
+		TFree(vis->vis_RectBuffer);
+		vis->vis_RectBuffer = TNULL;
+		TFree(recs);
+		vis->vis_Dirty = TTRUE;
+	}
+	
+	lua_pushvalue(L, 3);
+	return 1;
+}
+
 /*-----------------------------------------------------------------------------
 --	Visual:setClipRect(x0, y0, x1, y1): Set clipping rectangle
 -----------------------------------------------------------------------------*/
@@ -2073,6 +3128,7 @@ tek_lib_visual_setcliprect(lua_State *L)
 	vis->vis_ClipRect[2] = x + w - 1;
 	vis->vis_ClipRect[3] = y + h - 1;
 	vis->vis_HaveClipRect = TTRUE;
+	vis->vis_ClipRegionNum = 0;
 	
 	return 0;
 }
@@ -2087,6 +3143,7 @@ tek_lib_visual_unsetcliprect(lua_State *L)
 	TEKVisual *vis = checkvisptr(L, 1);
 	TVisualUnsetClipRect(vis->vis_Visual);
 	vis->vis_HaveClipRect = TFALSE;
+	vis->vis_ClipRegionNum = 0;
 	return 0;
 }
 
@@ -2108,12 +3165,17 @@ tek_lib_visual_setshift(lua_State *L)
 }
 
 /*-----------------------------------------------------------------------------
---	Visual:drawRGB(table, x, y, w, h[, pw[, ph[, has_alpha[, x0]]]): Draw a
---	table of RGB values as pixels. The table starts at index {{x0}}, default
---	{{0}}. {{pw}} and {{ph}} are the "thickness" of pixels, whih allows to
---	stretch the output by the given factor. The default is {{1}} respectively.
---	The boolean {{has_alpha}} determines whether the pixel values are to be
---	interpreted as ARGB and be rendered with alpha channel.
+--	Visual:drawRGB(x, y, src, w, h[, pw[, ph[, has_alpha[, x0]]]): Draw
+--	an array of RGB values as pixels. {{src}} can be a table, which starts
+--	at index {{x0}}, default {{0}}, or a pixmap, in which case {{w}} and
+--	{{h}} default to the pixmap's size, and {{has_alpha}} defaults to the
+--	pixmap's alpha channel. {{pw}} and {{ph}} are the "thickness" of pixels,
+--	which allows to stretch the output by the given factor. The default is
+--	{{1}} respectively. The boolean {{has_alpha}} determines whether the
+--	pixel values are to be interpreted as ARGB and be rendered with alpha
+--	channel. An unstretched pixmap is passed to the display directly,
+--	without intermediate copy; this is the fastest way to put a frame
+--	buffer that is updated from Lua on the screen.
 -----------------------------------------------------------------------------*/
 
 LOCAL LUACFUNC TINT
@@ -2124,61 +3186,99 @@ tek_lib_visual_drawrgb(lua_State *L)
 	TINT sx = vis->vis_ShiftX, sy = vis->vis_ShiftY;
 	TINT x0 = luaL_checkinteger(L, 2) + sx;
 	TINT y0 = luaL_checkinteger(L, 3) + sy;
-	TINT w = luaL_checkinteger(L, 5);
-	TINT h = luaL_checkinteger(L, 6);
-	TINT pw = luaL_optinteger(L, 7, 1);
-	TINT ph = luaL_optinteger(L, 8, 1);
-	TBOOL has_alpha = lua_toboolean(L, 9);
-	TINT i0 = luaL_optinteger(L, 10, 0);
+	TEKPixmap *pm = TNULL;
+	TINT w, h, pw, ph;
+	TBOOL has_alpha;
+	TUINT *buf, *p;
+	TINT bw, bh, xx, yy, x, y;
+	TTAGITEM tags[2];
 
-	TUINT *buf;
-	TINT bw = w * pw;
-	TINT bh = h * ph;
+	if (lua_type(L, 4) == LUA_TUSERDATA)
+	{
+		pm = checkpixmapptr(L, 4);
+		if (pm->pxm_Image.tpb_Data == TNULL)
+			return 0;
+		w = TMIN(luaL_optinteger(L, 5, pm->pxm_Width), pm->pxm_Width);
+		h = TMIN(luaL_optinteger(L, 6, pm->pxm_Height), pm->pxm_Height);
+		has_alpha = lua_isnoneornil(L, 9) ?
+			(pm->pxm_Flags & IMLFL_HAS_ALPHA) != 0 : lua_toboolean(L, 9);
+	}
+	else
+	{
+		luaL_checktype(L, 4, LUA_TTABLE);
+		w = luaL_checkinteger(L, 5);
+		h = luaL_checkinteger(L, 6);
+		has_alpha = lua_toboolean(L, 9);
+	}
+	pw = luaL_optinteger(L, 7, 1);
+	ph = luaL_optinteger(L, 8, 1);
+	if (w < 1 || h < 1 || pw < 1 || ph < 1)
+		return 0;
 
-	luaL_checktype(L, 4, LUA_TTABLE);
+	tags[0].tti_Tag = TVisual_AlphaChannel;
+	tags[0].tti_Value = has_alpha;
+	tags[1].tti_Tag = TTAG_DONE;
+	vis->vis_Dirty = TTRUE;
 
-	buf = TAlloc(TNULL, bw * bh * sizeof(TUINT));
-	if (buf)
+	if (pm && pw == 1 && ph == 1)
 	{
-		TUINT rgb;
-		TUINT *p = buf;
-		TINT i = i0;
-		TINT xx, yy, x, y;
+		TVisualDrawBuffer(vis->vis_Visual, x0, y0, pm->pxm_Image.tpb_Data,
+			w, h, pm->pxm_Width, tags);
+		return 0;
+	}
 
+	bw = w * pw;
+	bh = h * ph;
+	buf = tek_lib_visual_getdrawbuffer(L, vis, bw * bh * sizeof(TUINT));
+	p = buf;
+
+	if (pm)
+	{
 		for (y = 0; y < h; ++y)
 		{
 			TUINT *lp = p;
+			TUINT *s = (TUINT *) TVPB_GETADDRESS(&pm->pxm_Image, 0, y);
 			for (x = 0; x < w; ++x)
+				for (xx = 0; xx < pw; ++xx)
+					*p++ = s[x];
+			for (yy = 0; yy < ph - 1; ++yy)
 			{
+				TCopyMem(lp, p, bw * sizeof(TUINT));
+				p += bw;
+			}
+		}
+	}
+	else
+	{
+		TINT i = luaL_optinteger(L, 10, 0);
+		for (y = 0; y < h; ++y)
+		{
+			TUINT *lp = p;
+			for (x = 0; x < w; ++x)
+			{
+				TUINT rgb;
 				lua_rawgeti(L, 4, i++);
 				rgb = lua_tointeger(L, -1);
 				lua_pop(L, 1);
 				for (xx = 0; xx < pw; ++xx)
 					*p++ = rgb;
 			}
-
 			for (yy = 0; yy < ph - 1; ++yy)
 			{
 				TCopyMem(lp, p, bw * sizeof(TUINT));
 				p += bw;
 			}
 		}
-
-		TTAGITEM tags[2];
-		tags[0].tti_Tag = TVisual_AlphaChannel;
-		tags[0].tti_Value = has_alpha;
-		tags[1].tti_Tag = TTAG_DONE;
-		TVisualDrawBuffer(vis->vis_Visual, x0, y0, buf, bw, bh, bw, tags);
-
-		TFree(buf);
 	}
 
-	vis->vis_Dirty = TTRUE;
+	TVisualDrawBuffer(vis->vis_Visual, x0, y0, buf, bw, bh, bw, tags);
 	return 0;
 }
 
 /*-----------------------------------------------------------------------------
---	Visual:drawPixmap(pm, x0, y0, x1, y1): Draw pixmap.
+--	Visual:drawPixmap(pm, x0, y0[, x1, y1]): Draw pixmap. If the pixmap is
+--	drawn in its entirety, it is considered up to date afterwards, see also
+--	Visual:updatePixmap().
 -----------------------------------------------------------------------------*/
 
 LOCAL LUACFUNC TINT
@@ -2193,15 +3293,66 @@ tek_lib_visual_drawpixmap(lua_State *L)
 	TINT w = luaL_optinteger(L, 5, x0 + img->pxm_Width - 1) - x0 + 1;
 	TINT h = luaL_optinteger(L, 6, y0 + img->pxm_Height - 1) - y0 + 1;
 	TTAGITEM tags[2];
-	tags[0].tti_Tag = TVisual_AlphaChannel;
-	tags[0].tti_Value = img->pxm_Flags & IMLFL_HAS_ALPHA;
-	tags[1].tti_Tag = TTAG_DONE;
-	TVisualDrawBuffer(vis->vis_Visual, x0 + sx, y0 + sy,
-		img->pxm_Image.tpb_Data, w, h, img->pxm_Width, tags);
+	TAPTR native;
+	if (img->pxm_Image.tpb_Data == TNULL)
+		return 0;
+	w = TMIN(w, img->pxm_Width);
+	h = TMIN(h, img->pxm_Height);
+	if (w == img->pxm_Width && h == img->pxm_Height)
+		tek_lib_visual_cleanpixmap(img);
+	native = tek_lib_visual_getnativepixmap(img);
+	if (native)
+		TVisualDrawPixmap(vis->vis_Visual, native, x0 + sx, y0 + sy, w, h,
+			0, 0, TNULL);
+	else
+	{
+		tags[0].tti_Tag = TVisual_AlphaChannel;
+		tags[0].tti_Value = img->pxm_Flags & IMLFL_HAS_ALPHA;
+		tags[1].tti_Tag = TTAG_DONE;
+		TVisualDrawBuffer(vis->vis_Visual, x0 + sx, y0 + sy,
+			img->pxm_Image.tpb_Data, w, h, img->pxm_Width, tags);
+	}
 	vis->vis_Dirty = TTRUE;
 	return 0;
 }
 
+/*-----------------------------------------------------------------------------
+--	updated = Visual:updatePixmap(pm, x0, y0): Draws only the rows of a
+--	pixmap that were modified since it was last drawn in its entirety, and
+--	returns a boolean indicating whether anything was drawn. This is
+--	intended for pixmaps that are updated in place, e.g. using
+--	pixmap:setPixel(), pixmap:fill(), pixmap:blit() and
+--	pixmap:fromString(), and whose previous contents are still intact on
+--	the screen. Pixmaps with an alpha channel are blended over what is
+--	already on the screen, so their rows should be cleared first.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT
+tek_lib_visual_updatepixmap(lua_State *L)
+{
+	TEKVisual *vis = checkvisptr(L, 1);
+	TEKPixmap *img = checkpixmapptr(L, 2);
+	TINT x0 = luaL_checkinteger(L, 3) + vis->vis_ShiftX;
+	TINT y0 = luaL_checkinteger(L, 4) + vis->vis_ShiftY;
+	TINT y = img->pxm_DirtyY0;
+	TINT h = img->pxm_DirtyY1 - y + 1;
+	TBOOL updated = img->pxm_Image.tpb_Data && h > 0;
+	if (updated)
+	{
+		TTAGITEM tags[2];
+		tags[0].tti_Tag = TVisual_AlphaChannel;
+		tags[0].tti_Value = img->pxm_Flags & IMLFL_HAS_ALPHA;
+		tags[1].tti_Tag = TTAG_DONE;
+		TVisualDrawBuffer(vis->vis_Visual, x0, y0 + y,
+			TVPB_GETADDRESS(&img->pxm_Image, 0, y), img->pxm_Width, h,
+			img->pxm_Width, tags);
+		tek_lib_visual_cleanpixmap(img);
+		vis->vis_Dirty = TTRUE;
+	}
+	lua_pushboolean(L, updated);
+	return 1;
+}
+
 /*-----------------------------------------------------------------------------
 --	otx, oty = Visual:setTextureOrigin(tx, ty): Sets the texture origin for
 --	the drawing operations Visual:fillRect() and Visual:drawText(), and
@@ -2221,6 +3372,110 @@ tek_lib_visual_settextureorigin(lua_State *L)
 	return 2;
 }
 
+/*
+**	Gets a node for the stack of clipping rectangles and regions.
+*/
+
+static TEKClipNode *newclipnode(lua_State *L, TEKVisual *vis)
+{
+	struct TExecBase *TExecBase = vis->vis_ExecBase;
+	TEKClipNode *cn = (TEKClipNode *) TRemHead(&vis->vis_FreeRects);
+	if (cn == TNULL)
+	{
+		cn = TAlloc(TNULL, sizeof(TEKClipNode));
+		if (cn == TNULL)
+			luaL_error(L, "Out of memory");
+	}
+	cn->cn_Region = TNULL;
+	return cn;
+}
+
+/*
+**	Recalculates the clipping rectangle from the stack, and sends it to the
+**	visual. Regions are intersected only if the stack contains any; if the
+**	result is not a single rectangle, it is sent as a clipping region, and
+**	the clipping rectangle is set to its bounding box.
+*/
+
+static void updateclip(lua_State *L, TEKVisual *vis)
+{
+	struct TExecBase *TExecBase = vis->vis_ExecBase;
+	struct RectPool *pool = &vis->vis_RectPool;
+	struct TNode *next, *node = vis->vis_ClipStack.tlh_Head.tln_Succ;
+	TINT c[4] = { 0, 0, TEKUI_HUGE, TEKUI_HUGE };
+	TBOOL have_region = TFALSE;
+	TBOOL success = TTRUE;
+
+	vis->vis_ClipRegionNum = 0;
+	vis->vis_HaveClipRect = !TISLISTEMPTY(&vis->vis_ClipStack);
+	for (; (next = node->tln_Succ); node = next)
+	{
+		TEKClipNode *cn = (TEKClipNode *) node;
+		if (!region_intersect(c, cn->cn_Rect))
+		{
+			c[0] = c[1] = c[2] = c[3] = -1;
+			have_region = TFALSE;
+			break;
+		}
+		if (cn->cn_Region)
+			have_region = TTRUE;
+	}
+
+	if (have_region)
+	{
+		struct Region *R = region_new(pool, c);
+		success = R != TNULL;
+		node = vis->vis_ClipStack.tlh_Head.tln_Succ;
+		for (; success && (next = node->tln_Succ); node = next)
+		{
+			TEKClipNode *cn = (TEKClipNode *) node;
+			if (cn->cn_Region)
+				success = region_andregion(pool, R, cn->cn_Region);
+		}
+		if (success)
+		{
+			TINT num = R->rg_Rects.rl_NumNodes;
+			if (!region_getminmax(pool, R, c))
+				c[0] = c[1] = c[2] = c[3] = -1;
+			else if (num > 1)
+			{
+				TINT *r = vis->vis_ClipRegion;
+				if (num * 4 > vis->vis_ClipRegionSize)
+				{
+					TFree(r);
+					r = TAlloc(TNULL, sizeof(TINT) * 4 * num);
+					vis->vis_ClipRegion = r;
+					vis->vis_ClipRegionSize = r ? num * 4 : 0;
+					success = r != TNULL;
+				}
+				if (success)
+				{
+					node = R->rg_Rects.rl_List.tlh_Head.tln_Succ;
+					for (; (next = node->tln_Succ); node = next, r += 4)
+					{
+						struct RectNode *rn = (struct RectNode *) node;
+						r[0] = rn->rn_Rect[0];
+						r[1] = rn->rn_Rect[1];
+						r[2] = rn->rn_Rect[2];
+						r[3] = rn->rn_Rect[3];
+					}
+					vis->vis_ClipRegionNum = num;
+				}
+			}
+		}
+		if (R)
+			region_destroy(pool, R);
+	}
+
+	vis->vis_ClipRect[0] = c[0];
+	vis->vis_ClipRect[1] = c[1];
+	vis->vis_ClipRect[2] = c[2];
+	vis->vis_ClipRect[3] = c[3];
+	restoreclip(vis);
+	if (!success)
+		luaL_error(L, "Out of memory");
+}
+
 /*-----------------------------------------------------------------------------
 --	Visual:pushClipRect(x0, y0, x1, y1): Push a rectangle on top of the stack
 --	of clipping rectangles.
@@ -2230,26 +3485,25 @@ LOCAL LUACFUNC TINT
 tek_lib_visual_pushcliprect(lua_State *L)
 {
 	TEKVisual *vis = checkvisptr(L, 1);
-	struct TExecBase *TExecBase = vis->vis_ExecBase;
 	TINT sx = vis->vis_ShiftX;
 	TINT sy = vis->vis_ShiftY;
 	TINT x0 = luaL_checkinteger(L, 2) + sx;
 	TINT y0 = luaL_checkinteger(L, 3) + sy;
 	TINT x1 = luaL_checkinteger(L, 4) + sx;
 	TINT y1 = luaL_checkinteger(L, 5) + sy;
-	struct RectNode *clipnode = 
-		(struct RectNode *) TRemHead(&vis->vis_FreeRects);
-	if (clipnode == TNULL)
+	TEKClipNode *clipnode = newclipnode(L, vis);
+	clipnode->cn_Rect[0] = x0;
+	clipnode->cn_Rect[1] = y0;
+	clipnode->cn_Rect[2] = x1;
+	clipnode->cn_Rect[3] = y1;
+	TAddTail(&vis->vis_ClipStack, &clipnode->cn_Node);
+	
+	if (vis->vis_ClipRegionNum > 0)
 	{
-		clipnode = TAlloc(TNULL, sizeof(struct RectNode));
-		if (clipnode == TNULL)
-			luaL_error(L, "Out of memory");
+		/* intersect with the region in effect: */
+		updateclip(L, vis);
+		return 0;
 	}
-	clipnode->rn_Rect[0] = x0;
-	clipnode->rn_Rect[1] = y0;
-	clipnode->rn_Rect[2] = x1;
-	clipnode->rn_Rect[3] = y1;
-	TAddTail(&vis->vis_ClipStack, &clipnode->rn_Node);
 	
 	if (vis->vis_HaveClipRect)
 	{
@@ -2282,7 +3536,60 @@ tek_lib_visual_pushcliprect(lua_State *L)
 }
 
 /*-----------------------------------------------------------------------------
---	Visual:popClipRect(): Pop a rectangle from the top of the stack
+--	Visual:pushClipRegion(region): Push a [[#tek.lib.region : Region]] on
+--	top of the stack of clipping rectangles. Drawing is confined to the
+--	intersection of the region with the clipping rectangles and regions
+--	already on the stack. Use Visual:popClipRect() to remove it. The region
+--	is copied, so it may be modified or reused after this function returns.
+-----------------------------------------------------------------------------*/
+
+LOCAL LUACFUNC TINT 
+tek_lib_visual_pushclipregion(lua_State *L)
+{
+	TEKVisual *vis = checkvisptr(L, 1);
+	struct Region *region = luaL_checkudata(L, 2, TEK_LIB_REGION_CLASSNAME);
+	struct RectPool *pool = &vis->vis_RectPool;
+	TINT sx = vis->vis_ShiftX;
+	TINT sy = vis->vis_ShiftY;
+	TEKClipNode *clipnode = newclipnode(L, vis);
+	struct TNode *next, *node = region->rg_Rects.rl_List.tlh_Head.tln_Succ;
+	TINT *c = clipnode->cn_Rect;
+	struct Region *R = region_new(pool, TNULL);
+	TBOOL success = R != TNULL;
+
+	c[0] = c[1] = TEKUI_HUGE;
+	c[2] = c[3] = -TEKUI_HUGE;
+	for (; success && (next = node->tln_Succ); node = next)
+	{
+		struct RectNode *rn = (struct RectNode *) node;
+		TINT x0 = rn->rn_Rect[0] + sx;
+		TINT y0 = rn->rn_Rect[1] + sy;
+		TINT x1 = rn->rn_Rect[2] + sx;
+		TINT y1 = rn->rn_Rect[3] + sy;
+		/* rectangles of a region do not overlap: */
+		success = region_insertrect(pool, &R->rg_Rects, x0, y0, x1, y1);
+		c[0] = TMIN(c[0], x0);
+		c[1] = TMIN(c[1], y0);
+		c[2] = TMAX(c[2], x1);
+		c[3] = TMAX(c[3], y1);
+	}
+	if (!success)
+	{
+		if (R)
+			region_destroy(pool, R);
+		TAddHead(&vis->vis_FreeRects, &clipnode->cn_Node);
+		luaL_error(L, "Out of memory");
+	}
+	if (R->rg_Rects.rl_NumNodes == 0)
+		c[0] = c[1] = c[2] = c[3] = -1;
+	clipnode->cn_Region = R;
+	TAddTail(&vis->vis_ClipStack, &clipnode->cn_Node);
+	updateclip(L, vis);
+	return 0;
+}
+
+/*-----------------------------------------------------------------------------
+--	Visual:popClipRect(): Pop a rectangle or region from the top of the stack
 --	of clipping rectangles.
 -----------------------------------------------------------------------------*/
 
@@ -2290,48 +3597,17 @@ LOCAL LUACFUNC TINT
 tek_lib_visual_popcliprect(lua_State *L)
 {
 	TEKVisual *vis = checkvisptr(L, 1);
-	TINT x0 = -1;
-	TINT y0 = -1;
-	TINT x1 = -1;
-	TINT y1 = -1;
-	TINT have_cliprect = TFALSE;
-	TAddHead(&vis->vis_FreeRects, TRemTail(&vis->vis_ClipStack));
-	if (!TISLISTEMPTY(&vis->vis_ClipStack))
-	{
-		struct TNode *next, *node = vis->vis_ClipStack.tlh_Head.tln_Succ;
-		x0 = 0;
-		y0 = 0;
-		x1 = TEKUI_HUGE;
-		y1 = TEKUI_HUGE;
-		have_cliprect = TTRUE;
-		for (; (next = node->tln_Succ); node = next)
+	TEKClipNode *clipnode = (TEKClipNode *) TRemTail(&vis->vis_ClipStack);
+	if (clipnode)
+	{
+		if (clipnode->cn_Region)
 		{
-			struct RectNode *rn = (struct RectNode *) node;
-			TINT c0 = rn->rn_Rect[0];
-			TINT c1 = rn->rn_Rect[1];
-			TINT c2 = rn->rn_Rect[2];
-			TINT c3 = rn->rn_Rect[3];
-			if (!TEK_UI_OVERLAP(x0, y0, x1, y1, c0, c1, c2, c3))
-			{
-				x0 = y0 = x1 = y1 = -1;
-				break;
-			}
-			x0 = TMAX(x0, c0);
-			y0 = TMAX(y0, c1);
-			x1 = TMIN(x1, c2);
-			y1 = TMIN(y1, c3);
+			region_destroy(&vis->vis_RectPool, clipnode->cn_Region);
+			clipnode->cn_Region = TNULL;
 		}
+		TAddHead(&vis->vis_FreeRects, &clipnode->cn_Node);
 	}
-	vis->vis_HaveClipRect = have_cliprect;
-	vis->vis_ClipRect[0] = x0;
-	vis->vis_ClipRect[1] = y0;
-	vis->vis_ClipRect[2] = x1;
-	vis->vis_ClipRect[3] = y1;
-	if (have_cliprect)
-		TVisualSetClipRect(vis->vis_Visual, x0, y0, x1 - x0 + 1, y1 - y0 + 1,
-			TNULL);
-	else
-		TVisualUnsetClipRect(vis->vis_Visual);
+	updateclip(L, vis);
 	return 0;
 }
 
@@ -2434,9 +3710,11 @@ tek_lib_visual_setselection(lua_State *L)
 }
 
 /*-----------------------------------------------------------------------------
---	gradient = Visual.createGradient(x0, y0, x1, y1, rgb0, rgb1): If gradient
---	support is available, creates a gradient object with a gradient from the
---	coordinates x0,y0, with the color rgb0 to x1,y1, with the color rgb1.
+--	gradient = Visual.createGradient(x0, y0, x1, y1, rgb0, rgb1[, dither]):
+--	If gradient support is available, creates a gradient object with a
+--	gradient from the coordinates x0,y0, with the color rgb0 to x1,y1, with
+--	the color rgb1. If {{dither}} is '''true''', an ordered dither is
+--	applied, which avoids banding on displays with 16 bits per pixel.
 -----------------------------------------------------------------------------*/
 
 LOCAL LUACFUNC TINT tek_lib_visual_creategradient(lua_State *L)
@@ -2455,6 +3733,7 @@ LOCAL LUACFUNC TINT tek_lib_visual_creategradient(lua_State *L)
 	gr->B.r = (rgb1 & 0xff0000) >> 16;
 	gr->B.g = (rgb1 & 0xff00) >> 8;
 	gr->B.b = rgb1 & 0xff;
+	gr->dither = lua_toboolean(L, 7);
 	luaL_newmetatable(L, TEK_LIB_VISUALGRADIENT_CLASSNAME);
 	lua_setmetatable(L, -2);
 #else
@@ -40,6 +40,7 @@ static const luaL_Reg tek_lib_visual_funcs[] =
 	{ "getMsg", tek_lib_visual_getmsg },
 	{ "createPixmap", tek_lib_visual_createpixmap },
 	{ "createGradient", tek_lib_visual_creategradient },
+	{ "compileImage", tek_lib_visual_compileimage },
 	{ "getDisplayAttrs", tek_lib_visual_getdisplayattrs },
 	{ TNULL, TNULL }
 };
@@ -63,16 +64,19 @@ static const luaL_Reg tek_lib_visual_methods[] =
 	{ "textSize", tek_lib_visual_textsize_visual },
 	{ "setFont", tek_lib_visual_setfont },
 	{ "blitRect", tek_lib_visual_copyarea },
+	{ "blitRegions", tek_lib_visual_blitregions },
 	{ "setClipRect", tek_lib_visual_setcliprect },
 	{ "unsetClipRect", tek_lib_visual_unsetcliprect },
 	{ "setShift", tek_lib_visual_setshift },
 	{ "drawRGB", tek_lib_visual_drawrgb },
 	{ "drawPixmap", tek_lib_visual_drawpixmap },
+	{ "updatePixmap", tek_lib_visual_updatepixmap },
 	{ "getUserdata", tek_lib_visual_getuserdata },
 	{ "flush", tek_lib_visual_flush },
 	{ "setTextureOrigin", tek_lib_visual_settextureorigin },
 	{ "pushClipRect", tek_lib_visual_pushcliprect },
 	{ "popClipRect", tek_lib_visual_popcliprect },
+	{ "pushClipRegion", tek_lib_visual_pushclipregion },
 	{ "getClipRect", tek_lib_visual_getcliprect },
 	{ "setBGPen", tek_lib_visual_setbgpen },
 	{ "getSelection", tek_lib_visual_getselection },
@@ -90,6 +94,21 @@ static const luaL_Reg tek_lib_visual_fontmethods[] =
 	{ TNULL, TNULL }
 };
 
+static TINT tek_lib_visual_fonttextsizes(TAPTR fontud, TSTRPTR text,
+	TINT *runs, TINT *widths, TINT numruns)
+{
+	TEKFont *font = fontud;
+	if (font->font_Font == TNULL)
+		return 0;
+	return TVisualTextSizes(font->font_VisBase, font->font_Font, text, runs,
+		widths, numruns);
+}
+
+static const struct TEKUIFontAPI tek_lib_visual_fontapi =
+{
+	tek_lib_visual_fonttextsizes
+};
+
 static const luaL_Reg tek_lib_visual_pixmapmethods[] =
 {
 	{ "__gc", tek_lib_visual_freepixmap },
@@ -97,6 +116,9 @@ static const luaL_Reg tek_lib_visual_pixmapmethods[] =
 	{ "getPixel", tek_lib_visual_getpixmap },
 	{ "setPixel", tek_lib_visual_setpixmap },
 	{ "getAttrs", tek_lib_visual_getpixmapattr },
+	{ "fill", tek_lib_visual_fillpixmap },
+	{ "blit", tek_lib_visual_blitpixmap },
+	{ "fromString", tek_lib_visual_pixmapfromstring },
 	{ TNULL, TNULL }
 };
 
@@ -155,8 +177,12 @@ tek_lib_visual_open(lua_State *L)
 	vis->vis_TextureY = 0;
 	vis->vis_Display = visbase->vis_Display;
 	vis->vis_HaveClipRect = TFALSE;
+	vis->vis_ClipRegion = TNULL;
+	vis->vis_ClipRegionNum = 0;
+	vis->vis_ClipRegionSize = 0;
 	TINITLIST(&vis->vis_FreeRects);
 	TINITLIST(&vis->vis_ClipStack);
+	region_initpool(&vis->vis_RectPool, vis->vis_ExecBase);
 	
 	/* place ref to base in metatable: */
 	vis->vis_refBase = luaL_ref(L, -2);
@@ -435,11 +461,19 @@ tek_lib_visual_close(lua_State *L)
 
 	if (vis->vis_Visual)
 	{
-		struct TNode *node;
-		while ((node = TRemHead(&vis->vis_ClipStack)))
+		TEKClipNode *node;
+		while ((node = (TEKClipNode *) TRemHead(&vis->vis_ClipStack)))
+		{
+			if (node->cn_Region)
+				region_destroy(&vis->vis_RectPool, node->cn_Region);
 			TFree(node);
-		while ((node = TRemHead(&vis->vis_FreeRects)))
+		}
+		while ((node = (TEKClipNode *) TRemHead(&vis->vis_FreeRects)))
 			TFree(node);
+		region_destroypool(&vis->vis_RectPool);
+		TFree(vis->vis_ClipRegion);
+		vis->vis_ClipRegion = TNULL;
+		vis->vis_ClipRegionNum = 0;
 		
 		if (vis->vis_Device)
 			TDisplayFreeReq(vis->vis_Device, 
@@ -463,6 +497,8 @@ tek_lib_visual_close(lua_State *L)
 #endif
 			TVisualCloseFont(vis->vis_Base, vis->vis_Font);
 			TCloseModule(vis->vis_Base);
+			/* pixmaps collected hereafter must not access the display: */
+			vis->vis_Base = TNULL;
 		}
 		/* collected visual base; remove TEKlib module: */
 		TRemModules((struct TModInitNode *) &vis->vis_InitModules, 0);
@@ -578,6 +614,15 @@ TMODENTRY int luaopen_tek_lib_visual(lua_State *L)
 	tek_lua_register(L, NULL, tek_lib_visual_pixmapmethods, 0);
 	lua_pop(L, 1);
 	
+	/* prepare image metatable: */
+	luaL_newmetatable(L, TEK_LIB_VISUALIMAGE_CLASSNAME);
+	/* s: meta */
+	lua_pushcfunction(L, tek_lib_visual_freeimage);
+	/* s: meta, freefunc */
+	lua_setfield(L, -2, "__gc");
+	/* s: meta */
+	lua_pop(L, 1);
+
 	/* prepare font metatable and store reference in metatable: */
 	luaL_newmetatable(L, TEK_LIB_VISUALFONT_CLASSNAME);
 	/* s: fontmeta */
@@ -586,6 +631,11 @@ TMODENTRY int luaopen_tek_lib_visual(lua_State *L)
 	lua_setfield(L, -2, "__index");
 	/* s: fontmeta */
 	tek_lua_register(L, NULL, tek_lib_visual_fontmethods, 0);
+	/* native interface for batched measurements: */
+	lua_pushlightuserdata(L, (void *) &tek_lib_visual_fontapi);
+	/* s: fontmeta, fontapi */
+	lua_setfield(L, -2, TEKUI_FONTAPI);
+	/* s: fontmeta */
 	lua_pop(L, 1);
 
 	/* Add visual module to TEKlib's internal module list: */
@@ -17,13 +17,15 @@
 
 #define TEK_VISUAL_DEBUG
 
-#define TEK_LIB_VISUAL_VERSION "Visual 4.3"
+#define TEK_LIB_VISUAL_VERSION "Visual 4.13"
 #define TEK_LIB_VISUAL_BASECLASSNAME "tek.lib.visual.base*"
 #define TEK_LIB_VISUAL_CLASSNAME "tek.lib.visual*"
 #define TEK_LIB_VISUALPEN_CLASSNAME "tek.lib.visual.pen*"
 #define TEK_LIB_VISUALFONT_CLASSNAME "tek.lib.visual.font*"
 #define TEK_LIB_VISUALPIXMAP_CLASSNAME "tek.lib.visual.pixmap*"
 #define TEK_LIB_VISUALGRADIENT_CLASSNAME "tek.lib.visual.gradient*"
+#define TEK_LIB_VISUALIMAGE_CLASSNAME "tek.lib.visual.image*"
+#define TEK_LIB_REGION_CLASSNAME "tek.lib.region*"
 
 /*****************************************************************************/
 
@@ -95,6 +97,8 @@ typedef struct TEKVisual
 	struct TMsgPort *vis_IMsgPort;
 	
 	TINT *vis_DrawBuffer;
+	/* Number of images compiled (in base): */
+	TUINT vis_ImageSerial;
 	
 	TBOOL vis_Dirty;
 	TAPTR vis_Device;
@@ -104,6 +108,11 @@ typedef struct TEKVisual
 	struct TList vis_ClipStack;
 	RECTINT vis_ClipRect[4];
 	TBOOL vis_HaveClipRect;
+	/* Rectangles of the clipping region in effect, if not a single rect: */
+	TINT *vis_ClipRegion;
+	TINT vis_ClipRegionNum;
+	TINT vis_ClipRegionSize;
+	struct RectPool vis_RectPool;
 	
 	struct TEKPen *vis_BGPen;
 	int vis_refBGPen;
@@ -136,15 +145,62 @@ typedef struct TEKPen
 	TVPEN pen_Pen;
 	/* Visual: */
 	TEKVisual *pen_Visual;
+	/* Color, as passed to allocPen: */
+	TUINT pen_RGB;
 
 } TEKPen;
 
+typedef struct
+{
+	/* Format code, see Visual:drawImage(): */
+	TINT prm_Format;
+	/* Number of points: */
+	TINT prm_NumPoints;
+	/* Index of the first point in the image's coordinates: */
+	TINT prm_First;
+	/* Index of the pen key, -1 if undefined: */
+	TINT prm_Pen;
+	/* Index of the first pen key per point, -1 if not applicable: */
+	TINT prm_PointPens;
+} TEKImagePrim;
+
+#define TEKIMAGE_ANTIALIAS	0x0001
+#define TEKIMAGE_POINTPENS	0x0002
+
+typedef struct
+{
+	/* Number of primitives: */
+	TINT img_NumPrims;
+	/* Maximum number of points in a primitive: */
+	TINT img_MaxPoints;
+	/* Number of distinct pen keys: */
+	TINT img_NumPens;
+	/* Reference to the table of pen keys: */
+	int img_refPens;
+	/* Identifies the image in the pixmap cache, 0 if not cached: */
+	TUINT img_Serial;
+	/* See TEKIMAGE_*: */
+	TUINT img_Flags;
+	/* Primitive records: */
+	TEKImagePrim *img_Prims;
+	/* Coordinates, pairs of 0 to 0xffff: */
+	TINT *img_Coords;
+	/* Pen keys per point: */
+	TINT *img_PointPens;
+} TEKImage;
+
 typedef struct
 {
 	struct TVPixBuf pxm_Image;
 	TINT pxm_Width, pxm_Height;
 	TUINT pxm_Flags;
 	TEKVisual *pxm_VisualBase;
+	/* Range of rows modified since last drawn, empty if y0 > y1: */
+	TINT pxm_DirtyY0, pxm_DirtyY1;
+	/* Copy of the pixels in the display's format, or TNULL: */
+	TAPTR pxm_Native;
+	/* Draws since last modified; -1 if no native copy can be made: */
+	TINT pxm_NumDraws;
 } TEKPixmap;
 
 typedef struct
@@ -162,6 +218,15 @@ typedef struct
 
 } TEKFont;
 
+typedef struct
+{
+	struct TNode cn_Node;
+	/* Clipping rectangle, or bounding box of the region: */
+	RECTINT cn_Rect[4];
+	/* Clipping region, or TNULL for a plain rectangle: */
+	struct Region *cn_Region;
+} TEKClipNode;
+
 
 #if defined(ENABLE_GRADIENT)
 
@@ -175,6 +240,8 @@ typedef struct {
 typedef struct
 {
 	rgbpt A, B;
+	/* apply ordered dither: */
+	TUINT8 dither;
 } TEKGradient;
 
 #endif
@@ -205,12 +272,17 @@ LOCAL LUACFUNC TINT tek_lib_visual_line(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_plot(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_text(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_drawimage(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_compileimage(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_freeimage(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_drawpixmap(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_updatepixmap(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_getattrs(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_setattrs(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_textsize_visual(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_setfont(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_copyarea(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_blitregions(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_pushclipregion(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_setcliprect(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_unsetcliprect(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_setshift(lua_State *L);
@@ -221,6 +293,9 @@ LOCAL LUACFUNC TINT tek_lib_visual_createpixmap(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_freepixmap(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_getpixmap(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_setpixmap(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_fillpixmap(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_blitpixmap(lua_State *L);
+LOCAL LUACFUNC TINT tek_lib_visual_pixmapfromstring(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_flush(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_settextureorigin(lua_State *L);
 LOCAL LUACFUNC TINT tek_lib_visual_pushcliprect(lua_State *L);
@@ -142,7 +142,7 @@ local ui = _M
 
 local ui = { }
 package.loaded["tek.ui"] = ui
-ui._VERSION = "tekUI 54.1" -- module version string
+ui._VERSION = "tekUI 54.2" -- module version string
 
 ui.VERSION = 112 -- overall package version number
 ui.VERSIONSTRING = 
@@ -1142,5 +1142,7 @@ ui.FL_DONOTBLIT     = 0x0020000 -- redrawing the element should not initiate bli
 ui.FL_KEEPMINWIDTH  = 0x0040000 -- element maintains its minimal width
 ui.FL_KEEPMINHEIGHT = 0x0080000 -- element maintains its minimal height
 ui.FL_NOFOCUS       = 0x0100000 -- element does not accept the input focus
+ui.FL_RELAYOUT      = 0x0200000 -- element and its children need relayouting
+ui.FL_RELAYOUTCHILD = 0x0400000 -- a child of the element needs relayouting
 
 return ui
@@ -42,6 +42,11 @@
 --			sheets are separated by spaces. The last style sheet has the
 --			highest precedence, e.g. {{"desktop texture"}} would load the
 --			style sheets {{desktop.css}} and {{texture.css}}.
+--		- {{CoroutineBudget [IG]}} (number)
+--			Time in milliseconds that the application spends on resuming
+--			coroutines per iteration of its main loop, before returning
+--			to servicing messages and updates. When idle, the same budget
+--			applies to incremental garbage collection. Default: {{8}}
 --		- {{Copyright [IG]}} (string)
 --			Copyright notice applying to the application, default
 --			{{"unknown"}}
@@ -53,13 +58,28 @@
 --			or author manufacturing the application (preferrably without
 --			domain parts like {{"www."}} if they are not significant for
 --			identification). Default is {{"unknown"}}.
+--		- {{FrameRate [IG]}} (number)
+--			Number of frames per second targeted when updating the
+--			application's windows. Layout and repaint requests are
+--			accumulated across messages, and windows are updated and
+--			flushed at most once per frame. The first frame after a period
+--			of inactivity is drawn immediately. A value of {{0}} disables
+--			frame scheduling, so that windows are updated after every batch
+--			of messages. Default: {{60}}
 --		- {{GCControl [IG]}} (boolean or string)
 --			The application can perform a garbage collection of the specified
 --			type directly before getting suspended waiting for input. If set
 --			to '''false''', no explicit garbage collection is initiated. If
---			the value is '''true''' or {{"step"}}, the application performs a
---			single garbage collection step. Other values (e.g. {{"collect"}})
---			are passed unmodified to {{collectgarbage()}}. Default: '''true'''
+--			the value is '''true''' or {{"step"}}, the application performs
+--			incremental garbage collection steps, within the time budget
+--			given by {{CoroutineBudget}}, if memory was allocated since the
+--			last cycle was completed; see also Application:getGCStats().
+--			Other values (e.g. {{"collect"}}) are passed unmodified to
+--			{{collectgarbage()}}. Default: '''true'''
+--		- {{NumWorkers [IG]}} (number)
+--			Number of worker tasks in the application's
+--			[[#tek.ui.class.workerpool : WorkerPool]], which is created
+--			on demand by Application:getWorkerPool(). Default: {{2}}
 --		- {{ProgramName [IG]}} (string)
 --			Name of the application, as displayed to the user. This is
 --			also the fallback for the {{Title}} attribute in windows.
@@ -85,17 +105,27 @@
 --		- Application:connect() - Connects children recursively
 --		- Application:easyRequest() - Opens a message box
 --		- Application:getById() - Returns an element by Id
+--		- Application:getFrameStats() - Returns frame scheduling statistics
+--		- Application:getGCStats() - Returns garbage collection statistics
 --		- Application:getChildren() - Returns the application's children
 --		- Application:getGroup() - Returns the application's group
 --		- Application:getLocale() - Returns a locale for the application
+--		- Application:getWakeups() - Returns the rate of wakeups from idle
+--		- Application:getWorkerPool() - Returns the application's worker pool
+--		- Application:joinTask() - Synchronizes on completion of a child task
+--		- Application:loadImage() - Loads a picture asynchronously
 --		- Application:quit() - Quits the application
 --		- Application:obtainClipboard() - Obtain application clipboard access
 --		- Application:releaseClipboard() - Release application clipboard
 --		- Application:remInputHandler() - Removes a registered input handler
 --		- Application:requestFile() - Opens a file requester
 --		- Application:run() - Runs the application
+--		- Application:runTask() - Runs a function in a child task
+--		- Application:setCoroutinePriority() - Sets a coroutine's priority
+--		- Application:signalEvent() - Wakes up coroutines waiting for an event
 --		- Application:suspend() - Suspends the caller's coroutine
 --		- Application:up() - Function called when the application is up
+--		- Application:waitEvent() - Suspends the caller waiting for an event
 --
 --	OVERRIDES::
 --		- Family:addMember()
@@ -119,6 +149,7 @@ local costatus = coroutine.status
 local coyield = coroutine.yield
 local floor = math.floor
 local getmsg = Display.getMsg
+local gettime = Display.getTime
 local insert = table.insert
 local io_open = io.open
 local max = math.max
@@ -132,7 +163,7 @@ local unpack = unpack or table.unpack
 local wait = Display.wait
 
 local Application = Family.module("tek.ui.class.application", "tek.ui.class.family")
-Application._VERSION = "Application 43.1"
+Application._VERSION = "Application 44.3"
 
 -------------------------------------------------------------------------------
 --	Constants & Class data:
@@ -141,6 +172,8 @@ Application._VERSION = "Application 43.1"
 local MSG_USER = ui.MSG_USER
 local MSG_SIGNAL = ui.MSG_SIGNAL
 local MSGTYPES = { MSG_USER, MSG_SIGNAL }
+local SIG_CHILD = 0x40 -- TTASK_SIG_CHLD
+local GC_IDLE_KB = 64 -- min. allocation for garbage collection when idle
 
 -------------------------------------------------------------------------------
 --	new: overrides
@@ -156,11 +189,17 @@ function Application.new(class, self)
 	self.Author = self.Author or "unknown"
 	self.Clipboard = self.Clipboard or { }
 	self.Copyright = self.Copyright or "unknown"
+	self.CoroutineBudget = self.CoroutineBudget or 8
 	self.Coroutines = { }
+	self.CurrentCoroutine = false
 	self.Display = self.Display or false
 	self.Domain = self.Domain or "unknown"
 	self.ElementById = { }
 	self.FocusWindow = false
+	self.FrameRate = self.FrameRate or 60
+	self.FrameStats = { 0, 0, 0 } -- frames, late, dropped
+	self.GCStats = { 0, 0, 0, 0 } -- steps, time, max. pause, kbytes
+	self.WakeupStats = { 0, 0 } -- wakeups, since
 	local t = self.GCControl
 	if t == nil or t == true then
 		self.GCControl = "step"
@@ -178,6 +217,10 @@ function Application.new(class, self)
 	end
 	self.ProgramName = self.ProgramName or self.Title or "tekUI"
 	self.Status = "init"
+	self.NumTasks = 0 -- number of tasks started with runTask()
+	self.NumWorkers = self.NumWorkers or 2
+	self.WorkerPool = false
+	self.ImageLoader = false
 	Application.initStylesheets(self)
 	
 	self = Family.new(class, self)
@@ -511,6 +554,19 @@ function Application:closeWindow(window)
 	-- NOTE: windows are purged from OpenWindows list during wait()
 end
 
+-------------------------------------------------------------------------------
+--	frames, late, dropped = getFrameStats(): Returns the number of frames
+--	drawn by the application's frame scheduler, the number of frames that
+--	were drawn later than one frame period after their deadline, and the
+--	number of frame periods that were missed in total. See also the
+--	{{FrameRate}} attribute.
+-------------------------------------------------------------------------------
+
+function Application:getFrameStats()
+	local fs = self.FrameStats
+	return fs[1], fs[2], fs[3]
+end
+
 -------------------------------------------------------------------------------
 --	quit(): Quits the application.
 -------------------------------------------------------------------------------
@@ -531,7 +587,8 @@ end
 -- 	Message handlers: passAlways() passes a message always, passMsgNoModal()
 --	passes a message only to the modal window (if there is one),
 --	passMsgNewSize() bundles new sizes, passMsgRefresh() bundles damages for
---	the current window.
+--	the current window. Superseded mouse movements and intervals are already
+--	skipped, and refreshes merged, by Display.getMsg().
 -------------------------------------------------------------------------------
 
 function Application:passMsgAlways(msg)
@@ -563,6 +620,7 @@ function Application:passMsgRefresh(msg)
 	local win = msg[-1]
 	-- bundle damage rects:
 	local refresh = win.RefreshMsg
+	local rects = msg[13] or { msg[7], msg[8], msg[9], msg[10] }
 	if not refresh then
 		refresh = win.RefreshMsgStore
 		win.RefreshMsg = refresh
@@ -570,12 +628,17 @@ function Application:passMsgRefresh(msg)
 		refresh[8] = msg[8]
 		refresh[9] = msg[9]
 		refresh[10] = msg[10]
+		refresh[13] = rects
 	else
-		-- bundle damage rect:
+		-- bundle bounding box and rectangles:
 		refresh[7] = min(refresh[7], msg[7])
 		refresh[8] = min(refresh[8], msg[8])
 		refresh[9] = max(refresh[9], msg[9])
 		refresh[10] = max(refresh[10], msg[10])
+		local r = refresh[13]
+		for i = 1, #rects do
+			r[#r + 1] = rects[i]
+		end
 	end
 	refresh[0] = msg[0] -- update timestamp
 	refresh[1] = msg[1]
@@ -612,6 +675,15 @@ function Application:passMsgInterval(msg)
 	im[1] = msg[1]
 end
 
+-------------------------------------------------------------------------------
+--	getmillis: Gets the system time in 1/1000th seconds - internal
+-------------------------------------------------------------------------------
+
+local function getmillis()
+	local s, us = gettime()
+	return s * 1000 + us / 1000
+end
+
 -------------------------------------------------------------------------------
 -- 	success, status = run(): Runs the application. Returns when all child
 --	windows are closed or when the application's {{Status}} is set to "quit".
@@ -631,6 +703,15 @@ function Application:run()
 	local wmsg = { } -- window message
 	local msgdispatch = self.MsgDispatch
 
+	-- frame scheduling, in milliseconds:
+	local framerate = self.FrameRate
+	local period = framerate and framerate > 0 and 1000 / framerate
+	local nextframe = 0 -- deadline for the next frame
+	local pending = false -- updates were deferred to the next frame
+	local fs = self.FrameStats
+	local ws = self.WakeupStats
+	ws[1], ws[2] = 0, getmillis()
+
 	self:up()
 
 	-- the main loop:
@@ -660,6 +741,11 @@ function Application:run()
 			end
 		end
 
+		local now = period and getmillis()
+		local due = not period or now >= nextframe
+		local drawn = false
+		local deferred = false -- updates deferred in this pass
+
 		-- process remaining messages for all open windows:
 		for i = 1, #ow do
 			local win = ow[i]
@@ -680,10 +766,37 @@ function Application:run()
 				win:passMsg(win.IntervalMsg)
 				win.IntervalMsg = false
 			end
-			-- general update:
-			win:update()
+			-- general update, if a frame is due:
+			if win:checkUpdate() then
+				if due then
+					win:update()
+					drawn = true
+				else
+					deferred = true
+				end
+			end
 		end
 
+		if drawn and period then
+			fs[1] = fs[1] + 1
+			local late = now - nextframe
+			if not pending then
+				-- first frame after idle:
+				nextframe = now + period
+			elseif late < period then
+				-- on schedule, keep the cadence:
+				nextframe = nextframe + period
+			else
+				local dropped = floor(late / period)
+				fs[2] = fs[2] + 1
+				fs[3] = fs[3] + dropped
+				db.info("frame late by %dms, %d dropped", floor(late),
+					dropped)
+				nextframe = now + period
+			end
+		end
+		pending = deferred
+
 		-- service coroutines; idle means they are all suspended:
 		local idle = self:serviceCoroutines()
 
@@ -696,19 +809,47 @@ function Application:run()
 
 		-- wait if no coroutines are running, and windows are open:
 		if idle and #ow > 0 then
-			if gcarg then
+			if gcarg == "step" then
+				self:collectGarbage()
+			elseif gcarg then
 				collectgarbage(gcarg)
 			end
-			wait()
+			if pending then
+				-- wait no longer than until the next frame is due:
+				wait(max(nextframe - getmillis(), 0))
+			else
+				wait()
+			end
+			ws[1] = ws[1] + 1
 		end
 
 	end
 
+	if self.WorkerPool then
+		self.WorkerPool:shutdown()
+	end
+
 	self:hide()
 
 	return true, self.Status
 end
 
+-------------------------------------------------------------------------------
+--	rate = getWakeups(): Returns the number of times per second the
+--	application was woken up from waiting for input, measured over the
+--	time since the previous call, or since the application started running.
+--	This includes wakeups by interval timers; an idle application should
+--	report a rate close to zero.
+-------------------------------------------------------------------------------
+
+function Application:getWakeups()
+	local ws = self.WakeupStats
+	local now = getmillis()
+	local rate = ws[1] * 1000 / max(now - ws[2], 1)
+	ws[1], ws[2] = 0, now
+	return rate
+end
+
 -------------------------------------------------------------------------------
 --	addCoroutine(function, arg1, ...): Adds the specified function
 --	and arguments to the application as a new coroutine, and returns to the
@@ -720,39 +861,244 @@ end
 
 function Application:addCoroutine(func, ...)
 	local arg = { ... }
-	insert(self.Coroutines, { cocreate(function() func(unpack(arg)) end) } )
+	-- coroutine, waiting, priority, event, value, round:
+	insert(self.Coroutines, { cocreate(function() func(unpack(arg)) end),
+		false, 0, false, nil, 0 })
 end
 
 -------------------------------------------------------------------------------
---	idle = serviceCoroutines() - internal
+--	setCoroutinePriority(priority): Sets the priority of the calling
+--	coroutine, which must have been started with Application:addCoroutine().
+--	Coroutines of higher priority are resumed first. The default priority
+--	is {{0}}.
 -------------------------------------------------------------------------------
 
-function Application:serviceCoroutines()
+function Application:setCoroutinePriority(pri)
+	local c = self.CurrentCoroutine
+	assert(c and c[1] == corunning(), "Not in an application coroutine")
+	c[3] = pri
+end
+
+-------------------------------------------------------------------------------
+--	value = waitEvent(event): Suspends the calling coroutine, which must
+--	have been started with Application:addCoroutine(), until the specified
+--	event is signaled using Application:signalEvent(). The event can be any
+--	value except '''nil''' and '''false'''. A coroutine waiting for an event
+--	does not keep the application from going to sleep. Returns the value
+--	that was passed to Application:signalEvent().
+-------------------------------------------------------------------------------
+
+function Application:waitEvent(event)
+	local c = self.CurrentCoroutine
+	assert(c and c[1] == corunning(), "Not in an application coroutine")
+	assert(event, "Invalid event")
+	c[4] = event
+	return coyield(true)
+end
+
+-------------------------------------------------------------------------------
+--	num = signalEvent(event[, value]): Wakes up all coroutines waiting for
+--	the specified event using Application:waitEvent(), and passes them the
+--	optional value. Returns the number of coroutines woken up.
+-------------------------------------------------------------------------------
+
+function Application:signalEvent(event, value)
 	local crt = self.Coroutines
-	local c = remove(crt, 1)
-	if c then
-		local success, res = coresume(c[1])
-		local s = costatus(c[1])
-		if s == "suspended" then
-			c[2] = res or false -- extra argument from yield
-			insert(crt, c)
-		else
-			if success then
-				db.info("Coroutine finished successfully")
-			else
-				db.error("Error in coroutine:\n%s\n%s", res, traceback(c[1]))
-			end
+	local n = 0
+	for i = 1, #crt do
+		local c = crt[i]
+		if c[4] == event then
+			c[2], c[4], c[5] = false, false, value
+			n = n + 1
 		end
 	end
+	return n
+end
+
+-------------------------------------------------------------------------------
+--	idle = serviceCoroutines([budget]) - internal: Resumes coroutines in the
+--	order of their priority until the time budget (in milliseconds, by
+--	default {{CoroutineBudget}}) is exhausted. Coroutines that suspended
+--	themselves on a window are resumed once per call, busy coroutines as
+--	often as the budget permits, and coroutines waiting for an event only
+--	after it was signaled. Returns '''true''' if no coroutine is busy.
+-------------------------------------------------------------------------------
+
+local function resumecoroutine(self, c)
+	local co = c[1]
+	local value = c[5]
+	c[5] = nil
+	self.CurrentCoroutine = c
+	local success, res = coresume(co, value)
+	self.CurrentCoroutine = false
+	if costatus(co) == "suspended" then
+		c[2] = res or false -- extra argument from yield
+		return true
+	end
+	if success then
+		db.info("Coroutine finished successfully")
+	else
+		db.error("Error in coroutine:\n%s\n%s", res, traceback(co))
+	end
+end
+
+function Application:serviceCoroutines(budget)
+	local crt = self.Coroutines
+	if #crt > 0 then
+		local round = (self.CoroutineRound or 0) + 1
+		self.CoroutineRound = round
+		local deadline = getmillis() + (budget or self.CoroutineBudget)
+		repeat
+			-- first runnable coroutine of highest priority:
+			local c, ci
+			for i = 1, #crt do
+				local e = crt[i]
+				if not e[4] and (not e[2] or e[6] ~= round) and
+					(not c or e[3] > c[3]) then
+					c, ci = e, i
+				end
+			end
+			if not c then
+				break
+			end
+			remove(crt, ci)
+			c[6] = round
+			if resumecoroutine(self, c) then
+				insert(crt, c)
+			end
+		until getmillis() >= deadline
+	end
 	for i = 1, #crt do
 		local c = crt[i]
-		if not c[2] then
+		if not c[2] and not c[4] then
 			return false -- a coroutine is running
 		end
 	end
 	return true -- all coroutines are idle
 end
 
+-------------------------------------------------------------------------------
+--	collectGarbage() - internal: Performs incremental garbage collection
+--	steps while the application is idle, until a cycle is completed or the
+--	time budget is exhausted. Nothing is done if less than {{GC_IDLE_KB}}
+--	kilobytes were allocated since the last cycle was completed.
+-------------------------------------------------------------------------------
+
+function Application:collectGarbage(budget)
+	local gs = self.GCStats
+	if collectgarbage("count") - gs[4] < GC_IDLE_KB then
+		return
+	end
+	local t0 = getmillis()
+	local deadline = t0 + (budget or self.CoroutineBudget)
+	repeat
+		local done = collectgarbage("step")
+		local t1 = getmillis()
+		local pause = t1 - t0
+		gs[1] = gs[1] + 1
+		gs[2] = gs[2] + pause
+		if pause > gs[3] then
+			gs[3] = pause
+		end
+		if done then
+			gs[4] = collectgarbage("count")
+			break
+		end
+		t0 = t1
+	until t1 >= deadline
+end
+
+-------------------------------------------------------------------------------
+--	steps, time, maxpause = getGCStats(): Returns the number of incremental
+--	garbage collection steps that were performed while the application was
+--	idle, the total time spent on them, and the longest pause caused by a
+--	single step, both in milliseconds. See also {{GCControl}}.
+-------------------------------------------------------------------------------
+
+function Application:getGCStats()
+	local gs = self.GCStats
+	return gs[1], gs[2], gs[3]
+end
+
+-------------------------------------------------------------------------------
+--	task = runTask(func, ...): Runs a Lua function in a child task, using
+--	{{tek.lib.exec}}; see Exec.run() for the arguments. The child task can
+--	send messages of the type {{ui.MSG_USER}} back to the application using
+--	{{exec.sendport("*p", "ui", msg)}}. Unlike with a plain Exec.run(), the
+--	application does not quit when a task started by this function finishes.
+--	Errors in the child should be caught using {{pcall()}} in the child,
+--	because they are otherwise propagated to the application. Returns the
+--	child task handle, or '''nil''' if the task could not be started. Tasks
+--	started this way must be finished using Application:joinTask().
+-------------------------------------------------------------------------------
+
+function Application:runTask(...)
+	local success, exec = pcall(require, "tek.lib.exec")
+	local task = success and exec.run(...)
+	if task then
+		self.NumTasks = self.NumTasks + 1
+		return task
+	end
+end
+
+-------------------------------------------------------------------------------
+--	pool = getWorkerPool(): Returns the application's
+--	[[#tek.ui.class.workerpool : WorkerPool]], creating it on the first
+--	call. Its worker tasks are started when the first job is submitted, and
+--	stopped when the application's main loop is left.
+-------------------------------------------------------------------------------
+
+function Application:getWorkerPool()
+	local pool = self.WorkerPool
+	if not pool then
+		pool = ui.require("workerpool", 1):new
+		{
+			Application = self,
+			NumWorkers = self.NumWorkers
+		}
+		self.WorkerPool = pool
+	end
+	return pool
+end
+
+-------------------------------------------------------------------------------
+--	image = loadImage(fname[, width[, height]]): Loads a picture from a file
+--	in the application's worker tasks, using an
+--	[[#tek.ui.class.imageloader : ImageLoader]], which is created on the
+--	first call. The returned image object serves as a placeholder until the
+--	picture has arrived; see ImageLoader:load() for details.
+-------------------------------------------------------------------------------
+
+function Application:loadImage(fname, width, height)
+	local loader = self.ImageLoader
+	if not loader then
+		loader = ui.require("imageloader", 1):new { Application = self }
+		self.ImageLoader = loader
+	end
+	return loader:load(fname, width, height)
+end
+
+-------------------------------------------------------------------------------
+--	success, ... = joinTask(task[, mode]): Synchronizes on completion of a
+--	child task that was started with Application:runTask(). {{mode}} can be
+--	{{"join"}} (the default), {{"terminate"}} or {{"abort"}}; see the
+--	corresponding methods of the child task handle in {{tek.lib.exec}}.
+-------------------------------------------------------------------------------
+
+local function taskjoined(self, ...)
+	self.NumTasks = self.NumTasks - 1
+	if self.NumTasks == 0 then
+		-- the task signals its parent before it ends; if this signal is
+		-- still pending, it would arrive when no task is accounted for:
+		require "tek.lib.exec".getsignals("c")
+	end
+	return ...
+end
+
+function Application:joinTask(task, mode)
+	return taskjoined(self, task[mode or "join"](task))
+end
+
 -------------------------------------------------------------------------------
 --	suspend([window]): Suspends the caller (which must be running
 --	in a coroutine) until it is getting rescheduled by the application.
@@ -1069,6 +1415,10 @@ local MsgHandlers =
 		return msg
 	end,
 	[MSG_SIGNAL] = function(self, msg)
+		if msg[3] == SIG_CHILD and self.NumTasks > 0 then
+			-- a task started with runTask() has finished:
+			return msg
+		end
 		db.warn("received signal, quit")
 		self:quit()
 		return msg
@@ -62,6 +62,10 @@
 --			of its size.
 --			- {{FL_POPITEM}} - Used to identify elements in popups, handled in
 --			[[#tek.ui.class.popitem : PopItem]].
+--			- {{FL_RELAYOUT}}, {{FL_RELAYOUTCHILD}} - Set in
+--			Area:rethinkLayout() on the element and its parents, respectively.
+--			A [[#tek.ui.class.group : Group]] whose rectangle is unchanged
+--			layouts its children only if one of these flags is present.
 --		- {{Focus [SG]}} (boolean)
 --			If '''true''', the element has the input focus. This state variable
 --			is handled by the [[#tek.ui.class.widget : Widget]] class. Note:
@@ -185,11 +189,13 @@
 --		[[#tek.lib.region : Region]]
 --		- Area:rethinkLayout() - Causes a relayout of the element and its group
 --		- Area:setFlags() - Sets an element's flags
+--		- Area:setRect() - Sets the element's layouted rectangle
 --		- Area:setState() - Sets the background attribute of an element
 --		- Area:show() - Gets called when the element is about to be shown
 --
 --	OVERRIDES::
 --		- Element:cleanup()
+--		- Element:decodeProperties()
 --		- Object.init()
 --		- Class.new()
 --		- Element:onSetStyle()
@@ -198,7 +204,7 @@
 -------------------------------------------------------------------------------
 
 module("tek.ui.class.area", tek.ui.class.element)
-_VERSION = "Area 57.5"
+_VERSION = "Area 58.2"
 local Area = _M
 Element:newClass(Area)
 
@@ -217,7 +223,7 @@ Element:newClass(Area)
 #define AREA_CLASS_NAME "tek.ui.class.area"
 
 /* Version string: */
-#define AREA_CLASS_VERSION "Area 57.5"
+#define AREA_CLASS_VERSION "Area 58.3"
 
 /* Required tekui version: */
 #define AREA_TEKUI_VERSION 112
@@ -325,6 +331,162 @@ static lua_Integer getnumfield(lua_State *L, int idx, const char *key)
 	return res;
 }
 
+/* Get the retained area data of an element, or TNULL if it has none: */
+static struct TEKUIArea *getarea(lua_State *L, int idx)
+{
+	lua_getfield(L, idx, TEKUI_AREA_FIELD);
+	struct TEKUIArea *a = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return a;
+}
+
+static struct TEKUIArea *checkarea(lua_State *L)
+{
+	struct TEKUIArea *a = getarea(L, AREA_ISELF);
+	if (a == TNULL)
+		luaL_error(L, "Element has no area data");
+	return a;
+}
+
+/* Get the element's margins, reading them from its style properties if
+** they are not cached: */
+static TINT *getmargin(lua_State *L, struct TEKUIArea *a)
+{
+	if (!(a->ar_Valid & TEKUI_AREA_MARGIN))
+	{
+		lua_getfield(L, AREA_ISELF, "Properties");
+		lua_getfield(L, -1, "margin-left");
+		lua_getfield(L, -2, "margin-top");
+		lua_getfield(L, -3, "margin-right");
+		lua_getfield(L, -4, "margin-bottom");
+		a->ar_Margin[0] = lua_tointeger(L, -4);
+		a->ar_Margin[1] = lua_tointeger(L, -3);
+		a->ar_Margin[2] = lua_tointeger(L, -2);
+		a->ar_Margin[3] = lua_tointeger(L, -1);
+		lua_pop(L, 5);
+		a->ar_Valid |= TEKUI_AREA_MARGIN;
+	}
+	return a->ar_Margin;
+}
+
+/*
+**	The fields Rect and MinMax of an element hold views of its retained
+**	rectangles, supporting the subset of the Region interface that applies
+**	to a single rectangle. A view anchors the element's area data in a
+**	weak-keyed table in the registry, so that it can outlive the element.
+*/
+
+#define AREA_RECTVIEW_CLASSNAME "tek.ui.class.area.rect*"
+#define AREA_RECTVIEW_ANCHORS "tek.ui.class.area.anchors"
+
+struct AreaRectView
+{
+	struct TEKUIArea *rv_Area;
+	TUINT rv_Which;
+};
+
+static void newrectview(lua_State *L, int idx, struct TEKUIArea *a,
+	TUINT which)
+{
+	struct AreaRectView *v = lua_newuserdata(L, sizeof(struct AreaRectView));
+	v->rv_Area = a;
+	v->rv_Which = which;
+	luaL_getmetatable(L, AREA_RECTVIEW_CLASSNAME);
+	lua_setmetatable(L, -2);
+	lua_getfield(L, LUA_REGISTRYINDEX, AREA_RECTVIEW_ANCHORS);
+	lua_pushvalue(L, -2);
+	lua_getfield(L, idx < 0 ? idx - 3 : idx, TEKUI_AREA_FIELD);
+	/* s: view, anchors, view, area data */
+	lua_rawset(L, -3);
+	lua_pop(L, 1);
+}
+
+/* Get a view's rectangle, or TNULL if it is currently undefined: */
+static TINT *checkrectview(lua_State *L, struct AreaRectView **pv)
+{
+	struct AreaRectView *v = luaL_checkudata(L, 1, AREA_RECTVIEW_CLASSNAME);
+	struct TEKUIArea *a = v->rv_Area;
+	*pv = v;
+	if (!(a->ar_Valid & v->rv_Which))
+		return TNULL;
+	return v->rv_Which == TEKUI_AREA_RECT ? a->ar_Rect : a->ar_MinMax;
+}
+
+static int tek_ui_class_area_rectview_get(lua_State *L)
+{
+	struct AreaRectView *v;
+	TINT *r = checkrectview(L, &v);
+	if (r)
+	{
+		int i;
+		for (i = 0; i < 4; ++i)
+			lua_pushinteger(L, r[i]);
+		return 4;
+	}
+	return 0;
+}
+
+static int tek_ui_class_area_rectview_setrect(lua_State *L)
+{
+	struct AreaRectView *v;
+	TINT *r;
+	int i;
+	checkrectview(L, &v);
+	r = v->rv_Which == TEKUI_AREA_RECT ?
+		v->rv_Area->ar_Rect : v->rv_Area->ar_MinMax;
+	for (i = 0; i < 4; ++i)
+		r[i] = luaL_checkinteger(L, i + 2);
+	v->rv_Area->ar_Valid |= v->rv_Which;
+	lua_pushvalue(L, 1);
+	return 1;
+}
+
+static int tek_ui_class_area_rectview_isempty(lua_State *L)
+{
+	struct AreaRectView *v;
+	lua_pushboolean(L, checkrectview(L, &v) == TNULL);
+	return 1;
+}
+
+static int tek_ui_class_area_rectview_checkintersect(lua_State *L)
+{
+	struct AreaRectView *v;
+	TINT *r = checkrectview(L, &v);
+	lua_Integer x0 = luaL_checkinteger(L, 2);
+	lua_Integer y0 = luaL_checkinteger(L, 3);
+	lua_Integer x1 = luaL_checkinteger(L, 4);
+	lua_Integer y1 = luaL_checkinteger(L, 5);
+	lua_pushboolean(L, r && TEK_UI_OVERLAP(x0, y0, x1, y1,
+		r[0], r[1], r[2], r[3]));
+	return 1;
+}
+
+static int tek_ui_class_area_rectview_shift(lua_State *L)
+{
+	struct AreaRectView *v;
+	TINT *r = checkrectview(L, &v);
+	lua_Integer dx = luaL_checkinteger(L, 2);
+	lua_Integer dy = luaL_checkinteger(L, 3);
+	if (r)
+	{
+		r[0] += dx;
+		r[1] += dy;
+		r[2] += dx;
+		r[3] += dy;
+	}
+	return 0;
+}
+
+static const luaL_Reg tek_ui_class_area_rectviewfuncs[] =
+{
+	{ "get", tek_ui_class_area_rectview_get },
+	{ "setRect", tek_ui_class_area_rectview_setrect },
+	{ "isEmpty", tek_ui_class_area_rectview_isempty },
+	{ "checkIntersect", tek_ui_class_area_rectview_checkintersect },
+	{ "shift", tek_ui_class_area_rectview_shift },
+	{ NULL, NULL }
+};
+
 #define TEKUI_FL_DRAWOK \
 	(TEKUI_FL_LAYOUT | TEKUI_FL_SHOW | TEKUI_FL_SETUP)
 
@@ -334,27 +496,43 @@ static lua_Integer getnumfield(lua_State *L, int idx, const char *key)
 #define TEKUI_FL_BUBBLEUP \
 	(TEKUI_FL_REDRAW | TEKUI_FL_REDRAWBORDER | TEKUI_FL_CHANGED)
 
+/* Push the element's rectangle if it is layouted and can be drawn: */
+static int pushrect(lua_State *L, struct TEKUIArea *a, int n)
+{
+	if ((getnumfield(L, AREA_ISELF, "Flags") & TEKUI_FL_DRAWOK) ==
+		TEKUI_FL_DRAWOK &&
+		(a->ar_Valid & TEKUI_AREA_RECT))
+	{
+		int i;
+		for (i = 0; i < n; ++i)
+			lua_pushinteger(L, a->ar_Rect[i]);
+		return n;
+	}
+	return 0;
+}
+
 static lua_Integer clrsetflags(lua_State *L, lua_Integer clr, lua_Integer set,
 	TBOOL bubbleup)
 {
-	lua_getfield(L, AREA_ISELF, "Flags");
-	lua_Integer f = lua_tointeger(L, -1);
+	lua_Integer f = getnumfield(L, AREA_ISELF, "Flags");
 	lua_Integer nf = (f & ~clr) | set;
 	if (nf != f)
 	{
 		lua_pushinteger(L, nf);
 		lua_setfield(L, AREA_ISELF, "Flags");
 	}
-	lua_pop(L, 1);
 	
 	if (bubbleup && (set & TEKUI_FL_BUBBLEUP) && !(nf & TEKUI_FL_UPDATE))
 	{
 		lua_pushvalue(L, AREA_ISELF);
 		do
 		{
-			f = getnumfield(L, -1, "Flags");
-			lua_pushinteger(L, f | TEKUI_FL_UPDATE);
-			lua_setfield(L, -2, "Flags");
+			lua_Integer pf = getnumfield(L, -1, "Flags");
+			if (!(pf & TEKUI_FL_UPDATE))
+			{
+				lua_pushinteger(L, pf | TEKUI_FL_UPDATE);
+				lua_setfield(L, -2, "Flags");
+			}
 			callfield(L, -1, "getParent", 1, 1);
 		} while (lua_toboolean(L, -1));
 		lua_pop(L, 1);
@@ -410,10 +588,11 @@ static int tek_ui_class_area_new(lua_State *L)
 	else
 		lua_newtable(L);
 	/* class, self or { } */
-	callfield(L, AREA_IREGION, "new", 0, 1);
-	lua_setfield(L, -2, "MinMax");
-	callfield(L, AREA_IREGION, "new", 0, 1);
-	lua_setfield(L, -2, "Rect");
+	struct TEKUIArea *a = lua_newuserdata(L, sizeof(struct TEKUIArea));
+	memset(a, 0, sizeof(struct TEKUIArea));
+	luaL_getmetatable(L, TEKUI_AREA_CLASSNAME);
+	lua_setmetatable(L, -2);
+	lua_setfield(L, -2, TEKUI_AREA_FIELD);
 	
 	setfieldbool(L, -1, "BGPen", TFALSE);
 	setfieldbool(L, -1, "DamageRegion", TFALSE);
@@ -448,6 +627,12 @@ static int tek_ui_class_area_new(lua_State *L)
 	lua_pushinteger(L, flags);
 	lua_setfield(L, -2, "Flags");
 	
+	/* Region-like views of the retained rectangles: */
+	newrectview(L, -1, a, TEKUI_AREA_RECT);
+	lua_setfield(L, -2, "Rect");
+	newrectview(L, -1, a, TEKUI_AREA_MINMAX);
+	lua_setfield(L, -2, "MinMax");
+	
 	callfield(L, AREA_ISUPERCLASS, "new", 2, 1);
 	return 1;
 }
@@ -482,14 +667,11 @@ static int tek_ui_class_area_cleanup(lua_State *L)
 	lua_pushvalue(L, AREA_ISELF);
 	lua_call(L, 1, 0);
 	setfieldbool(L, AREA_ISELF, "DamageRegion", TFALSE);
-	lua_getfield(L, AREA_IREGION, "new");
-	lua_call(L, 0, 1);
-	lua_setfield(L, AREA_ISELF, "MinMax");
-	lua_getfield(L, AREA_IREGION, "new");
-	lua_call(L, 0, 1);
-	lua_setfield(L, AREA_ISELF, "Rect");
-	clrsetflags(L, TEKUI_FL_LAYOUT | TEKUI_FL_SETUP | TEKUI_FL_REDRAW, 0,
-		TFALSE);
+	checkarea(L)->ar_Valid &=
+		~(TEKUI_AREA_RECT | TEKUI_AREA_MINMAX | TEKUI_AREA_ASKMINMAX |
+		TEKUI_AREA_STRUCTURE);
+	clrsetflags(L, TEKUI_FL_LAYOUT | TEKUI_FL_SETUP | TEKUI_FL_REDRAW |
+		TEKUI_FL_RELAYOUT | TEKUI_FL_RELAYOUTCHILD, 0, TFALSE);
 	return 0;
 }
 
@@ -503,34 +685,26 @@ static int tek_ui_class_area_cleanup(lua_State *L)
 
 static int tek_ui_class_area_damage(lua_State *L)
 {
+	struct TEKUIArea *a = checkarea(L);
 	lua_settop(L, 5);
+	lua_Integer flags = getnumfield(L, AREA_ISELF, "Flags");
 
-	if ((clrsetflags(L, 0, 0, TFALSE) & (TEKUI_FL_LAYOUT | TEKUI_FL_SHOW)) ==
-		(TEKUI_FL_LAYOUT | TEKUI_FL_SHOW))
+	if ((flags & TEKUI_FL_DRAWOK) == TEKUI_FL_DRAWOK &&
+		(a->ar_Valid & TEKUI_AREA_RECT))
 	{
-		lua_getfield(L, AREA_ISELF, "getRect");
-		lua_pushvalue(L, AREA_ISELF);
-		lua_call(L, 1, 4);
 		lua_Integer r1 = lua_tointeger(L, 2);
 		lua_Integer r2 = lua_tointeger(L, 3);
 		lua_Integer r3 = lua_tointeger(L, 4);
 		lua_Integer r4 = lua_tointeger(L, 5);
-		lua_Integer s1 = lua_tointeger(L, -4);
-		lua_Integer s2 = lua_tointeger(L, -3);
-		lua_Integer s3 = lua_tointeger(L, -2);
-		lua_Integer s4 = lua_tointeger(L, -1);
-		lua_pop(L, 4);
-		if (TEK_UI_OVERLAP(r1, r2, r3, r4, s1, s2, s3, s4))
+		TINT *s = a->ar_Rect;
+		if (TEK_UI_OVERLAP(r1, r2, r3, r4, s[0], s[1], s[2], s[3]))
 		{
-			r1 = TMAX(s1, r1);
-			r2 = TMAX(s2, r2);
-			r3 = TMIN(s3, r3);
-			r4 = TMIN(s4, r4);
-			TBOOL track = 
-				getnumfield(L, AREA_ISELF, "Flags") & TEKUI_FL_TRACKDAMAGE;
-			TBOOL redraw = TFALSE;
-			if (!track)
-				redraw = clrsetflags(L, 0, 0, TFALSE) & TEKUI_FL_REDRAW;
+			r1 = TMAX(s[0], r1);
+			r2 = TMAX(s[1], r2);
+			r3 = TMIN(s[2], r3);
+			r4 = TMIN(s[3], r4);
+			TBOOL track = flags & TEKUI_FL_TRACKDAMAGE;
+			TBOOL redraw = flags & TEKUI_FL_REDRAW;
 			if (track || !redraw)
 			{
 				lua_getfield(L, AREA_ISELF, "DamageRegion");
@@ -560,6 +734,41 @@ static int tek_ui_class_area_damage(lua_State *L)
 	return 0;
 }
 
+/* Subtract rectangle s from d, storing up to four resulting rectangles
+** in out, and returning their number: */
+static int subrect(TINT out[4][4], TINT *d, TINT *s)
+{
+	int n = 0;
+	if (!TEK_UI_OVERLAPRECT(d, s))
+	{
+		memcpy(out[n++], d, sizeof(TINT) * 4);
+		return n;
+	}
+	if (d[1] < s[1])
+	{
+		TINT *o = out[n++];
+		o[0] = d[0]; o[1] = d[1]; o[2] = d[2]; o[3] = s[1] - 1;
+	}
+	if (d[3] > s[3])
+	{
+		TINT *o = out[n++];
+		o[0] = d[0]; o[1] = s[3] + 1; o[2] = d[2]; o[3] = d[3];
+	}
+	if (d[0] < s[0])
+	{
+		TINT *o = out[n++];
+		o[0] = d[0]; o[1] = TMAX(d[1], s[1]);
+		o[2] = s[0] - 1; o[3] = TMIN(d[3], s[3]);
+	}
+	if (d[2] > s[2])
+	{
+		TINT *o = out[n++];
+		o[0] = s[2] + 1; o[1] = TMAX(d[1], s[1]);
+		o[2] = d[2]; o[3] = TMIN(d[3], s[3]);
+	}
+	return n;
+}
+
 /*-----------------------------------------------------------------------------
 --	changed = Area:layout(x0, y0, x1, y1[, markdamage]): Layouts the element
 --	into the specified rectangle. If the element's (or any of its childrens')
@@ -569,48 +778,36 @@ static int tek_ui_class_area_damage(lua_State *L)
 
 static int tek_ui_class_area_layout(lua_State *L)
 {
+	struct TEKUIArea *a = checkarea(L);
+	TINT *r = a->ar_Rect;
+	TINT *m;
 	lua_settop(L, 6);
 	
-	lua_pushvalue(L, AREA_ISELF);	
-	callfield(L, AREA_ISELF, "getMargin", 1, 4);
-	lua_Integer m1 = lua_tointeger(L, -4);
-	lua_Integer m2 = lua_tointeger(L, -3);
-	lua_Integer m3 = lua_tointeger(L, -2);
-	lua_Integer m4 = lua_tointeger(L, -1);
-	lua_pop(L, 4);
+	m = getmargin(L, a);
+	lua_Integer m1 = m[0];
+	lua_Integer m2 = m[1];
+	lua_Integer m3 = m[2];
+	lua_Integer m4 = m[3];
 	
 	lua_Integer x0 = lua_tointeger(L, 2) + m1;
 	lua_Integer y0 = lua_tointeger(L, 3) + m2;
 	lua_Integer x1 = lua_tointeger(L, 4) - m3;
 	lua_Integer y1 = lua_tointeger(L, 5) - m4;
-
-	lua_getfield(L, AREA_ISELF, "Rect");
-	/* r */
 	
-	lua_getfield(L, -1, "get");
-	lua_pushvalue(L, -2);
-	lua_call(L, 1, 4);
-	lua_Integer r1 = lua_tointeger(L, -4);
-	lua_Integer r2 = lua_tointeger(L, -3);
-	lua_Integer r3 = lua_tointeger(L, -2);
-	lua_Integer r4 = lua_tointeger(L, -1);
-	TBOOL not_r1 = !lua_toboolean(L, -4);
-	lua_pop(L, 4);
+	TBOOL not_r1 = !(a->ar_Valid & TEKUI_AREA_RECT);
+	lua_Integer r1 = r[0];
+	lua_Integer r2 = r[1];
+	lua_Integer r3 = r[2];
+	lua_Integer r4 = r[3];
 	
 	if (!not_r1 && r1 == x0 && r2 == y0 && r3 == x1 && r4 == y1)
-	{
-		lua_pop(L, 1);
 		return 0;
-	}
-	
-	lua_pushinteger(L, x0);
-	lua_pushinteger(L, y0);
-	lua_pushinteger(L, x1);
-	lua_pushinteger(L, y1);
-	callfield(L, -5, "setRect", 5, 0);
-	
-	/* */
 	
+	r[0] = x0;
+	r[1] = y0;
+	r[2] = x1;
+	r[3] = y1;
+	a->ar_Valid |= TEKUI_AREA_RECT;
 	clrsetflags(L, 0, TEKUI_FL_LAYOUT, TFALSE);
 	
 	TBOOL markdamage = !(lua_isboolean(L, 6) && !lua_toboolean(L, 6));
@@ -703,37 +900,23 @@ static int tek_ui_class_area_layout(lua_State *L)
 		lua_Integer s3 = x1 - dx + m3;
 		lua_Integer s4 = y1 - dy + m4;
 		
-		lua_getfield(L, AREA_IREGION, "new");
-		lua_pushinteger(L, r1 + sx - m1);
-		lua_pushinteger(L, r2 + sy - m2);
-		lua_pushinteger(L, r3 + sx + m3);
-		lua_pushinteger(L, r4 + sy + m4);
-		lua_call(L, 4, 1);
-		/* win, d, r */
-		lua_getfield(L, -1, "subRect");
-		lua_pushvalue(L, -2);
-		lua_pushinteger(L, c1);
-		lua_pushinteger(L, c2);
-		lua_pushinteger(L, c3);
-		lua_pushinteger(L, c4);
-		lua_call(L, 5, 0);
-		lua_getfield(L, -1, "shift");
-		lua_pushvalue(L, -2);
-		lua_pushinteger(L, dx);
-		lua_pushinteger(L, dy);
-		lua_call(L, 3, 0);
-		lua_getfield(L, -1, "andRect");
-		lua_pushvalue(L, -2);
-		lua_pushinteger(L, c1);
-		lua_pushinteger(L, c2);
-		lua_pushinteger(L, c3);
-		lua_pushinteger(L, c4);
-		lua_call(L, 5, 0);
-		lua_getfield(L, -1, "isEmpty");
-		lua_pushvalue(L, -2);
-		lua_call(L, 1, 1);
-		can_copy = lua_toboolean(L, -1);
-		lua_pop(L, 2);
+		/* the move is not possible if parts of the source that are outside
+		** the clipping rectangle were to be moved into it, i.e. if the
+		** moved source overlaps the clipping rectangle outside the moved
+		** clipping rectangle: */
+		lua_Integer b1 = r1 + sx - m1 + dx;
+		lua_Integer b2 = r2 + sy - m2 + dy;
+		lua_Integer b3 = r3 + sx + m3 + dx;
+		lua_Integer b4 = r4 + sy + m4 + dy;
+		if (TEK_UI_OVERLAP(b1, b2, b3, b4, c1, c2, c3, c4))
+		{
+			b1 = TMAX(b1, c1);
+			b2 = TMAX(b2, c2);
+			b3 = TMIN(b3, c3);
+			b4 = TMIN(b4, c4);
+			can_copy = b1 >= c1 + dx && b2 >= c2 + dy && 
+				b3 <= c3 + dx && b4 <= c4 + dy;
+		}
 			
 		if (can_copy)
 		{
@@ -753,11 +936,11 @@ static int tek_ui_class_area_layout(lua_State *L)
 			lua_pushinteger(L, s4 + sy);
 			lua_pushinteger(L, dx);
 			lua_pushinteger(L, dy);
-				lua_pushinteger(L, c1);
-				lua_pushinteger(L, c2);
-				lua_pushinteger(L, c3);
-				lua_pushinteger(L, c4);
-				lua_call(L, 11, 0);
+			lua_pushinteger(L, c1);
+			lua_pushinteger(L, c2);
+			lua_pushinteger(L, c3);
+			lua_pushinteger(L, c4);
+			lua_call(L, 11, 0);
 			if (samesize)
 			{
 				lua_pop(L, 2);
@@ -777,33 +960,24 @@ static int tek_ui_class_area_layout(lua_State *L)
 	{
 		if (x0 == r1 && y0 == r2)
 		{
-			lua_getfield(L, AREA_IREGION, "new");
-			lua_pushinteger(L, x0);
-			lua_pushinteger(L, y0);
-			lua_pushinteger(L, x1);
-			lua_pushinteger(L, y1);
-			lua_call(L, 4, 1);
-			lua_getfield(L, -1, "subRect");
-			lua_insert(L, -2);
-			lua_pushinteger(L, r1);
-			lua_pushinteger(L, r2);
-			lua_pushinteger(L, r3);
-			lua_pushinteger(L, r4);
-			lua_call(L, 5, 1);
-			/* win, d, r */
-			lua_getfield(L, -1, "andRect");
-			lua_pushvalue(L, -2);
-			lua_pushinteger(L, c1 - sx);
-			lua_pushinteger(L, c2 - sy);
-			lua_pushinteger(L, c3 - sx);
-			lua_pushinteger(L, c4 - sy);
-			lua_call(L, 5, 0);
-			lua_getfield(L, -1, "forEach");
-			lua_pushvalue(L, -2);
-			lua_getfield(L, AREA_ISELF, "damage");
-			lua_pushvalue(L, AREA_ISELF);
-			lua_call(L, 3, 0);
-			lua_pop(L, 1);
+			/* damage the new parts of the element that are visible: */
+			TINT n[4] = { x0, y0, x1, y1 };
+			TINT o[4] = { r1, r2, r3, r4 };
+			TINT c[4] = { c1 - sx, c2 - sy, c3 - sx, c4 - sy };
+			TINT d[4][4];
+			int i, nd = subrect(d, n, o);
+			for (i = 0; i < nd; ++i)
+			{
+				if (!TEK_UI_OVERLAPRECT(d[i], c))
+					continue;
+				lua_getfield(L, AREA_ISELF, "damage");
+				lua_pushvalue(L, AREA_ISELF);
+				lua_pushinteger(L, TMAX(d[i][0], c[0]));
+				lua_pushinteger(L, TMAX(d[i][1], c[1]));
+				lua_pushinteger(L, TMIN(d[i][2], c[2]));
+				lua_pushinteger(L, TMIN(d[i][3], c[3]));
+				lua_call(L, 5, 0);
+			}
 		}
 		else
 		{
@@ -826,6 +1000,32 @@ static int tek_ui_class_area_layout(lua_State *L)
 	return 1;
 }
 
+/*-----------------------------------------------------------------------------
+--	changed = Area:setRect(x0, y0, x1, y1): Sets the rectangle which the
+--	element is layouted to, without any of the side effects of Area:layout(),
+--	and returns '''true''' if the rectangle has changed. This function is
+--	intended for classes implementing shortcuts in their layouting.
+-----------------------------------------------------------------------------*/
+
+static int tek_ui_class_area_setrect(lua_State *L)
+{
+	struct TEKUIArea *a = checkarea(L);
+	TINT *r = a->ar_Rect;
+	TINT x0 = luaL_checkinteger(L, 2);
+	TINT y0 = luaL_checkinteger(L, 3);
+	TINT x1 = luaL_checkinteger(L, 4);
+	TINT y1 = luaL_checkinteger(L, 5);
+	TBOOL changed = !(a->ar_Valid & TEKUI_AREA_RECT) || r[0] != x0 || 
+		r[1] != y0 || r[2] != x1 || r[3] != y1;
+	r[0] = x0;
+	r[1] = y0;
+	r[2] = x1;
+	r[3] = y1;
+	a->ar_Valid |= TEKUI_AREA_RECT;
+	lua_pushboolean(L, changed);
+	return 1;
+}
+
 /*-----------------------------------------------------------------------------
 --	Area:punch(region): Subtracts the element from (by punching a hole into)
 --	the specified Region. This function is called by the layouter.
@@ -833,10 +1033,17 @@ static int tek_ui_class_area_layout(lua_State *L)
 
 static int tek_ui_class_area_punch(lua_State *L)
 {
-	lua_getfield(L, 2, "subRegion");
-	lua_pushvalue(L, 2);
-	lua_getfield(L, AREA_ISELF, "Rect");
-	lua_call(L, 2, 0);
+	struct TEKUIArea *a = checkarea(L);
+	if (a->ar_Valid & TEKUI_AREA_RECT)
+	{
+		lua_getfield(L, 2, "subRect");
+		lua_pushvalue(L, 2);
+		lua_pushinteger(L, a->ar_Rect[0]);
+		lua_pushinteger(L, a->ar_Rect[1]);
+		lua_pushinteger(L, a->ar_Rect[2]);
+		lua_pushinteger(L, a->ar_Rect[3]);
+		lua_call(L, 5, 0);
+	}
 	return 0;
 }
 
@@ -878,7 +1085,8 @@ static int tek_ui_class_area_draw(lua_State *L)
 	if ((clrsetflags(L, TEKUI_FL_REDRAW, 0, TFALSE) & TEKUI_FL_REDRAWOK) == 
 		TEKUI_FL_REDRAWOK)
 	{
-		TBOOL erasebg = getnumfield(L, AREA_ISELF, "Flags") & TEKUI_FL_ERASEBG;
+		TBOOL erasebg =
+			getnumfield(L, AREA_ISELF, "Flags") & TEKUI_FL_ERASEBG;
 		if (erasebg)
 		{
 			lua_getfield(L, AREA_ISELF, "drawBegin");
@@ -911,27 +1119,19 @@ static int tek_ui_class_area_draw(lua_State *L)
 
 static int tek_ui_class_area_getbyxy(lua_State *L)
 {
-	lua_settop(L, 3);
-	lua_getfield(L, AREA_ISELF, "getRect");
-	lua_pushvalue(L, AREA_ISELF);
-	lua_call(L, 1, 4);
-	if (lua_toboolean(L, -4))
+	struct TEKUIArea *a = checkarea(L);
+	if ((getnumfield(L, AREA_ISELF, "Flags") & TEKUI_FL_DRAWOK) ==
+		TEKUI_FL_DRAWOK && (a->ar_Valid & TEKUI_AREA_RECT))
 	{
-		lua_Integer r1 = lua_tointeger(L, -4);
-		lua_Integer r2 = lua_tointeger(L, -3);
-		lua_Integer r3 = lua_tointeger(L, -2);
-		lua_Integer r4 = lua_tointeger(L, -1);
+		TINT *r = a->ar_Rect;
 		lua_Integer x = lua_tointeger(L, 2);
 		lua_Integer y = lua_tointeger(L, 3);
-		lua_pop(L, 4);
-		if (x >= r1 && x <= r3 && y >= r2 && y <= r4)
+		if (x >= r[0] && x <= r[2] && y >= r[1] && y <= r[3])
 		{
 			lua_pushvalue(L, AREA_ISELF);
 			return 1;
 		}
 	}
-	else
-		lua_pop(L, 4);
 	return 0;
 }
 
@@ -940,32 +1140,31 @@ static int tek_ui_class_area_getbyxy(lua_State *L)
 --	margins in the order left, top, right, bottom.
 -----------------------------------------------------------------------------*/
 
-typedef struct { int r1, r2, r3, r4; } rect;
-
-static rect tek_ui_class_area_getmargin_int(lua_State *L)
+static int tek_ui_class_area_getmargin(lua_State *L)
 {
-	rect res;
-	lua_getfield(L, AREA_ISELF, "Properties");
-	lua_getfield(L, -1, "margin-left");
-	lua_getfield(L, -2, "margin-top");
-	lua_getfield(L, -3, "margin-right");
-	lua_getfield(L, -4, "margin-bottom");
-	res.r1 = lua_tointeger(L, -4);
-	res.r2 = lua_tointeger(L, -3);
-	res.r3 = lua_tointeger(L, -2);
-	res.r4 = lua_tointeger(L, -1);
-	lua_pop(L, 5);
-	return res;
+	TINT *m = getmargin(L, checkarea(L));
+	lua_pushinteger(L, m[0]);
+	lua_pushinteger(L, m[1]);
+	lua_pushinteger(L, m[2]);
+	lua_pushinteger(L, m[3]);
+	return 4;
 }
 
-static int tek_ui_class_area_getmargin(lua_State *L)
+/*-----------------------------------------------------------------------------
+--	decodeProperties: overrides
+-----------------------------------------------------------------------------*/
+
+static int tek_ui_class_area_decodeproperties(lua_State *L)
 {
-	rect res = tek_ui_class_area_getmargin_int(L);
-	lua_pushinteger(L, res.r1);
-	lua_pushinteger(L, res.r2);
-	lua_pushinteger(L, res.r3);
-	lua_pushinteger(L, res.r4);
-	return 4;
+	struct TEKUIArea *a = checkarea(L);
+	lua_settop(L, 2);
+	lua_getfield(L, AREA_ISUPERCLASS, "decodeProperties");
+	lua_pushvalue(L, AREA_ISELF);
+	lua_pushvalue(L, 2);
+	lua_call(L, 2, 0);
+	/* margins and sizes are reread from the new properties when needed: */
+	a->ar_Valid &= ~(TEKUI_AREA_MARGIN | TEKUI_AREA_ASKMINMAX);
+	return 0;
 }
 
 /*-----------------------------------------------------------------------------
@@ -1135,11 +1334,16 @@ static int tek_ui_class_area_setflags(lua_State *L)
 
 static int tek_ui_class_area_getminmax(lua_State *L)
 {
-	lua_getfield(L, AREA_ISELF, "MinMax");
-	lua_getfield(L, -1, "get");
-	lua_insert(L, -2);
-	lua_call(L, 1, 4);
-	return 4;
+	struct TEKUIArea *a = checkarea(L);
+	if (a->ar_Valid & TEKUI_AREA_MINMAX)
+	{
+		lua_pushinteger(L, a->ar_MinMax[0]);
+		lua_pushinteger(L, a->ar_MinMax[1]);
+		lua_pushinteger(L, a->ar_MinMax[2]);
+		lua_pushinteger(L, a->ar_MinMax[3]);
+		return 4;
+	}
+	return 0;
 }
 
 /*-----------------------------------------------------------------------------
@@ -1221,15 +1425,7 @@ static int tek_ui_class_area_getparent(lua_State *L)
 
 static int tek_ui_class_area_getrect(lua_State *L)
 {
-	if ((clrsetflags(L, 0, 0, TFALSE) & TEKUI_FL_DRAWOK) == TEKUI_FL_DRAWOK)
-	{
-		lua_getfield(L, AREA_ISELF, "Rect");
-		lua_getfield(L, -1, "get");
-		lua_insert(L, -2);
-		lua_call(L, 1, 4);
-		return 4;
-	}
-	return 0;
+	return pushrect(L, checkarea(L), 4);
 }
 
 /*-----------------------------------------------------------------------------
@@ -1242,22 +1438,17 @@ static int tek_ui_class_area_getrect(lua_State *L)
 
 static int tek_ui_class_area_focusrect(lua_State *L)
 {
+	struct TEKUIArea *a = checkarea(L);
 	lua_Integer r1, r2, r3, r4;
 	lua_settop(L, 5);
 	if (!lua_toboolean(L, 2))
 	{
-		lua_getfield(L, AREA_ISELF, "Rect");
-		lua_getfield(L, -1, "get");
-		lua_insert(L, -2);
-		lua_call(L, 1, 4);
-		int have_rect = lua_toboolean(L, -4);
-		r1 = lua_tointeger(L, -4);
-		r2 = lua_tointeger(L, -3);
-		r3 = lua_tointeger(L, -2);
-		r4 = lua_tointeger(L, -1);
-		lua_pop(L, 4);
-		if (!have_rect)
+		if (!(a->ar_Valid & TEKUI_AREA_RECT))
 			return 0;
+		r1 = a->ar_Rect[0];
+		r2 = a->ar_Rect[1];
+		r3 = a->ar_Rect[2];
+		r4 = a->ar_Rect[3];
 	}
 	else
 	{
@@ -1274,13 +1465,13 @@ static int tek_ui_class_area_focusrect(lua_State *L)
 	lua_call(L, 1, 1);
 	if (lua_toboolean(L, -1))
 	{
-		rect m = tek_ui_class_area_getmargin_int(L);
+		TINT *m = getmargin(L, a);
 		lua_getfield(L, -1, "focusRect");
 		lua_insert(L, -2);
-		lua_pushinteger(L, r1 - m.r1);
-		lua_pushinteger(L, r2 - m.r2);
-		lua_pushinteger(L, r3 - m.r3);
-		lua_pushinteger(L, r4 - m.r4);
+		lua_pushinteger(L, r1 - m[0]);
+		lua_pushinteger(L, r2 - m[1]);
+		lua_pushinteger(L, r3 - m[2]);
+		lua_pushinteger(L, r4 - m[3]);
 		lua_call(L, 5, 1);
 		return 1;
 	}
@@ -1524,11 +1715,9 @@ static int tek_ui_class_area_erase(lua_State *L)
 		/* d, fillrect() */
 		lua_insert(L, -2);
 		/* fillrect, d */
-		lua_getfield(L, AREA_ISELF, "getRect");
-		lua_pushvalue(L, AREA_ISELF);
-		lua_call(L, 1, 4);
+		int n = pushrect(L, checkarea(L), 4);
 		/* fillrect, d, r1, r2, r3, r4 */
-		lua_call(L, 5, 0);
+		lua_call(L, n + 1, 0);
 	}
 	return 0;
 }
@@ -1612,9 +1801,11 @@ static int tek_ui_class_area_getbg(lua_State *L)
 		/* p, bgpen */
 		if (scrollable)
 		{
-			lua_getfield(L, AREA_ISELF, "getRect");
-			lua_pushvalue(L, AREA_ISELF);
-			lua_call(L, 1, 2);
+			if (pushrect(L, checkarea(L), 2) == 0)
+			{
+				lua_pushnil(L);
+				lua_pushnil(L);
+			}
 			/* p, bgpen, tx, ty */
 		}
 		else
@@ -1692,26 +1883,18 @@ static int tek_ui_class_area_askminmax(lua_State *L)
 	m2 = TMAX(minh, m2 + p2 + p4);
 	m3 = TMAX(TMIN(maxw, m3 + p1 + p3), m1);
 	m4 = TMAX(TMIN(maxh, m4 + p2 + p4), m2);
-	lua_getfield(L, AREA_ISELF, "getMargin");
-	lua_pushvalue(L, AREA_ISELF);
-	lua_call(L, 1, 4);
-	lua_Integer ma1 = lua_tonumber(L, -4);
-	lua_Integer ma2 = lua_tonumber(L, -3);
-	lua_Integer ma3 = lua_tonumber(L, -2);
-	lua_Integer ma4 = lua_tonumber(L, -1);
-	lua_pop(L, 12);
-	m1 += ma1 + ma3;
-	m2 += ma2 + ma4;
-	m3 += ma1 + ma3;
-	m4 += ma2 + ma4;
-	lua_getfield(L, AREA_ISELF, "MinMax");
-	lua_getfield(L, -1, "setRect");
-	lua_insert(L, -2);
-	lua_pushinteger(L, m1);
-	lua_pushinteger(L, m2);
-	lua_pushinteger(L, m3);
-	lua_pushinteger(L, m4);
-	lua_call(L, 5, 0);
+	lua_pop(L, 8);
+	struct TEKUIArea *a = checkarea(L);
+	TINT *ma = getmargin(L, a);
+	m1 += ma[0] + ma[2];
+	m2 += ma[1] + ma[3];
+	m3 += ma[0] + ma[2];
+	m4 += ma[1] + ma[3];
+	a->ar_MinMax[0] = m1;
+	a->ar_MinMax[1] = m2;
+	a->ar_MinMax[2] = m3;
+	a->ar_MinMax[3] = m4;
+	a->ar_Valid |= TEKUI_AREA_MINMAX;
 	lua_pushinteger(L, m1);
 	lua_pushinteger(L, m2);
 	lua_pushinteger(L, m3);
@@ -1732,6 +1915,11 @@ static int tek_ui_class_area_askminmax(lua_State *L)
 --		unconditionally
 --	The optional argument {{check_size}} (a boolean) can be used to
 --	recalculate the element's minimum and maximum size requirements.
+--	The element is marked with {{FL_RELAYOUT}}, and its parents with
+--	{{FL_RELAYOUTCHILD}}, so that groups with unchanged rectangles can skip
+--	layouting their children. If the size is to be checked, the sizes
+--	memorized for the element and its parents are invalidated as well,
+--	and so is the layouting structure of the element and its parent.
 -----------------------------------------------------------------------------*/
 
 static int tek_ui_class_area_rethinklayout(lua_State *L)
@@ -1739,6 +1927,8 @@ static int tek_ui_class_area_rethinklayout(lua_State *L)
 	if (clrsetflags(L, 0, 0, TFALSE) & TEKUI_FL_SETUP)
 	{
 		TBOOL check_size = lua_toboolean(L, 3);
+		TUINT set = TEKUI_FL_RELAYOUT;
+		TUINT clr = TEKUI_AREA_ASKMINMAX | TEKUI_AREA_STRUCTURE;
 		if (check_size)
 		{
 			lua_getfield(L, AREA_ISELF, "getGroup");
@@ -1746,6 +1936,21 @@ static int tek_ui_class_area_rethinklayout(lua_State *L)
 			lua_call(L, 1, 1);
 			clrsetflags(L, 0, TEKUI_FL_CHANGED, TTRUE);
 		}
+		lua_pushvalue(L, AREA_ISELF);
+		do
+		{
+			struct TEKUIArea *p = getarea(L, -1);
+			lua_pushinteger(L, getnumfield(L, -1, "Flags") | set);
+			lua_setfield(L, -2, "Flags");
+			if (p && check_size)
+				p->ar_Valid &= ~clr;
+			/* only the element and its parent hold structure: */
+			if (set == TEKUI_FL_RELAYOUTCHILD)
+				clr = TEKUI_AREA_ASKMINMAX;
+			set = TEKUI_FL_RELAYOUTCHILD;
+			callfield(L, -1, "getParent", 1, 1);
+		} while (lua_toboolean(L, -1));
+		lua_pop(L, 1);
 		lua_getfield(L, AREA_ISELF, "Window");
 		lua_getfield(L, -1, "addLayout");
 		lua_insert(L, -2);
@@ -1801,12 +2006,7 @@ static int tek_ui_class_area_beginpopup(lua_State *L)
 static int tek_ui_class_area_reconfigure(lua_State *L)
 {
 	setfieldbool(L, AREA_ISELF, "DamageRegion", TFALSE);
-	lua_getfield(L, AREA_IREGION, "new");
-	lua_call(L, 0, 1);
-	lua_setfield(L, AREA_ISELF, "MinMax");
-	lua_getfield(L, AREA_IREGION, "new");
-	lua_call(L, 0, 1);
-	lua_setfield(L, AREA_ISELF, "Rect");
+	checkarea(L)->ar_Valid = 0;
 	setfieldbool(L, AREA_ISELF, "BGPen", TFALSE);
 	lua_getfield(L, AREA_ISELF, "setState");
 	lua_pushvalue(L, AREA_ISELF);
@@ -1981,10 +2181,12 @@ static const luaL_Reg tek_ui_class_area_classfuncs[] =
 	{ "cleanup", tek_ui_class_area_cleanup },
 	{ "damage", tek_ui_class_area_damage },
 	{ "layout", tek_ui_class_area_layout },
+	{ "setRect", tek_ui_class_area_setrect },
 	{ "punch", tek_ui_class_area_punch },
 	{ "draw", tek_ui_class_area_draw },
 	{ "getByXY", tek_ui_class_area_getbyxy },
 	{ "getMargin", tek_ui_class_area_getmargin },
+	{ "decodeProperties", tek_ui_class_area_decodeproperties },
 	{ "onSetStyle", tek_ui_class_area_onsetstyle },
 	{ "setState", tek_ui_class_area_setstate },
 	{ "getDisplacement", tek_ui_class_area_getdisplacement },
@@ -2025,6 +2227,25 @@ static const luaL_Reg tek_ui_class_area_classfuncs[] =
 
 int luaopen_tek_ui_class_area(lua_State *L)
 {
+	/* metatable of the elements' retained area data: */
+	luaL_newmetatable(L, TEKUI_AREA_CLASSNAME);
+	lua_pop(L, 1);
+	
+	/* metatable of the views in the Rect and MinMax fields: */
+	luaL_newmetatable(L, AREA_RECTVIEW_CLASSNAME);
+	lua_pushvalue(L, -1);
+	lua_setfield(L, -2, "__index");
+	tek_lua_register(L, NULL, tek_ui_class_area_rectviewfuncs, 0);
+	lua_pop(L, 1);
+	
+	/* area data, by the views anchoring it: */
+	lua_newtable(L);
+	lua_newtable(L);
+	lua_pushliteral(L, "k");
+	lua_setfield(L, -2, "__mode");
+	lua_setmetatable(L, -2);
+	lua_setfield(L, LUA_REGISTRYINDEX, AREA_RECTVIEW_ANCHORS);
+	
 	lua_getglobal(L, "require");
 	lua_pushliteral(L, AREA_SUPERCLASS_NAME);
 	lua_call(L, 1, 1);
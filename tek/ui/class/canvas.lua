@@ -100,7 +100,7 @@ local intersect = Region.intersect
 local tonumber = tonumber
 
 local Canvas = Frame.module("tek.ui.class.canvas", "tek.ui.class.frame")
-Canvas._VERSION = "Canvas 37.6"
+Canvas._VERSION = "Canvas 37.7"
 
 -------------------------------------------------------------------------------
 --	constants & class data:
@@ -113,6 +113,7 @@ local FL_RECVMOUSEMOVE = ui.FL_RECVMOUSEMOVE
 local FL_AUTOPOSITION = ui.FL_AUTOPOSITION
 local FL_KEEPMINWIDTH = ui.FL_KEEPMINWIDTH
 local FL_KEEPMINHEIGHT = ui.FL_KEEPMINHEIGHT
+local FL_RELAYOUT = ui.FL_RELAYOUT
 
 -------------------------------------------------------------------------------
 --	addClassNotifications: overrides
@@ -289,6 +290,11 @@ function Canvas:layout(r1, r2, r3, r4, markdamage)
 		end
 	end
 
+	if self:checkClearFlags(FL_RELAYOUT) then
+		-- relayouting applies to the child as well:
+		c:setFlags(FL_RELAYOUT)
+	end
+
 	if self:drawBegin() then
 	
 		-- layout child until width and height settle in:
@@ -39,6 +39,14 @@
 --			The currently selected entry (may be a file or directory)
 --		- {{Path [IG]}} (string)
 --			Directory in the file system
+--		- {{ScanTask [IG]}} (boolean)
+--			If '''true''', directories are scanned in a child task, which
+--			sends the entries back to the lister in batches. This keeps
+--			the user interface responsive while scanning large or slow
+--			(e.g. network-mounted) directories. The child task is used
+--			only if the directory lister operates on the local filesystem,
+--			i.e. if the functions for filesystem access are not
+--			overridden. Default: '''true'''
 --		- {{BasePath}} (string)
 --			Filesystem base path in which the lister is allowed to operate
 --		- {{Selection [G]}} (table)
@@ -79,17 +87,32 @@ local List = require "tek.class.list"
 local ui = require "tek.ui".checkVersion(112)
 
 local Group = ui.require("group", 31)
-local Lister = ui.require("lister", 30)
+local Lister = ui.require("lister", 32)
 local Text = ui.require("text", 28)
 local Input = ui.require("input")
 
+local find = string.find
+local floor = math.floor
 local insert = table.insert
 local pairs = pairs
 local pcall = pcall
+local remove = table.remove
 local sort = table.sort
+local sub = string.sub
+local tonumber = tonumber
+local tostring = tostring
+local type = type
 
 local DirList = Group.module("tek.ui.class.dirlist", "tek.ui.class.group")
-DirList._VERSION = "DirList 17.5"
+DirList._VERSION = "DirList 17.7"
+
+-------------------------------------------------------------------------------
+--	Constants & Class data:
+-------------------------------------------------------------------------------
+
+local MSG_USER = ui.MSG_USER
+local SCAN_BATCHSIZE = 200 -- max. number of entries per message
+local ScanCount = 0 -- for tagging messages from scan tasks
 
 -------------------------------------------------------------------------------
 --	basepath = getBasePath()
@@ -240,6 +263,10 @@ function DirList.new(class, self)
 	self.Status = "running"
 
 	self.ScanMode = false
+	self.ScanQueue = { }
+	self.ScanTag = false
+	self.ScanUnsorted = false
+	self.ScanTask = self.ScanTask == nil and true or self.ScanTask
 	self.DirList = false
 	self.ListComplete = false
 
@@ -309,6 +336,7 @@ function DirList.new(class, self)
 	self.Lister = self.Lister or Lister:new
 	{
 		AlignColumn = 1,
+		Virtual = true,
 		SelectMode = self.SelectMode or "single",
 		ListObject = self.DirList,
 		onPress = function(lister)
@@ -525,6 +553,250 @@ function DirList:sort(list)
 	sort(list, compareEntries)
 end
 
+-------------------------------------------------------------------------------
+--	scantask: Runs in a child task, scans a directory and sends its entries
+--	in batches to the parent's "ui" port. The message format is a header line
+--	"<tag> <kind>\n", followed by records of the form
+--	"<mode>\t<size>\t<namelength>\t<name>". This function is dumped and
+--	executed in a fresh Lua state, therefore it must not have upvalues, and
+--	globals shadowed by locals in this module are accessed through _G.
+-------------------------------------------------------------------------------
+
+local function scantask()
+	local pcall, tonumber, tostring = _G.pcall, _G.tonumber, _G.tostring
+	local exec = require "tek.lib.exec"
+	local path, sep, displaymode, tag = arg[1], arg[2], arg[3], arg[5]
+	local batchsize = tonumber(arg[4])
+	local success, err = pcall(function()
+		local lfs = require "lfs"
+		local buf, n = { }, 0
+		local t = os.time()
+		for name in lfs.dir(path) do
+			if exec.getsignals("t") then
+				return
+			end
+			if name ~= "." and name ~= ".." then
+				local fname = path .. sep .. name
+				local attr = lfs.attributes(fname)
+				local mode = attr and attr.mode or ""
+				if displaymode ~= "onlydirs" or mode == "directory" then
+					local size = mode ~= "directory" and attr and
+						attr.size or ""
+					n = n + 1
+					buf[n] = mode .. "\t" .. size .. "\t" .. #name .. "\t" ..
+						name
+					-- flush full batches, and at least once per second:
+					if n == batchsize or os.time() ~= t then
+						exec.sendport("*p", "ui", tag .. " batch\n" ..
+							table.concat(buf))
+						buf, n = { }, 0
+						t = os.time()
+					end
+				end
+			end
+		end
+		if n > 0 then
+			exec.sendport("*p", "ui", tag .. " batch\n" .. table.concat(buf))
+		end
+	end)
+	if success then
+		exec.sendport("*p", "ui", tag .. " done\n")
+	else
+		exec.sendport("*p", "ui", tag .. " error\n" .. tostring(err))
+	end
+end
+
+-------------------------------------------------------------------------------
+--	msgScan: Input handler collecting messages from the scan task
+-------------------------------------------------------------------------------
+
+function DirList:msgScan(msg)
+	local body = msg[-1]
+	local tag = self.ScanTag
+	if tag and sub(body, 1, #tag + 1) == tag .. " " then
+		insert(self.ScanQueue, body)
+		return false
+	end
+	return msg
+end
+
+-------------------------------------------------------------------------------
+--	decodeBatch: Converts a message from the scan task into entries
+--	corresponding to those returned by DirList:scanEntry().
+-------------------------------------------------------------------------------
+
+function DirList:decodeBatch(body, pos, list)
+	local dirtext = self.Locale.DIR
+	while true do
+		local p1 = find(body, "\t", pos, true)
+		if not p1 then
+			break
+		end
+		local p2 = find(body, "\t", p1 + 1, true)
+		local p3 = find(body, "\t", p2 + 1, true)
+		local p4 = p3 + tonumber(sub(body, p2 + 1, p3 - 1))
+		local mode = sub(body, pos, p1 - 1)
+		local size = sub(body, p1 + 1, p2 - 1)
+		insert(list, { { sub(body, p3 + 1, p4),
+			mode == "directory" and dirtext or tonumber(size) or "[?]" },
+			mode })
+		pos = p4 + 1
+	end
+	return list
+end
+
+-------------------------------------------------------------------------------
+--	insertEntries(batch): Inserts a batch of new entries into the lister,
+--	without repainting it. With the default sort order, each entry is placed
+--	at its position in the already sorted list; otherwise, the entries are
+--	appended, and the list is sorted by showentries().
+-------------------------------------------------------------------------------
+
+function DirList:insertEntries(batch)
+	local obj = self.Lister
+	if self.sort ~= DirList.sort then
+		for i = 1, #batch do
+			obj:addItem(batch[i], nil, true)
+		end
+		self.ScanUnsorted = true
+		return
+	end
+	for i = 1, #batch do
+		local entry = batch[i]
+		-- first line sorting after the entry:
+		local lo, hi = 1, obj:getN() + 1
+		while lo < hi do
+			local mid = floor((lo + hi) / 2)
+			if compareEntries(entry, obj:getItem(mid)) then
+				hi = mid
+			else
+				lo = mid + 1
+			end
+		end
+		obj:addItem(entry, lo, true)
+	end
+end
+
+-------------------------------------------------------------------------------
+--	showentries: Sorts and repaints the entries inserted so far
+-------------------------------------------------------------------------------
+
+local function showentries(self)
+	local obj = self.Lister
+	if self.ScanUnsorted then
+		self:sort(obj.ListObject.Items)
+		self.ScanUnsorted = false
+	end
+	obj:repaint()
+	self:showStats(0, obj:getN())
+end
+
+-------------------------------------------------------------------------------
+--	useScanTask(): Returns '''true''' if a directory can be scanned in a
+--	child task.
+-------------------------------------------------------------------------------
+
+function DirList:useScanTask()
+	return self.ScanTask and type(lfs) == "table" and
+		self.getDirIterator == DirList.getDirIterator and
+		self.filterEntry == DirList.filterEntry and
+		self.getFileStat == DirList.getFileStat and
+		self.scanEntry == DirList.scanEntry and
+		self.VToRealPath == DirList.VToRealPath
+end
+
+-------------------------------------------------------------------------------
+--	completescan: Places the cursor and finishes scanning
+-------------------------------------------------------------------------------
+
+local function completescan(self, path, list)
+	local obj = self.Lister
+	local selectline = 1
+	local preselect = self.Preselect
+	if preselect then
+		for lnr = 1, #list do
+			if list[lnr][1][1] == preselect then
+				selectline = lnr
+				break
+			end
+		end
+	end
+	self.Preselect = false
+	obj:repaint()
+	obj:setValue("CursorLine", selectline)
+	if self.FocusElement == "list" then
+		obj:setValue("Focus", true)
+	end
+	self:showStats()
+	self:finishScanDir(path)
+	self.ListComplete = true
+end
+
+-------------------------------------------------------------------------------
+--	scanDirTask: scans a directory in a child task, inserting entries
+--	progressively as they arrive. Must be called in a coroutine.
+-------------------------------------------------------------------------------
+
+function DirList:scanDirTask(path)
+	local app = self.Application
+	ScanCount = ScanCount + 1
+	local tag = "tek.ui.class.dirlist." .. ScanCount
+	local task = app:runTask(scantask, self:VToRealPath(path),
+		ui.PathSeparator, self.DisplayMode, tostring(SCAN_BATCHSIZE), tag)
+	if not task then
+		return false
+	end
+	self.ScanTag = tag
+	self.ScanQueue = { }
+	app:addInputHandler(MSG_USER, self, self.msgScan)
+	self.ScanUnsorted = false
+	local status, pending
+	while not status do
+		local body = remove(self.ScanQueue, 1)
+		if body then
+			local _, e, kind = find(body, "^%S+ (%a+)\n")
+			if kind == "batch" then
+				self:insertEntries(self:decodeBatch(body, e + 1, { }))
+				pending = true
+			elseif kind == "error" then
+				db.error("scan task failed: %s", sub(body, e + 1))
+				status = "error"
+			else
+				status = "done"
+			end
+		else
+			-- show new entries at most once per frame:
+			if pending then
+				showentries(self)
+				pending = false
+			end
+			app:suspend(self.Window or nil)
+			if self.ScanMode ~= "scanning" then
+				db.warn("scan aborted")
+				status = "abort"
+			end
+		end
+	end
+	app:remInputHandler(MSG_USER, self, self.msgScan)
+	self.ScanTag = false
+	self.ScanQueue = { }
+	app:joinTask(task, status == "abort" and "terminate" or "join")
+	if status == "abort" then
+		self.ScanMode = false
+	elseif status == "error" then
+		if pending then
+			showentries(self)
+		end
+	else
+		if self.ScanUnsorted then
+			self:sort(self.Lister.ListObject.Items)
+			self.ScanUnsorted = false
+		end
+		completescan(self, path, self.Lister.ListObject.Items)
+	end
+	return true
+end
+
 -------------------------------------------------------------------------------
 --	scanDir(path)
 -------------------------------------------------------------------------------
@@ -532,7 +804,8 @@ end
 function DirList:scanDir(path)
 
 	local app = self.Application
-	local diri = self:getDirIterator(path)
+	local usetask = self:useScanTask()
+	local diri = not usetask and self:getDirIterator(path)
 
 	self.ListComplete = false
 	
@@ -547,6 +820,13 @@ function DirList:scanDir(path)
 		obj:setList(List:new())
 
 		self.Selection = { }
+
+		if usetask and self:scanDirTask(path) then
+			self.ScanMode = false
+			return
+		end
+
+		diri = diri or self:getDirIterator(path)
 		if diri then
 			local list = { }
 			local n = 0
@@ -573,25 +853,10 @@ function DirList:scanDir(path)
 			self:showStats(0, n)
 			app:suspend()
 
-			local selectline = 1
-			local preselect = self.Preselect
 			for lnr = 1, #list do
-				local entry = list[lnr]
-				if preselect and entry[1][1] == preselect then
-					selectline = lnr
-				end
-				obj:addItem(entry, nil, true)
+				obj:addItem(list[lnr], nil, true)
 			end
-			self.Preselect = false
-
-			obj:repaint()
-			obj:setValue("CursorLine", selectline)
-			if self.FocusElement == "list" then
-				obj:setValue("Focus", true)
-			end
-			self:showStats()
-			self:finishScanDir(path)
-			self.ListComplete = true
+			completescan(self, path, list)
 
 		end
 
@@ -20,6 +20,7 @@
 --
 --	IMPLEMENTS::
 --		- Display:closeFont() - Closes font
+--		- Display.compileImage() - Compiles a vector image
 --		- Display.createPixMap() - Creates a pixmap from picture file data
 --		- Display:getFontAttrs() - Gets font attributes
 --		- Display.getPaint() - Gets a a paint object, cached
@@ -99,7 +100,7 @@ local tonumber = tonumber
 local unpack = unpack or table.unpack
 
 local Display = Element.module("tek.ui.class.display", "tek.ui.class.element")
-Display._VERSION = "Display 33.7"
+Display._VERSION = "Display 34.1"
 
 -------------------------------------------------------------------------------
 --	Class data and constants:
@@ -251,6 +252,14 @@ local PixmapCache = { }
 Display.createPixmap = Visual.createPixmap
 Display.createGradient = Visual.createGradient
 
+-------------------------------------------------------------------------------
+--	image = Display.compileImage(table): Compiles a table containing a
+--	vector image into an image object, which can be drawn repeatedly
+--	without traversing the table. See Visual.compileImage().
+-------------------------------------------------------------------------------
+
+Display.compileImage = Visual.compileImage
+
 -------------------------------------------------------------------------------
 
 Display.getDisplayAttrs = Visual.getDisplayAttrs
@@ -258,14 +267,19 @@ Display.getDisplayAttrs = Visual.getDisplayAttrs
 -------------------------------------------------------------------------------
 --	image, width, height, transparency = Display.getPaint(imgspec):
 --	Gets a paint object from a specifier, either by loading it from the
---	filesystem, generating it, or by retrieving it from the cache. To resolve
---	symbolic color names, a display instance must be given.
+--	filesystem, generating it, or by retrieving it from the cache. Pictures
+--	are scaled to {{width}} and {{height}}, if given. To resolve
+--	symbolic color names, a display instance must be given. A gradient is
+--	specified as {{gradient(x0,y0,color0,x1,y1,color1)}}; an optional
+--	trailing {{,dither}} applies an ordered dither to the gradient.
 -------------------------------------------------------------------------------
 
 function Display.getPaint(imgspec, display, width, height)
-	if PixmapCache[imgspec] then
-		db.trace("got cache copy for '%s'", imgspec)
-		return unpack(PixmapCache[imgspec])
+	local key = (width or height) and 
+		("%s@%sx%s"):format(imgspec, width or "", height or "") or imgspec
+	if PixmapCache[key] then
+		db.trace("got cache copy for '%s'", key)
+		return unpack(PixmapCache[key])
 	end
 	local imgtype, location = imgspec:match("^(%a+)%((.+)%)")
 	local paint, w, h, trans
@@ -278,6 +292,8 @@ function Display.getPaint(imgspec, display, width, height)
 			db.warn("cannot load image '%s'", location)
 		end
 	elseif imgtype == "gradient" then
+		local spec, dither = location:match("^(.+),(dither)$")
+		location = spec or location
 		local x0, y0, c0, x1, y1, c1 = 
 			location:match("^(%-?%d+),(%-?%d+),(%S+),(%-?%d+),(%-?%d+),(%S+)$")
 		local _, r0, g0, b0
@@ -293,14 +309,15 @@ function Display.getPaint(imgspec, display, width, height)
 			if r0 and r1 then
 				local rgb0 = r0 * 65536 + g0 * 256 + b0
 				local rgb1 = r1 * 65536 + g1 * 256 + b1
-				paint = Display.createGradient(x0, y0, x1, y1, rgb0, rgb1)
+				paint = Display.createGradient(x0, y0, x1, y1, rgb0, rgb1,
+					dither == "dither")
 			end
 		else
 			db.error("Invalid gradient arguments: '%s'", location)
 		end
 	end
 	if paint then
-		PixmapCache[imgspec] = { paint, w, h, trans }
+		PixmapCache[key] = { paint, w, h, trans }
 	end
 	return paint, w, h, trans
 end
@@ -332,7 +349,8 @@ function Display.hexToRGB(col)
 end
 
 -------------------------------------------------------------------------------
---	wait:
+--	Display.wait([ms]): Waits for input from any window, or until the
+--	specified number of 1/1000th seconds has elapsed.
 -------------------------------------------------------------------------------
 
 Display.wait = Visual.wait
@@ -59,13 +59,17 @@ local Frame = ui.require("frame", 22)
 local Region = ui.loadLibrary("region", 9)
 
 local concat = table.concat
-local insert = table.insert
+local find = string.find
+local floor = math.floor
+local gmatch = string.gmatch
 local max = math.max
+local min = math.min
 local intersect = Region.intersect
-local remove = table.remove
+local setmetatable = setmetatable
+local sub = string.sub
 
 local FloatText = Frame.module("tek.ui.class.floattext", "tek.ui.class.frame")
-FloatText._VERSION = "FloatText 22.1"
+FloatText._VERSION = "FloatText 22.5"
 
 -------------------------------------------------------------------------------
 --	constants & class data:
@@ -74,6 +78,10 @@ FloatText._VERSION = "FloatText 22.1"
 local FL_REDRAW = ui.FL_REDRAW
 local FL_LAYOUT = ui.FL_LAYOUT
 
+-- word widths, cached per font and shared by all instances:
+local FontCaches = setmetatable({ }, { __mode = "k" })
+local FONTCACHE_MAXWORDS = 4096
+
 -------------------------------------------------------------------------------
 --	addClassNotifications: overrides
 -------------------------------------------------------------------------------
@@ -102,20 +110,24 @@ FloatText.Properties = {
 
 function FloatText.new(class, self)
 	self = self or { }
+	self.AppendText = false
 	self.Canvas = false
 	self.CanvasHeight = false
 	self.FHeight = false
 	self.FontHandle = false
 	self.FGPen = false
 	self.FWidth = false
+	self.LayoutFrom = false
+	self.LayoutWidth = false
 	self.Lines = false
+	self.ParagraphCache = false
+	self.Paragraphs = false
 	self.Preformatted = self.Preformatted or false
 	self.Reposition = false
 	self.Text = self.Text or ""
 	if self.TrackDamage == nil then
 		self.TrackDamage = true
 	end
-	self.WidthsCache = false
 	self.WordSpacing = false
 	return Frame.new(class, self)
 end
@@ -128,6 +140,10 @@ function FloatText:initFont()
 	local f = self.Application.Display:openFont(self.Properties["font"])
 	self.FontHandle = f
 	self.FWidth, self.FHeight = f:getTextSize("W")
+	self.WordSpacing = f:getTextSize(" ")
+	-- paragraphs need to be remeasured:
+	self.ParagraphCache = false
+	self.Paragraphs = false
 end
 
 -------------------------------------------------------------------------------
@@ -168,65 +184,141 @@ function FloatText:erase()
 		local x1 = ca and x0 + ca.CanvasWidth - 1 or r3
 		d:setFont(self.FontHandle)
 		d:setBGPen(self:getBG())
-		dr:forEach(self.drawPatch, self, d, x0, x1, self.FGPen)
+		local r1, r2, r3, r4 = dr:get()
+		if r1 then
+			d:pushClipRegion(dr)
+			self:drawPatch(r1, r2, r3, r4, d, x0, x1, self.FGPen)
+			d:popClipRect()
+		end
 	end
 end
 
 -------------------------------------------------------------------------------
---	drawPatch: draw a single patch
+--	drawPatch: draw the lines overlapping a rectangle; clipping is up to
+--	the caller
 -------------------------------------------------------------------------------
 
 function FloatText:drawPatch(r1, r2, r3, r4, d, x0, x1, fp)
-	d:pushClipRect(r1, r2, r3, r4)
 	local lines = self.Lines
-	for lnr = 1, #lines do
+	local fh = self.FHeight
+	local lx, ly = self:getRect()
+	-- lines overlapping the damage:
+	for lnr = max(floor((r2 - ly) / fh) + 1, 1),
+		min(floor((r4 - ly) / fh) + 1, #lines) do
 		local t = lines[lnr]
-		-- overlap between damage and line:
-		if intersect(r1, r2, r3, r4, x0, t[2], x1, t[4]) then
-			-- draw line background:
-			d:fillRect(x0, t[2], x1, t[4])
-			-- overlap between damage and text:
-			if intersect(r1, r2, r3, r4, t[1], t[2], t[3], t[4]) then
-				-- draw text:
-				d:drawText(t[1], t[2], t[3], t[4], t[5], fp)
-			end
+		local y0 = ly + (lnr - 1) * fh
+		local y1 = y0 + fh - 1
+		-- draw line background:
+		d:fillRect(x0, y0, x1, y1)
+		-- overlap between damage and text:
+		local tx1 = lx + t[1] - 1
+		if t[1] > 0 and intersect(r1, r2, r3, r4, lx, y0, tx1, y1) then
+			-- draw text:
+			d:drawText(lx, y0, tx1, y1, t[2], fp)
 		end
 	end
-	d:popClipRect()
 end
 
 -------------------------------------------------------------------------------
---	prepareText: internal
+--	getwordwidth: internal; returns the width of a word, cached per font
 -------------------------------------------------------------------------------
 
-function FloatText:prepareText()
+local function getwordwidth(f, word)
+	local fc = FontCaches[f]
+	if not fc then
+		fc = { Widths = { }, NumWords = 0 }
+		FontCaches[f] = fc
+	end
+	local widths = fc.Widths
+	local w = widths[word]
+	if not w then
+		w = f:getTextSize(word)
+		local n = fc.NumWords
+		if n >= FONTCACHE_MAXWORDS then
+			-- flush:
+			widths = { }
+			fc.Widths = widths
+			n = 0
+		end
+		widths[word] = w
+		fc.NumWords = n + 1
+	end
+	return w
+end
+
+-------------------------------------------------------------------------------
+--	newParagraph: internal; measures a paragraph, i.e. a line of text
+--	without newlines. Paragraphs are shared by content, their wrapped lines
+--	are retained for the last width they were laid out to.
+-------------------------------------------------------------------------------
+
+function FloatText:newParagraph(text)
+	local f = self.FontHandle
+	if self.Preformatted then
+		local w = getwordwidth(f, text)
+		return { Width = w, MinWidth = w, WrapWidth = true,
+			Lines = { { w, text } } }
+	end
+	local words, widths = { }, { }
+	local n, mw, tw = 0, 0, 0
+	for word in gmatch(text, "%S+") do
+		local w = getwordwidth(f, word)
+		n = n + 1
+		words[n], widths[n] = word, w
+		mw = max(mw, w)
+		tw = tw + w
+	end
+	return { Words = words, Widths = widths, MinWidth = mw,
+		Width = tw + max(n - 1, 0) * self.WordSpacing, WrapWidth = false,
+		Lines = false }
+end
+
+-------------------------------------------------------------------------------
+--	prepareText: internal; splits the text into paragraphs, reusing those
+--	whose content is unchanged. If the optional {{append}} argument is
+--	given, it is the text that was appended after a newline, and only this
+--	part is processed.
+-------------------------------------------------------------------------------
+
+function FloatText:prepareText(append)
 	local f = self.FontHandle
 	if f then
-		local lw = 0 -- widest width in text
-		local w, h
-		local i = 0
-		local wl = { }
-		self.WidthsCache = wl -- cache for word lengths / line lengths
-		if self.Preformatted then
-			-- determine widths line by line
-			for line in self.Text:gmatch("([^\n]*)\n?") do
-				w, h = f:getTextSize(line)
-				lw = max(lw, w)
-				i = i + 1
-				wl[i] = w
-			end
+		local paras = self.Paragraphs
+		local cache = self.ParagraphCache
+		local text, newcache, mw, n
+		if append and paras then
+			text = append
+			newcache = cache
+			mw = self.MinWidth
+			n = #paras
+			self.LayoutFrom = min(self.LayoutFrom or n + 1, n + 1)
 		else
-			-- determine widths word by word
-			for spc, word in self.Text:gmatch("(%s*)([^%s]*)") do
-				w, h = f:getTextSize(word)
-				lw = max(lw, w)
-				i = i + 1
-				wl[i] = w
+			text = self.Text
+			cache = cache or { }
+			newcache = { }
+			paras = { }
+			mw = 0
+			n = 0
+			self.LayoutFrom = 1
+		end
+		local pos = 1
+		while true do
+			local e = find(text, "\n", pos, true)
+			local t = sub(text, pos, (e or 0) - 1)
+			local p = cache[t] or self:newParagraph(t)
+			newcache[t] = p
+			n = n + 1
+			paras[n] = p
+			mw = max(mw, p.MinWidth)
+			if not e then
+				break
 			end
-			self.WordSpacing = f:getTextSize(" ")
+			pos = e + 1
 		end
-		self.MinWidth, self.MinHeight = lw, h
-		return lw, h
+		self.Paragraphs = paras
+		self.ParagraphCache = newcache
+		self.MinWidth, self.MinHeight = mw, self.FHeight
+		return mw, self.FHeight
 	end
 end
 
@@ -243,72 +335,66 @@ function FloatText:askMinMax(m1, m2, m3, m4)
 end
 
 -------------------------------------------------------------------------------
---	layoutText: internal
+--	layoutText: internal; wraps the paragraphs starting at the given index
+--	and appends their lines to the list of lines. Returns the number of lines.
 -------------------------------------------------------------------------------
 
-local function insline(text, line, x, y, tw, so, fh)
-	line = line and concat(line, " ")
-	insert(text, { x, y, x + tw + so - 1, y + fh - 1, line })
+local function wrapparagraph(p, width, ws)
+	local ww = p.WrapWidth
+	if ww == width or ww == true or
+		(p.Lines and p.Width <= width and p.Width <= ww) then
+		-- unchanged, or fits into a single line in both widths:
+		return p.Lines
+	end
+	local lines = { }
+	local words, widths = p.Words, p.Widths
+	local nl = 0
+	local line, lw = { }, 0
+	for i = 1, #words do
+		local w = widths[i]
+		local n = #line
+		if n > 0 and lw + ws + w > width then
+			nl = nl + 1
+			lines[nl] = { lw, concat(line, " ") }
+			line, lw = { words[i] }, w
+		else
+			line[n + 1] = words[i]
+			lw = n > 0 and lw + ws + w or w
+		end
+	end
+	lines[nl + 1] = { lw, concat(line, " ") }
+	p.Lines = lines
+	p.WrapWidth = width
+	return lines
 end
 
-function FloatText:layoutText(x, y, width, text)
-	text = text or { }
-	local line = false
-	local fh = self.FHeight
-	local tw = 0
-	local i = 0
-	local wl = self.WidthsCache
-	local so = 0
-	if self.Preformatted then
-		local n = 0
-		for line in self.Text:gmatch("([^\n]*)\n?") do
-			n = n + 1
-			local tw = wl[n]
-			insline(text, { line }, x, y, tw, 0, fh)
-			y = y + fh
-		end
-	else
-		local ws = self.WordSpacing
-		for spc, word in self.Text:gmatch("(%s*)([^%s]*)") do
-			for s in spc:gmatch("%s") do
-				if s == "\n" then
-					insline(text, line, x, y, tw, so, fh)
-					y = y + fh
-					line = false
-					so = 0
-					tw = 0
-				end
-			end
-			if word then
-				line = line or { }
-				insert(line, word)
-				i = i + 1
-				tw = tw + wl[i]
-				if tw + so > width then
-					if #line > 0 then
-						remove(line)
-						insline(text, line, x, y, tw, so, fh)
-						y = y + fh
-					end
-					line = { word }
-					so = 0
-					tw = wl[i]
-				end
-				so = so + ws
-			end
-		end
-		if line and #line > 0 then
-			insline(text, line, x, y, tw, so, fh)
-			y = y + fh
+function FloatText:layoutText(width, from, lines)
+	local paras = self.Paragraphs
+	local ws = self.WordSpacing
+	local nl = #lines
+	for i = from, #paras do
+		local pl = wrapparagraph(paras[i], width, ws)
+		for j = 1, #pl do
+			nl = nl + 1
+			lines[nl] = pl[j]
 		end
 	end
-	return text, y
+	return nl
 end
 
 -------------------------------------------------------------------------------
 --	layout: overrides
 -------------------------------------------------------------------------------
 
+local function updatecanvas(self)
+	if self.Canvas then
+		self.Canvas:setValue("CanvasHeight", self.CanvasHeight)
+		if self.Reposition == "tail" then
+			self.Canvas:setValue("CanvasTop", self.CanvasHeight)
+		end
+	end
+end
+
 function FloatText:layout(r1, r2, r3, r4, markdamage)
 
 	local s1, s2, s3, s4 = self:getRect()
@@ -321,30 +407,55 @@ function FloatText:layout(r1, r2, r3, r4, markdamage)
 	local x0 = r1 + m1
 	local y0 = r2 + m2
 	local x1 = r3 - m3
-	local redraw
+	local redraw, newline
 
-	if not ch or (not s1 or s3 - s1 + 1 ~= width) then
-		self.Lines, ch = self:layoutText(r1 + m1, r2 + m2, width)
-		ch = ch + m4
+	local from = self.LayoutFrom
+	if not ch or not self.Lines or width ~= self.LayoutWidth then
+		from = 1
+	end
+	if from then
+		-- full layout, or only appended paragraphs:
+		redraw = from == 1
+		if redraw then
+			self.Lines = { }
+		else
+			newline = #self.Lines + 1
+		end
+		local nl = self:layoutText(width, from, self.Lines)
+		self.LayoutFrom = false
+		self.LayoutWidth = width
+		ch = r2 + m2 + nl * self.FHeight + m4
 		self.CanvasHeight = ch
-		redraw = true
 	end
 
 	local y1 = self.Canvas and r2 + ch - 1 - m4 or r4 - m4
 
-	if redraw or markdamage or
-		s1 ~= x0 or s2 ~= y0 or s3 ~= x1 or s4 ~= y1 then
-		if self.Canvas then
-			self.Canvas:setValue("CanvasHeight", self.CanvasHeight)
-			if self.Reposition == "tail" then
-				self.Canvas:setValue("CanvasTop", self.CanvasHeight)
+	if not redraw and s1 == x0 and s2 == y0 and s3 == x1 then
+		-- origin and width unchanged; only appended lines, and those
+		-- exposed by growing, need to be drawn:
+		local dy = newline and y0 + (newline - 1) * self.FHeight or s4 + 1
+		if s4 ~= y1 then
+			updatecanvas(self)
+			self:setRect(x0, y0, x1, y1)
+			changed = true
+		end
+		if dy <= y1 then
+			local dr = self.DamageRegion
+			if dr then
+				dr:orRect(x0, dy, x1, y1)
+			else
+				self.DamageRegion = Region.new(x0, dy, x1, y1)
 			end
+			self:setFlags(FL_LAYOUT + FL_REDRAW)
 		end
+	elseif redraw or markdamage or
+		s1 ~= x0 or s2 ~= y0 or s3 ~= x1 or s4 ~= y1 then
+		updatecanvas(self)
 		self.DamageRegion = Region.new(x0, y0, x1, y1)
 		if not markdamage and not redraw and s1 == x0 and s2 == y0 then
 			self.DamageRegion:subRect(s1, s2, s3, s4)
 		end
-		self.Rect:setRect(x0, y0, x1, y1)
+		self:setRect(x0, y0, x1, y1)
 		self:setFlags(FL_LAYOUT + FL_REDRAW)
 		changed = true
 	end
@@ -371,9 +482,18 @@ end
 -------------------------------------------------------------------------------
 
 function FloatText:onSetText()
-	self:prepareText()
-	self.CanvasHeight = false
-	self:rethinkLayout(2)
+	local append = self.AppendText
+	self.AppendText = false
+	if append and self.Paragraphs then
+		-- new lines are damaged in layout(); check the size only if the
+		-- minimum width has grown:
+		local mw = self.MinWidth
+		self:prepareText(append)
+		self:rethinkLayout(0, self.MinWidth ~= mw)
+	else
+		self:prepareText()
+		self:rethinkLayout(2)
+	end
 end
 
 -------------------------------------------------------------------------------
@@ -387,6 +507,8 @@ function FloatText:appendLine(text, movetail)
 	if self.Text == "" then
 		self:setValue("Text", text)
 	else
+		-- only the appended paragraphs need to be measured and laid out:
+		self.AppendText = text
 		self:setValue("Text", self.Text .. "\n" .. text)
 	end
 end
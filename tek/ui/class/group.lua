@@ -74,7 +74,7 @@ local intersect = Region.intersect
 local type = type
 
 local Group = Widget.module("tek.ui.class.group", "tek.ui.class.widget")
-Group._VERSION = "Group 35.2"
+Group._VERSION = "Group 35.3"
 
 -------------------------------------------------------------------------------
 --	constants:
@@ -89,6 +89,8 @@ local FL_SETUP = ui.FL_SETUP
 local FL_RECVINPUT = ui.FL_RECVINPUT
 local FL_RECVMOUSEMOVE = ui.FL_RECVMOUSEMOVE
 local FL_TRACKDAMAGE = ui.FL_TRACKDAMAGE
+local FL_RELAYOUT = ui.FL_RELAYOUT
+local FL_RELAYOUTCHILD = ui.FL_RELAYOUTCHILD
 
 local MSGFLAGS = FL_LAYOUT + FL_SETUP + FL_SHOW + FL_RECVINPUT
 local MSGFLAGS_MM = MSGFLAGS + FL_RECVMOUSEMOVE
@@ -336,16 +338,30 @@ function Group:askMinMax(m1, m2, m3, m4)
 end
 
 -------------------------------------------------------------------------------
---	layout: overrides; note that layouting takes place unconditionally here
+--	layout: overrides; the contents are layouted only if the group's
+--	rectangle has changed, or if the group or any of its children have been
+--	slated for relayouting using Area:rethinkLayout()
 -------------------------------------------------------------------------------
 
 function Group:layout(r1, r2, r3, r4, markdamage)
 	local res = Widget.layout(self, r1, r2, r3, r4, markdamage)
-	-- layout contents, update freeregion:
-	local fr = (self.FreeRegion or Region.new()):setRect(r1, r2, r3, r4)
-	self.FreeRegion = fr
-	self.Layout:layout(self, r1, r2, r3, r4, markdamage)
-	fr:subRegion(self.BorderRegion)
+	local relayout = self:checkFlags(FL_RELAYOUT)
+	if res or relayout or self:checkFlags(FL_RELAYOUTCHILD) or
+		not self.FreeRegion then
+		self:checkClearFlags(0, FL_RELAYOUT + FL_RELAYOUTCHILD)
+		if relayout then
+			-- relayouting applies to the children as well:
+			local c = self.Children
+			for i = 1, #c do
+				c[i]:setFlags(FL_RELAYOUT)
+			end
+		end
+		-- layout contents, update freeregion:
+		local fr = (self.FreeRegion or Region.new()):setRect(r1, r2, r3, r4)
+		self.FreeRegion = fr
+		self.Layout:layout(self, r1, r2, r3, r4, markdamage)
+		fr:subRegion(self.BorderRegion)
+	end
 	if res then
 		if self.Properties["background-attachment"] == "fixed" then
 			-- fully repaint groups with fixed texture when resized:
@@ -37,7 +37,7 @@ local max = math.max
 local min = math.min
 
 local Handle = Widget.module("tek.ui.class.handle", "tek.ui.class.widget")
-Handle._VERSION = "Handle 7.2"
+Handle._VERSION = "Handle 7.3"
 
 -------------------------------------------------------------------------------
 -- Class implementation:
@@ -95,7 +95,7 @@ function Handle:startMove(x, y)
 	for _, e in ipairs(g.Children) do
 		local df = 0 -- delta free
 		local mf = 0 -- max free
-		local mm = { e.MinMax:get() }
+		local mm = { e:getMinMax() }
 		if mm[i3] > mm[i1] then
 			local er = { e:getRect() }
 			local emb = { e:getMargin() }
@@ -14,10 +14,32 @@ local ui = require "tek.ui".checkVersion(112)
 local Display = ui.require("display", 21)
 
 local assert = assert
+local setmetatable = setmetatable
 local type = type
 
 local Image = Class.module("tek.ui.class.image", "tek.class")
-Image._VERSION = "Image 3.1"
+Image._VERSION = "Image 3.3"
+
+-- compiled vector images, by coordinates and primitives tables. Images
+-- sharing these tables share their compiled object, and with it their
+-- entries in the pixmap cache:
+
+local Compiled = setmetatable({ }, { __mode = "k" })
+
+local function compileimage(image)
+	local coords, prims = image[1], image[5]
+	local byprims = Compiled[coords]
+	if not byprims then
+		byprims = setmetatable({ }, { __mode = "k" })
+		Compiled[coords] = byprims
+	end
+	local compiled = byprims[prims]
+	if not compiled then
+		compiled = Display.compileImage(image)
+		byprims[prims] = compiled
+	end
+	return compiled
+end
 
 function Image.new(class, image)
 	if type(image) == "string" then
@@ -28,12 +50,14 @@ function Image.new(class, image)
 	image[3] = image[3] or false -- height (false: stretchable)
 	image[4] = image[4] or false -- transparent? (false: opaque)
 	image[5] = image[5] or false -- vector primitives (false: is a pixmap)
+	-- compiled vector image:
+	image[6] = image[5] and compileimage(image) or false
 	return Class.new(class, image)
 end
 
 function Image:draw(d, r1, r2, r3, r4, pen)
 	if self[5] then
-		d:drawImage(self, r1, r2, r3, r4, pen)
+		d:drawImage(self[6], r1, r2, r3, r4, pen)
 	else
 		d:drawPixmap(self[1], r1, r2, r3, r4)
 	end
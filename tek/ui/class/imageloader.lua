@@ -0,0 +1,256 @@
+-------------------------------------------------------------------------------
+--
+--	tek.ui.class.imageloader
+--	Written by Timm S. Mueller <tmueller at schulze-mueller.de>
+--	See copyright notice in COPYRIGHT
+--
+--	OVERVIEW::
+--		[[#ClassOverview]] :
+--		[[#tek.class : Class]] /
+--		ImageLoader ${subclasses(ImageLoader)}
+--
+--		This class loads pictures asynchronously. Pictures are decoded
+--		(and optionally scaled) by {{tek.lib.imgload}} in the worker tasks
+--		of a [[#tek.ui.class.workerpool : WorkerPool]], which deliver the
+--		decoded rows in bands as messages of the type {{ui.MSG_USER}}.
+--
+--		ImageLoader:load() immediately returns an image object, which
+--		can be placed in an [[#tek.ui.class.imagewidget : ImageWidget]]
+--		like any other image. Until the picture's size is known, the
+--		image is drawn as a placeholder in the widget's background, and
+--		subsequently filled in as the bands arrive. Elements displaying the
+--		image are registered with it, and are notified using their
+--		{{setImage()}} method when its size or transparency become known
+--		or when it is complete, and using {{setFlags(ui.FL_REDRAW)}} when
+--		a band was received.
+--
+--	ATTRIBUTES::
+--		- {{Application [IG]}} ([[#tek.ui.class.application : Application]])
+--			The application to which bands are delivered. Mandatory.
+--		- {{BandSize [IG]}} (number)
+--			Approximate number of bytes per band of decoded rows.
+--			Default: {{65536}}
+--		- {{WorkerPool [IG]}} ([[#tek.ui.class.workerpool : WorkerPool]])
+--			The pool in which pictures are decoded. Default: the
+--			application's pool, see Application:getWorkerPool()
+--
+--	IMPLEMENTS::
+--		- ImageLoader:load() - Loads a picture asynchronously
+--
+--	OVERRIDES::
+--		- Class.new()
+--
+-------------------------------------------------------------------------------
+
+local db = require "tek.lib.debug"
+local ui = require "tek.ui".checkVersion(112)
+local Class = require "tek.class"
+local Display = ui.require("display", 34)
+local Image = ui.require("image", 3)
+
+local assert = assert
+local find = string.find
+local pairs = pairs
+local setmetatable = setmetatable
+local sub = string.sub
+local tonumber = tonumber
+
+local ImageLoader = Class.module("tek.ui.class.imageloader", "tek.class")
+ImageLoader._VERSION = "ImageLoader 1.0"
+
+-------------------------------------------------------------------------------
+--	constants & class data:
+-------------------------------------------------------------------------------
+
+local MSG_USER = ui.MSG_USER
+local FL_REDRAW = ui.FL_REDRAW
+
+local LoaderCount = 0
+
+-------------------------------------------------------------------------------
+--	LoaderImage: Image class for pictures being loaded. The fields Status
+--	({{"pending"}}, {{"done"}} or {{"error"}}) and Rows (number of rows
+--	received) reflect the progress.
+-------------------------------------------------------------------------------
+
+local LoaderImage = Image:newClass { _NAME = "tek.ui.class.imageloader.image" }
+
+function LoaderImage.new(class, self)
+	self[1] = false -- pixmap, created when the size is known
+	self[2] = self[2] or false
+	self[3] = self[3] or false
+	self[4] = false
+	self[5] = false
+	self[6] = false
+	self.Status = "pending"
+	self.Rows = 0
+	self.Clients = setmetatable({ }, { __mode = "k" })
+	return Class.new(class, self)
+end
+
+function LoaderImage:draw(d, r1, r2, r3, r4, pen)
+	local pm = self[1]
+	if self.Status == "done" then
+		if pm then
+			d:drawPixmap(pm, r1, r2, r3, r4)
+		end
+		return
+	end
+	-- placeholder in the background pen for missing rows:
+	local y = r2 + self.Rows
+	if pm and y > r2 then
+		if self[4] then
+			d:fillRect(r1, r2, r3, y - 1)
+		end
+		d:drawPixmap(pm, r1, r2, r3, y - 1)
+	end
+	if y <= r4 then
+		d:fillRect(r1, y, r3, r4)
+	end
+end
+
+function LoaderImage:getPixmap()
+	if self.Status == "done" then
+		return self[1], self[2], self[3], self[4]
+	end
+end
+
+function LoaderImage:addClient(client)
+	self.Clients[client] = true
+end
+
+function LoaderImage:remClient(client)
+	self.Clients[client] = nil
+end
+
+function LoaderImage:notify(changed)
+	for client in pairs(self.Clients) do
+		if changed then
+			client:setImage(self)
+		else
+			client:setFlags(FL_REDRAW)
+		end
+	end
+end
+
+ImageLoader.Image = LoaderImage
+
+-------------------------------------------------------------------------------
+--	decodejob: Runs in a worker task, decoding a picture and sending its
+--	size and bands of rows to the parent's "ui" port. A size message consists
+--	of a line "<tag> <id> size <width> <height> <alpha>\n", a band message of
+--	a line "<tag> <id> band <y> <numrows>\n", followed by the pixels in the
+--	format of pixmap:fromString(). This function is dumped to the worker
+--	task, therefore it must not have upvalues, and accesses globals
+--	through _G.
+-------------------------------------------------------------------------------
+
+local function decodejob(tag, id, fname, width, height, bandsize)
+	local exec = _G.require "tek.lib.exec"
+	local imgload = _G.require "tek.lib.imgload"
+	local f = _G.assert(_G.io.open(fname, "rb"))
+	local dec = imgload.open(f, width or 0, height or 0)
+	if not dec then
+		f:close()
+		_G.error("cannot decode image '" .. fname .. "'")
+	end
+	local w, h, alpha = dec:getAttrs()
+	local prefix = tag .. " " .. id
+	exec.sendport("*p", "ui", prefix .. " size " .. w .. " " .. h .. " " ..
+		(alpha and 1 or 0) .. "\n")
+	local numrows = _G.math.max(1, _G.math.floor(bandsize / (w * 4)))
+	while true do
+		local data, y, n = dec:read(numrows)
+		if not data then
+			break
+		end
+		exec.sendport("*p", "ui", prefix .. " band " .. y .. " " .. n .. "\n" ..
+			data)
+	end
+	dec:close()
+	f:close()
+	return w, h, alpha
+end
+
+-------------------------------------------------------------------------------
+--	new: overrides
+-------------------------------------------------------------------------------
+
+function ImageLoader.new(class, self)
+	self = self or { }
+	assert(self.Application, "Application missing")
+	LoaderCount = LoaderCount + 1
+	self.Tag = "tek.ui.class.imageloader." .. LoaderCount
+	self.BandSize = self.BandSize or 65536
+	self.WorkerPool = self.WorkerPool or self.Application:getWorkerPool()
+	self.Images = { } -- images being loaded, by id
+	self.Count = 0
+	self = Class.new(class, self)
+	self.Application:addInputHandler(MSG_USER, self, self.msgBand)
+	return self
+end
+
+-------------------------------------------------------------------------------
+--	image = load(fname[, width[, height]]): Starts loading a picture from a
+--	file in the PNG or PPM format, and returns an image object, which serves
+--	as a placeholder until the picture has arrived. Optionally, the picture
+--	is scaled to the given size; if only one of width and height are given,
+--	it is scaled proportionally. If the picture cannot be loaded, the
+--	image's field {{Status}} is set to {{"error"}}, and it remains a
+--	placeholder.
+-------------------------------------------------------------------------------
+
+function ImageLoader:load(fname, width, height)
+	local image = LoaderImage:new { false, width or false, height or false }
+	local id = self.Count + 1
+	self.Count = id
+	local job = self.WorkerPool:submit(decodejob, self.Tag, id, fname,
+		width, height, self.BandSize)
+	if not job then
+		image.Status = "error"
+		return image
+	end
+	self.Images[id] = image
+	job.Callback = function(job, success, msg)
+		self.Images[id] = nil
+		if success then
+			image.Status = "done"
+			image.Rows = image[3] or 0
+		else
+			db.warn("cannot load image '%s': %s", fname, msg)
+			image.Status = "error"
+		end
+		image:notify(true)
+	end
+	return image
+end
+
+-------------------------------------------------------------------------------
+--	msgBand: Input handler collecting sizes and bands from the worker tasks
+-------------------------------------------------------------------------------
+
+function ImageLoader:msgBand(msg)
+	local body = msg[-1]
+	local tag = self.Tag
+	if sub(body, 1, #tag + 1) ~= tag .. " " then
+		return msg
+	end
+	local _, e, id, kind, a, b, c =
+		find(body, "^%S+ (%d+) (%a+) (%d+) (%d+) ?(%d*)\n")
+	local image = id and self.Images[tonumber(id)]
+	if image then
+		a, b = tonumber(a), tonumber(b)
+		if kind == "size" then
+			image[1] = Display.createPixmap(a, b, c == "1")
+			image[2], image[3], image[4] = a, b, c == "1"
+			image:notify(true)
+		elseif kind == "band" and image[1] then
+			image[1]:fromString(sub(body, e + 1), 0, a, image[2], b)
+			image.Rows = a + b
+			image:notify(false)
+		end
+	end
+	return false
+end
+
+return ImageLoader
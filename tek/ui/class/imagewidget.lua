@@ -18,10 +18,17 @@
 --		Images are instances of the Image class, which handles pixmaps
 --		and simple vector graphics.
 --		They can be obtained by ui.loadImage(), ui.getStockImage(),
---		or by directly instantiating the Image class or derivations thereof.
+--		Application:loadImage(), or by directly instantiating the Image
+--		class or derivations thereof.
 --
 --	ATTRIBUTES::
 --		- {{Image [ISG]}} (image object)
+--		- {{ImageFile [IG]}} (string)
+--			Name of a picture file, which is loaded asynchronously using
+--			Application:loadImage() when the widget is set up, unless an
+--			{{Image}} is given. If {{ImageWidth}} or {{ImageHeight}} are
+--			specified, the picture is scaled accordingly. Until the picture
+--			has arrived, the widget's background is shown in its place.
 --
 --	IMPLEMENTS::
 --		- ImageWidget:onSetImage() - Handler for the {{Image}} attribute
@@ -29,9 +36,11 @@
 --	OVERRIDES::
 --		- Object.addClassNotifications()
 --		- Area:askMinMax()
+--		- Element:cleanup()
 --		- Area:draw()
 --		- Area:layout()
 --		- Object.new()
+--		- Element:setup()
 --
 -------------------------------------------------------------------------------
 
@@ -45,7 +54,7 @@ local type = type
 local unpack = unpack or table.unpack
 
 local ImageWidget = Widget.module("tek.ui.class.imagewidget", "tek.ui.class.widget")
-ImageWidget._VERSION = "ImageWidget 15.2"
+ImageWidget._VERSION = "ImageWidget 15.4"
 
 -------------------------------------------------------------------------------
 --	addClassNotifications: overrides
@@ -73,12 +82,14 @@ function ImageWidget.new(class, self)
 		self.Image = ui.getStockImage(self.Image)
 	end
 	self.Image = self.Image or false
+	self.ImageFile = self.ImageFile or false
 	self.ImageAspectX = self.ImageAspectX or 1
 	self.ImageAspectY = self.ImageAspectY or 1
 	self.ImageData = { } -- layouted x, y, width, height
 	self.ImageWidth = self.ImageWidth or false
 	self.ImageHeight = self.ImageHeight or false
 	self.Region = false
+	self.WatchedImage = false -- image being loaded, see setImage()
 	self = Widget.new(class, self)
 	self:setImage(self.Image)
 	return self
@@ -119,6 +130,16 @@ end
 
 function ImageWidget:setImage(img)
 	self.Image = img
+	-- images being loaded notify us of their progress:
+	local watched = self.WatchedImage
+	local watch = img and img.addClient and img.Status == "pending" and img
+	if watched and watched ~= watch then
+		watched:remClient(self)
+	end
+	self.WatchedImage = watch or false
+	if watch then
+		img:addClient(self)
+	end
 	self:setFlags(ui.FL_CHANGED + ui.FL_REDRAW)
 	if img then
 		local iw, ih = img:askWidthHeight(false, false)
@@ -130,6 +151,34 @@ function ImageWidget:setImage(img)
 	end
 end
 
+-------------------------------------------------------------------------------
+--	setup: overrides
+-------------------------------------------------------------------------------
+
+function ImageWidget:setup(app, window)
+	Widget.setup(self, app, window)
+	if self.ImageFile and not self.Image then
+		self:setValue("Image", app:loadImage(self.ImageFile,
+			self.ImageWidth, self.ImageHeight))
+	elseif self.Image and self.Image.addClient then
+		-- watch an image being loaded again, catching up on the progress
+		-- made while we were not set up:
+		self:setImage(self.Image)
+	end
+end
+
+-------------------------------------------------------------------------------
+--	cleanup: overrides
+-------------------------------------------------------------------------------
+
+function ImageWidget:cleanup()
+	if self.WatchedImage then
+		self.WatchedImage:remClient(self)
+		self.WatchedImage = false
+	end
+	Widget.cleanup(self)
+end
+
 -------------------------------------------------------------------------------
 --	layout: overrides
 -------------------------------------------------------------------------------
@@ -198,8 +247,9 @@ function ImageWidget:draw()
 		local d = self.Window.Drawable
 		local R = self.Region
 		local img = self.Image
+		-- also used by images for their placeholders:
+		d:setBGPen(self:getBG())
 		if R then
-			d:setBGPen(self:getBG())
 			R:forEach(d.fillRect, d)
 		end
 		if img then
@@ -73,6 +73,13 @@
 --		- {{SelectMode [IG]}} (string)
 --			The Lister's selection mode, which can be {{"none"}},
 --			{{"single"}}, or {{"multi"}}.
+--		- {{Virtual [IG]}} (boolean)
+--			If '''true''', the Lister operates in virtualized mode, which is
+--			suitable for very large lists: Only lines becoming visible are
+--			measured, and the column widths are maintained incrementally
+--			as lines are measured, removed or changed. As a consequence,
+--			columns may widen when scrolling to lines not yet seen.
+--			Default: '''false'''
 --
 --	IMPLEMENTS::
 --		- Lister:addItem() - Adds an item to the list
@@ -122,6 +129,7 @@ local intersect = Region.intersect
 local max = math.max
 local min = math.min
 local pairs = pairs
+local setmetatable = setmetatable
 local sort = table.sort
 local tonumber = tonumber
 local tostring = tostring
@@ -129,7 +137,7 @@ local type = type
 local unpack = unpack or table.unpack
 
 local Lister = Text.module("tek.ui.class.lister", "tek.ui.class.text")
-Lister._VERSION = "Lister 32.1"
+Lister._VERSION = "Lister 32.3"
 
 -------------------------------------------------------------------------------
 --	Constants & Class data:
@@ -139,6 +147,75 @@ local FL_LAYOUT = ui.FL_LAYOUT
 local MSG_KEYDOWN = ui.MSG_KEYDOWN
 local MSG_KEYUP = ui.MSG_KEYUP
 
+-------------------------------------------------------------------------------
+--	Width sets: multisets of widths, supporting insertion, removal and
+--	retrieval of the maximum in O(log n). Removed widths are deleted from
+--	the heap lazily, i.e. when they turn up at its top.
+-------------------------------------------------------------------------------
+
+local function newwidthset()
+	return { Count = { }, Heap = { } }
+end
+
+local function addwidth(ws, w)
+	local c = ws.Count
+	local n = c[w]
+	c[w] = (n or 0) + 1
+	if not n then
+		local h = ws.Heap
+		local i = #h + 1
+		h[i] = w
+		while i > 1 do
+			local p = floor(i / 2)
+			if h[p] >= w then
+				break
+			end
+			h[i], h[p] = h[p], w
+			i = p
+		end
+	end
+end
+
+local function remwidth(ws, w)
+	local c = ws.Count
+	local n = c[w]
+	if n then
+		c[w] = n > 1 and n - 1 or nil
+	end
+end
+
+local function maxwidth(ws)
+	local c, h = ws.Count, ws.Heap
+	local w = h[1]
+	while w and not c[w] do
+		-- purge removed width from the top of the heap:
+		local n = #h
+		local e = h[n]
+		h[n] = nil
+		n = n - 1
+		local i = 1
+		while true do
+			local l = i * 2
+			if l > n then
+				break
+			end
+			if l < n and h[l + 1] > h[l] then
+				l = l + 1
+			end
+			if e >= h[l] then
+				break
+			end
+			h[i] = h[l]
+			i = l
+		end
+		if n > 0 then
+			h[i] = e
+		end
+		w = h[1]
+	end
+	return w or 0
+end
+
 -------------------------------------------------------------------------------
 --	addClassNotifications: overrides
 -------------------------------------------------------------------------------
@@ -206,6 +283,13 @@ function Lister.new(class, self)
 	-- selection modes ("none", "single", "multi"):
 	self.SelectMode = self.SelectMode or "single"
 	self.TrackDamage = true
+	self.Virtual = self.Virtual or false
+	-- virtual mode: width sets per column and for the number of columns,
+	-- and measured widths per line:
+	self.ColumnSets = false
+	self.NumColumnsSet = false
+	self.LineMetrics = false
+	self.NotifyCanvasTop = { self, "onSetCanvasTop" }
 	self.OldCursorLine = self.CursorLine
 	self.OldSelectedLine = self.SelectedLine
 	return Text.new(class, self)
@@ -232,6 +316,109 @@ function Lister:initFont()
 	local _, b2, _, b4 = self.CursorObject:getBorder()
 	self.LineHeight = self.FHeight + b2 + b4
 	self.ColumnPadding = self.ColumnPadding or self.FWidth
+	self:resetMetrics()
+end
+
+-------------------------------------------------------------------------------
+--	resetMetrics: discards all line measurements of the virtual mode
+-------------------------------------------------------------------------------
+
+function Lister:resetMetrics()
+	if self.Virtual then
+		self.ColumnSets = { }
+		self.NumColumnsSet = newwidthset()
+		self.LineMetrics = setmetatable({ }, { __mode = "k" })
+	end
+end
+
+-------------------------------------------------------------------------------
+--	changed = measureLine(line): Measures a line in virtual mode, unless it
+--	has been measured already, and adds its widths to the column metrics.
+--	Returns '''true''' if the line has not been measured before.
+-------------------------------------------------------------------------------
+
+function Lister:measureLine(l)
+	local lm = self.LineMetrics
+	if lm[l] then
+		return false
+	end
+	local f = self.FontHandle
+	local columns = l[1]
+	local cs = self.ColumnSets
+	local w = { }
+	for i = 1, #columns do
+		local cw = f:getTextSize(columns[i])
+		w[i] = cw
+		local ws = cs[i]
+		if not ws then
+			ws = newwidthset()
+			cs[i] = ws
+		end
+		addwidth(ws, cw)
+	end
+	addwidth(self.NumColumnsSet, #columns)
+	lm[l] = w
+	return true
+end
+
+-------------------------------------------------------------------------------
+--	unmeasureLine(line): Removes a line's widths from the column metrics
+-------------------------------------------------------------------------------
+
+function Lister:unmeasureLine(l)
+	local lm = self.LineMetrics
+	local w = lm and lm[l]
+	if w then
+		local cs = self.ColumnSets
+		for i = 1, #w do
+			remwidth(cs[i], w[i])
+		end
+		remwidth(self.NumColumnsSet, #w)
+		lm[l] = nil
+	end
+end
+
+-------------------------------------------------------------------------------
+--	changed = measureVisibleLines(): Measures the lines in the visible part
+--	of the canvas. Returns '''true''' if the column metrics have changed.
+-------------------------------------------------------------------------------
+
+function Lister:measureVisibleLines()
+	local lo = self.ListObject
+	local c = self.Canvas
+	local lh = self.LineHeight
+	if not (lo and c and lh and self.LineMetrics) then
+		return false
+	end
+	local _, r2, _, r4 = c:getRect()
+	if not r2 then
+		return false
+	end
+	local cs = self.ColumnSets
+	local nc = maxwidth(self.NumColumnsSet)
+	local oldw = { }
+	for i = 1, #cs do
+		oldw[i] = maxwidth(cs[i])
+	end
+	local y0 = c.CanvasTop
+	local measured
+	for lnr = floor(y0 / lh) + 1,
+		min(lo:getN(), floor((y0 + r4 - r2) / lh) + 1) do
+		if self:measureLine(lo:getItem(lnr)) then
+			measured = true
+		end
+	end
+	if measured then
+		if maxwidth(self.NumColumnsSet) ~= nc or #cs ~= #oldw then
+			return true
+		end
+		for i = 1, #cs do
+			if maxwidth(cs[i]) ~= oldw[i] then
+				return true
+			end
+		end
+	end
+	return false
 end
 
 -------------------------------------------------------------------------------
@@ -257,6 +444,10 @@ function Lister:setup(app, window)
 		{ Border = { b, b, b, b } })
 	self:initFont()
 	self:prepare(false)
+	if self.Virtual then
+		self.Canvas:addNotify("CanvasTop", ui.NOTIFY_ALWAYS,
+			self.NotifyCanvasTop)
+	end
 end
 
 -------------------------------------------------------------------------------
@@ -264,6 +455,10 @@ end
 -------------------------------------------------------------------------------
 
 function Lister:cleanup()
+	if self.Virtual then
+		self.Canvas:remNotify("CanvasTop", ui.NOTIFY_ALWAYS,
+			self.NotifyCanvasTop)
+	end
 	self.FontHandle = self.Application.Display:closeFont(self.FontHandle)
 	self.CursorObject = ui.destroyHook(self.CursorObject)
 -- 	self.SelectedLines = false
@@ -308,30 +503,33 @@ end
 --	getLineOnScreen:
 -------------------------------------------------------------------------------
 
-function Lister:getLineOnScreen(lnr)
-	local l = self.ListObject and self.ListObject:getItem(lnr)
-	if l then
+function Lister:getLineOnScreen(lnr, lnr2)
+	local lo = self.ListObject
+	local lh = self.LineHeight
+	if lo and lh and lnr >= 1 and lnr <= lo:getN() then
 		local c = self.Canvas
 		if c then
 			local r1, r2, r3, r4 = c:getRect()
 			if r1 then
+				lnr2 = lnr2 and min(lnr2, lo:getN()) or lnr
 				local v1 = c.CanvasLeft
 				local v2 = c.CanvasTop
 				local v3 = v1 + r3 - r1
 				local v4 = v2 + r4 - r2
-				return intersect(v1, v2, v3, v4, 0, l[4], c.CanvasWidth - 1,
-					l[5])
+				return intersect(v1, v2, v3, v4, 0, (lnr - 1) * lh,
+					c.CanvasWidth - 1, lnr2 * lh - 1)
 			end
 		end
 	end
 end
 
 -------------------------------------------------------------------------------
---	damageLine(lnr): Marks the specified line for repainting.
+--	damageLine(lnr[, lnr2]): Marks the specified line (or range of lines up
+--	to and including {{lnr2}}) for repainting.
 -------------------------------------------------------------------------------
 
-function Lister:damageLine(lnr)
-	local r1, r2, r3, r4 = self:getLineOnScreen(lnr)
+function Lister:damageLine(lnr, lnr2)
+	local r1, r2, r3, r4 = self:getLineOnScreen(lnr, lnr2)
 	if r1 then
 		self:damage(r1, r2, r3, r4)
 	end
@@ -382,9 +580,7 @@ function Lister:addItem(entry, lnr, quick)
 		end
 		if not quick then
 			self:prepare(true)
-			for i = lnr, lo:getN() do
-				self:damageLine(i)
-			end
+			self:damageLine(lnr, lo:getN())
 			if self.Canvas then
 				self.Canvas:updateUnusedRegion()
 			end
@@ -409,11 +605,12 @@ function Lister:remItem(lnr, quick)
 				self.NumSelectedLines = self.NumSelectedLines - 1
 			end
 			self:shiftSelection(lnr + 1, -1)
+			if self.Virtual then
+				self:unmeasureLine(entry)
+			end
 			if not quick then
 				self:prepare(true)
-				for i = lnr, lo:getN() do
-					self:damageLine(i)
-				end
+				self:damageLine(lnr, lo:getN())
 				self:moveLine()
 			end
 		end
@@ -450,6 +647,7 @@ function Lister:setList(listobject)
 	assert(not listobject or listobject:instanceOf(List))
 	self.ListObject = listobject
 	self:initSelectedLines()
+	self:resetMetrics()
 	self:prepare(true)
 end
 
@@ -487,16 +685,27 @@ function Lister:prepare(damage)
 			end
 		end
 
-		for lnr = 1, lo:getN() do
-			local l = lo:getItem(lnr)
-			local columns = l[1]
-			nc = max(nc, #columns)
-			for i, t in ipairs(columns) do
-				local w = f:getTextSize(columns[i])
-				cw[i] = max(cw[i] or 0, w)
+		if self.Virtual then
+			-- only visible lines are measured, widths are kept in sets:
+			self:measureVisibleLines()
+			local cs = self.ColumnSets
+			for i = 1, #cs do
+				cw[i] = max(cw[i] or 0, maxwidth(cs[i]))
+			end
+			nc = maxwidth(self.NumColumnsSet)
+			y = lo:getN() * lh
+		else
+			for lnr = 1, lo:getN() do
+				local l = lo:getItem(lnr)
+				local columns = l[1]
+				nc = max(nc, #columns)
+				for i, t in ipairs(columns) do
+					local w = f:getTextSize(columns[i])
+					cw[i] = max(cw[i] or 0, w)
+				end
+				l[4], l[5] = y, y + lh - 1
+				y = y + lh
 			end
-			l[4], l[5] = y, y + lh - 1
-			y = y + lh
 		end
 
 		-- TODO: it's nonsense to depend on 'damage' here,
@@ -603,23 +812,25 @@ function Lister:drawPatch(r1, r2, r3, r4, t, d, lo, lh, x1, fpen, cpen,
 	d:pushClipRect(r1, r2, r3, r4)
 	for lnr = floor(r2 / lh) + 1, min(lo:getN(), floor(r4 / lh) + 1) do
 		local l = lo:getItem(lnr)
+		local y0 = (lnr - 1) * lh
+		local y1 = y0 + lh - 1
 		-- overlap between damage and line:
-		if intersect(r1, r2, r3, r4, 0, l[4], x1, l[5]) then
+		if intersect(r1, r2, r3, r4, 0, y0, x1, y1) then
 			local b1, b2, b3, b4 = unpack(t, 1, 4)
 			local cp = self.ColumnPositions
 			local bpen = t[6 + lnr % 2]
 			if lnr == self.CursorLine then
 				-- with cursor:
-				d:fillRect(b1, l[4] + b2, x1 - b3, l[5] - b4,
+				d:fillRect(b1, y0 + b2, x1 - b3, y1 - b4,
 					l[3] and cpen or bpen)
 				for ci = 1, #cp do
 					local text = l[1][ci]
 					if text then
 						local cx = cp[ci]
-						d:pushClipRect(b1 + cx, l[4] + b2,
-							b1 + cx + self.ColumnWidths[ci], l[5] - b4)
-						d:drawText(b1 + cx, l[4] + b2,
-							b1 + cx + self.ColumnWidths[ci], l[5] - b4,
+						d:pushClipRect(b1 + cx, y0 + b2,
+							b1 + cx + self.ColumnWidths[ci], y1 - b4)
+						d:drawText(b1 + cx, y0 + b2,
+							b1 + cx + self.ColumnWidths[ci], y1 - b4,
 							l[1][ci], l[3] and cfpen or fpen)
 						d:popClipRect()
 					end
@@ -627,19 +838,19 @@ function Lister:drawPatch(r1, r2, r3, r4, t, d, lo, lh, x1, fpen, cpen,
 				self.CursorObject:draw(d)
 			else
 				-- without cursor:
-				d:fillRect(0, l[4], x1, l[5], l[3] and cpen or bpen)
+				d:fillRect(0, y0, x1, y1, l[3] and cpen or bpen)
 				for ci = 1, #cp do
 					local text = l[1][ci]
 					if text then
 						local cx = cp[ci]
-						if intersect(r1, r2, r3, r4, cx, l[4],
-							b1 + cx + self.ColumnWidths[ci] - 1, l[5]) then
-							d:pushClipRect(b1 + cx, l[4] + b2,
-								b1 + cx + self.ColumnWidths[ci], l[5] - b4)
+						if intersect(r1, r2, r3, r4, cx, y0,
+							b1 + cx + self.ColumnWidths[ci] - 1, y1) then
+							d:pushClipRect(b1 + cx, y0 + b2,
+								b1 + cx + self.ColumnWidths[ci], y1 - b4)
 							-- draw text:
-							d:drawText(b1 + cx, l[4] + b2,
+							d:drawText(b1 + cx, y0 + b2,
 								b1 + cx + self.ColumnWidths[ci],
-								l[5] - b4, l[1][ci], l[3] and cfpen or fpen)
+								y1 - b4, l[1][ci], l[3] and cfpen or fpen)
 							d:popClipRect()
 						end
 					end
@@ -664,15 +875,17 @@ function Lister:layout(r1, r2, r3, r4, markdamage)
 	local y0 = r2 + m2
 	local x1 = r3 - m3
 	local y1 = r2 + ch - 1 - m4
-	local r = self.Rect
-	local r1, r2, r3, r4 = r:get()
-	if r1 ~= x0 or r2 ~= y0 or r3 ~= x1 or r4 ~= x1 then
-		r:setRect(x0, y0, x1, y1)
+	if self:setRect(x0, y0, x1, y1) then
 		c:setValue("CanvasHeight", ch)
 		self:layoutCursor()
 		self:setFlags(FL_LAYOUT)
 		res = true
 	end
+	if self.Virtual and self:measureVisibleLines() then
+		-- newly visible lines changed the column metrics:
+		self:prepare(true)
+		res = true
+	end
 	if markdamage then
 		c:damageChild(0, 0, cw - 1, ch - 1)
 	end
@@ -721,6 +934,16 @@ function Lister:onSetCursor()
 	end
 end
 
+-------------------------------------------------------------------------------
+--	onSetCanvasTop: Measures lines becoming visible in virtual mode
+-------------------------------------------------------------------------------
+
+function Lister:onSetCanvasTop()
+	if self:measureVisibleLines() then
+		self:prepare(true)
+	end
+end
+
 -------------------------------------------------------------------------------
 --	onDblClick(): overrides
 -------------------------------------------------------------------------------
@@ -795,30 +1018,26 @@ function Lister:moveLine(lnr, follow)
 	local ca = self.Canvas
 	if ca then
 		local x1 = ca.CanvasWidth - 1
+		local lh = self.LineHeight
 		local cl = self.CursorLine
-		if cl >= 0 then
-			local ol = lo:getItem(cl)
-			if ol then
-				self:damage(0, ol[4], x1, ol[5])
-			end
+		if cl > 0 and lo:getItem(cl) then
+			self:damage(0, (cl - 1) * lh, x1, cl * lh - 1)
 		end
 		local l = lnr and lo:getItem(lnr)
 		if l then
-			local y0, y1 = l[4], l[5]
-			if y0 and y1 then
-				self:damage(0, y0, x1, y1)
-				if y1 < ca.CanvasTop then
-					if follow then
-						ca:setValue("CanvasTop", y0)
-					end
-				else
-					local _, r2, _, r4 = ca:getRect()
-					if r2 then
-						local vh = r4 - r2 + 1 - (y1 - y0 + 1)
-						if y0 > ca.CanvasTop + vh then
-							if follow then
-								ca:setValue("CanvasTop", y0 - vh)
-							end
+			local y0, y1 = (lnr - 1) * lh, lnr * lh - 1
+			self:damage(0, y0, x1, y1)
+			if y1 < ca.CanvasTop then
+				if follow then
+					ca:setValue("CanvasTop", y0)
+				end
+			else
+				local _, r2, _, r4 = ca:getRect()
+				if r2 then
+					local vh = r4 - r2 + 1 - (y1 - y0 + 1)
+					if y0 > ca.CanvasTop + vh then
+						if follow then
+							ca:setValue("CanvasTop", y0 - vh)
 						end
 					end
 				end
@@ -833,12 +1052,11 @@ end
 
 function Lister:findLine(y)
 	local lo = self.ListObject
-	if lo then
-		for lnr = 1, lo:getN() do
-			local l = lo:getItem(lnr)
-			if y >= l[4] and y <= l[5] then
-				return lnr
-			end
+	local lh = self.LineHeight
+	if lo and lh and y >= 0 then
+		local lnr = floor(y / lh) + 1
+		if lnr <= lo:getN() then
+			return lnr
 		end
 	end
 end
@@ -935,8 +1153,8 @@ function Lister:handleInput(msg)
 					if qual == 4 or qual == 8 then
 						self:moveLine(numl, true)
 					else
-						local entry = self:getItem(lnr)
-						local y0 = entry and entry[4] or self.CanvasTop
+						local y0 = self:getItem(lnr) and
+							(lnr - 1) * self.LineHeight or self.Canvas.CanvasTop
 						local l1 = self:findLine(y0 + getheight(self)) or numl
 						self:moveLine(l1, true)
 					end
@@ -944,8 +1162,8 @@ function Lister:handleInput(msg)
 					if qual == 4 or qual == 8 then
 						self:moveLine(1, true)
 					else
-						local entry = self:getItem(lnr)
-						local y0 = entry and entry[4] or self.CanvasTop
+						local y0 = self:getItem(lnr) and
+							(lnr - 1) * self.LineHeight or self.Canvas.CanvasTop
 						local l1 = self:findLine(y0 - getheight(self)) or 1
 						self:moveLine(l1, true)
 					end
@@ -1027,6 +1245,7 @@ function Lister:clear()
 	local lo = self.ListObject
 	if lo then
 		lo:clear()
+		self:resetMetrics()
 	end
 end
 
@@ -67,7 +67,7 @@ local min = math.min
 local remove = table.remove
 
 local ScrollGroup = Group.module("tek.ui.class.scrollgroup", "tek.ui.class.group")
-ScrollGroup._VERSION = "ScrollGroup 19.3"
+ScrollGroup._VERSION = "ScrollGroup 19.4"
 
 local FL_DRAW = ui.FL_SETUP + ui.FL_SHOW + ui.FL_LAYOUT
 local FL_DONOTBLIT = ui.FL_DONOTBLIT
@@ -153,12 +153,21 @@ function ScrollGroup:askMinMax(m1, m2, m3, m4)
 	m1, m2, m3, m4 = Group.askMinMax(self, m1, m2, m3, m4)
 	local cb1, cb2, cb3, cb4 = self.Child:getMargin()
 	local b1, b2, b3, b4 = self:getMargin()
-	if self.HSliderMode == "auto" and self.Child:getAttr("MinWidth") == 0 then
-		local n1 = self.Child:askMinMax(0, 0, 0, 0)
-		self.Child.MinWidth = n1 - cb1 - cb3 - b1 - b3
+	local c = self.Child
+	local changed
+	if self.HSliderMode == "auto" and c:getAttr("MinWidth") == 0 then
+		local w = c:askMinMax(0, 0, 0, 0) - cb1 - cb3 - b1 - b3
+		changed = c.MinWidth ~= w
+		c.MinWidth = w
+	end
+	if self.VSliderMode == "auto" and c:getAttr("MinHeight") == 0 then
+		local h = m2 - cb2 - cb4 - b2 - b4
+		changed = changed or c.MinHeight ~= h
+		c.MinHeight = h
 	end
-	if self.VSliderMode == "auto" and self.Child:getAttr("MinHeight") == 0 then
-		self.Child.MinHeight = m2 - cb2 - cb4 - b2 - b4
+	if changed then
+		-- sizes memorized by the layouter are no longer valid:
+		c:rethinkLayout(0, true)
 	end
 	return m1, m2, m3, m4
 end
@@ -38,7 +38,7 @@ local max = math.max
 local min = math.min
 
 local Sizeable = Widget.module("tek.ui.class.sizeable", "tek.ui.class.widget")
-Sizeable._VERSION = "Sizeable 11.4"
+Sizeable._VERSION = "Sizeable 11.5"
 
 local FL_TRACKDAMAGE = ui.FL_TRACKDAMAGE
 local FL_DONOTBLIT = ui.FL_DONOTBLIT
@@ -181,7 +181,7 @@ function Sizeable:layout(x0, y0, x1, y1, markdamage)
 		self.InsertNum = 0
 		
 		if redraw then
-			self.Rect:setRect(n1, n2, n3, n4)
+			self:setRect(n1, n2, n3, n4)
 			self:setFlags(ui.FL_REDRAW)
 			return true
 		end
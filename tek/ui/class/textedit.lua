@@ -61,7 +61,7 @@ local type = type
 local unpack = unpack or table.unpack
 
 local TextEdit = Sizeable.module("tek.ui.class.textedit", "tek.ui.class.sizeable")
-TextEdit._VERSION = "TextEdit 21.1"
+TextEdit._VERSION = "TextEdit 21.3"
 
 local LNR_HUGE = 1000000000
 local FAKECANVASWIDTH = 1000000000 --30000
@@ -1325,13 +1325,24 @@ function TextEdit:getRealCursorX(vx, cy)
 end
 
 -------------------------------------------------------------------------------
---	getTextWidth(text, p0, p1)
---	take into account tabs
+--	getTextWidth(text, p0, p1[, positions])
+--	take into account tabs. Unless the font is fixed-width or getRawTextWidth
+--	is overridden, the runs are measured natively with a single request.
+--	If a table is given in positions, it receives the x positions following
+--	each character (native path only; returns '''false''' otherwise).
 -------------------------------------------------------------------------------
 
-function TextEdit:getTextWidth(text, p0, p1)
+function TextEdit:getTextWidth(text, p0, p1, positions)
+	local fw = self.FixedFWidth
+	if not fw and self.getRawTextWidth == TextEdit.getRawTextWidth then
+		return text:getTextWidth(self.TabSize, p0, p1, self.FontHandle,
+			positions, self.FWidth)
+	end
+	if positions then
+		return false
+	end
 	return text:getTextWidth(self.TabSize, p0, p1, 
-		self.FixedFWidth or self.getRawTextWidth, self, self.FWidth)
+		fw or self.getRawTextWidth, self, self.FWidth)
 end
 
 -------------------------------------------------------------------------------
@@ -1730,9 +1741,26 @@ function TextEdit:getCursorByX(text, x)
 	end
 	local p0 = 0
 	local p1 = text:len()
+	local pos = { }
+	local x1 = self:getTextWidth(text, 1, p1, pos)
+	if x1 then
+		-- bisect character positions, measured in one go:
+		if x >= x1 then
+			return p1 + 1
+		end
+		while p0 + 1 < p1 do
+			local pn = p0 + floor((p1 - p0) / 2)
+			if pos[pn] > x then
+				p1 = pn
+			else
+				p0 = pn
+			end
+		end
+		return p1
+	end
 	local pn
 	local x0 = 0
-	local x1 = self:getTextWidth(text, 1, p1)
+	x1 = self:getTextWidth(text, 1, p1)
 	local xn
 	while true do
 		if x >= x1 then
@@ -2132,21 +2160,14 @@ function TextEdit:mark(line, lnr, p0, p1)
 end
 
 function TextEdit:markWord(text)
-	local marklen = String:new():set(text):len()
 	local numl = self:getN()
 	for y = 1, numl do
 		local line = self:getLineText(y)
-		local p0 = 0
-		local damage
-		while true do
-			p0 = line:find(text, p0 + 1)
-			if not p0 then
-				break
-			end
-			self:mark(line, y, p0, p0 + marklen - 1)
-			damage = true
+		local found = line:findall(text)
+		for i = 1, #found, 2 do
+			self:mark(line, y, found[i], found[i + 1])
 		end
-		if damage then
+		if #found > 0 then
 			self:damageLine(y)
 		end
 	end
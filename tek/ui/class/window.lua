@@ -65,6 +65,7 @@
 --		- Window:addInputHandler() - Adds an input handler to the window
 --		- Window:addInterval() - Adds an interval timer to the window
 --		- Window:checkDblClickTime() - Checks a time for a doubleclick event
+--		- Window:checkUpdate() - Checks for pending layout and repaints
 --		- Window:clickElement() - Simulates a click on an element
 --		- Window:onChangeStatus() - Handler for {{Status}}
 --		- Window:onHide() - Handler for when the window is about to be closed
@@ -79,6 +80,7 @@
 --
 --	OVERRIDES::
 --		- Object.addClassNotifications()
+--		- Area:getByXY()
 --		- Area:hide()
 --		- Area:layout()
 --		- Class.new()
@@ -92,6 +94,8 @@ local db = require "tek.lib.debug"
 local ui = require "tek.ui".checkVersion(112)
 local Display = ui.require("display", 25)
 local Widget = ui.require("widget", 26)
+local Area = ui.require("area", 57)
+local Frame = ui.require("frame", 24)
 local Group = ui.require("group", 31)
 local Region = ui.loadLibrary("region", 10)
 
@@ -105,13 +109,12 @@ local min = math.min
 local pairs = pairs
 local remove = table.remove
 local setmetatable = setmetatable
-local sort = table.sort
 local tonumber = tonumber
 local type = type
 local unpack = unpack or table.unpack
 
 local Window = Group.module("tek.ui.class.window", "tek.ui.class.group")
-Window._VERSION = "Window 46.5"
+Window._VERSION = "Window 46.9"
 
 -------------------------------------------------------------------------------
 --	constants & class data:
@@ -337,6 +340,7 @@ function Window.new(class, self)
 	self.EventMask = ui.MSG_ALL
 	self.Flags = ui.bor(self.Flags or 0, FL_ISWINDOW)
 	self.FocusElement = false
+	self.FocusOrder = false
 	
 	self.PopupWindow = self.PopupWindow or false
 	if self.PopupWindow then
@@ -356,6 +360,7 @@ function Window.new(class, self)
 	
 	self.HideOnEscape = self.HideOnEscape or false
 	self.HiliteElement = false
+	self.HitIndex = false
 	-- Active hold tick counter - number of ticks left to next hold event:
 	self.HoldTickActive = 0
 	-- Hold tick counter reinitialization (see below):
@@ -634,6 +639,8 @@ function Window:hide()
 		d:close()
 		self.Drawable = false
 		self.ActiveElement = false
+		self.FocusOrder = false
+		self.HitIndex = false
 		self.Application:closeWindow(self)
 		self.PenTable = false
 	end
@@ -888,7 +895,14 @@ local MsgHandlers =
 		return false -- do not pass this msg to group
 	end,
 	[ui.MSG_REFRESH] = function(self, msg)
-		self:damage(msg[7], msg[8], msg[9], msg[10])
+		local r = msg[13]
+		if r then
+			for i = 1, #r, 4 do
+				self:damage(r[i], r[i + 1], r[i + 2], r[i + 3])
+			end
+		else
+			self:damage(msg[7], msg[8], msg[9], msg[10])
+		end
 		return false -- do not pass this msg to group
 	end,
 	[ui.MSG_MOUSEOVER] = function(self, msg)
@@ -1058,52 +1072,30 @@ end
 --	draw:
 -------------------------------------------------------------------------------
 
-local function sortcopies(a, b) return a[1] > b[1] end
-
-local function insertblitx(t, r1, r2, r3, r4, dir, e)
-	insert(t, { r1 * dir, r1, r2, r3, r4, e })
-end
-
-local function insertblity(t, r1, r2, r3, r4, dir, e)
-	insert(t, { r2 * dir, r1, r2, r3, r4, e })
-end
-
 function Window:draw()
 	-- handle copies:
 	local ca = self.Blits
-	local t = { }
-	for key, e in pairs(ca) do
-		local dx, dy, region = e[1], e[2], e[3]
-		if dy == 0 then
-			region:forEach(insertblitx, t, dx > 0 and 1 or -1, e)
-		else
-			region:forEach(insertblity, t, dy > 0 and 1 or -1, e)
-		end
-		ca[key] = nil
-	end
-	sort(t, sortcopies)
 	local d = self.Drawable
-	for i = 1, #t do
-		local r = t[i]
-		local e = r[6]
-		local t = { }
-		local dx, dy = e[1], e[2]
-		if e[4] then
-			d:pushClipRect(e[4], e[5], e[6], e[7])
-		end
-		d:blitRect(r[2], r[3], r[4], r[5], r[2] + dx, r[3] + dy, t)
-		if e[4] then
-			d:popClipRect()
-		end
-		for i = 1, #t, 4 do
-			self:damage(t[i], t[i + 1], t[i + 2], t[i + 3])
-		end
+	if #ca > 0 then
+		self.Blits = { }
+		d:blitRegions(ca, Region.new()):forEach(self.damage, self)
 	end
 	self.BlitObjects = { }
 	Group.draw(self)
 	d:flush()
 end
 
+-------------------------------------------------------------------------------
+--	pending = checkUpdate(): Returns '''true''' if the window is open and
+--	has layout, copy or repaint requests pending, which will be processed
+--	in its next update.
+-------------------------------------------------------------------------------
+
+function Window:checkUpdate()
+	return self.Status == "show" and (#self.Relayouts > 0 or
+		#self.Blits > 0 or self:checkFlags(FL_UPDATE))
+end
+
 -------------------------------------------------------------------------------
 --	update:
 -------------------------------------------------------------------------------
@@ -1195,6 +1187,8 @@ end
 
 function Window:layout(_, _, _, _, markdamage)
 	self.FreeRegion = false
+	self.FocusOrder = false
+	self.HitIndex = false
 	local w, h = self.Drawable:getAttrs()
 	return Group.layout(self, 0, 0, w - 1, h - 1, markdamage)
 end
@@ -1204,6 +1198,8 @@ end
 -------------------------------------------------------------------------------
 
 function Window:relayout(e, x0, y0, x1, y1, markdamage)
+	self.FocusOrder = false
+	self.HitIndex = false
 	local temp = { e }
 	while not e:checkFlags(FL_ISWINDOW) do
 		e = e:getParent()
@@ -1233,6 +1229,94 @@ function Window:relayout(e, x0, y0, x1, y1, markdamage)
 	return res
 end
 
+-------------------------------------------------------------------------------
+--	hit index: The window's elements are entered into a uniform grid of
+--	cells of HITCELL pixels, in the order in which Group:getByXY() would
+--	visit them, and clipped to the rectangles of their enclosing groups.
+--	Groups are resolved into their children; elements overriding getByXY()
+--	in other ways (e.g. canvases and page groups) are entered as a whole
+--	and asked for the actual element when hit. The index is discarded
+--	when the window is layouted.
+-------------------------------------------------------------------------------
+
+local HITCELL = 64
+
+local function addhit(grid, e, x0, y0, x1, y1)
+	local entry = { e, x0, y0, x1, y1 }
+	for cy = floor(y0 / HITCELL), floor(y1 / HITCELL) do
+		for cx = floor(x0 / HITCELL), floor(x1 / HITCELL) do
+			local key = cy * 0x10000 + cx
+			local cell = grid[key]
+			if not cell then
+				cell = { }
+				grid[key] = cell
+			end
+			cell[#cell + 1] = entry
+		end
+	end
+end
+
+local function addhitgroup(grid, g, c1, c2, c3, c4)
+	local c = g.Children
+	for i = 1, #c do
+		local e = c[i]
+		local getbyxy = e.getByXY
+		if getbyxy == Group.getByXY then
+			local r1, r2, r3, r4 = e:getRect()
+			if r1 then
+				r1, r2, r3, r4 = intersect(r1, r2, r3, r4, c1, c2, c3, c4)
+				if r1 then
+					addhitgroup(grid, e, r1, r2, r3, r4)
+				end
+			end
+		elseif getbyxy == Area.getByXY or getbyxy == Frame.getByXY then
+			local r1, r2, r3, r4 = e:getRect()
+			if r1 then
+				if getbyxy == Frame.getByXY then
+					local b1, b2, b3, b4 = e:getBorder()
+					r1, r2, r3, r4 = r1 - b1, r2 - b2, r3 + b3, r4 + b4
+				end
+				r1, r2, r3, r4 = intersect(r1, r2, r3, r4, c1, c2, c3, c4)
+				if r1 then
+					addhit(grid, e, r1, r2, r3, r4)
+				end
+			end
+		else
+			addhit(grid, e, c1, c2, c3, c4)
+		end
+	end
+end
+
+-------------------------------------------------------------------------------
+--	getByXY: overrides
+-------------------------------------------------------------------------------
+
+function Window:getByXY(x, y)
+	local grid = self.HitIndex
+	if not grid then
+		local r1, r2, r3, r4 = self:getRect()
+		if not r1 then
+			return Group.getByXY(self, x, y)
+		end
+		grid = { }
+		addhitgroup(grid, self, r1, r2, r3, r4)
+		self.HitIndex = grid
+	end
+	local cell = grid[floor(y / HITCELL) * 0x10000 + floor(x / HITCELL)]
+	if cell then
+		for i = 1, #cell do
+			local h = cell[i]
+			if x >= h[2] and x <= h[4] and y >= h[3] and y <= h[5] then
+				local ret = h[1]:getByXY(x, y)
+				if ret then
+					return ret
+				end
+			end
+		end
+	end
+	return false
+end
+
 -------------------------------------------------------------------------------
 --	setHiliteElement(element): Sets/unsets the element which is being
 --	hovered by the mouse pointer.
@@ -1415,11 +1499,65 @@ function Window:getNext()
 end
 
 -------------------------------------------------------------------------------
---	getNextElement: Cycles through elements, gets the next element that can
---	receive the focus.
+--	focus order: The sequences in which Window:getNextElement() visits the
+--	window's elements, in both directions, along with a map of each
+--	element's position. Forward, an element is followed by its first child
+--	or else by its next sibling; backward, it is followed by its last child
+--	or else by its previous sibling. The order is discarded when the window
+--	is layouted.
 -------------------------------------------------------------------------------
 
-function Window:getNextElement(e, backward)
+local function addfocusorder(list, pos, e, backward)
+	local n = #list + 1
+	list[n] = e
+	pos[e] = n
+	local c = e:getChildren()
+	if c then
+		if backward then
+			for i = #c, 1, -1 do
+				addfocusorder(list, pos, c[i], true)
+			end
+		else
+			for i = 1, #c do
+				addfocusorder(list, pos, c[i])
+			end
+		end
+	end
+end
+
+local function getfocusorder(self, backward)
+	local fo = self.FocusOrder
+	if not fo then
+		fo = { }
+		self.FocusOrder = fo
+	end
+	local o = fo[backward and 2 or 1]
+	if not o then
+		local list, pos = { }, { }
+		local c = self:getChildren()
+		if c then
+			if backward then
+				for i = #c, 1, -1 do
+					addfocusorder(list, pos, c[i], true)
+				end
+			else
+				for i = 1, #c do
+					addfocusorder(list, pos, c[i])
+				end
+			end
+		end
+		o = { list, pos }
+		fo[backward and 2 or 1] = o
+	end
+	return o[1], o[2]
+end
+
+-------------------------------------------------------------------------------
+--	walknextelement: Gets the next element that can receive the focus by
+--	walking the element tree.
+-------------------------------------------------------------------------------
+
+local function walknextelement(self, e, backward)
 	local oe = e
 	local ne
 	repeat
@@ -1446,6 +1584,30 @@ function Window:getNextElement(e, backward)
 	until not e or e == oe
 end
 
+-------------------------------------------------------------------------------
+--	getNextElement: Cycles through elements, gets the next element that can
+--	receive the focus.
+-------------------------------------------------------------------------------
+
+function Window:getNextElement(e, backward)
+	local list, pos = getfocusorder(self, backward)
+	local p = 0
+	if e then
+		p = pos[e]
+		if not p then
+			-- not (yet) in the focus order, walk the tree:
+			return walknextelement(self, e, backward)
+		end
+	end
+	local n = #list
+	for i = 1, n do
+		local ne = list[(p + i - 1) % n + 1]
+		if ne:checkFocus() then
+			return ne
+		end
+	end
+end
+
 -------------------------------------------------------------------------------
 --	addKeyShortcut:
 -------------------------------------------------------------------------------
@@ -1557,19 +1719,17 @@ function Window:addBlit(x0, y0, x1, y1, dx, dy, c1, c2, c3, c4)
 	end
 	if x0 then
 		if x1 >= x0 and y1 >= y0 then
-			local key
-			if c1 then
-				key = ("%d:%d:%d:%d:%d:%d"):format(dx, dy, c1, c2, c3, c4)
-			else
-				key = ("%d:%d"):format(dx, dy)
-			end
 			local ca = self.Blits
-			if ca[key] then
-				ca[key][3]:orRect(x0, y0, x1, y1)
-			else
-				ca[key] = { dx, dy, 
-					Region.new(x0, y0, x1, y1), c1, c2, c3, c4 }
+			for i = 1, #ca do
+				local e = ca[i]
+				if e[1] == dx and e[2] == dy and e[4] == c1 and e[5] == c2 and
+					e[6] == c3 and e[7] == c4 then
+					e[3]:orRect(x0, y0, x1, y1)
+					return
+				end
 			end
+			ca[#ca + 1] = { dx, dy, Region.new(x0, y0, x1, y1),
+				c1, c2, c3, c4 }
 		else
 			db.warn("illegal blitrect: %s %s %s %s", x0, y0, x1, y1)
 		end
@@ -0,0 +1,454 @@
+-------------------------------------------------------------------------------
+--
+--	tek.ui.class.workerpool
+--	Written by Timm S. Mueller <tmueller at schulze-mueller.de>
+--	See copyright notice in COPYRIGHT
+--
+--	OVERVIEW::
+--		[[#ClassOverview]] :
+--		[[#tek.class : Class]] /
+--		WorkerPool ${subclasses(WorkerPool)}
+--
+--		This class implements a pool of persistent worker tasks, to which
+--		an application can offload Lua computations. The worker tasks are
+--		started once, using Application:runTask(), and stay alive until
+--		the pool is shut down, so that the cost for creating a Lua state
+--		and loading modules is paid only once per worker.
+--
+--		A job consists of a Lua function and its arguments. The function is
+--		transferred as bytecode, and therefore must not have upvalues. Its
+--		arguments and results are serialized, and are restricted to
+--		'''nil''', booleans, numbers, strings, and tables thereof without
+--		cycles. The results are delivered to the application as messages
+--		of the type {{ui.MSG_USER}}, and can be retrieved by polling the
+--		job, by waiting for it in a coroutine, or by a callback.
+--
+--		Each worker keeps the functions it has loaded, as well as its
+--		global state, across jobs. Jobs running the same function are
+--		preferrably dispatched to the same worker while some of them are
+--		pending, unless it is considerably busier than others.
+--
+--	EXAMPLE::
+--				local pool = app:getWorkerPool()
+--				local job = pool:submit(function(list)
+--				  table.sort(list)
+--				  return list
+--				end, list)
+--				app:addCoroutine(function()
+--				  local success, list = pool:wait(job)
+--				end)
+--
+--	ATTRIBUTES::
+--		- {{Application [IG]}} ([[#tek.ui.class.application : Application]])
+--			The application to which results are delivered. Mandatory.
+--		- {{NumWorkers [IG]}} (number)
+--			Number of worker tasks. Default: {{2}}
+--
+--	IMPLEMENTS::
+--		- WorkerPool.decode() - Deserializes values
+--		- WorkerPool.encode() - Serializes values
+--		- WorkerPool:poll() - Gets the status and results of a job
+--		- WorkerPool:shutdown() - Stops all worker tasks
+--		- WorkerPool:submit() - Submits a job to the pool
+--		- WorkerPool:wait() - Waits for completion of a job
+--
+--	OVERRIDES::
+--		- Class.new()
+--
+-------------------------------------------------------------------------------
+
+local db = require "tek.lib.debug"
+local ui = require "tek.ui".checkVersion(112)
+local Class = require "tek.class"
+
+local assert = assert
+local dump = string.dump
+local error = error
+local find = string.find
+local getupvalue = debug.getupvalue
+local insert = table.insert
+local pairs = pairs
+local pcall = pcall
+local select = select
+local setmetatable = setmetatable
+local sub = string.sub
+local tonumber = tonumber
+local unpack = unpack or table.unpack
+
+local WorkerPool = Class.module("tek.ui.class.workerpool", "tek.class")
+WorkerPool._VERSION = "WorkerPool 1.1"
+
+-------------------------------------------------------------------------------
+--	constants & class data:
+-------------------------------------------------------------------------------
+
+local MSG_USER = ui.MSG_USER
+
+-- max. number of extra pending jobs tolerated on a worker with affinity:
+local AFFINITY_SLACK = 2
+
+local PoolCount = 0
+
+local function pack(...)
+	return { n = select("#", ...), ... }
+end
+
+-------------------------------------------------------------------------------
+--	data = WorkerPool.encode(...): Serializes its arguments into a string,
+--	which can be converted back using WorkerPool.decode(). Supported types
+--	are '''nil''', booleans, numbers, strings, and tables with keys and
+--	values of these types. Raises an error if a value cannot be serialized.
+--	This function is also dumped to the worker tasks, therefore it must not
+--	have upvalues, and accesses globals through _G.
+-------------------------------------------------------------------------------
+
+function WorkerPool.encode(...)
+	local error, format, pairs, tostring, type =
+		_G.error, _G.string.format, _G.pairs, _G.tostring, _G.type
+	local buf, n = { }, 0
+	local seen = { }
+	local function put(v)
+		local t = type(v)
+		if t == "number" then
+			n = n + 1
+			if v ~= v then
+				buf[n] = "0/0"
+			elseif v == 1/0 then
+				buf[n] = "1/0"
+			elseif v == -1/0 then
+				buf[n] = "-1/0"
+			else
+				buf[n] = format("%.17g", v)
+			end
+		elseif t == "string" then
+			n = n + 1
+			buf[n] = format("%q", v)
+		elseif t == "boolean" or t == "nil" then
+			n = n + 1
+			buf[n] = tostring(v)
+		elseif t == "table" then
+			if seen[v] then
+				error("cannot serialize cyclic table")
+			end
+			seen[v] = true
+			n = n + 1
+			buf[n] = "{"
+			for key, val in pairs(v) do
+				n = n + 1
+				buf[n] = "["
+				put(key)
+				n = n + 1
+				buf[n] = "]="
+				put(val)
+				n = n + 1
+				buf[n] = ","
+			end
+			n = n + 1
+			buf[n] = "}"
+			seen[v] = nil
+		else
+			error("cannot serialize value of type " .. t)
+		end
+	end
+	local narg = _G.select("#", ...)
+	n = 1
+	buf[1] = "{n=" .. narg .. ","
+	for i = 1, narg do
+		put((_G.select(i, ...)))
+		n = n + 1
+		buf[n] = ","
+	end
+	n = n + 1
+	buf[n] = "}"
+	return _G.table.concat(buf)
+end
+
+-------------------------------------------------------------------------------
+--	... = WorkerPool.decode(data): Deserializes the values contained in a
+--	string that was produced by WorkerPool.encode(). The data is evaluated
+--	in an empty environment. Like WorkerPool.encode(), this function must
+--	not have upvalues.
+-------------------------------------------------------------------------------
+
+function WorkerPool.decode(data)
+	local f, err
+	if _G.setfenv then
+		f, err = _G.loadstring("return " .. data, "=data")
+		if f then
+			_G.setfenv(f, { })
+		end
+	else
+		f, err = _G.load("return " .. data, "=data", "t", { })
+	end
+	if not f then
+		_G.error(err)
+	end
+	local t = f()
+	return (_G.unpack or _G.table.unpack)(t, 1, t.n)
+end
+
+-------------------------------------------------------------------------------
+--	workertask: Runs in a worker task, receiving jobs and sending back their
+--	results to the parent's "ui" port. A job message consists of a header
+--	line "<id> <codelength>\n", followed by the function's bytecode and its
+--	serialized arguments. A result message consists of a header line
+--	"<tag> <id> ok|error\n", followed by the serialized results or an error
+--	message. A message without a valid header terminates the worker. This
+--	function is dumped and executed in a fresh Lua state, therefore it must
+--	not have upvalues, and accesses globals through _G.
+-------------------------------------------------------------------------------
+
+local function workertask()
+	local find, pcall, sub, tostring =
+		_G.string.find, _G.pcall, _G.string.sub, _G.tostring
+	local load = _G.loadstring or _G.load
+	local exec = require "tek.lib.exec"
+	local encode, decode = load(arg[1]), load(arg[2])
+	local tag = arg[3]
+	-- functions loaded, by bytecode:
+	local funcs, numfuncs = { }, 0
+	while true do
+		local msg = exec.waitmsg()
+		if msg then
+			local _, e, id, len = find(msg, "^(%d+) (%d+)\n")
+			if not id then
+				break
+			end
+			len = _G.tonumber(len)
+			local code = sub(msg, e + 1, e + len)
+			local success, res = pcall(function()
+				local func = funcs[code]
+				if not func then
+					if numfuncs >= 64 then
+						funcs, numfuncs = { }, 0
+					end
+					func = _G.assert(load(code))
+					funcs[code] = func
+					numfuncs = numfuncs + 1
+				end
+				return encode(func(decode(sub(msg, e + len + 1))))
+			end)
+			if success then
+				exec.sendport("*p", "ui", tag .. " " .. id .. " ok\n" .. res)
+			else
+				exec.sendport("*p", "ui", tag .. " " .. id .. " error\n" ..
+					tostring(res))
+			end
+		end
+	end
+end
+
+-------------------------------------------------------------------------------
+--	new: overrides
+-------------------------------------------------------------------------------
+
+function WorkerPool.new(class, self)
+	self = self or { }
+	assert(self.Application, "Application missing")
+	PoolCount = PoolCount + 1
+	self.Tag = "tek.ui.class.workerpool." .. PoolCount
+	self.NumWorkers = self.NumWorkers or 2
+	self.Workers = { } -- worker records, see startworkers()
+	self.Jobs = { } -- pending jobs, by id
+	self.JobCount = 0
+	self.Affinity = { } -- worker index, number of pending jobs, by bytecode
+	self.Bytecode = setmetatable({ }, { __mode = "k" }) -- by function
+	self = Class.new(class, self)
+	self.Application:addInputHandler(MSG_USER, self, self.msgResult)
+	return self
+end
+
+-------------------------------------------------------------------------------
+--	startworkers: starts the worker tasks, if not already running
+-------------------------------------------------------------------------------
+
+local function startworkers(self)
+	local workers = self.Workers
+	if #workers == 0 then
+		local app = self.Application
+		local enc, dec = dump(WorkerPool.encode), dump(WorkerPool.decode)
+		for i = 1, self.NumWorkers do
+			local task = app:runTask(workertask, enc, dec, self.Tag)
+			if task then
+				-- task, number of pending jobs:
+				insert(workers, { task, 0 })
+			end
+		end
+		if #workers == 0 then
+			db.error("could not start worker tasks")
+		end
+	end
+	return #workers > 0
+end
+
+-------------------------------------------------------------------------------
+--	job = submit(func, ...): Submits a function and its arguments to the
+--	pool. Returns a job handle, which can be passed to WorkerPool:poll() and
+--	WorkerPool:wait(). The job's field {{Callback}} can be set to a function,
+--	which will be called with the job, a boolean indicating success, and the
+--	results or an error message, when the job is finished. Results are never
+--	delivered before control is returned to the application's main loop.
+--	Returns '''nil''' if the job could not be submitted. Raises an error if
+--	the function has upvalues.
+-------------------------------------------------------------------------------
+
+function WorkerPool:submit(func, ...)
+	if not startworkers(self) then
+		return
+	end
+	local code = self.Bytecode[func]
+	if not code then
+		-- upvalues would be lost; only a leading _ENV is set by load():
+		local i, name = 1, getupvalue(func, 1)
+		while name do
+			if name ~= "_ENV" or i > 1 then
+				error("job function must not have upvalues", 2)
+			end
+			i = i + 1
+			name = getupvalue(func, i)
+		end
+		code = dump(func)
+		self.Bytecode[func] = code
+	end
+	-- worker with affinity to this function, unless it is considerably
+	-- busier than the least busy worker:
+	local workers = self.Workers
+	local wi = 1
+	for i = 2, #workers do
+		if workers[i][2] < workers[wi][2] then
+			wi = i
+		end
+	end
+	local aff = self.Affinity[code]
+	if aff then
+		local ai = aff[1]
+		if workers[ai] and
+			workers[ai][2] - workers[wi][2] <= AFFINITY_SLACK then
+			wi = ai
+		end
+	else
+		aff = { wi, 0 }
+		self.Affinity[code] = aff
+	end
+	local w = workers[wi]
+	local id = self.JobCount + 1
+	self.JobCount = id
+	w[1]:sendmsg(id .. " " .. #code .. "\n" .. code ..
+		WorkerPool.encode(...))
+	w[2] = w[2] + 1
+	aff[1] = wi
+	aff[2] = aff[2] + 1
+	local job = { Id = id, Status = "pending", Worker = wi, Results = false,
+		Callback = false, Code = code }
+	self.Jobs[id] = job
+	return job
+end
+
+-------------------------------------------------------------------------------
+--	msgResult: Input handler collecting results from the worker tasks
+-------------------------------------------------------------------------------
+
+function WorkerPool:msgResult(msg)
+	local body = msg[-1]
+	local tag = self.Tag
+	if sub(body, 1, #tag + 1) ~= tag .. " " then
+		return msg
+	end
+	local _, e, id, status = find(body, "^%S+ (%d+) (%a+)\n")
+	local job = id and self.Jobs[tonumber(id)]
+	if job then
+		self.Jobs[job.Id] = nil
+		local w = self.Workers[job.Worker]
+		if w then
+			w[2] = w[2] - 1
+		end
+		-- forget the affinity when the last pending job has finished:
+		local aff = self.Affinity[job.Code]
+		if aff then
+			aff[2] = aff[2] - 1
+			if aff[2] == 0 then
+				self.Affinity[job.Code] = nil
+			end
+		end
+		local data = sub(body, e + 1)
+		if status == "ok" then
+			local success, res = pcall(function()
+				return pack(WorkerPool.decode(data))
+			end)
+			if success then
+				job.Status = "done"
+				job.Results = res
+			else
+				job.Status = "error"
+				job.Results = { n = 1, res }
+			end
+		else
+			job.Status = "error"
+			job.Results = { n = 1, data }
+		end
+		if job.Callback then
+			job.Callback(job, job.Status == "done", unpack(job.Results, 1,
+				job.Results.n))
+		end
+		self.Application:signalEvent(job)
+	end
+	return false
+end
+
+-------------------------------------------------------------------------------
+--	status, ... = poll(job): Returns the status of a job, which can be
+--	{{"pending"}}, {{"done"}}, or {{"error"}}. If the job is done, its
+--	results are returned in addition; in case of an error, the error
+--	message.
+-------------------------------------------------------------------------------
+
+function WorkerPool:poll(job)
+	local r = job.Results
+	if r then
+		return job.Status, unpack(r, 1, r.n)
+	end
+	return job.Status
+end
+
+-------------------------------------------------------------------------------
+--	success, ... = wait(job): Suspends the calling coroutine, which must
+--	have been started with Application:addCoroutine(), until the job is
+--	finished. Returns '''true''' followed by the job's results, or
+--	'''false''' followed by an error message.
+-------------------------------------------------------------------------------
+
+function WorkerPool:wait(job)
+	while job.Status == "pending" do
+		self.Application:waitEvent(job)
+	end
+	local r = job.Results
+	return job.Status == "done", unpack(r, 1, r.n)
+end
+
+-------------------------------------------------------------------------------
+--	shutdown(): Stops all worker tasks, after they have finished their
+--	current jobs. Jobs still pending are finished with an error. The pool
+--	restarts its workers when another job is submitted.
+-------------------------------------------------------------------------------
+
+function WorkerPool:shutdown()
+	local app = self.Application
+	local workers = self.Workers
+	for i = 1, #workers do
+		workers[i][1]:sendmsg("quit\n")
+	end
+	for i = 1, #workers do
+		app:joinTask(workers[i][1])
+	end
+	self.Workers = { }
+	self.Affinity = { }
+	local jobs = self.Jobs
+	self.Jobs = { }
+	for _, job in pairs(jobs) do
+		job.Status = "error"
+		job.Results = { n = 1, "pool shut down" }
+		app:signalEvent(job)
+	end
+end
+
+return WorkerPool
@@ -24,7 +24,7 @@
 -------------------------------------------------------------------------------
 
 module("tek.ui.layout.default", tek.ui.class.layout)
-_VERSION = "Default Layout 9.2"
+_VERSION = "Default Layout 10.0"
 local DefaultLayout = _M
 
 ******************************************************************************/
@@ -41,18 +41,30 @@ local DefaultLayout = _M
 #define DEFLAYOUT_CLASS_NAME "tek.ui.layout.default"
 
 /* Version: */
-#define DEFLAYOUT_CLASS_VERSION "Default Layout 9.2"
+#define DEFLAYOUT_CLASS_VERSION "Default Layout 10.0"
 
 /* Required tekui version: */
 #define DEFLAYOUT_TEKUI_VERSION 112
 
 /*****************************************************************************/
+/*
+**	The group's structure is cached in a userdata in the layouter's
+**	Structure field: the grid dimensions, the layouting attributes of each
+**	child, and the summed weights per column and row. It is rebuilt when
+**	TEKUI_AREA_STRUCTURE is cleared in the group's area data, which
+**	Area:rethinkLayout() does for an element and its parent, or when the
+**	group's children table is replaced or changes in length. The minimum
+**	and maximum sizes per column and row, as determined in askMinMax(),
+**	are kept in another userdata in the layouter's TempMinMax field.
+*/
 
-static const char *ALIGN[2][6] =
-{
-	{ "HAlign", "VAlign", "right", "bottom", "Width", "Height" },
-	{ "VAlign", "HAlign", "bottom", "right", "Height", "Width" }
-};
+#define LAYOUT_ALIGN_NONE		0
+#define LAYOUT_ALIGN_CENTER		1
+#define LAYOUT_ALIGN_OPPOSITE	2	/* "right" or "bottom" */
+
+#define LAYOUT_SIZE_NONE		0
+#define LAYOUT_SIZE_FILL		1
+#define LAYOUT_SIZE_FREE		2
 
 static const int INDICES[2][6] =
 {
@@ -60,7 +72,53 @@ static const int INDICES[2][6] =
 	{ 2, 1, 4, 3, 6, 5 },
 };
 
-typedef struct { int orientation, width, height; } layout_struct;
+typedef struct
+{
+	/* Layouting attributes of a child: */
+	lua_Integer weight;	/* Weight, or -1 if none */
+	int invisible;		/* Invisible */
+	int align[2];		/* HAlign, VAlign: LAYOUT_ALIGN_* */
+	int size[2];		/* Width, Height: LAYOUT_SIZE_* */
+
+} layout_child;
+
+typedef struct
+{
+	/* Size distribution in one column or row: */
+	lua_Integer mins, maxs;	/* maxs is -1 if none */
+	lua_Integer weight;		/* -1 if none */
+	lua_Integer size;
+	int free, hassize;
+
+} layout_cell;
+
+typedef struct
+{
+	/* Identity and length of the children table: */
+	const void *children;
+	int numchildren;
+	int orientation, width, height;
+	int samesize[2];
+	/* Capacity of the arrays: */
+	int maxchildren, maxcells;
+	layout_child *child;
+	/* Summed weights per column and row, -1 if none: */
+	lua_Integer *weights[2];
+	/* Size distribution on the outer and inner axis: */
+	layout_cell *cells[2];
+	int *order[2];
+
+} layout_struct;
+
+typedef struct
+{
+	/* Number of columns and rows: */
+	int size[2];
+	int maxsize;
+	/* Minimum, maximum sizes per column and row; maximum -1 if none: */
+	lua_Integer *minmax[4];
+
+} layout_minmax;
 
 typedef struct
 {
@@ -74,6 +132,75 @@ typedef struct
 
 /*****************************************************************************/
 
+static struct TEKUIArea *layout_getarea(lua_State *L, int idx)
+{
+	lua_getfield(L, idx, TEKUI_AREA_FIELD);
+	struct TEKUIArea *a = luaL_checkudata(L, -1, TEKUI_AREA_CLASSNAME);
+	lua_pop(L, 1);
+	return a;
+}
+
+static void layout_getminmax(struct TEKUIArea *a, RECTINT *minmax)
+{
+	if (a->ar_Valid & TEKUI_AREA_MINMAX)
+		memcpy(minmax, a->ar_MinMax, sizeof(RECTINT) * 4);
+	else
+		memset(minmax, 0, sizeof(RECTINT) * 4);
+}
+
+/*
+**	Asks the child element at the top of the stack for its min/max sizes,
+**	with the arguments at argidx. If the element's sizes haven't been
+**	invalidated using Area:rethinkLayout() since it was last asked with
+**	the same arguments, the memorized results are returned instead.
+*/
+
+static void layout_askchild(lua_State *L, int argidx, int *mm)
+{
+	struct TEKUIArea *ca = layout_getarea(L, -1);
+	TBOOL memo = TTRUE;
+	TINT args[4];
+	int i;
+	for (i = 0; i < 4; ++i)
+	{
+		if (lua_type(L, argidx + i) != LUA_TNUMBER)
+		{
+			memo = TFALSE;
+			break;
+		}
+		args[i] = lua_tointeger(L, argidx + i);
+	}
+	if (memo && (ca->ar_Valid & TEKUI_AREA_ASKMINMAX) &&
+		memcmp(args, ca->ar_AskArgs, sizeof args) == 0)
+	{
+		for (i = 0; i < 4; ++i)
+			mm[i] = ca->ar_AskResult[i];
+		return;
+	}
+	lua_getfield(L, -1, "askMinMax");
+	lua_pushvalue(L, -2);
+	for (i = 0; i < 4; ++i)
+		lua_pushvalue(L, argidx + i);
+	/* s: c, c.askMinMax, c, m1, m2, m3, m4 */
+	lua_call(L, 5, 4);
+	/* s: c, mm1, mm2, mm3, mm4 */
+	for (i = 0; i < 4; ++i)
+		mm[i] = lua_tointeger(L, -4 + i);
+	lua_pop(L, 4);
+	/* s: c */
+	if (memo)
+	{
+		memcpy(ca->ar_AskArgs, args, sizeof args);
+		for (i = 0; i < 4; ++i)
+			ca->ar_AskResult[i] = mm[i];
+		ca->ar_Valid |= TEKUI_AREA_ASKMINMAX;
+	}
+	else
+		ca->ar_Valid &= ~TEKUI_AREA_ASKMINMAX;
+}
+
+/*****************************************************************************/
+
 static int layout_getsamesize(lua_State *L, int groupindex, int axis)
 {
 	int res;
@@ -92,147 +219,289 @@ static int layout_getsamesize(lua_State *L, int groupindex, int axis)
 
 /*****************************************************************************/
 
-static layout_struct layout_getstructure(lua_State *L, int group)
+static const char *layout_getattr(lua_State *L, const char *key)
 {
-	layout_struct res;
-	
-	size_t nc;
-	int gw, gh;
-	lua_getfield(L, group, "Columns");
-	gw = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 0;
-	lua_getfield(L, group, "Rows");
-	gh = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 0;
-	lua_getfield(L, group, "Children");
+	/* s: c */
+	lua_getfield(L, -1, "getAttr");
+	lua_pushvalue(L, -2);
+	lua_pushstring(L, key);
+	lua_call(L, 2, 1);
+	/* s: c, c[key] */
+	return lua_type(L, -1) == LUA_TSTRING ? lua_tostring(L, -1) : TNULL;
+}
+
+static int layout_getalign(lua_State *L, const char *key, const char *opp)
+{
+	const char *s = layout_getattr(L, key);
+	int res = LAYOUT_ALIGN_NONE;
+	if (s)
+	{
+		if (strcmp(s, "center") == 0)
+			res = LAYOUT_ALIGN_CENTER;
+		else if (strcmp(s, opp) == 0)
+			res = LAYOUT_ALIGN_OPPOSITE;
+	}
+	lua_pop(L, 1);
+	return res;
+}
+
+static int layout_getsize(lua_State *L, const char *key)
+{
+	const char *s = layout_getattr(L, key);
+	int res = LAYOUT_SIZE_NONE;
+	if (s)
+	{
+		if (strcmp(s, "fill") == 0)
+			res = LAYOUT_SIZE_FILL;
+		else if (strcmp(s, "free") == 0)
+			res = LAYOUT_SIZE_FREE;
+	}
+	lua_pop(L, 1);
+	return res;
+}
+
+/*****************************************************************************/
+/*
+**	s = layout_getstructure(L): Gets the structure of the group at stack
+**	index 2, rebuilding it if necessary, and leaves the userdata holding it
+**	on the stack.
+*/
+
+static layout_struct *layout_newstructure(lua_State *L, int nc, int ncells)
+{
+	size_t size = sizeof(layout_struct) + sizeof(layout_child) * nc +
+		(sizeof(lua_Integer) + sizeof(layout_cell) + sizeof(int)) * 2 *
+		ncells;
+	layout_struct *s = lua_newuserdata(L, size);
+	TUINT8 *p = (TUINT8 *) (s + 1);
+	int i;
+	s->maxchildren = nc;
+	s->maxcells = ncells;
+	s->child = (layout_child *) p;
+	p += sizeof(layout_child) * nc;
+	for (i = 0; i < 2; ++i)
+	{
+		s->cells[i] = (layout_cell *) p;
+		p += sizeof(layout_cell) * ncells;
+	}
+	for (i = 0; i < 2; ++i)
+	{
+		s->weights[i] = (lua_Integer *) p;
+		p += sizeof(lua_Integer) * ncells;
+	}
+	for (i = 0; i < 2; ++i)
+	{
+		s->order[i] = (int *) p;
+		p += sizeof(int) * ncells;
+	}
+	lua_pushvalue(L, -1);
+	lua_setfield(L, 1, "Structure");
+	return s;
+}
+
+static layout_struct *layout_getstructure(lua_State *L)
+{
+	struct TEKUIArea *garea = layout_getarea(L, 2);
+	layout_struct *s;
+	const void *children;
+	int nc, gw, gh, ori, ncells, cidx;
+
+	lua_getfield(L, 2, "Children");
+	children = lua_topointer(L, -1);
 #if LUA_VERSION_NUM < 502
 	nc = lua_objlen(L, -1);
 #else
 	nc = lua_rawlen(L, -1);
 #endif
-	lua_pop(L, 3);
-	
+	lua_getfield(L, 1, "Structure");
+	s = lua_touserdata(L, -1);
+	/* s: children, structure */
+
+	if (s && (garea->ar_Valid & TEKUI_AREA_STRUCTURE) &&
+		s->children == children && s->numchildren == nc)
+	{
+		lua_remove(L, -2);
+		/* s: structure */
+		return s;
+	}
+
+	lua_getfield(L, 2, "Columns");
+	gw = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 0;
+	lua_getfield(L, 2, "Rows");
+	gh = lua_isnumber(L, -1) ? lua_tointeger(L, -1) : 0;
+	lua_pop(L, 2);
+
 	if (gw)
 	{
-		res.orientation = 1;
-		res.width = gw;
-		res.height = (nc + gw - 1) / gw;
+		ori = 1;
+		gh = (nc + gw - 1) / gw;
 	}
 	else if (gh)
 	{
-		res.orientation = 2;
-		res.width = (nc + gh - 1) / gh;
-		res.height = gh;
+		ori = 2;
+		gw = (nc + gh - 1) / gh;
 	}
 	else
 	{
 		const char *key;
-		lua_getfield(L, group, "Orientation");
+		lua_getfield(L, 2, "Orientation");
 		key = lua_tostring(L, -1);
 		if (key && key[0] == 'h') /* "horizontal" */
 		{
-			res.orientation = 1;
-			res.width = nc;
-			res.height = 1;
+			ori = 1;
+			gw = nc;
+			gh = 1;
 		}
 		else
 		{
-			res.orientation = 2;
-			res.width = 1;
-			res.height = nc;
+			ori = 2;
+			gw = 1;
+			gh = nc;
 		}
 		lua_pop(L, 1);
 	}
-	
-	return res;
+
+	ncells = TMAX(gw, gh);
+	if (!s || s->maxchildren < nc || s->maxcells < ncells)
+	{
+		lua_pop(L, 1);
+		s = layout_newstructure(L, nc, ncells);
+	}
+	/* s: children, structure */
+
+	s->children = children;
+	s->numchildren = nc;
+	s->orientation = ori;
+	s->width = gw;
+	s->height = gh;
+	s->samesize[0] = layout_getsamesize(L, 2, 1);
+	s->samesize[1] = layout_getsamesize(L, 2, 2);
+
+	/**
+	**	local wx, wy = { }, { }
+	**	for cidx = 1, #group.Children do
+	**		local c = group.Children[cidx]
+	**		if not c.Invisible then
+	**			local w = c.Weight
+	**			if w then
+	**				wx[x] = (wx[x] or 0) + w
+	**				wy[y] = (wy[y] or 0) + w
+	**			end
+	**		end
+	**	end
+	**/
+
+	for (cidx = 0; cidx < ncells; ++cidx)
+	{
+		s->weights[0][cidx] = -1;
+		s->weights[1][cidx] = -1;
+	}
+
+	for (cidx = 0; cidx < nc; ++cidx)
+	{
+		layout_child *c = &s->child[cidx];
+		lua_rawgeti(L, -2, cidx + 1);
+		/* s: children, structure, c */
+		lua_getfield(L, -1, "Invisible");
+		c->invisible = lua_toboolean(L, -1);
+		lua_getfield(L, -2, "Weight");
+		c->weight = lua_isnumber(L, -1) ? (lua_Integer) lua_tonumber(L, -1) : -1;
+		lua_pop(L, 2);
+		c->align[0] = layout_getalign(L, "HAlign", "right");
+		c->align[1] = layout_getalign(L, "VAlign", "bottom");
+		c->size[0] = layout_getsize(L, "Width");
+		c->size[1] = layout_getsize(L, "Height");
+		lua_pop(L, 1);
+		if (!c->invisible && c->weight >= 0)
+		{
+			int x = cidx % gw;
+			int y = cidx / gw;
+			s->weights[0][x] = TMAX(s->weights[0][x], 0) + c->weight;
+			s->weights[1][y] = TMAX(s->weights[1][y], 0) + c->weight;
+		}
+	}
+
+	garea->ar_Valid |= TEKUI_AREA_STRUCTURE;
+	lua_remove(L, -2);
+	/* s: structure */
+	return s;
 }
 
 /*****************************************************************************/
+/*
+**	tmm = layout_newminmax(L, gw, gh): Gets a cleared array of the minimum
+**	and maximum sizes per column and row, and leaves the userdata holding
+**	it on the stack.
+*/
 
-static void layout_calcweights(lua_State *L, layout_struct *lstruct)
+static layout_minmax *layout_newminmax(lua_State *L, int gw, int gh)
 {
-	int cidx = 1;
-	int y, x;
-	lua_getfield(L, 1, "Weights");
-	lua_newtable(L);
-	lua_newtable(L);
-	lua_getfield(L, 2, "Children");
-	/* weights, wx, wy, children */
-	for (y = 1; y <= lstruct->height; ++y)
+	int n = TMAX(gw, gh);
+	layout_minmax *tmm;
+	int i;
+	lua_getfield(L, 1, "TempMinMax");
+	tmm = lua_touserdata(L, -1);
+	if (!tmm || tmm->maxsize < n)
 	{
-		for (x = 1; x <= lstruct->width; ++x)
+		TUINT8 *p;
+		lua_pop(L, 1);
+		tmm = lua_newuserdata(L, sizeof(layout_minmax) +
+			sizeof(lua_Integer) * 4 * n);
+		tmm->maxsize = n;
+		p = (TUINT8 *) (tmm + 1);
+		for (i = 0; i < 4; ++i)
 		{
-			lua_rawgeti(L, -1, cidx);
-			/* weights, wx, wy, children, c */
-			if (lua_isnil(L, -1))
-			{
-				lua_pop(L, 1);
-				break;
-			}
-			lua_getfield(L, -1, "Invisible");
-			TBOOL invisible = lua_toboolean(L, -1);
-			lua_pop(L, 1);
-			if (!invisible)
-			{
-				lua_getfield(L, -1, "Weight");
-				/* weights, wx, wy, children, c, weight */
-				if (lua_isnumber(L, -1))
-				{
-					lua_Integer w = lua_tonumber(L, -1);
-					lua_rawgeti(L, -5, x);
-					/* weights, wx, wy, children, c, weight, wx[x] */
-					lua_rawgeti(L, -5, y);
-					/* weights, wx, wy, children, c, weight, wx[x], wy[y] */
-					lua_pushinteger(L, luaL_optinteger(L, -2, 0) + w);
-					/* weights, wx, wy, children, c, weight, wx[x], wy[y], wx' */
-					lua_rawseti(L, -8, x);
-					/* weights, wx, wy, children, c, weight, wx[x], wy[y] */
-					lua_pushinteger(L, luaL_optinteger(L, -1, 0) + w);
-					/* weights, wx, wy, children, c, weight, wx[x], wy[y], wy' */
-					lua_rawseti(L, -7, y);
-					/* weights, wx, wy, children, c, weight, wx[x], wy[y] */
-					lua_pop(L, 2);
-				}
-				lua_pop(L, 1);
-			}
-			lua_pop(L, 1);
-			/* weights, wx, wy, children */
-			cidx++;
+			tmm->minmax[i] = (lua_Integer *) p;
+			p += sizeof(lua_Integer) * n;
 		}
+		lua_pushvalue(L, -1);
+		lua_setfield(L, 1, "TempMinMax");
 	}
-	lua_pop(L, 1);
-	/* weights, wx, wy */
-	lua_rawseti(L, -3, 2);
-	/* weights, wx */
-	lua_rawseti(L, -2, 1);
-	/* weights */
-	lua_pop(L, 1);
+	tmm->size[0] = gw;
+	tmm->size[1] = gh;
+	for (i = 0; i < n; ++i)
+	{
+		tmm->minmax[0][i] = 0;
+		tmm->minmax[1][i] = 0;
+		tmm->minmax[2][i] = -1;
+		tmm->minmax[3][i] = -1;
+	}
+	return tmm;
+}
+
+/* Get entry n (counting from 0) in column/row minmax array i (1...4): */
+
+static lua_Integer layout_gettmm(layout_minmax *tmm, int i, int n)
+{
+	if (tmm && n < tmm->size[(i - 1) & 1])
+		return tmm->minmax[i - 1][n];
+	return i <= 2 ? 0 : -1;
 }
 
 /*****************************************************************************/
 /*
-**	list = layoutAxis(self, group, layout)
+**	layoutAxis(layout, s, tmm, list): Distributes the free space on an axis
+**	over the columns or rows, storing their sizes in the list.
 */
 
-static int layout_layoutaxis(lua_State *L)
+static void layout_layoutaxis(layout *layout, layout_struct *s,
+	layout_minmax *tmm, layout_cell *list)
 {
-	layout *layout = lua_touserdata(L, 3);
-	int free = layout->free;
+	lua_Integer free = layout->free;
 	int i1 = layout->i1;
 	int i3 = layout->i3;
 	int n = layout->n;
 	RECTINT *padding = layout->padding;
 	RECTINT *margin = layout->margin;
 	RECTINT *minmax = layout->minmax;
-
+	int *e = s->order[0];
+	int *e2 = s->order[1];
 	int it = 0;
-	size_t len;
 	int ssb, ssn = 0;
-	int i;
+	int i, ne;
 
 	/**
 	**	local fw, tw = 0, 0
-	**	local list = { }
-	**	local tmm = self.TempMinMax
-	**	local wgh = group.Weights
 	**	for i = 1, n do
 	**		local mins, maxs = tmm[i1][i], tmm[i3][i]
 	**		local free = maxs and (maxs > mins)
@@ -253,56 +522,22 @@ static int layout_layoutaxis(lua_State *L)
 	lua_Number fw;
 	lua_Number tw;
 
-	lua_createtable(L, n, 0);
-	lua_getfield(L, 1, "TempMinMax");
-	lua_rawgeti(L, -1, i1);
-	lua_rawgeti(L, -2, i3);
-	/* s: list, tmm, tmm[i1], tmm[i3] */
-	lua_remove(L, -3);
-	/* s: list, tmm[i1], tmm[i3] */
-	
-	lua_getfield(L, 1, "Weights");
-	/* s: list, tmm[i1], tmm[i3], weights */
-	lua_rawgeti(L, -1, i1);
-	/* s: list, tmm[i1], tmm[i3], weights, wgh[i1] */
-	lua_remove(L, -2);
-
-	for (i = 1; i <= n; ++i)
+	for (i = 0; i < n; ++i)
 	{
-		int free;
-		lua_rawgeti(L, -3, i);
-		/* s: l, tmm[i1], tmm[i3], wgh[i1], mins */
-		lua_rawgeti(L, -3, i);
-		/* s: l, tmm[i1], tmm[i3], wgh[i1], mins, maxs */
-		lua_rawgeti(L, -3, i);
-		/* s: l, tmm[i1], tmm[i3], wgh[i1], mins, maxs, weight */
-		free = lua_toboolean(L, -2) ?
-			lua_tointeger(L, -2) > lua_tointeger(L, -3) : 0;
-		lua_createtable(L, 5, 0);
-		/* s: l, tmm[i1], tmm[i3], wgh[i1], mins, maxs, weight, t */
-		lua_pushboolean(L, free);
-		lua_rawseti(L, -2, 1);
-		lua_pushvalue(L, -4);
-		lua_rawseti(L, -2, 2);
-		lua_pushvalue(L, -3);
-		lua_rawseti(L, -2, 3);
-		lua_pushvalue(L, -2);
-		lua_rawseti(L, -2, 4);
-		lua_pushnil(L);
-		lua_rawseti(L, -2, 5);
-		/* s: l, tmm[i1], tmm[i3], wgh[i1], mins, maxs, weight, t */
-		lua_rawseti(L, -8, i);
-		/* s: l, tmm[i1], tmm[i3], wgh[i1], mins, maxs, weight */
-		if (free)
+		layout_cell *c = &list[i];
+		c->mins = layout_gettmm(tmm, i1, i);
+		c->maxs = layout_gettmm(tmm, i3, i);
+		c->weight = s->weights[i1 - 1][i];
+		c->free = c->maxs >= 0 && c->maxs > c->mins;
+		c->hassize = 0;
+		if (c->free)
 		{
-			if (lua_toboolean(L, -1))
-				tw0 += lua_tointeger(L, -1);
+			if (c->weight >= 0)
+				tw0 += c->weight;
 			else
 				fw0 += 0x100;
 		}
-		lua_pop(L, 3);
 	}
-	lua_pop(L, 3);
 
 	/**
 	**	if tw < 0x10000 then
@@ -336,12 +571,11 @@ static int layout_layoutaxis(lua_State *L)
 	fw = fw0 / 0x100;
 
 	/**
-	**	local mab = group.MarginAndBorder
 	**	local ss = group:getSameSize(i1) and
 	**		(group.MinMax[i1] - mab[i1] - mab[i3] - pad[i1] - pad[i3]) / n
 	**/
 
-	ssb = layout_getsamesize(L, 2, i1);
+	ssb = s->samesize[i1 - 1];
 	if (ssb)
 	{
 		ssn = minmax[i1 - 1];
@@ -352,69 +586,34 @@ static int layout_layoutaxis(lua_State *L)
 		ssn /= n;
 	}
 
-	lua_getglobal(L, "table");
-	lua_getfield(L, -1, "insert");
-	lua_getfield(L, -2, "remove");
-	lua_remove(L, -3);
-	/* s: list, insert, remove */
-
 	/**
 	**	local e = { unpack(list) }
-	**/
-
-#if LUA_VERSION_NUM < 502
-	len = lua_objlen(L, -3);
-#else
-	len = lua_rawlen(L, -3);
-#endif
-	lua_createtable(L, len, 0);
-	/* s: list, insert, remove, e */
-	for (i = 1; i <= (int) len; ++i)
-	{
-		lua_rawgeti(L, -4, i);
-		lua_rawseti(L, -2, i);
-	}
-
-	/**
 	**	local it = 0
 	**	while #e > 0 do
+	**		local rest = free
+	**		local newfree = free
+	**		it = it + 1
+	**		local e2 = { }
 	**/
 
-#if LUA_VERSION_NUM < 502
-	while ((len = lua_objlen(L, -1)) > 0)
-#else
-	while ((len = lua_rawlen(L, -1)) > 0)
-#endif
-	{
-		/**
-		**	local rest = free
-		**	local newfree = free
-		**	it = it + 1
-		**	local e2 = { }
-		**/
+	for (i = 0; i < n; ++i)
+		e[i] = i;
+	ne = n;
 
+	while (ne > 0)
+	{
 		lua_Integer rest = free;
 		lua_Integer newfree = free;
+		int ne2 = 0;
+		int *t;
 		it++;
 
-		lua_createtable(L, len, 0);
-		/* s: insert, remove, e, e2 */
-
-		/**
-		**	repeat
-		**		...
-		**	until #e == 0
-		**/
-
-		do
+		for (i = 0; i < ne; ++i)
 		{
-			lua_Integer olds, news, ti;
+			layout_cell *c = &list[e[i]];
+			lua_Integer delta = 0, olds, news, ti;
 
 			/**
-			**	delta = 0
-			**
-			**	c = remove(e, 1)
-			**
 			**	if c[1] then -- free
 			**		if c[4] then -- weight
 			**			delta = free * (c[4] / 0x100) * (tw / 0x100) / 0x10000
@@ -423,30 +622,17 @@ static int layout_layoutaxis(lua_State *L)
 			**		end
 			**		delta = floor(delta)
 			**	end
+			**	if delta == 0 and it > 1 then
+			**		delta = rest
+			**	end
 			**/
 
-			lua_Integer delta = 0;
-
-			/* s: insert, remove, e, e2 */
-			lua_pushvalue(L, -3);
-			/* s: insert, remove, e, e2, remove */
-			lua_pushvalue(L, -3);
-			/* s: insert, remove, e, e2, remove, e */
-			lua_pushinteger(L, 1);
-			/* s: insert, remove, e, e2, remove, e, 1 */
-			lua_call(L, 2, 1);
-			/* s: insert, remove, e, e2, c */
-
-			lua_rawgeti(L, -1, 1);
-			/* s: insert, remove, e, e2, c, c[1] */
-			if (lua_toboolean(L, -1))
+			if (c->free)
 			{
 				lua_Number t;
-				lua_rawgeti(L, -2, 4);
-				/* s: insert, remove, e, e2, c, c[1], c[4] */
-				if (lua_toboolean(L, -1))
+				if (c->weight >= 0)
 				{
-					t = lua_tointeger(L, -1);
+					t = c->weight;
 					t /= 0x100;
 					t *= tw;
 					t *= free;
@@ -459,15 +645,7 @@ static int layout_layoutaxis(lua_State *L)
 				}
 				t /= 0x10000;
 				delta = t;
-				lua_pop(L, 1);
 			}
-			/* s: insert, remove, e, e2, c, c[1] */
-
-			/**
-			**	if delta == 0 and it > 1 then
-			**		delta = rest
-			**	end
-			**/
 
 			if (delta == 0 && it > 1)
 				delta = rest;
@@ -479,37 +657,24 @@ static int layout_layoutaxis(lua_State *L)
 			**		news = c[3] -- maxs
 			**	end
 			**	c[5] = news
+			**	delta = news - olds
+			**	newfree = newfree - delta
+			**	rest = rest - delta
 			**/
 
-			lua_rawgeti(L, -2, 5);
-			lua_rawgeti(L, -3, 2);
-			/* s: insert, remove, e, e2, c, c[1], c[5], c[2] */
-
-			if (lua_toboolean(L, -2))
-				olds = lua_tointeger(L, -2);
+			if (c->hassize)
+				olds = c->size;
 			else if (ssb)
 				olds = ssn;
 			else
-				olds = lua_tointeger(L, -1);
-			/* s: insert, remove, e, e2, c, c[1], c[5], c[2] */
+				olds = c->mins;
 
-			ti = ssb ? ssn : lua_tointeger(L, -1);
+			ti = ssb ? ssn : c->mins;
 			news = TMAX(olds + delta, ti);
-
-			lua_rawgeti(L, -4, 3);
-			/* s: insert, remove, e, e2, c, c[1], c[5], c[2], c[3] */
-			if (!(ssb && layout->isgrid) && lua_toboolean(L, -1) && 
-				news > lua_tointeger(L, -1))
-				news = lua_tointeger(L, -1);
-
-			lua_pushinteger(L, news);
-			lua_rawseti(L, -6, 5);
-
-			/**
-			**	delta = news - olds
-			**	newfree = newfree - delta
-			**	rest = rest - delta
-			**/
+			if (!(ssb && layout->isgrid) && c->maxs >= 0 && news > c->maxs)
+				news = c->maxs;
+			c->size = news;
+			c->hassize = 1;
 
 			delta = news - olds;
 			newfree -= delta;
@@ -521,52 +686,27 @@ static int layout_layoutaxis(lua_State *L)
 			**	end
 			**/
 
-			if (!lua_toboolean(L, -1) || lua_tointeger(L, -1) >= TEKUI_HUGE ||
-				lua_tointeger(L, -3) < lua_tointeger(L, -1))
-			{
-				/* redo in next iteration: */
-				/* s: ins, rem, e, e2, c, c[1], c[5], c[2], c[3] */
-				lua_pushvalue(L, -9);
-				/* s: ins, rem, e, e2, c, c[1], c[5], c[2], c[3], ins */
-				lua_pushvalue(L, -7);
-				/* s: ins, rem, e, e2, c, c[1], c[5], c[2], c[3], ins, e2 */
-				lua_pushvalue(L, -7);
-				/* s: ins, rem, e, e2, c, c[1], c[5], c[2], c[3], ins, e2, c */
-				lua_call(L, 2, 0);
-				/* s: insert, remove, e, e2, c, c[1], c[5], c[2], c[3] */
-			}
+			if (c->maxs < 0 || c->maxs >= TEKUI_HUGE || c->size < c->maxs)
+				e2[ne2++] = e[i];
+		}
 
-			lua_pop(L, 5);
-			/* s: insert, remove, e, e2 */
-#if LUA_VERSION_NUM < 502
-		} while (lua_objlen(L, -2) > 0);
-#else
-		} while (lua_rawlen(L, -2) > 0);
-#endif
 		/**
 		**	if newfree < 1 then
 		**		break
 		**	end
-		**
 		**	free = newfree
 		**	e = e2
 		**/
 
 		free = newfree;
 		if (free < 1)
-		{
-			lua_pop(L, 1);
 			break;
-		}
 
-		/* s: insert, remove, e, e2 */
-		lua_replace(L, -2);
-		/* s: insert, remove, e */
+		t = e;
+		e = e2;
+		e2 = t;
+		ne = ne2;
 	}
-
-	lua_pop(L, 3);
-	/* s: list */
-	return 1;
 }
 
 /*****************************************************************************/
@@ -583,10 +723,11 @@ static int layout_layout(lua_State *L)
 	**	if gs1 > 0 and gs2 > 0 then
 	**/
 
-	layout_struct lstruct = layout_getstructure(L, 2);
-	int ori = lstruct.orientation;
-	int gs1 = lstruct.width;
-	int gs2 = lstruct.height;
+	layout_struct *s = layout_getstructure(L);
+	int ori = s->orientation;
+	int gs1 = s->width;
+	int gs2 = s->height;
+	/* s: structure */
 
 	if (gs1 > 0 && gs2 > 0)
 	{
@@ -594,10 +735,6 @@ static int layout_layout(lua_State *L)
 		**	local isgrid = gs1 > 1 and gs2 > 1
 		**	local i1, i2, i3, i4, i5, i6 = unpack(INDICES[ori])
 		**
-		**	local c, isz, osz, m3, m4, mm, a
-		**	local cidx = 1
-		**	local A = ALIGN[ori]
-		**
 		**	if i1 == 2 then
 		**		gs1, gs2 = gs2, gs1
 		**		r1, r2, r3, r4 = r2, r1, r4, r3
@@ -607,12 +744,7 @@ static int layout_layout(lua_State *L)
 		**	local gr = { group:getRect() }
 		**	local gp = { group:getPadding() }
 		**	local goffs = gm[i1] + gp[i1]
-		**	local xywh = self.XYWH
-		**	local minmax = { group.MinMax:get() }
-		**
-		**	if group.Flags:checkClear(FL_STRUCTURE) then
-		**		self:calcWeights(group)
-		**	end
+		**	local minmax = { group:getMinMax() }
 		**/
 
 		const int *I = INDICES[ori - 1];
@@ -621,9 +753,13 @@ static int layout_layout(lua_State *L)
 		lua_Integer isz, osz, oszmax, t, iidx;
 		lua_Integer m3, m4, oidx, goffs;
 		lua_Integer r1, r2, r3, r4;
-		lua_Integer cidx = 1;
-
-		const char **A = ALIGN[ori - 1], *s;
+		lua_Integer xywh[7];
+		RECTINT mm[4];
+		int cidx = 1;
+		layout_minmax *tmm;
+		layout_cell *olist = s->cells[0];
+		layout_cell *ilist = s->cells[1];
+		struct TEKUIArea *garea;
 
 		layout.isgrid = (gs1 > 1) && (gs2 > 1);
 
@@ -644,7 +780,7 @@ static int layout_layout(lua_State *L)
 			r3 = lua_tointeger(L, 5);
 			r4 = lua_tointeger(L, 6);
 		}
-		
+
 		lua_getfield(L, 2, "getMargin");
 		lua_pushvalue(L, 2);
 		lua_call(L, 1, 4);
@@ -653,16 +789,7 @@ static int layout_layout(lua_State *L)
 		layout.margin[2] = lua_tointeger(L, -2);
 		layout.margin[3] = lua_tointeger(L, -1);
 		lua_pop(L, 4);
-		
-		lua_getfield(L, 2, "getRect");
-		lua_pushvalue(L, 2);
-		lua_call(L, 1, 4);
-		layout.rect[0] = lua_tointeger(L, -4);
-		layout.rect[1] = lua_tointeger(L, -3);
-		layout.rect[2] = lua_tointeger(L, -2);
-		layout.rect[3] = lua_tointeger(L, -1);
-		lua_pop(L, 4);
-		
+
 		lua_getfield(L, 2, "getPadding");
 		lua_pushvalue(L, 2);
 		lua_call(L, 1, 4);
@@ -671,27 +798,20 @@ static int layout_layout(lua_State *L)
 		layout.padding[2] = lua_tointeger(L, -2);
 		layout.padding[3] = lua_tointeger(L, -1);
 		lua_pop(L, 4);
-		
-		lua_getfield(L, 2, "MinMax");
-		lua_getfield(L, -1, "get");
-		lua_pushvalue(L, -2);
-		lua_call(L, 1, 4);
-		layout.minmax[0] = lua_tointeger(L, -4);
-		layout.minmax[1] = lua_tointeger(L, -3);
-		layout.minmax[2] = lua_tointeger(L, -2);
-		layout.minmax[3] = lua_tointeger(L, -1);
-		lua_pop(L, 5);
-		
+
+		garea = layout_getarea(L, 2);
+		if (garea->ar_Valid & TEKUI_AREA_RECT)
+			memcpy(layout.rect, garea->ar_Rect, sizeof(RECTINT) * 4);
+		else
+			memset(layout.rect, 0, sizeof(RECTINT) * 4);
+		layout_getminmax(garea, layout.minmax);
+
 		goffs = layout.margin[i1 - 1] + layout.padding[i1 - 1];
-		
-		lua_createtable(L, 6, 0);
-		/* s: xywh */
 
-		lua_getfield(L, 2, "Flags");
-		if (lua_tointeger(L, -1) & TEKUI_FL_CHANGED)
-			layout_calcweights(L, &lstruct);
-		lua_pop(L, 1);
-		
+		lua_getfield(L, 1, "TempMinMax");
+		tmm = lua_touserdata(L, -1);
+		/* s: structure, tmm */
+
 		/**
 		**	local olist = self:layoutAxis(group,
 		**		r4 - r2 + 1 - group.MinMax[i2], i2, i4, gs2, isgrid, gp, gm, minmax)
@@ -705,26 +825,14 @@ static int layout_layout(lua_State *L)
 		layout.i1 = i2;
 		layout.i3 = i4;
 		layout.n = gs2;
-		lua_getfield(L, 1, "layoutAxis");
-		lua_pushvalue(L, 1);
-		lua_pushvalue(L, 2);
-		lua_pushlightuserdata(L, &layout);
-		/* s: xywh, layoutAxis, self, group, layout */	
-		lua_call(L, 3, 1);
-		/* s: xywh, olist */
-		
+		layout_layoutaxis(&layout, s, tmm, olist);
+
 		/* layout on inner axis: */
 		layout.free = r3 - r1 + 1 - layout.minmax[i1 - 1];
 		layout.i1 = i1;
 		layout.i3 = i3;
 		layout.n = gs1;
-		lua_getfield(L, 1, "layoutAxis");
-		lua_pushvalue(L, 1);
-		lua_pushvalue(L, 2);
-		lua_pushlightuserdata(L, &layout);
-		/* s: xywh, olist, layoutAxis, self, group, layout */
-		lua_call(L, 3, 1);
-		/* s: xywh, olist, ilist */
+		layout_layoutaxis(&layout, s, tmm, ilist);
 
 		/**
 		**	local children = group.Children
@@ -733,16 +841,15 @@ static int layout_layout(lua_State *L)
 		**/
 
 		lua_getfield(L, 2, "Children");
-		/* s: xywh, olist, ilist, children */
+		lua_getfield(L, 2, "FreeRegion");
+		/* s: structure, tmm, children, freeregion */
 
 		/* size on outer axis: */
 		oszmax = layout.rect[i4 - 1] - layout.rect[i2 - 1] + 1 -
 			layout.padding[i2 - 1] - layout.padding[i4 - 1];
 
 		/* starting position on outer axis: */
-		lua_pushinteger(L,
-			r2 + layout.padding[i2 - 1] + layout.margin[i2 - 1]);
-		lua_rawseti(L, -5, i6);
+		xywh[i6] = r2 + layout.padding[i2 - 1] + layout.margin[i2 - 1];
 
 		/**
 		**	for oidx = 1, gs2 do
@@ -756,18 +863,10 @@ static int layout_layout(lua_State *L)
 		for (oidx = 1; oidx <= gs2; ++oidx)
 		{
 			if (gs2 > 1)
-			{
-				lua_rawgeti(L, -3, oidx);
-				lua_rawgeti(L, -1, 5);
-				/* s: xywh, olist, ilist, children, olist[oidx], olist[oidx][5] */
-				oszmax = lua_tointeger(L, -1);
-				lua_pop(L, 2);
-			}
+				oszmax = olist[oidx - 1].size;
 
 			/* starting position on inner axis: */
-			lua_pushinteger(L, r1 + goffs);
-			/* s: xywh, olist, ilist, children, val */
-			lua_rawseti(L, -5, i5);
+			xywh[i5] = r1 + goffs;
 
 			/**
 			**	for iidx = 1, gs1 do
@@ -780,61 +879,39 @@ static int layout_layout(lua_State *L)
 			/* loop inner axis: */
 			for (iidx = 1; iidx <= gs1; ++iidx)
 			{
-				/* s: xywh, olist, ilist, children */
-				lua_rawgeti(L, -1, cidx);
-				/* s: xywh, olist, ilist, children, c */
-				if (!lua_toboolean(L, -1))
+				layout_child *c;
+
+				if (cidx > s->numchildren)
 				{
-					lua_pop(L, 5);
+					lua_pop(L, 4);
 					return 0;
 				}
-				
-				lua_getfield(L, -1, "Invisible");
-				TBOOL invisible = lua_toboolean(L, -1);
-				lua_pop(L, 1);
-				if (!invisible)
+
+				c = &s->child[cidx - 1];
+				if (!c->invisible)
 				{
 					/**
 					**	xywh[1] = xywh[5]
 					**	xywh[2] = xywh[6]
-					**	mm = c.MinMax
+					**	mm = { c:getMinMax() }
 					**	m3, m4 = mm[i3], mm[i4]
 					**	isz = ilist[iidx][5] -- size
 					**/
 
+					lua_rawgeti(L, -2, cidx);
+					/* s: structure, tmm, children, freeregion, c */
+
 					/* x0, y0 of child rectangle: */
-					lua_rawgeti(L, -5, 5);
-					lua_rawseti(L, -6, 1);
-					lua_rawgeti(L, -5, 6);
-					lua_rawseti(L, -6, 2);
+					xywh[1] = xywh[5];
+					xywh[2] = xywh[6];
 
 					/* element minmax: */
-					lua_getfield(L, -1, "MinMax");
-					/* s: mm */
-					lua_getfield(L, -1, "get");
-					/* s: mm, get() */
-					lua_pushvalue(L, -2);
-					/* s: mm, get(), mm */
-					lua_call(L, 1, 4);
-					/* s: mm, mm1, mm2, mm3, mm4 */
-					layout.minmax[0] = lua_tointeger(L, -4);
-					layout.minmax[1] = lua_tointeger(L, -3);
-					layout.minmax[2] = lua_tointeger(L, -2);
-					layout.minmax[3] = lua_tointeger(L, -1);
-					lua_pop(L, 5);
-					m3 = layout.minmax[i3 - 1];
-					m4 = layout.minmax[i4 - 1];
+					layout_getminmax(layout_getarea(L, -1), mm);
+					m3 = mm[i3 - 1];
+					m4 = mm[i4 - 1];
 
 					/* inner size: */
-					lua_pushvalue(L, -3);
-					/* s: xywh, olist, ilist, children, c, ilist */
-					lua_rawgeti(L, -1, iidx);
-					/* s: xywh, olist, ilist, children, c, ilist, ilist[iidx] */
-					lua_rawgeti(L, -1, 5);
-					/* s: xywh, olist, ilist, children, c, ilist, ilist[iidx], ilist[iidx][5] */
-					isz = lua_tointeger(L, -1);
-					lua_pop(L, 3);
-					/* s: xywh, olist, ilist, children, c */
+					isz = ilist[iidx - 1].size;
 
 					/**
 					**	a = c:getAttr(A[5])
@@ -842,25 +919,14 @@ static int layout_layout(lua_State *L)
 					**		m3 = gr[i3] - gr[i1] + 1 - gp[i1] - gp[i3]
 					**	end
 					**/
-					
-					lua_getfield(L, -1, "getAttr");
-					lua_pushvalue(L, -2);
-					lua_pushstring(L, A[4]);
-					lua_call(L, 2, 1);
-					/* s: xywh, olist, ilist, children, c, c[A[5]] */
-					s = lua_tostring(L, -1);
-					if (s)
+
+					if (c->size[i1 - 1] != LAYOUT_SIZE_NONE)
 					{
-						if (s[0] == 'f') /* "free" or "fill" */
-						{
-							m3 = layout.rect[i3 - 1] + 1;
-							m3 -= layout.rect[i1 - 1];
-							m3 -= layout.padding[i1 - 1];
-							m3 -= layout.padding[i3 - 1];
-						}
+						m3 = layout.rect[i3 - 1] + 1;
+						m3 -= layout.rect[i1 - 1];
+						m3 -= layout.padding[i1 - 1];
+						m3 -= layout.padding[i3 - 1];
 					}
-					lua_pop(L, 1);
-					/* s: xywh, olist, ilist, children, c */
 
 					/**
 					** if m3 < isz then
@@ -877,40 +943,11 @@ static int layout_layout(lua_State *L)
 
 					if (m3 < isz)
 					{
-						lua_getfield(L, -1, "getAttr");
-						lua_pushvalue(L, -2);
-						lua_pushstring(L, A[0]);
-						lua_call(L, 2, 1);
-						/* s: xywh, olist, ilist, children, c, c[A[1]] */
-						s = lua_tostring(L, -1);
-						if (s)
-						{
-							if (strcmp(s, "center") == 0)
-							{
-								lua_rawgeti(L, -6, i1);
-								/* s: xywh, olist, ilist, children, c, c[A[1]], xywh[i1] */
-								t = lua_tointeger(L, -1);
-								t += (isz - m3) / 2;
-								lua_pushinteger(L, t);
-								lua_rawseti(L, -8, i1);
-								lua_pop(L, 1);
-							}
-							else if (strcmp(s, A[2]) == 0)
-							{
-								/* opposite side: */
-								lua_rawgeti(L, -6, i1);
-								/* s: xywh, olist, ilist, children, c, c[A[1]], xywh[i1] */
-								t = lua_tointeger(L, -1);
-								t += isz - m3;
-								lua_pushinteger(L, t);
-								lua_rawseti(L, -8, i1);
-								lua_pop(L, 1);
-							}
-							/* s: xywh, olist, ilist, children, c, c[A[1]] */
-						}
+						if (c->align[i1 - 1] == LAYOUT_ALIGN_CENTER)
+							xywh[i1] += (isz - m3) / 2;
+						else if (c->align[i1 - 1] == LAYOUT_ALIGN_OPPOSITE)
+							xywh[i1] += isz - m3;
 						isz = m3;
-						lua_pop(L, 1);
-						/* s: xywh, olist, ilist, children, c */
 					}
 
 					/**
@@ -933,63 +970,20 @@ static int layout_layout(lua_State *L)
 					**/
 
 					/* outer size: */
-					lua_getfield(L, -1, "getAttr");
-					lua_pushvalue(L, -2);
-					lua_pushstring(L, A[5]);
-					lua_call(L, 2, 1);
-					/* s: xywh, olist, ilist, children, c, c[A[6]] */
-					s = lua_tostring(L, -1);
-					if (s && s[0] == 'f') /* "free" or "fill" */
+					if (c->size[i2 - 1] != LAYOUT_SIZE_NONE)
 						osz = oszmax;
 					else
 					{
-						lua_rawgeti(L, -5, oidx);
-						/* s: xywh, olist, ilist, children, c, c[A[6]], olist[oidx] */
-						lua_rawgeti(L, -1, 5);
-						/* s: xywh, olist, ilist, children, c, c[A[6]], olist[oidx], olist[oidx][5] */
-						osz = lua_tointeger(L, -1);
-						osz = TMIN(osz, m4);
-						lua_pop(L, 2);
+						osz = TMIN(olist[oidx - 1].size, m4);
 						/* align if element does not fully occupy outer size: */
-						/* s: xywh, olist, ilist, children, c, c[A[6]] */
 						if (osz < oszmax)
 						{
-							lua_getfield(L, -2, "getAttr");
-							lua_pushvalue(L, -3);
-							lua_pushstring(L, A[1]);
-							lua_call(L, 2, 1);
-							/* s: xywh, olist, ilist, children, c, c[A[6]], c[A[2]] */
-							s = lua_tostring(L, -1);
-							if (s)
-							{
-								if (strcmp(s, "center") == 0)
-								{
-									lua_rawgeti(L, -7, i2);
-									/* s: xywh, olist, ilist, children, c, c[A[6]], c[A[2]], xywh[i2] */
-									t = lua_tointeger(L, -1);
-									t += (oszmax - osz) / 2;
-									lua_pushinteger(L, t);
-									lua_rawseti(L, -9, i2);
-									lua_pop(L, 1);
-								}
-								else if (strcmp(s, A[3]) == 0)
-								{
-									/* opposite side: */
-									lua_rawgeti(L, -7, i2);
-									/* s: xywh, olist, ilist, children, c, c[A[6]], c[A[2]], xywh[i2] */
-									t = lua_tointeger(L, -1);
-									t += oszmax - osz;
-									lua_pushinteger(L, t);
-									lua_rawseti(L, -9, i2);
-									lua_pop(L, 1);
-								}
-							}
-							lua_pop(L, 1);
-							/* s: xywh, olist, ilist, children, c, c[A[6]] */
+							if (c->align[i2 - 1] == LAYOUT_ALIGN_CENTER)
+								xywh[i2] += (oszmax - osz) / 2;
+							else if (c->align[i2 - 1] == LAYOUT_ALIGN_OPPOSITE)
+								xywh[i2] += oszmax - osz;
 						}
 					}
-					lua_pop(L, 1);
-					/* s: xywh, olist, ilist, children, c */
 
 					/**
 					**	xywh[i3] = xywh[i1] + isz - 1
@@ -997,21 +991,8 @@ static int layout_layout(lua_State *L)
 					**/
 
 					/* x1, y1 of child rectangle: */
-					lua_rawgeti(L, -5, i1);
-					/* s: xywh, olist, ilist, children, c, xywh[i1] */
-					t = lua_tointeger(L, -1);
-					lua_pushinteger(L, t + isz - 1);
-					/* s: xywh, olist, ilist, children, c, xywh[i1], val */
-					lua_rawseti(L, -7, i3);
-					lua_pop(L, 1);
-
-					lua_rawgeti(L, -5, i2);
-					/* s: xywh, olist, ilist, children, c, xywh[i2] */
-					t = lua_tointeger(L, -1);
-					lua_pushinteger(L, t + osz - 1);
-					lua_rawseti(L, -7, i4);
-					lua_pop(L, 1);
-					/* s: xywh, olist, ilist, children, c */
+					xywh[i3] = xywh[i1] + isz - 1;
+					xywh[i4] = xywh[i2] + osz - 1;
 
 					/**
 					**	c:layout(xywh[1], xywh[2], xywh[3], xywh[4], markdamage)
@@ -1021,46 +1002,31 @@ static int layout_layout(lua_State *L)
 					/* enter recursion: */
 					lua_getfield(L, -1, "layout");
 					lua_pushvalue(L, -2);
-					/* s: xywh, olist, ilist, children, c, c.layout, c */
-					lua_rawgeti(L, -7, 1);
-					lua_rawgeti(L, -8, 2);
-					lua_rawgeti(L, -9, 3);
-					lua_rawgeti(L, -10, 4);
+					lua_pushinteger(L, xywh[1]);
+					lua_pushinteger(L, xywh[2]);
+					lua_pushinteger(L, xywh[3]);
+					lua_pushinteger(L, xywh[4]);
 					lua_pushvalue(L, 7);
-					/* s: xywh, olist, ilist, children, c, c.layout, c, xywh[1], xywh[2], xywh[3], xywh[4], markdamage */
+					/* s: structure, tmm, children, freeregion, c, c.layout, c, x0, y0, x1, y1, markdamage */
 					lua_call(L, 6, 0);
-					/* s: xywh, olist, ilist, children, c */
+					/* s: structure, tmm, children, freeregion, c */
 
 					/* punch a hole for the element into the background: */
 					lua_getfield(L, -1, "punch");
-					lua_pushvalue(L, -2);
-					lua_getfield(L, 2, "FreeRegion");
-					/* s: xywh, olist, ilist, children, c, c.punch, c, group.FreeRegion */
+					lua_insert(L, -2);
+					lua_pushvalue(L, -3);
+					/* s: structure, tmm, children, freeregion, c.punch, c, freeregion */
 					lua_call(L, 2, 0);
-					/* s: xywh, olist, ilist, children, c */
+					/* s: structure, tmm, children, freeregion */
 
 					/**
 					**	xywh[i5] = xywh[i5] + ilist[iidx][5] -- size
-					**	cidx = cidx + 1
 					**/
 
 					/* update x0: */
-					lua_rawgeti(L, -5, i5);
-					/* s: xywh, olist, ilist, children, c, xywh[i5] */
-					lua_rawgeti(L, -4, iidx);
-					lua_rawgeti(L, -1, 5);
-					/* s: xywh, olist, ilist, children, c, xywh[i5], ilist[iidx], ilist[iidx][5] */
-					t = lua_tointeger(L, -3);
-					t += lua_tointeger(L, -1);
-					lua_pushinteger(L, t);
-					/* s: xywh, olist, ilist, children, c, xywh[i5], ilist[iidx], ilist[iidx][5], val */
-					lua_rawseti(L, -9, i5);
-					/* s: xywh, olist, ilist, children, c, xywh[i5], ilist[iidx], ilist[iidx][5] */
-					lua_pop(L, 3);
-					/* s: xywh, olist, ilist, children */
+					xywh[i5] += ilist[iidx - 1].size;
 				}
-				lua_pop(L, 1);
-				
+
 				/* next child index: */
 				cidx++;
 			}
@@ -1070,24 +1036,14 @@ static int layout_layout(lua_State *L)
 			**/
 
 			/* update y0: */
-			lua_rawgeti(L, -4, i6);
-			/* s: xywh, olist, ilist, children, xywh[i5] */
-			lua_rawgeti(L, -4, oidx);
-			lua_rawgeti(L, -1, 5);
-			/* s: xywh, olist, ilist, children, xywh[i5], olist[oidx], olist[oidx][5] */
-			t = lua_tointeger(L, -3);
-			t += lua_tointeger(L, -1);
-			lua_pushinteger(L, t);
-			/* s: xywh, olist, ilist, children, xywh[i5], olist[oidx], olist[oidx][5], val */
-			lua_rawseti(L, -8, i6);
-			/* s: xywh, olist, ilist, children, xywh[i5], olist[oidx], olist[oidx][5] */
-			lua_pop(L, 3);
-			/* s: xywh, olist, ilist, children */
+			xywh[i6] += olist[oidx - 1].size;
 		}
 
-		lua_pop(L, 4);
-	
+		lua_pop(L, 3);
+		/* s: structure */
 	}
+
+	lua_pop(L, 1);
 	return 0;
 }
 
@@ -1106,16 +1062,16 @@ static int layout_askMinMax(lua_State *L)
 	**/
 
 	int m[5] = { 0, 0, 0, 0, 0 };
-	layout_struct lstruct = layout_getstructure(L, 2);
-	int ori = lstruct.orientation;
-	int gw = lstruct.width;
-	int gh = lstruct.height;
+	layout_struct *s = layout_getstructure(L);
+	int ori = s->orientation;
+	int gw = s->width;
+	int gh = s->height;
+	/* s: structure */
 
 	if (gw > 0 && gh > 0)
 	{
 		/**
 		**	local cidx = 1
-		**	local gss = group:getSameSize(ori)
 		**	local minx, miny, maxx, maxy = { }, { }, { }, { }
 		**	local tmm = { minx, miny, maxx, maxy }
 		**	self.TempMinMax = tmm
@@ -1126,211 +1082,88 @@ static int layout_askMinMax(lua_State *L)
 		**/
 
 		int i1, gs, y, x;
-		int cidx = 1;
-		
-		lua_createtable(L, 4, 0);
-		lua_pushvalue(L, -1);
-		lua_setfield(L, 1, "TempMinMax");
-		lua_createtable(L, gw, 0);
-		lua_createtable(L, gh, 0);
-		lua_createtable(L, gw, 0);
-		lua_createtable(L, gh, 0);
-		lua_getfield(L, 2, "Children");
+		int cidx = 0;
+		layout_minmax *tmm = layout_newminmax(L, gw, gh);
+		lua_Integer *minx = tmm->minmax[0];
+		lua_Integer *miny = tmm->minmax[1];
+		lua_Integer *maxx = tmm->minmax[2];
+		lua_Integer *maxy = tmm->minmax[3];
 
-		/* s: tmm, minx, miny, maxx, maxy, children */
+		lua_getfield(L, 2, "Children");
+		/* s: structure, tmm, children */
 
-		for (y = 1; y <= gh; ++y)
+		for (y = 0; y < gh; ++y)
 		{
-			for (x = 1; x <= gw; ++x)
+			for (x = 0; x < gw && cidx < s->numchildren; ++x)
 			{
-				int mm1, mm2, mm3, mm4;
-				int minxx, minyy;
-				const char *s;
-				
+				layout_child *c = &s->child[cidx++];
+				int mm[4];
+
+				if (c->invisible)
+					continue;
+
 				/**
-				**	c = group.Children[cidx]
-				**	if not c then
-				**		break
-				**	end
-				**	cidx = cidx + 1
+				**	mm1, mm2, mm3, mm4 = c:askMinMax(m1, m2, m3, m4)
+				**	(unless memorized from a previous call)
 				**/
 
 				lua_rawgeti(L, -1, cidx);
-				/* s: tmm, minx, miny, maxx, maxy, children, c */
-
-				if (!lua_toboolean(L, -1))
-				{
-					lua_pop(L, 1);
-					break;
-				}
-				cidx++;
-				
-				lua_getfield(L, -1, "Invisible");
-				TBOOL invisible = lua_toboolean(L, -1);
+				/* s: structure, tmm, children, c */
+				layout_askchild(L, 3, mm);
 				lua_pop(L, 1);
-				if (!invisible)
-				{
-					/**
-					**	mm1, mm2, mm3, mm4 = c:askMinMax(m1, m2, m3, m4)
-					**/
-
-					lua_getfield(L, -1, "askMinMax");
-					lua_pushvalue(L, -2);
-					lua_pushvalue(L, 3);
-					lua_pushvalue(L, 4);
-					lua_pushvalue(L, 5);
-					lua_pushvalue(L, 6);
-					/* s: c, c.askMinMax, c, m1, m2, m3, m4 */
-					lua_call(L, 5, 4);
-					/* s: c, mm1, mm2, mm3, mm4 */
-					mm1 = lua_tointeger(L, -4);
-					mm2 = lua_tointeger(L, -3);
-					mm3 = lua_tointeger(L, -2);
-					mm4 = lua_tointeger(L, -1);
-					lua_pop(L, 4);
-					/* s: c */
-
-					/**
-					**	local cw = c:getAttr("Width")
-					**	if cw == "fill" then
-					**		mm3 = nil
-					**	elseif cw == "free" then
-					**		mm3 = ui.HUGE
-					**	end
-					**/
-
-					lua_getfield(L, -1, "getAttr");
-					lua_pushvalue(L, -2);
-					lua_pushstring(L, "Width");
-					lua_call(L, 2, 1);
-					/* s: c, c.Width */
-					s = lua_tostring(L, -1);
-					if (s)
-					{
-						if (strcmp(s, "fill") == 0)
-							mm3 = -1; /* nil */
-						else if (strcmp(s, "free") == 0)
-							mm3 = TEKUI_HUGE;
-					}
-					lua_pop(L, 1);
-
-					/**
-					**	local ch = c:getAttr("Height")
-					**	if ch == "fill" then
-					**		mm4 = nil
-					**	elseif ch == "free" then
-					**		mm4 = ui.HUGE
-					**	end
-					**/
-
-					lua_getfield(L, -1, "getAttr");
-					lua_pushvalue(L, -2);
-					lua_pushstring(L, "Height");
-					lua_call(L, 2, 1);
-					/* s: c, c.Height */
-					s = lua_tostring(L, -1);
-					if (s)
-					{
-						if (strcmp(s, "fill") == 0)
-							mm4 = -1; /* nil */
-						else if (strcmp(s, "free") == 0)
-							mm4 = TEKUI_HUGE;
-					}
-					lua_pop(L, 2);
-					/* s: tmm, minx, miny, maxx, maxy, children */
+				/* s: structure, tmm, children */
 
-					/**
-					**	mm3 = mm3 or ori == 2 and mm1
-					**	mm4 = mm4 or ori == 1 and mm2
-					**/
-
-					if (mm3 < 0 && ori == 2)
-						mm3 = mm1;
-					if (mm4 < 0 && ori == 1)
-						mm4 = mm2;
+				/**
+				**	local cw = c:getAttr("Width")
+				**	if cw == "fill" then
+				**		mm3 = nil
+				**	elseif cw == "free" then
+				**		mm3 = ui.HUGE
+				**	end
+				**	local ch = c:getAttr("Height")
+				**	...
+				**	mm3 = mm3 or ori == 2 and mm1
+				**	mm4 = mm4 or ori == 1 and mm2
+				**/
 
-					/**
-					**	minx[x] = max(minx[x] or 0, mm1)
-					**	miny[y] = max(miny[y] or 0, mm2)
-					**/
+				if (c->size[0] == LAYOUT_SIZE_FILL)
+					mm[2] = -1; /* nil */
+				else if (c->size[0] == LAYOUT_SIZE_FREE)
+					mm[2] = TEKUI_HUGE;
 
-					lua_rawgeti(L, -5, x);
-					/* s: tmm, minx, miny, maxx, maxy, children, minx[x] */
-					minxx = lua_isnil(L, -1) ? 0 : lua_tointeger(L, -1);
-					minxx = TMAX(minxx, mm1);
-					lua_pushinteger(L, minxx);
-					/* s: tmm, minx, miny, maxx, maxy, children, minx[x], minxx */
-					lua_rawseti(L, -7, x);
-					/* s: tmm, minx, miny, maxx, maxy, children, minx[x] */
-					lua_pop(L, 1);
-					/* s: tmm, minx, miny, maxx, maxy, children */
-
-					lua_rawgeti(L, -4, y);
-					/* s: tmm, minx, miny, maxx, maxy, children, miny[y] */
-					minyy = lua_isnil(L, -1) ? 0 : lua_tointeger(L, -1);
-					minyy = TMAX(minyy, mm2);
-					lua_pushinteger(L, minyy);
-					/* s: tmm, minx, miny, maxx, maxy, children, miny[y], minyy */
-					lua_rawseti(L, -6, y);
-					/* s: tmm, minx, miny, maxx, maxy, children, miny[y] */
-					lua_pop(L, 1);
-					/* s: tmm, minx, miny, maxx, maxy, children */
+				if (c->size[1] == LAYOUT_SIZE_FILL)
+					mm[3] = -1; /* nil */
+				else if (c->size[1] == LAYOUT_SIZE_FREE)
+					mm[3] = TEKUI_HUGE;
 
-					/**
-					**	if mm3 and (not maxx[x] or mm3 > maxx[x]) then
-					**		maxx[x] = max(mm3, minx[x])
-					**	end
-					**/
+				if (mm[2] < 0 && ori == 2)
+					mm[2] = mm[0];
+				if (mm[3] < 0 && ori == 1)
+					mm[3] = mm[1];
 
-					if (mm3 >= 0)
-					{
-						lua_rawgeti(L, -3, x);
-						/* s: tmm, minx, miny, maxx, maxy, children, maxx[x] */
-						if (lua_isnil(L, -1) || mm3 > lua_tointeger(L, -1))
-						{
-							lua_pushinteger(L, TMAX(mm3, minxx));
-							/* s: tmm, minx, miny, maxx, maxy, children, maxx[x], val */
-							lua_rawseti(L, -5, x);
-							/* s: tmm, minx, miny, maxx, maxy, children, maxx[x] */
-						}
-						lua_pop(L, 1);
-					}
+				/**
+				**	minx[x] = max(minx[x] or 0, mm1)
+				**	miny[y] = max(miny[y] or 0, mm2)
+				**	if mm3 and (not maxx[x] or mm3 > maxx[x]) then
+				**		maxx[x] = max(mm3, minx[x])
+				**	end
+				**	if mm4 and (not maxy[y] or mm4 > maxy[y]) then
+				**		maxy[y] = max(mm4, miny[y])
+				**	end
+				**/
 
-					/**
-					**	if mm4 and (not maxy[y] or mm4 > maxy[y]) then
-					**		maxy[y] = max(mm4, miny[y])
-					**	end
-					**/
-
-					if (mm4 >= 0)
-					{
-						lua_rawgeti(L, -2, y);
-						/* s: tmm, minx, miny, maxx, maxy, children, maxy[y] */
-						if (lua_isnil(L, -1) || mm4 > lua_tointeger(L, -1))
-						{
-							lua_pushinteger(L, TMAX(mm4, minyy));
-							/* s: tmm, minx, miny, maxx, maxy, children, maxy[y], val */
-							lua_rawseti(L, -4, y);
-							/* s: tmm, minx, miny, maxx, maxy, children, maxy[y] */
-						}
-						lua_pop(L, 1);
-					}
-					
-				}
-				else
-					lua_pop(L, 1);
+				minx[x] = TMAX(minx[x], mm[0]);
+				miny[y] = TMAX(miny[y], mm[1]);
 
+				if (mm[2] >= 0 && mm[2] > maxx[x])
+					maxx[x] = TMAX(mm[2], minx[x]);
+				if (mm[3] >= 0 && mm[3] > maxy[y])
+					maxy[y] = TMAX(mm[3], miny[y]);
 			}
 		}
 
-		/* s: tmm, minx, miny, maxx, maxy, children */
 		lua_pop(L, 1);
-		/* s: tmm, minx, miny, maxx, maxy */
-		lua_rawseti(L, -5, 4);
-		lua_rawseti(L, -4, 3);
-		lua_rawseti(L, -3, 2);
-		lua_rawseti(L, -2, 1);
-		/* s: tmm */
+		/* s: structure, tmm */
 
 		/**
 		**	local gs = gw
@@ -1349,10 +1182,10 @@ static int layout_askMinMax(lua_State *L)
 			int i3 = i1 + 2;
 			int numfree = 0;
 			int remainder = 0;
-			
-			ss = layout_getsamesize(L, 2, i1);
 
-			for (n = 1; n <= gs; ++n)
+			ss = s->samesize[i1 - 1];
+
+			for (n = 0; n < gs; ++n)
 			{
 				/**
 				**	local mins = tmm[i1][n] or 0
@@ -1369,16 +1202,9 @@ static int layout_askMinMax(lua_State *L)
 				**	end
 				**/
 
-				/* s: tmm */
-				lua_rawgeti(L, -1, i1);
-				lua_rawgeti(L, -1, n);
-				/* s: tmm, tmm[i1], tmm[i1][n] */
-				mins = lua_tointeger(L, -1);
-				lua_rawgeti(L, -3, i3);
-				lua_rawgeti(L, -1, n);
-				maxs = lua_isnil(L, -1) ? -1 : lua_tointeger(L, -1);
-				/* s: tmm, tmm[i1], tmm[i1][n], tmm[i3], tmm[i3][n] */
-				
+				mins = tmm->minmax[i1 - 1][n];
+				maxs = tmm->minmax[i3 - 1][n];
+
 				if (ss)
 				{
 					if (maxs < 0 || maxs > mins)
@@ -1389,7 +1215,7 @@ static int layout_askMinMax(lua_State *L)
 				}
 				else
 					m[i1] += mins;
-				
+
 				/**
 				**	if maxs then
 				**		maxs = max(maxs, mins)
@@ -1403,10 +1229,7 @@ static int layout_askMinMax(lua_State *L)
 				if (maxs >= 0)
 				{
 					maxs = TMAX(maxs, mins);
-					lua_pushinteger(L, maxs);
-					/* s: tmm, tmm[i1], tmm[i1][n], tmm[i3], tmm[i3][n], val */
-					lua_rawseti(L, -3, n);
-					/* s: tmm, tmm[i1], tmm[i1][n], tmm[i3], tmm[i3][n] */
+					tmm->minmax[i3 - 1][n] = maxs;
 					m[i3] = TMAX(m[i3], 0) + maxs;
 				}
 				else if (ori == i1)
@@ -1414,8 +1237,6 @@ static int layout_askMinMax(lua_State *L)
 					/* if on primary axis, we must reserve at least min: */
 					m[i3] = TMAX(m[i3], 0) + mins;
 				}
-				
-				lua_pop(L, 4);
 			}
 
 			/**
@@ -1443,10 +1264,11 @@ static int layout_askMinMax(lua_State *L)
 			gs = gh;
 		}
 
-		/* s: tmm */
 		lua_pop(L, 1);
+		/* s: structure */
 	}
 
+	lua_pop(L, 1);
 	lua_pushinteger(L, m[1]);
 	lua_pushinteger(L, m[2]);
 	lua_pushinteger(L, m[3]);
@@ -1473,22 +1295,20 @@ static int layout_new(lua_State *L)
 	/* s: Layout.new, class */
 	lua_pushvalue(L, 2);
 	/* s: Layout.new, class, self */
-	lua_newtable(L);
+	lua_pushboolean(L, TFALSE);
+	lua_setfield(L, -2, "Structure");
+	lua_pushboolean(L, TFALSE);
 	lua_setfield(L, -2, "TempMinMax");
-	lua_newtable(L);
-	lua_setfield(L, -2, "Weights");
 	lua_call(L, 2, 1);
 	/* s: self */
 	return 1;
 }
-
 /*****************************************************************************/
 
 static const luaL_Reg tek_ui_layout_default_funcs[] =
 {
 	{ "new", layout_new },
 	{ "askMinMax", layout_askMinMax },
-	{ "layoutAxis", layout_layoutaxis },
 	{ "layout", layout_layout },
 	{ NULL, NULL }
 };